@@ -0,0 +1,268 @@
+#include "alloc.h"
+#include "vector.h"
+
+// libc
+
+static
+void *
+libc_alloc(Allocator *a, size_t n)
+{
+    (void) a;
+    return malloc(n ? n : 1);
+}
+
+static
+void
+libc_free(Allocator *a, void *p, size_t n)
+{
+    (void) a;
+    (void) n;
+    free(p);
+}
+
+static
+void
+libc_destroy(Allocator *a)
+{
+    (void) a;
+}
+
+static Allocator libc_allocator = {
+    .alloc = libc_alloc,
+    .free = libc_free,
+    .reset = NULL,
+    .destroy = libc_destroy,
+};
+
+Allocator *alloc_heap = &libc_allocator;
+Allocator *alloc_scratch = &libc_allocator;
+
+Allocator *
+alloc_libc(void)
+{
+    return &libc_allocator;
+}
+
+// pool
+
+enum {
+    POOL_GRANULE = 16,
+    POOL_NCLASSES = 32,
+    POOL_MAX = POOL_GRANULE * POOL_NCLASSES,
+    POOL_CHUNK = 64 * 1024,
+};
+
+typedef struct PoolBlock {
+    struct PoolBlock *next;
+} PoolBlock;
+
+typedef struct {
+    Allocator base;
+    PoolBlock *free_lists[POOL_NCLASSES];
+    VECTOR_OF(char *) chunks;
+} Pool;
+
+static inline
+size_t
+pool_class(size_t n)
+{
+    return n ? (n - 1) / POOL_GRANULE : 0;
+}
+
+static
+void
+pool_refill(Pool *pool, size_t cls)
+{
+    const size_t blocksz = (cls + 1) * POOL_GRANULE;
+    const size_t nblocks = POOL_CHUNK / blocksz;
+    char *chunk = xmalloc(nblocks, blocksz);
+    VECTOR_PUSH(pool->chunks, chunk);
+
+    PoolBlock *head = pool->free_lists[cls];
+    for (size_t i = nblocks; i; --i) {
+        PoolBlock *b = (PoolBlock *) (chunk + (i - 1) * blocksz);
+        b->next = head;
+        head = b;
+    }
+    pool->free_lists[cls] = head;
+}
+
+static
+void *
+pool_alloc(Allocator *a, size_t n)
+{
+    if (n > POOL_MAX) {
+        return malloc(n);
+    }
+    Pool *pool = (Pool *) a;
+    const size_t cls = pool_class(n);
+    if (!pool->free_lists[cls]) {
+        pool_refill(pool, cls);
+    }
+    PoolBlock *b = pool->free_lists[cls];
+    pool->free_lists[cls] = b->next;
+    return b;
+}
+
+static
+void
+pool_free(Allocator *a, void *p, size_t n)
+{
+    if (n > POOL_MAX) {
+        free(p);
+        return;
+    }
+    if (!p) {
+        return;
+    }
+    Pool *pool = (Pool *) a;
+    const size_t cls = pool_class(n);
+    PoolBlock *b = p;
+    b->next = pool->free_lists[cls];
+    pool->free_lists[cls] = b;
+}
+
+static
+void
+pool_destroy(Allocator *a)
+{
+    Pool *pool = (Pool *) a;
+    for (size_t i = 0; i < pool->chunks.size; ++i) {
+        free(pool->chunks.data[i]);
+    }
+    VECTOR_FREE(pool->chunks);
+    free(pool);
+}
+
+Allocator *
+alloc_pool_new(void)
+{
+    Pool *pool = XNEW0(Pool, 1);
+    pool->base = (Allocator) {
+        .alloc = pool_alloc,
+        .free = pool_free,
+        .reset = NULL,
+        .destroy = pool_destroy,
+    };
+    return &pool->base;
+}
+
+// arena
+
+enum {
+    ARENA_ALIGN = 16,
+    ARENA_CHUNK = 256 * 1024,
+};
+
+typedef struct {
+    Allocator base;
+    // Chunks are never given back before /destroy/; /reset/ rewinds to the
+    // first one, so that a steady-state workload does not touch libc.
+    VECTOR_OF(char *) chunks;
+    size_t cur;     // index of the chunk being bumped
+    size_t used;    // bytes used in it
+    // Blocks too large for a chunk, freed on reset.
+    VECTOR_OF(void *) large;
+} Arena;
+
+static inline
+size_t
+arena_round(size_t n)
+{
+    return (n + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+}
+
+static
+void *
+arena_alloc(Allocator *a, size_t n)
+{
+    Arena *arena = (Arena *) a;
+    n = arena_round(n ? n : 1);
+    if (n > ARENA_CHUNK / 4) {
+        void *r = malloc(n);
+        if (r) {
+            VECTOR_PUSH(arena->large, r);
+        }
+        return r;
+    }
+    while (1) {
+        if (arena->cur < arena->chunks.size) {
+            if (arena->used + n <= ARENA_CHUNK) {
+                void *r = arena->chunks.data[arena->cur] + arena->used;
+                arena->used += n;
+                return r;
+            }
+            if (arena->cur + 1 < arena->chunks.size) {
+                ++arena->cur;
+                arena->used = 0;
+                continue;
+            }
+        }
+        VECTOR_PUSH(arena->chunks, xmalloc(ARENA_CHUNK, 1));
+        arena->cur = arena->chunks.size - 1;
+        arena->used = 0;
+    }
+}
+
+static
+void
+arena_free(Allocator *a, void *p, size_t n)
+{
+    Arena *arena = (Arena *) a;
+    if (!p) {
+        return;
+    }
+    n = arena_round(n ? n : 1);
+    if (n > ARENA_CHUNK / 4) {
+        if (arena->large.size && arena->large.data[arena->large.size - 1] == p) {
+            free(VECTOR_POP(arena->large));
+        }
+        return;
+    }
+    if (arena->cur < arena->chunks.size &&
+        arena->used >= n &&
+        arena->chunks.data[arena->cur] + arena->used - n == (char *) p)
+    {
+        arena->used -= n;
+    }
+}
+
+static
+void
+arena_reset(Allocator *a)
+{
+    Arena *arena = (Arena *) a;
+    for (size_t i = 0; i < arena->large.size; ++i) {
+        free(arena->large.data[i]);
+    }
+    VECTOR_CLEAR(arena->large);
+    arena->cur = 0;
+    arena->used = 0;
+}
+
+static
+void
+arena_destroy(Allocator *a)
+{
+    Arena *arena = (Arena *) a;
+    arena_reset(a);
+    for (size_t i = 0; i < arena->chunks.size; ++i) {
+        free(arena->chunks.data[i]);
+    }
+    VECTOR_FREE(arena->chunks);
+    VECTOR_FREE(arena->large);
+    free(arena);
+}
+
+Allocator *
+alloc_arena_new(void)
+{
+    Arena *arena = XNEW0(Arena, 1);
+    arena->base = (Allocator) {
+        .alloc = arena_alloc,
+        .free = arena_free,
+        .reset = arena_reset,
+        .destroy = arena_destroy,
+    };
+    return &arena->base;
+}
@@ -0,0 +1,87 @@
+#ifndef alloc_h_
+#define alloc_h_
+
+#include "common.h"
+
+// Allocator interface for the interpreter's own objects. Unlike /malloc/,
+// /free/ is told the size of the block, which is what lets a size-class
+// pool do without per-block headers.
+//
+// Two allocators are active at any time:
+//   * /alloc_heap/ for garbage-collected objects (Matrix, Str, Func);
+//   * /alloc_scratch/ for temporary buffers that never outlive the
+//     instruction that allocated them; the VM calls /reset/ on it at every
+//     line marker, so an arena can release all of them at once.
+// Both default to plain libc until a /Runtime/ installs its own.
+
+typedef struct Allocator Allocator;
+
+struct Allocator {
+    void *(*alloc)(Allocator *a, size_t n);
+    void (*free)(Allocator *a, void *p, size_t n);
+    // May be NULL.
+    void (*reset)(Allocator *a);
+    void (*destroy)(Allocator *a);
+};
+
+extern Allocator *alloc_heap;
+extern Allocator *alloc_scratch;
+
+Allocator *
+alloc_libc(void);
+
+// Size-class free-list pool for small blocks; larger ones go to libc.
+Allocator *
+alloc_pool_new(void);
+
+// Bump allocator; /free/ only takes back the most recent block, /reset/
+// takes back everything.
+Allocator *
+alloc_arena_new(void);
+
+INHEADER
+void *
+heap_alloc(size_t n)
+{
+    void *r = alloc_heap->alloc(alloc_heap, n);
+    if (n && !r) {
+        oom_handler();
+    }
+    return r;
+}
+
+INHEADER
+void
+heap_free(void *p, size_t n)
+{
+    alloc_heap->free(alloc_heap, p, n);
+}
+
+INHEADER
+void *
+scratch_alloc(size_t n)
+{
+    void *r = alloc_scratch->alloc(alloc_scratch, n);
+    if (n && !r) {
+        oom_handler();
+    }
+    return r;
+}
+
+INHEADER
+void
+scratch_free(void *p, size_t n)
+{
+    alloc_scratch->free(alloc_scratch, p, n);
+}
+
+INHEADER
+void
+scratch_reset(void)
+{
+    if (alloc_scratch->reset) {
+        alloc_scratch->reset(alloc_scratch);
+    }
+}
+
+#endif
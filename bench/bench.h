@@ -0,0 +1,152 @@
+#ifndef bench_h_
+#define bench_h_
+
+#include "../common.h"
+
+#include <time.h>
+
+// Shared helpers for the micro-benchmarks in this directory. Every
+// benchmark prints one line per measurement:
+//
+//     <name> <value> <unit> peak <value> <unit> (<percent>%)
+//
+// where "peak" is what this machine is able to do on the same working set:
+// the streaming bandwidth of /memcpy/ for memory-bound kernels and the
+// vector multiply-add throughput of one core for compute-bound ones. Both
+// are derived from measurements rather than a data sheet, so the percentage
+// tells how far a component is from its own roofline.
+
+INHEADER
+double
+bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Calls /fn/ with doubling repetition counts until a batch takes at least
+// /mintime/ seconds; returns seconds per call.
+INHEADER
+double
+bench_time(void (*fn)(void *ctx, size_t nreps), void *ctx, double mintime)
+{
+    for (size_t nreps = 1; ; nreps *= 2) {
+        const double start = bench_now();
+        fn(ctx, nreps);
+        const double elapsed = bench_now() - start;
+        if (elapsed >= mintime) {
+            return elapsed / nreps;
+        }
+    }
+}
+
+#define BENCH_MINTIME 0.2
+
+// Defeats dead-store elimination of benchmark results.
+static volatile double bench_sink;
+
+typedef struct {
+    char *src;
+    char *dst;
+    size_t n;
+} BenchCopyCtx;
+
+static
+void
+bench_copy_fn(void *ctx, size_t nreps)
+{
+    BenchCopyCtx *c = ctx;
+    for (size_t i = 0; i < nreps; ++i) {
+        memcpy(c->dst, c->src, c->n);
+        bench_sink += c->dst[i % c->n];
+    }
+}
+
+// Peak memory bandwidth, in bytes per second, for a working set of /nbytes/
+// (read + write counted, as in a one-in-one-out streaming kernel).
+INHEADER
+double
+bench_peak_bandwidth(size_t nbytes)
+{
+    const size_t n = nbytes / 2 ? nbytes / 2 : 1;
+    BenchCopyCtx c = {.src = xmalloc(n, 1), .dst = xmalloc(n, 1), .n = n};
+    memset(c.src, 1, n);
+    memset(c.dst, 2, n);
+    const double t = bench_time(bench_copy_fn, &c, BENCH_MINTIME);
+    free(c.src);
+    free(c.dst);
+    return 2 * n / t;
+}
+
+static
+void
+bench_flops_fn(void *ctx, size_t nreps)
+{
+    double a[16];
+    for (int j = 0; j < 16; ++j) {
+        a[j] = 1;
+    }
+    const double m = *(double *) ctx;
+    const double c = 1e-9;
+    for (size_t i = 0; i < nreps * 1024; ++i) {
+        a[0]  = a[0]  * m + c; a[1]  = a[1]  * m + c; a[2]  = a[2]  * m + c;
+        a[3]  = a[3]  * m + c; a[4]  = a[4]  * m + c; a[5]  = a[5]  * m + c;
+        a[6]  = a[6]  * m + c; a[7]  = a[7]  * m + c; a[8]  = a[8]  * m + c;
+        a[9]  = a[9]  * m + c; a[10] = a[10] * m + c; a[11] = a[11] * m + c;
+        a[12] = a[12] * m + c; a[13] = a[13] * m + c; a[14] = a[14] * m + c;
+        a[15] = a[15] * m + c;
+    }
+    double sum = 0;
+    for (int j = 0; j < 16; ++j) {
+        sum += a[j];
+    }
+    bench_sink += sum;
+}
+
+// Theoretical double-precision FLOP/s of one core: the measured throughput
+// of scalar multiply-add chains (16 independent ones, enough to hide the
+// latency), scaled by the widest vector unit the CPU reports and by 2 if it
+// can fuse the multiply and the add.
+INHEADER
+double
+bench_peak_flops(void)
+{
+    double m = 0.999999;
+    const double t = bench_time(bench_flops_fn, &m, BENCH_MINTIME);
+    double scalar = 16 * 2 * 1024 / t;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        scalar *= 8;
+    } else if (__builtin_cpu_supports("avx")) {
+        scalar *= 4;
+    } else {
+        scalar *= 2;
+    }
+    if (__builtin_cpu_supports("fma")) {
+        scalar *= 2;
+    }
+#endif
+    return scalar;
+}
+
+INHEADER
+void
+bench_report(const char *name, double value, double peak, const char *unit)
+{
+    printf("%-40s %10.3f %-8s peak %10.3f %-8s (%5.1f%%)\n",
+           name, value, unit, peak, unit, 100 * value / peak);
+}
+
+// For comparisons against an older or simpler implementation rather than
+// against the machine.
+INHEADER
+void
+bench_compare(const char *name, double value, double baseline, const char *unit)
+{
+    printf("%-40s %10.3f %-8s base %10.3f %-8s (%5.2fx)\n",
+           name, value, unit, baseline, unit, value / baseline);
+}
+
+#endif
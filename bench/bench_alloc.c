@@ -0,0 +1,56 @@
+#include "bench.h"
+#include "../alloc.h"
+#include "../matrix.h"
+#include "../linalg.h"
+
+// Matrix allocation through the pool allocator versus libc, on the pattern
+// of 'v := v * M' in a loop: a small matrix is created, the previous one is
+// released. Reported in millions of iterations per second.
+
+typedef struct {
+    unsigned height;
+    unsigned width;
+    Matrix *m;
+} Ctx;
+
+static
+void
+cycle_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    Matrix *v = matrix_new(1, c->height);
+    for (size_t r = 0; r < nreps; ++r) {
+        Matrix *w = matrix_new_uninit(1, c->width);
+        linalg_gemm(w->elems, v->elems, c->m->elems, 1, c->height, c->width);
+        value_unref(MK_MAT(v));
+        v = w;
+    }
+    bench_sink += v->elems[0];
+    value_unref(MK_MAT(v));
+}
+
+int
+main(void)
+{
+    static const unsigned dims[] = {2, 4, 8, 32};
+    for (size_t i = 0; i < sizeof(dims) / sizeof(dims[0]); ++i) {
+        Ctx c = {.height = dims[i], .width = dims[i]};
+        c.m = matrix_new(dims[i], dims[i]);
+
+        alloc_heap = alloc_libc();
+        const double base = 1e-6 / bench_time(cycle_fn, &c, BENCH_MINTIME);
+
+        Allocator *pool = alloc_pool_new();
+        alloc_heap = pool;
+        const double pooled = 1e-6 / bench_time(cycle_fn, &c, BENCH_MINTIME);
+        alloc_heap = alloc_libc();
+        pool->destroy(pool);
+
+        char name[64];
+        snprintf(name, sizeof(name), "v := v * M, M is %ux%u", dims[i], dims[i]);
+        bench_compare(name, pooled, base, "Mit/s");
+
+        value_unref(MK_MAT(c.m));
+    }
+    return 0;
+}
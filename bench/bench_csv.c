@@ -0,0 +1,253 @@
+#include "bench.h"
+#include "../matio.h"
+#include "../workers.h"
+#include "../osdep.h"
+
+#include <math.h>
+
+// /matio_parse_csv/ and /matio_write_csv_file/ throughput, in MB/s of CSV
+// text, from 1 thread to one per processor ($CALC_THREADS overrides the
+// maximum), next to a naive single-threaded loop of /strtod/, or of
+// /fprintf/ with "%.17g", over the same text. Also checks that parsing
+// gives the same bits as /strtod/ does, whatever the number of threads,
+// that writing then parsing gives back the same bits, and that fields
+// /strtod/ takes outside the CSV grammar, such as hexadecimal, are not
+// numbers.
+
+typedef struct {
+    // NUL-terminated.
+    char *text;
+    size_t ntext;
+    Scalar *out;
+    size_t nout;
+    const Matrix *m;
+    FILE *sink;
+} Ctx;
+
+static
+void
+naive_parse_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        const char *p = c->text;
+        for (size_t k = 0; k < c->nout; ++k) {
+            char *stop;
+            c->out[k] = strtod(p, &stop);
+            // The separator or the newline.
+            p = stop + 1;
+        }
+        bench_sink += c->out[c->nout - 1];
+    }
+}
+
+static
+void
+parse_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        char err[128];
+        Matrix *m = matio_parse_csv(c->text, c->ntext, ',', false, err, sizeof(err));
+        if (!m) {
+            PANIC("benchmark CSV does not parse");
+        }
+        bench_sink += m->elems[0];
+        value_unref(MK_MAT(m));
+    }
+}
+
+static
+void
+naive_write_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        for (unsigned i = 0; i < c->m->height; ++i) {
+            for (unsigned j = 0; j < c->m->width; ++j) {
+                fprintf(c->sink, "%.17g%c", matrix_at(c->m, i, j),
+                        j + 1 < c->m->width ? ',' : '\n');
+            }
+        }
+    }
+}
+
+static
+void
+write_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        if (!matio_write_csv_file(c->sink, c->m, ',')) {
+            PANIC("cannot write benchmark CSV");
+        }
+    }
+}
+
+// Rows of numbers of the kinds CSV files are made of: integers, short
+// decimals, and doubles with all their digits.
+static
+char *
+generate(unsigned nrows, unsigned ncols, size_t *ntext)
+{
+    const size_t cap = (size_t) nrows * ncols * 26 + 1;
+    char *text = XNEW(char, cap);
+    size_t n = 0;
+    uint_least32_t seed = 12345;
+    for (unsigned i = 0; i < nrows; ++i) {
+        for (unsigned j = 0; j < ncols; ++j) {
+            seed = seed * 1103515245 + 12345;
+            const double u = (double) (seed >> 8 & 0xffffff) / 0x1000000;
+            const char sep = j + 1 < ncols ? ',' : '\n';
+            switch (j % 4) {
+            case 0:
+                n += sprintf(text + n, "%ld%c", (long) (u * 1e6) - 500000, sep);
+                break;
+            case 1:
+                n += sprintf(text + n, "%.3f%c", u * 100 - 50, sep);
+                break;
+            case 2:
+                n += sprintf(text + n, "%.17g%c", u, sep);
+                break;
+            default:
+                n += sprintf(text + n, "%.6e%c", (u - 0.5) * 1e-10, sep);
+                break;
+            }
+        }
+    }
+    *ntext = n;
+    return text;
+}
+
+static
+bool
+same_bits(const Scalar *x, const Scalar *y, size_t n)
+{
+    return memcmp(x, y, n * sizeof(Scalar)) == 0;
+}
+
+static
+void
+check(Ctx *c, unsigned maxthreads)
+{
+    naive_parse_fn(c, 1);
+    for (unsigned nthreads = 1; nthreads <= maxthreads; nthreads *= 2) {
+        workers_global = workers_new(nthreads);
+        char err[128];
+        Matrix *m = matio_parse_csv(c->text, c->ntext, ',', false, err, sizeof(err));
+        if (!m || !same_bits(m->elems, c->out, c->nout)) {
+            PANIC("matio_parse_csv differs from strtod");
+        }
+
+        FILE *f = tmpfile();
+        if (!f || !matio_write_csv_file(f, m, ',')) {
+            PANIC("cannot write CSV to a temporary file");
+        }
+        const long nf = ftell(f);
+        char *back = XNEW(char, nf + 1);
+        rewind(f);
+        if (fread(back, 1, nf, f) != (size_t) nf) {
+            PANIC("cannot read back CSV");
+        }
+        fclose(f);
+        Matrix *m2 = matio_parse_csv(back, nf, ',', false, err, sizeof(err));
+        if (!m2 || m2->height != m->height || m2->width != m->width ||
+            !same_bits(m2->elems, m->elems, c->nout))
+        {
+            PANIC("CSV written by matio_write_csv_file does not read back the same");
+        }
+        free(back);
+        value_unref(MK_MAT(m));
+        value_unref(MK_MAT(m2));
+        workers_destroy(workers_global);
+        workers_global = NULL;
+    }
+
+    // Where a fast path would round differently from strtod.
+    static const char *hard =
+        "9007199254740993\n1e23\n0.1\n2.2250738585072011e-308\n1.7976931348623157e308\n"
+        "4.9e-324\n123456789012345678901234567890\n1e-400\n1e400\n-0\n0.30000000000000004\n"
+        "7.2057594037927933e16\n8.98846567431158e307\n1448997445238699\n"
+        "3.0540915485972349e-05\n1.00000000000000011102230246251565404236316680908203125\n";
+    char err[128];
+    Matrix *m = matio_parse_csv(hard, strlen(hard), ',', false, err, sizeof(err));
+    const char *p = hard;
+    for (unsigned i = 0; i < m->height; ++i) {
+        char *stop;
+        const Scalar x = strtod(p, &stop);
+        if (!same_bits(&x, &m->elems[i], 1)) {
+            PANIC("matio_parse_csv differs from strtod");
+        }
+        p = stop + 1;
+    }
+    value_unref(MK_MAT(m));
+
+    // What /strtod/ takes but the CSV grammar does not.
+    static const char *const not_numbers[] = {
+        "0x10", "0x1p3", "infinity", "nan(1)", "1e", ".", "-", "+-1", "1,5e", "in", "nana",
+    };
+    for (size_t i = 0; i < sizeof(not_numbers) / sizeof(not_numbers[0]); ++i) {
+        m = matio_parse_csv(not_numbers[i], strlen(not_numbers[i]), ';', false, err, sizeof(err));
+        if (m) {
+            PANIC("matio_parse_csv takes a field that is not a number");
+        }
+    }
+    static const char *special = "inf,-Inf,+INF,nan,NaN,-nan,1.,.5,+.5e-3\n";
+    m = matio_parse_csv(special, strlen(special), ',', false, err, sizeof(err));
+    if (!m || m->width != 9 || m->elems[0] != INFINITY || m->elems[1] != -INFINITY ||
+        m->elems[2] != INFINITY || !isnan(m->elems[3]) || !isnan(m->elems[4]) ||
+        !isnan(m->elems[5]) || m->elems[6] != 1 || m->elems[7] != 0.5 || m->elems[8] != 5e-4)
+    {
+        PANIC("matio_parse_csv does not read infinities, NaNs or short decimals");
+    }
+    value_unref(MK_MAT(m));
+}
+
+int
+main(void)
+{
+    unsigned maxthreads = osdep_ncpus();
+    const char *env = getenv("CALC_THREADS");
+    if (env && atoi(env) > 0) {
+        maxthreads = atoi(env);
+    }
+
+    const unsigned nrows = 250000;
+    const unsigned ncols = 8;
+    Ctx c = {.nout = (size_t) nrows * ncols};
+    c.text = generate(nrows, ncols, &c.ntext);
+    c.out = XNEW(Scalar, c.nout);
+    check(&c, maxthreads);
+
+    char err[128];
+    Matrix *m = matio_parse_csv(c.text, c.ntext, ',', false, err, sizeof(err));
+    c.m = m;
+    c.sink = fopen("/dev/null", "wb");
+    if (!c.sink) {
+        PANIC("cannot open /dev/null");
+    }
+
+    const double mb = c.ntext / 1e6;
+    const double naive_parse = mb / bench_time(naive_parse_fn, &c, BENCH_MINTIME);
+    const double naive_write = mb / bench_time(naive_write_fn, &c, BENCH_MINTIME);
+    // 1, 2, 4, ..., and /maxthreads/ itself.
+    for (unsigned nthreads = 1; ; nthreads = 2 * nthreads < maxthreads ? 2 * nthreads : maxthreads) {
+        workers_global = workers_new(nthreads);
+        char name[64];
+        snprintf(name, sizeof(name), "parse csv %.0f MB x%u", mb, nthreads);
+        bench_compare(name, mb / bench_time(parse_fn, &c, BENCH_MINTIME), naive_parse, "MB/s");
+        snprintf(name, sizeof(name), "write csv %.0f MB x%u", mb, nthreads);
+        bench_compare(name, mb / bench_time(write_fn, &c, BENCH_MINTIME), naive_write, "MB/s");
+        workers_destroy(workers_global);
+        workers_global = NULL;
+        if (nthreads == maxthreads) {
+            break;
+        }
+    }
+
+    fclose(c.sink);
+    value_unref(MK_MAT(m));
+    free(c.text);
+    free(c.out);
+    return 0;
+}
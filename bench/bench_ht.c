@@ -0,0 +1,92 @@
+#include "bench.h"
+#include "../ht.h"
+
+// /ht_put/ and /ht_get/ throughput for several table sizes and key lengths.
+// Throughput is reported as key bytes processed per second, against the
+// streaming bandwidth for the table's working set: a lookup has to hash the
+// whole key and compare it once, so that is the bound it is working against.
+
+typedef struct {
+    char *keys;
+    size_t nkey;
+    size_t nkeys;
+    Ht *h;
+} Ctx;
+
+static
+void
+make_keys(Ctx *c)
+{
+    c->keys = xmalloc(c->nkeys, c->nkey);
+    for (size_t i = 0; i < c->nkeys; ++i) {
+        char *k = c->keys + i * c->nkey;
+        size_t x = i;
+        for (size_t j = 0; j < c->nkey; ++j) {
+            k[c->nkey - 1 - j] = 'a' + x % 26;
+            x /= 26;
+        }
+    }
+}
+
+static
+void
+put_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        Ht *h = ht_new(6);
+        for (size_t i = 0; i < c->nkeys; ++i) {
+            ht_put(h, c->keys + i * c->nkey, c->nkey, i);
+        }
+        ht_destroy(h);
+    }
+}
+
+static
+void
+get_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    size_t acc = 0;
+    for (size_t r = 0; r < nreps; ++r) {
+        for (size_t i = 0; i < c->nkeys; ++i) {
+            acc += ht_get(c->h, c->keys + i * c->nkey, c->nkey);
+        }
+    }
+    bench_sink += acc;
+}
+
+int
+main(void)
+{
+    static const size_t sizes[] = {16, 1024, 65536, 1 << 20};
+    static const size_t keylens[] = {4, 16, 64};
+
+    for (size_t si = 0; si < sizeof(sizes) / sizeof(sizes[0]); ++si) {
+        for (size_t ki = 0; ki < sizeof(keylens) / sizeof(keylens[0]); ++ki) {
+            Ctx c = {.nkey = keylens[ki], .nkeys = sizes[si]};
+            make_keys(&c);
+            c.h = ht_new(6);
+            for (size_t i = 0; i < c.nkeys; ++i) {
+                ht_put(c.h, c.keys + i * c.nkey, c.nkey, i);
+            }
+
+            const size_t nbytes = c.nkeys * c.nkey;
+            // keys stored twice (ours and the table's) plus entries and buckets
+            const double peak = bench_peak_bandwidth(2 * nbytes + c.nkeys * 16) / 1e6;
+
+            char name[64];
+            snprintf(name, sizeof(name), "ht_put n=%zu key=%zu", c.nkeys, c.nkey);
+            bench_report(name, nbytes / bench_time(put_fn, &c, BENCH_MINTIME) / 1e6,
+                         peak, "MB/s");
+
+            snprintf(name, sizeof(name), "ht_get n=%zu key=%zu", c.nkeys, c.nkey);
+            bench_report(name, nbytes / bench_time(get_fn, &c, BENCH_MINTIME) / 1e6,
+                         peak, "MB/s");
+
+            ht_destroy(c.h);
+            free(c.keys);
+        }
+    }
+    return 0;
+}
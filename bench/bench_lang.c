@@ -0,0 +1,671 @@
+#include "bench.h"
+#include "../runtime.h"
+#include "../matrix.h"
+#include "../matio.h"
+#include "../str.h"
+
+#include <unistd.h>
+
+// /lexer_next/ and /parser_parse/ throughput on a large generated script,
+// in MB/s of source text, against the streaming bandwidth for a buffer of
+// the same size. The parser figure includes lexing. Also runs scripts that
+// check that the jumps of loops land where they should, that assigning to an
+// element of a shared matrix copies it, that loops whose bounds checks are
+// hoisted behave like loops whose checks are not, that slices of views pick
+// the right elements and raise the right errors, and that /LoadNpy/ takes
+// only the versions of .npy there are.
+
+static
+Value
+dummy_unary(struct Env *e, Value a)
+{
+    (void) e;
+    return a;
+}
+
+static
+Value
+dummy_binary(struct Env *e, Value a, Value b)
+{
+    (void) e;
+    (void) b;
+    return a;
+}
+
+// The correctness checks run scripts in fresh runtimes, with the operators
+// below, on scalars, and a few functions: /Mat/, /Trans/ and /LoadNpy/ like
+// the interpreter's, and /Check/, which records its arguments.
+
+enum { MAX_CHECKED = 8 };
+
+// What a script passed to /Check/ last, and the first error it raised.
+typedef struct {
+    Scalar vals[MAX_CHECKED];
+    unsigned nvals;
+    char err[128];
+} Outcome;
+
+static Outcome *outcome;
+
+static
+Value
+scalar_add(struct Env *e, Value a, Value b)
+{
+    (void) e;
+    return MK_SCL(AS_SCL(a) + AS_SCL(b));
+}
+
+static
+Value
+scalar_sub(struct Env *e, Value a, Value b)
+{
+    (void) e;
+    return MK_SCL(AS_SCL(a) - AS_SCL(b));
+}
+
+static
+Value
+scalar_mul(struct Env *e, Value a, Value b)
+{
+    (void) e;
+    return MK_SCL(AS_SCL(a) * AS_SCL(b));
+}
+
+static
+Value
+scalar_lt(struct Env *e, Value a, Value b)
+{
+    (void) e;
+    return MK_SCL(AS_SCL(a) < AS_SCL(b));
+}
+
+static
+Value
+scalar_le(struct Env *e, Value a, Value b)
+{
+    (void) e;
+    return MK_SCL(AS_SCL(a) <= AS_SCL(b));
+}
+
+static
+Value
+scalar_eq(struct Env *e, Value a, Value b)
+{
+    (void) e;
+    return MK_SCL(AS_SCL(a) == AS_SCL(b));
+}
+
+static
+Value
+check_fn(struct Env *e, const Value *args, unsigned nargs)
+{
+    if (nargs > MAX_CHECKED) {
+        env_throw(e, "'Check' takes at most %d arguments", (int) MAX_CHECKED);
+    }
+    for (unsigned i = 0; i < nargs; ++i) {
+        if (args[i].kind != VAL_KIND_SCALAR) {
+            env_throw(e, "'Check' takes scalars");
+        }
+        outcome->vals[i] = AS_SCL(args[i]);
+    }
+    outcome->nvals = nargs;
+    return MK_SCL(0);
+}
+
+static
+Value
+mat_fn(struct Env *e, const Value *args, unsigned nargs)
+{
+    if (nargs != 2 || args[0].kind != VAL_KIND_SCALAR || args[1].kind != VAL_KIND_SCALAR) {
+        env_throw(e, "'Mat' expects two scalars");
+    }
+    return MK_MAT(matrix_new(AS_SCL(args[0]), AS_SCL(args[1])));
+}
+
+static
+Value
+trans_fn(struct Env *e, const Value *args, unsigned nargs)
+{
+    if (nargs != 1 || args[0].kind != VAL_KIND_MATRIX) {
+        env_throw(e, "'Trans' expects a matrix");
+    }
+    return MK_MAT(matrix_transposed(AS_MAT(args[0])));
+}
+
+static
+Value
+load_npy_fn(struct Env *e, const Value *args, unsigned nargs)
+{
+    if (nargs != 1 || args[0].kind != VAL_KIND_STR) {
+        env_throw(e, "'LoadNpy' expects a file name");
+    }
+    const Str *name = AS_STR(args[0]);
+    char path[MATIO_PATH_MAX];
+    snprintf(path, sizeof(path), "%.*s", (int) name->ndata, name->data);
+    return MK_MAT(matio_load_npy(e, path));
+}
+
+// Runs /nparts/ pieces of script one after the other in a fresh runtime,
+// going on after an error, as the REPL does. The error messages go to
+// /o->err/ rather than to stderr.
+static
+void
+run(Outcome *o, const char *const *parts, size_t nparts)
+{
+    *o = (Outcome) {.nvals = 0};
+    outcome = o;
+    Runtime rt = runtime_new(NULL, 1);
+#define BINARY(Fn_, Priority_, Means_) (Op) { \
+        .arity = 2, .assoc = OP_ASSOC_LEFT, .priority = Priority_, .exec = {.binary = Fn_}, \
+        .means = Means_, \
+    }
+    runtime_reg_op(rt, "+", BINARY(scalar_add, 1, OP_MEANS_ADD));
+    runtime_reg_op(rt, "-", BINARY(scalar_sub, 1, OP_MEANS_OTHER));
+    runtime_reg_op(rt, "*", BINARY(scalar_mul, 2, OP_MEANS_OTHER));
+    runtime_reg_op(rt, "<", BINARY(scalar_lt, 0, OP_MEANS_BELOW));
+    runtime_reg_op(rt, "<=", BINARY(scalar_le, 0, OP_MEANS_BELOW));
+    runtime_reg_op(rt, "==", BINARY(scalar_eq, 0, OP_MEANS_OTHER));
+#undef BINARY
+    runtime_put(rt, "Check", MK_CFUNC(check_fn));
+    runtime_put(rt, "Mat", MK_CFUNC(mat_fn));
+    runtime_put(rt, "Trans", MK_CFUNC(trans_fn));
+    runtime_put(rt, "LoadNpy", MK_CFUNC(load_npy_fn));
+
+    FILE *errs = tmpfile();
+    const int saved = dup(2);
+    if (!errs || saved < 0) {
+        PANIC("cannot redirect stderr");
+    }
+    fflush(stderr);
+    dup2(fileno(errs), 2);
+    for (size_t i = 0; i < nparts; ++i) {
+        const ExecError err = runtime_exec(rt, NULL, parts[i], strlen(parts[i]));
+        if (err.kind != ERR_KIND_OK && err.kind != ERR_KIND_RTIME) {
+            PANIC("check script does not compile");
+        }
+    }
+    fflush(stderr);
+    dup2(saved, 2);
+    close(saved);
+    rewind(errs);
+    // "Error: <message>", then where it happened.
+    static const char prefix[] = "Error: ";
+    if (fgets(o->err, sizeof(o->err), errs)) {
+        o->err[strcspn(o->err, "\n")] = '\0';
+        if (strncmp(o->err, prefix, strlen(prefix)) == 0) {
+            memmove(o->err, o->err + strlen(prefix), strlen(o->err) - strlen(prefix) + 1);
+        }
+    }
+    fclose(errs);
+    runtime_destroy(rt);
+    outcome = NULL;
+}
+
+// Whether running /parts/ passes /want/ to /Check/ and raises /err/ (or
+// nothing, if NULL).
+static
+bool
+gives(const char *const *parts, size_t nparts, const Scalar *want, unsigned nwant,
+      const char *err)
+{
+    Outcome o;
+    run(&o, parts, nparts);
+    if (o.nvals != nwant || memcmp(o.vals, want, nwant * sizeof(Scalar)) != 0) {
+        return false;
+    }
+    return err ? strcmp(o.err, err) == 0 : !o.err[0];
+}
+
+#define GIVES(Parts_, Err_, ...) \
+    gives((Parts_), sizeof(Parts_) / sizeof((Parts_)[0]), \
+          (const Scalar[]) {__VA_ARGS__}, \
+          sizeof((const Scalar[]) {__VA_ARGS__}) / sizeof(Scalar), (Err_))
+
+static
+void
+report(const char *what, bool ok)
+{
+    printf("%s: %s\n", what, ok ? "same" : "MISMATCH");
+}
+
+// Loops with /continue/, whose jumps back must land on the condition
+// (for /while/) or the step (for /for/).
+static
+void
+check_loops(void)
+{
+    static const char *const script[] = {
+        "k = 0\n"
+        "for i | 1; i <= 10; i + 1 do\n"
+        "    if i == 3 then\n"
+        "        continue\n"
+        "    end\n"
+        "    k = k + i\n"
+        "end\n"
+        "j = 0\n"
+        "while j < 5 do\n"
+        "    j = j + 1\n"
+        "    if j == 2 then\n"
+        "        continue\n"
+        "    end\n"
+        "end\n"
+        "r = Check(k, j)\n",
+    };
+    report("loops with continue", GIVES(script, NULL, 52, 5));
+}
+
+// /seq(h, w)/ is an /h/ x /w/ matrix of 1, 2, ... row after row. Matrices
+// of more than 16 elements give views when transposed or sliced.
+static const char *seq_def =
+    "fu seq(h, w)\n"
+    "    m := Mat(h, w)\n"
+    "    for k | 1; k <= h * w; k + 1 do\n"
+    "        m[k] = k\n"
+    "    end\n"
+    "    return m\n"
+    "end\n";
+
+// Assigning to an element of a matrix that something else refers to
+// changes the copy being assigned to alone.
+static
+void
+check_copy_on_write(void)
+{
+    static const char *aliases =
+        "a = seq(5, 5)\n"
+        "b = a\n"
+        "b[1] = 9\n"
+        "b[2, 2] = 9\n"
+        "fu local()\n"
+        "    x := seq(5, 5)\n"
+        "    y := x\n"
+        "    y[1] = 9\n"
+        "    return x[1] + y[1] * 10\n"
+        "end\n"
+        "r = Check(a[1], a[7], b[1], b[7], local())\n";
+    report("copy on write: b = a; b[1] = 9",
+           GIVES(((const char *[]) {seq_def, aliases}), NULL, 1, 7, 9, 9, 91));
+
+    static const char *args =
+        "fu poke(m)\n"
+        "    m[3] = 9\n"
+        "    m[1, 4] = 9\n"
+        "    m[2:3, 1] = 9\n"
+        "    return m[3] + m[4] + m[6] + m[11]\n"
+        "end\n"
+        "a = seq(5, 5)\n"
+        "r = Check(poke(a), a[3], a[4], a[6], a[11])\n";
+    report("copy on write: argument",
+           GIVES(((const char *[]) {seq_def, args}), NULL, 36, 3, 4, 6, 11));
+
+    // Views share the elements of /a/ until either side is assigned to.
+    static const char *views =
+        "a = seq(5, 5)\n"
+        "t = Trans(a)\n"
+        "t[1, 2] = 9\n"
+        "s = a[2:5, :]\n"
+        "s[1, 1] = 9\n"
+        "u = a[:, 2:4]\n"
+        "a[5, 3] = 9\n"
+        "r = Check(a[1, 2], a[2, 1], t[1, 2], t[2, 1], s[1, 1], a[6], u[5, 2], a[23])\n";
+    report("copy on write: views",
+           GIVES(((const char *[]) {seq_def, views}), NULL, 2, 6, 9, 2, 9, 6, 23, 9));
+
+    // In /a[1] = f()/, /a/ is loaded before /f/ reassigns it.
+    static const char *reassigned =
+        "fu f()\n"
+        "    a = [7, 8, 9]\n"
+        "    return 5\n"
+        "end\n"
+        "a = seq(5, 5)\n"
+        "b = a\n"
+        "a[1] = f()\n"
+        "r1 = a[1] + a[3] * 10\n"
+        "a = seq(5, 5)\n"
+        "a[1, 2] = f()\n"
+        "r2 = a[2]\n"
+        "a = seq(5, 5)\n"
+        "a[1:2] = f()\n"
+        "r = Check(r1, r2, a[1], a[2], b[1], b[2])\n";
+    report("copy on write: global reassigned during a store",
+           GIVES(((const char *[]) {seq_def, reassigned}), NULL, 97, 8, 7, 8, 1, 2));
+}
+
+// Loops whose subscripts the parser checks once, before the loop, each
+// with a /while/ twin that it does not touch: with the bound a local or a
+// number, a fractional step, nested loops, and an inner bound set by the
+// outer loop. Global /done/ counts the iterations that got through.
+static const char *hoisted_defs =
+    "fu fa(m, lo, n)\n"
+    "    s := 0\n"
+    "    for i | lo; i <= n; i + 1 do\n"
+    "        m[i] = m[i] * 2\n"
+    "        s = s + m[i] * i\n"
+    "        done = done + 1\n"
+    "    end\n"
+    "    return s + m[1]\n"
+    "end\n"
+    "fu wa(m, lo, n)\n"
+    "    s := 0\n"
+    "    i := lo\n"
+    "    while i <= n do\n"
+    "        m[i] = m[i] * 2\n"
+    "        s = s + m[i] * i\n"
+    "        done = done + 1\n"
+    "        i = i + 1\n"
+    "    end\n"
+    "    return s + m[1]\n"
+    "end\n"
+    "fu fb(m, lo, n)\n"
+    "    s := 0\n"
+    "    for i | lo; i < n; i + 0.5 do\n"
+    "        s = s + m[i] * i\n"
+    "        done = done + 1\n"
+    "    end\n"
+    "    return s\n"
+    "end\n"
+    "fu wb(m, lo, n)\n"
+    "    s := 0\n"
+    "    i := lo\n"
+    "    while i < n do\n"
+    "        s = s + m[i] * i\n"
+    "        done = done + 1\n"
+    "        i = i + 0.5\n"
+    "    end\n"
+    "    return s\n"
+    "end\n"
+    "fu fc(m, lo, n)\n"
+    "    s := 0\n"
+    "    for i | lo; i <= 5; i + 1 do\n"
+    "        s = s + m[i, 2] * i\n"
+    "        done = done + 1\n"
+    "    end\n"
+    "    return s\n"
+    "end\n"
+    "fu wc(m, lo, n)\n"
+    "    s := 0\n"
+    "    i := lo\n"
+    "    while i <= 5 do\n"
+    "        s = s + m[i, 2] * i\n"
+    "        done = done + 1\n"
+    "        i = i + 1\n"
+    "    end\n"
+    "    return s\n"
+    "end\n"
+    "fu fd(m, lo, n)\n"
+    "    s := 0\n"
+    "    for i | lo; i <= 5; i + 1 do\n"
+    "        for j | 1; j <= n; j + 1 do\n"
+    "            s = s + m[i, j] * (i - j)\n"
+    "            done = done + 1\n"
+    "        end\n"
+    "        for j | 1; j <= i; j + 1 do\n"
+    "            m[i, j] = 0\n"
+    "        end\n"
+    "    end\n"
+    "    return s + m[1, 2] + m[2, 1]\n"
+    "end\n"
+    "fu wd(m, lo, n)\n"
+    "    s := 0\n"
+    "    j := 0\n"
+    "    i := lo\n"
+    "    while i <= 5 do\n"
+    "        j = 1\n"
+    "        while j <= n do\n"
+    "            s = s + m[i, j] * (i - j)\n"
+    "            done = done + 1\n"
+    "            j = j + 1\n"
+    "        end\n"
+    "        j = 1\n"
+    "        while j <= i do\n"
+    "            m[i, j] = 0\n"
+    "            j = j + 1\n"
+    "        end\n"
+    "        i = i + 1\n"
+    "    end\n"
+    "    return s + m[1, 2] + m[2, 1]\n"
+    "end\n";
+
+// The loops of /hoisted_defs/ do what their twins do, out of range too.
+static
+void
+check_hoisted(void)
+{
+    static const struct {
+        // The function, less its first letter, and its arguments.
+        const char *call;
+        // The error it stops with, if any.
+        const char *err;
+    } cases[] = {
+        {"a(seq(5, 5), 1, 25)", NULL},
+        {"a(seq(5, 5), 3, 26)", "element number out of range"},
+        {"a(seq(5, 5), 0, 4)", "element number out of range"},
+        {"b(seq(5, 5), 1, 26)", NULL},
+        {"b(seq(5, 5), 1.5, 25.75)", NULL},
+        {"b(seq(5, 5), 1, 26.5)", "element number out of range"},
+        {"c(seq(5, 5), 1, 0)", NULL},
+        {"c(seq(4, 5), 2, 0)", "row number out of range"},
+        {"d(seq(5, 5), 1, 5)", NULL},
+        {"d(seq(5, 5), 1, 6)", "column number out of range"},
+        {"d(seq(5, 4), 2, 4)", "column number out of range"},
+    };
+    bool ok = true;
+    for (size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); ++k) {
+        Outcome o[2];
+        for (int twin = 0; twin < 2; ++twin) {
+            char call[128];
+            snprintf(call, sizeof(call), "done = 0\nr = 0\nr = %c%s\n",
+                     "fw"[twin], cases[k].call);
+            const char *const parts[] = {seq_def, hoisted_defs, call, "x = Check(r, done)\n"};
+            run(&o[twin], parts, sizeof(parts) / sizeof(parts[0]));
+        }
+        ok = ok && o[0].nvals == 2 && o[1].nvals == 2 &&
+             memcmp(o[0].vals, o[1].vals, sizeof(o[0].vals)) == 0 &&
+             strcmp(o[0].err, o[1].err) == 0 &&
+             (cases[k].err ? strcmp(o[0].err, cases[k].err) == 0 : !o[0].err[0]);
+    }
+    report("loops with hoisted bounds checks", ok);
+}
+
+// Slices of views: of slices, of transpositions, and transpositions of
+// slices, all large enough to be views, and subscripts out of the range of
+// the view (but not of what it is a view of).
+static
+void
+check_slices(void)
+{
+    static const char *views =
+        "a = seq(8, 8)\n"
+        "s = a[2:8, 2:8]\n"
+        "ss = s[2:6, 2:6]\n"
+        "v = s[3:20]\n"
+        "t = Trans(a)\n"
+        "ts = t[2:7, 3:6]\n"
+        "u = Trans(a[1:3, :])\n"
+        "ss[1, 1] = 0\n"
+        "ts[:, 1] = 0\n"
+        "r = Check(ss[1, 1], ss[5, 5], v[1], v[18], ts[2, 2], ts[6, 4], u[8, 3], s[2, 2])\n";
+    report("slices of views",
+           GIVES(((const char *[]) {seq_def, views}), NULL, 0, 55, 12, 31, 27, 47, 24, 19));
+
+    static const struct {
+        const char *stmt;
+        const char *err;
+    } cases[] = {
+        {"x = s[8, :]", "row number out of range"},
+        {"x = s[1:8, 1]", "row number out of range"},
+        {"x = s[:, 8]", "column number out of range"},
+        {"x = s[50:51]", "element number out of range"},
+        {"x = s[3:2, 1]", "row range is empty"},
+        {"x = t[7, :]", "row number out of range"},
+        {"x = t[:, 1:9]", "column number out of range"},
+        {"x = t[2:49]", "element number out of range"},
+        {"ss[1:6, :] = 0", "row number out of range"},
+        {"s[1, :] = [1, 2]", "cannot assign a 1 x 2 matrix to a 1 x 7 slice"},
+    };
+    bool ok = true;
+    for (size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); ++k) {
+        char script[256];
+        snprintf(script, sizeof(script),
+                 "a = seq(8, 8)\n"
+                 "s = a[2:8, 2:8]\n"
+                 "ss = s[2:6, 2:6]\n"
+                 "t = Trans(seq(8, 6))\n"
+                 "r = Check(1)\n"
+                 "%s\n"
+                 "r = Check(2)\n",
+                 cases[k].stmt);
+        ok = ok && GIVES(((const char *[]) {seq_def, script}), cases[k].err, 1);
+    }
+    report("slices out of range", ok);
+}
+
+// Only versions 1, 2 and 3 of .npy are read, each with the header length
+// where it belongs: a file of version 0, 4 or 255 laid out like version 2
+// is not a .npy file.
+static
+void
+check_npy(void)
+{
+    static const char dict[] = "{'descr': '<f8', 'fortran_order': False, 'shape': (2, 2), }";
+    // Version 2 puts four bytes of header length after the version, and the
+    // elements start at a multiple of 64.
+    unsigned char file[128 + 4 * sizeof(double)] = "\x93NUMPY";
+    const size_t nhdr = 128 - 12;
+    memset(file + 12, ' ', nhdr);
+    memcpy(file + 12, dict, strlen(dict));
+    file[127] = '\n';
+    file[8] = nhdr & 0xff;
+    file[9] = nhdr >> 8;
+    file[10] = file[11] = 0;
+    const double elems[] = {1, 2, 3, 4};
+    memcpy(file + 128, elems, sizeof(elems));
+
+    char path[] = "/tmp/bench_lang.XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        PANIC("cannot create a temporary file");
+    }
+    close(fd);
+    char script[64];
+    snprintf(script, sizeof(script), "m = LoadNpy(\"%s\")\nr = Check(m[4])\n", path);
+    char err[128];
+    snprintf(err, sizeof(err), "'LoadNpy': '%s' is not a .npy file", path);
+
+    static const unsigned char majors[] = {2, 3, 0, 4, 255};
+    bool ok = true;
+    for (size_t k = 0; k < sizeof(majors) / sizeof(majors[0]); ++k) {
+        file[6] = majors[k];
+        FILE *f = fopen(path, "wb");
+        if (!f || fwrite(file, 1, sizeof(file), f) != sizeof(file) || fclose(f) != 0) {
+            PANIC("cannot write a temporary file");
+        }
+        const char *const parts[] = {script};
+        Outcome o;
+        run(&o, parts, 1);
+        ok = ok && (majors[k] == 2 || majors[k] == 3
+                    ? o.nvals == 1 && o.vals[0] == 4 && !o.err[0]
+                    : o.nvals == 0 && strcmp(o.err, err) == 0);
+    }
+    remove(path);
+    report("LoadNpy versions", ok);
+}
+
+static const char *snippet =
+    "fu f(x, y)\n"
+    "    r := 0\n"
+    "    for i | 1; i <= x; i+1 do\n"
+    "        r = r + i * y - (x ^ 2) / 3.25 % 7\n"
+    "        if r > 1000 && !(r == 5) then\n"
+    "            r = r - 1000\n"
+    "        end\n"
+    "    end\n"
+    "    return [r, r + 1; \"str\", x]\n"
+    "end\n"
+    "a = f(10, 20)\n"
+    "a[1, 2] = Dim(a)[1] * 0.5\n";
+
+typedef struct {
+    Runtime rt;
+    const char *buf;
+    size_t nbuf;
+} Ctx;
+
+static
+void
+lex_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    size_t acc = 0;
+    for (size_t r = 0; r < nreps; ++r) {
+        lexer_reset(c->rt.lexer, c->buf, c->nbuf);
+        for (Lexem m; (m = lexer_next(c->rt.lexer)).kind != LEX_KIND_EOF;) {
+            acc += m.kind;
+        }
+    }
+    bench_sink += acc;
+}
+
+static
+void
+parse_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        lexer_reset(c->rt.lexer, c->buf, c->nbuf);
+        if (!parser_parse(c->rt.parser)) {
+            PANIC("benchmark script does not parse");
+        }
+    }
+}
+
+int
+main(void)
+{
+    check_loops();
+    check_copy_on_write();
+    check_hoisted();
+    check_slices();
+    check_npy();
+
+    Runtime rt = runtime_new(NULL, 1);
+
+#define UNARY(...) (Op) {.arity = 1, .exec = {.unary = dummy_unary}, __VA_ARGS__}
+#define BINARY(...) (Op) {.arity = 2, .exec = {.binary = dummy_binary}, __VA_ARGS__}
+    runtime_reg_ambig_op(rt, "-",
+        UNARY(.assoc = OP_ASSOC_RIGHT, .priority = 100),
+        BINARY(.assoc = OP_ASSOC_LEFT, .priority = 1));
+    static const char *binops[] = {
+        "+", "*", "/", "%", "^", "~~", "&&", "||", "<", "<=", "==", "!=", ">", ">=",
+    };
+    for (size_t i = 0; i < sizeof(binops) / sizeof(binops[0]); ++i) {
+        runtime_reg_op(rt, binops[i], BINARY(.assoc = OP_ASSOC_LEFT, .priority = 1));
+    }
+    runtime_reg_op(rt, "!", UNARY(.assoc = OP_ASSOC_RIGHT, .priority = 0));
+#undef UNARY
+#undef BINARY
+
+    static const size_t sizes[] = {1 << 12, 1 << 16, 1 << 22};
+    const size_t nsnippet = strlen(snippet);
+    for (size_t si = 0; si < sizeof(sizes) / sizeof(sizes[0]); ++si) {
+        const size_t ncopies = (sizes[si] + nsnippet - 1) / nsnippet;
+        char *buf = xmalloc(ncopies, nsnippet);
+        for (size_t i = 0; i < ncopies; ++i) {
+            memcpy(buf + i * nsnippet, snippet, nsnippet);
+        }
+        Ctx c = {.rt = rt, .buf = buf, .nbuf = ncopies * nsnippet};
+        const double peak = bench_peak_bandwidth(c.nbuf) / 1e6;
+
+        char name[64];
+        snprintf(name, sizeof(name), "lexer_next size=%zu", c.nbuf);
+        bench_report(name, c.nbuf / bench_time(lex_fn, &c, BENCH_MINTIME) / 1e6, peak, "MB/s");
+
+        snprintf(name, sizeof(name), "parser_parse size=%zu", c.nbuf);
+        bench_report(name, c.nbuf / bench_time(parse_fn, &c, BENCH_MINTIME) / 1e6, peak, "MB/s");
+
+        free(buf);
+    }
+
+    runtime_destroy(rt);
+    return 0;
+}
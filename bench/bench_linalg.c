@@ -0,0 +1,1676 @@
+#include "bench.h"
+#include "../linalg.h"
+
+#include <math.h>
+
+// Matrix kernels behind the arithmetic operators and 'Trans': GEMM in
+// GFLOP/s against the multiply-add peak and, for every instruction set the
+// CPU supports, against the naive triple loop it replaced; GEMM with a
+// transposed operand read in place against transposing it first; products
+// with a single row or column in GB/s against the streaming bandwidth and
+// the naive loop; elementwise and transposition kernels in GB/s against
+// the streaming bandwidth for their working set, elementwise kernels and
+// scans for every instruction set against the scalar loops, elementwise
+// functions against libm (and their errors against long double),
+// reductions against a plain loop (and their errors against long double),
+// kernels for matrices up to 4 x 4 against the general ones, LU
+// factorization against the multiply-add peak and unblocked elimination
+// (and its backward errors), Cholesky, QR and symmetric eigenvalues
+// against the peak (and their backward errors), products with a sparse
+// matrix in GB/s against the streaming bandwidth and a loop over triplets
+// (and the conjugate gradient residual), and transposition against its
+// element-by-element version.
+
+typedef struct {
+    Scalar *x;
+    Scalar *y;
+    Scalar *z;
+    // Room for a transposed copy of /x/ or /y/.
+    Scalar *t;
+    unsigned m;
+    unsigned n;
+    unsigned p;
+} Ctx;
+
+static
+Scalar *
+new_filled(size_t n)
+{
+    Scalar *r = XNEW(Scalar, n ? n : 1);
+    for (size_t i = 0; i < n; ++i) {
+        r[i] = (Scalar) (i % 17) / 16 - 0.5;
+    }
+    return r;
+}
+
+static
+void
+gemm_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_gemm(c->z, c->x, c->y, c->m, c->n, c->p);
+    }
+    bench_sink += c->z[0];
+}
+
+// The i-j-k loop /linalg_gemm/ used before blocking, kept as a baseline.
+static
+void
+gemm_naive(Scalar *z, const Scalar *x, const Scalar *y, unsigned m, unsigned n, unsigned p)
+{
+    for (unsigned i = 0; i < m; ++i) {
+        for (unsigned j = 0; j < p; ++j) {
+            Scalar elem = 0;
+            for (unsigned k = 0; k < n; ++k) {
+                elem += x[(size_t) i * n + k] * y[(size_t) k * p + j];
+            }
+            z[(size_t) i * p + j] = elem;
+        }
+    }
+}
+
+static
+void
+gemm_naive_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        gemm_naive(c->z, c->x, c->y, c->m, c->n, c->p);
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+add_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_add(c->z, c->x, c->y, (size_t) c->m * c->n);
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+scale_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_scale(c->z, 1.5, c->x, (size_t) c->m * c->n);
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+transpose_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_transpose(c->z, c->x, c->m, c->n);
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+bench_gemm(unsigned m, unsigned n, unsigned p, double peak)
+{
+    Ctx c = {
+        .x = new_filled((size_t) m * n),
+        .y = new_filled((size_t) n * p),
+        .z = new_filled((size_t) m * p),
+        .m = m, .n = n, .p = p,
+    };
+    const double nflops = 2.0 * m * n * p;
+    const double base = nflops / bench_time(gemm_naive_fn, &c, BENCH_MINTIME) / 1e9;
+    char name[64];
+
+    const LinalgIsa best = linalg_isa_supported();
+    for (LinalgIsa isa = LINALG_ISA_GENERIC; isa <= best; ++isa) {
+        linalg_set_isa(isa);
+        snprintf(name, sizeof(name), "gemm %ux%u * %ux%u %s", m, n, n, p, linalg_isa_name(isa));
+        const double value = nflops / bench_time(gemm_fn, &c, BENCH_MINTIME) / 1e9;
+        if (isa == best) {
+            bench_report(name, value, peak, "GFLOP/s");
+        }
+        bench_compare(name, value, base, "GFLOP/s");
+    }
+    linalg_set_isa(best);
+
+    free(c.x);
+    free(c.y);
+    free(c.z);
+}
+
+// Products with a single row or column, which take the GEMV kernels: in
+// GB/s of matrix read, against the streaming bandwidth for that much data
+// and, for every instruction set, against the naive triple loop.
+static
+void
+bench_gemv(unsigned m, unsigned n, unsigned p)
+{
+    Ctx c = {
+        .x = new_filled((size_t) m * n),
+        .y = new_filled((size_t) n * p),
+        .z = new_filled((size_t) m * p),
+        .m = m, .n = n, .p = p,
+    };
+    const double nbytes = (double) n * (m > p ? m : p) * sizeof(Scalar);
+    const double peak = bench_peak_bandwidth(nbytes) / 1e9;
+    const double base = nbytes / bench_time(gemm_naive_fn, &c, BENCH_MINTIME) / 1e9;
+    char name[64];
+
+    const LinalgIsa best = linalg_isa_supported();
+    for (LinalgIsa isa = LINALG_ISA_GENERIC; isa <= best; ++isa) {
+        linalg_set_isa(isa);
+        snprintf(name, sizeof(name), "gemv %ux%u * %ux%u %s", m, n, n, p, linalg_isa_name(isa));
+        const double value = nbytes / bench_time(gemm_fn, &c, BENCH_MINTIME) / 1e9;
+        if (isa == best) {
+            bench_report(name, value, peak, "GB/s");
+        }
+        bench_compare(name, value, base, "GB/s");
+    }
+    linalg_set_isa(best);
+
+    free(c.x);
+    free(c.y);
+    free(c.z);
+}
+
+// Trans(x) * y with /x/ stored n x m, and x * Trans(y) with /y/ stored
+// p x n: read in place through /linalg_gemm_strided/, or transposed into
+// /t/ first, as 'Trans' did before it returned views.
+
+static
+void
+gemm_tn_view_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_gemm_strided(c->z, c->x, 1, c->m, c->y, c->p, 1, c->m, c->n, c->p);
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+gemm_tn_copy_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_transpose(c->t, c->x, c->n, c->m);
+        linalg_gemm(c->z, c->t, c->y, c->m, c->n, c->p);
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+gemm_nt_view_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_gemm_strided(c->z, c->x, c->n, 1, c->y, 1, c->n, c->m, c->n, c->p);
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+gemm_nt_copy_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_transpose(c->t, c->y, c->p, c->n);
+        linalg_gemm(c->z, c->x, c->t, c->m, c->n, c->p);
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+bench_gemm_trans(unsigned m, unsigned n, unsigned p)
+{
+    const size_t nt = (size_t) n * (m > p ? m : p);
+    Ctx c = {
+        .x = new_filled((size_t) m * n),
+        .y = new_filled((size_t) n * p),
+        .z = new_filled((size_t) m * p),
+        .t = new_filled(nt),
+        .m = m, .n = n, .p = p,
+    };
+    const double nflops = 2.0 * m * n * p;
+    char name[64];
+
+    // Same products, same order of operations: same bits.
+    Scalar *ref = new_filled((size_t) m * p);
+    gemm_tn_copy_fn(&c, 1);
+    memcpy(ref, c.z, (size_t) m * p * sizeof(Scalar));
+    gemm_tn_view_fn(&c, 1);
+    const bool tn_ok = !memcmp(ref, c.z, (size_t) m * p * sizeof(Scalar));
+    gemm_nt_copy_fn(&c, 1);
+    memcpy(ref, c.z, (size_t) m * p * sizeof(Scalar));
+    gemm_nt_view_fn(&c, 1);
+    const bool nt_ok = !memcmp(ref, c.z, (size_t) m * p * sizeof(Scalar));
+    free(ref);
+
+    double base = nflops / bench_time(gemm_tn_copy_fn, &c, BENCH_MINTIME) / 1e9;
+    snprintf(name, sizeof(name), "gemm T(%ux%u) * %ux%u%s", n, m, n, p, tn_ok ? "" : " MISMATCH");
+    bench_compare(name, nflops / bench_time(gemm_tn_view_fn, &c, BENCH_MINTIME) / 1e9, base,
+                  "GFLOP/s");
+
+    base = nflops / bench_time(gemm_nt_copy_fn, &c, BENCH_MINTIME) / 1e9;
+    snprintf(name, sizeof(name), "gemm %ux%u * T(%ux%u)%s", m, n, p, n, nt_ok ? "" : " MISMATCH");
+    bench_compare(name, nflops / bench_time(gemm_nt_view_fn, &c, BENCH_MINTIME) / 1e9, base,
+                  "GFLOP/s");
+
+    free(c.x);
+    free(c.y);
+    free(c.z);
+    free(c.t);
+}
+
+// All paths but FMA must agree bit for bit; FMA must agree to rounding.
+static
+void
+check_gemm(unsigned m, unsigned n, unsigned p)
+{
+    Scalar *x = new_filled((size_t) m * n);
+    Scalar *y = new_filled((size_t) n * p);
+    Scalar *ref = new_filled((size_t) m * p);
+    Scalar *z = new_filled((size_t) m * p);
+    const size_t nz = (size_t) m * p;
+
+    const LinalgIsa best = linalg_isa_supported();
+    linalg_set_isa(LINALG_ISA_GENERIC);
+    linalg_gemm(ref, x, y, m, n, p);
+    for (LinalgIsa isa = LINALG_ISA_GENERIC + 1; isa <= best; ++isa) {
+        linalg_set_isa(isa);
+        linalg_gemm(z, x, y, m, n, p);
+        double maxdiff = 0;
+        size_t ndiffer = 0;
+        for (size_t i = 0; i < nz; ++i) {
+            const double d = fabs(z[i] - ref[i]);
+            ndiffer += z[i] != ref[i];
+            maxdiff = d > maxdiff ? d : maxdiff;
+        }
+        const int ok = isa == LINALG_ISA_FMA ? maxdiff < 1e-9 * n : ndiffer == 0;
+        printf("gemm %ux%u * %ux%u %-8s vs generic: %zu differ, max %g%s\n",
+               m, n, n, p, linalg_isa_name(isa), ndiffer, maxdiff, ok ? "" : "  MISMATCH");
+    }
+    linalg_set_isa(best);
+
+    free(x);
+    free(y);
+    free(ref);
+    free(z);
+}
+
+// The element-by-element loop /linalg_transpose/ used before blocking.
+static
+void
+transpose_naive(Scalar *y, const Scalar *x, unsigned height, unsigned width)
+{
+    for (unsigned i = 0; i < width; ++i) {
+        for (unsigned j = 0; j < height; ++j) {
+            y[(size_t) i * height + j] = x[(size_t) j * width + i];
+        }
+    }
+}
+
+static
+void
+transpose_naive_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        transpose_naive(c->z, c->x, c->m, c->n);
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+transpose_square_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_transpose_square(c->x, c->m);
+    }
+    bench_sink += c->x[0];
+}
+
+static
+void
+bench_transpose(unsigned height, unsigned width)
+{
+    const size_t n = (size_t) height * width;
+    Ctx c = {
+        .x = new_filled(n),
+        .z = new_filled(n),
+        .m = height, .n = width,
+    };
+    const double nbytes = 2.0 * n * sizeof(Scalar);
+    const double base = nbytes / bench_time(transpose_naive_fn, &c, BENCH_MINTIME) / 1e9;
+    char name[64];
+
+    const LinalgIsa best = linalg_isa_supported();
+    for (LinalgIsa isa = LINALG_ISA_GENERIC; isa <= best; ++isa) {
+        linalg_set_isa(isa);
+        snprintf(name, sizeof(name), "transpose %ux%u %s", height, width, linalg_isa_name(isa));
+        bench_compare(name, nbytes / bench_time(transpose_fn, &c, BENCH_MINTIME) / 1e9, base, "GB/s");
+        if (height == width) {
+            snprintf(name, sizeof(name), "transpose in place %ux%u %s", height, width,
+                     linalg_isa_name(isa));
+            bench_compare(name, nbytes / bench_time(transpose_square_fn, &c, BENCH_MINTIME) / 1e9,
+                          base, "GB/s");
+        }
+    }
+    linalg_set_isa(best);
+
+    free(c.x);
+    free(c.z);
+}
+
+static
+void
+check_transpose(unsigned height, unsigned width)
+{
+    const size_t n = (size_t) height * width;
+    Scalar *x = new_filled(n);
+    Scalar *ref = new_filled(n);
+    Scalar *y = new_filled(n);
+    for (size_t i = 0; i < n; ++i) {
+        x[i] = i;
+    }
+    transpose_naive(ref, x, height, width);
+
+    const LinalgIsa best = linalg_isa_supported();
+    for (LinalgIsa isa = LINALG_ISA_GENERIC; isa <= best; ++isa) {
+        linalg_set_isa(isa);
+        linalg_transpose(y, x, height, width);
+        bool ok = memcmp(y, ref, n * sizeof(Scalar)) == 0;
+        if (height == width) {
+            memcpy(y, x, n * sizeof(Scalar));
+            linalg_transpose_square(y, height);
+            ok = ok && memcmp(y, ref, n * sizeof(Scalar)) == 0;
+        }
+        printf("transpose %ux%u %-8s vs naive: %s\n",
+               height, width, linalg_isa_name(isa), ok ? "same" : "MISMATCH");
+    }
+    linalg_set_isa(best);
+
+    free(x);
+    free(ref);
+    free(y);
+}
+
+static
+void
+neg_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_neg(c->z, c->x, (size_t) c->m * c->n);
+    }
+    bench_sink += c->z[0];
+}
+
+// /x/ against /y/ holding the same elements: a full scan.
+static
+void
+eq_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        bench_sink += linalg_eq(c->x, c->y, (size_t) c->m * c->n);
+    }
+}
+
+// Over the all-zero /t/: a full scan.
+static
+void
+any_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        bench_sink += linalg_any(c->t, (size_t) c->m * c->n);
+    }
+}
+
+// /n/ elements as an n x 1 matrix; results of LINALG_STREAM_MIN elements
+// and up are written with non-temporal stores.
+static
+void
+bench_elementwise(size_t n)
+{
+    Ctx c = {
+        .x = new_filled(n),
+        .y = new_filled(n),
+        .z = new_filled(n),
+        .t = XNEW(Scalar, n),
+        .m = n, .n = 1,
+    };
+    memset(c.t, 0, n * sizeof(Scalar));
+    const double nbytes = (double) n * sizeof(Scalar);
+    const struct {
+        const char *name;
+        void (*fn)(void *ctx, size_t nreps);
+        // Arrays read and written.
+        double narrays;
+    } ops[] = {
+        {"add", add_fn, 3},
+        {"neg", neg_fn, 2},
+        {"scale", scale_fn, 2},
+        {"eq", eq_fn, 2},
+        {"any", any_fn, 1},
+    };
+    char name[64];
+
+    const LinalgIsa best = linalg_isa_supported();
+    for (size_t k = 0; k < sizeof(ops) / sizeof(ops[0]); ++k) {
+        const double gb = ops[k].narrays * nbytes / 1e9;
+        linalg_set_isa(LINALG_ISA_GENERIC);
+        const double base = gb / bench_time(ops[k].fn, &c, BENCH_MINTIME);
+        for (LinalgIsa isa = LINALG_ISA_SSE2; isa <= best; ++isa) {
+            linalg_set_isa(isa);
+            snprintf(name, sizeof(name), "%s %zu %s", ops[k].name, n, linalg_isa_name(isa));
+            bench_compare(name, gb / bench_time(ops[k].fn, &c, BENCH_MINTIME), base, "GB/s");
+        }
+    }
+    linalg_set_isa(best);
+
+    free(c.x);
+    free(c.y);
+    free(c.z);
+    free(c.t);
+}
+
+static const struct {
+    const char *name;
+    LinalgFn fn;
+    long double (*ref)(long double);
+    // Arguments are drawn uniformly from [lo, hi], or from 2^[lo, hi] if
+    // /logscale/.
+    double lo, hi;
+    bool logscale;
+} map_cases[] = {
+    {"exp", LINALG_FN_EXP, expl, -1, 1, false},
+    {"exp", LINALG_FN_EXP, expl, -745, 709, false},
+    {"log", LINALG_FN_LOG, logl, 0.5, 2, false},
+    {"log", LINALG_FN_LOG, logl, -1074, 1023, true},
+    {"sin", LINALG_FN_SIN, sinl, -4, 4, false},
+    {"sin", LINALG_FN_SIN, sinl, -1e6, 1e6, false},
+    {"cos", LINALG_FN_COS, cosl, -4, 4, false},
+    {"cos", LINALG_FN_COS, cosl, -1e6, 1e6, false},
+};
+
+static
+double
+ulp_error(double got, long double ref)
+{
+    if ((isnan(got) && isnan((double) ref)) || got == ref) {
+        return 0;
+    }
+    const double r = fabs((double) ref);
+    if (isinf(r) || isinf(got)) {
+        return INFINITY;
+    }
+    return (double) (fabsl(got - ref) / (nextafter(r, INFINITY) - r));
+}
+
+static
+double
+map_arg(size_t k, size_t *seed)
+{
+    *seed = *seed * 6364136223846793005u + 1442695040888963407u;
+    const double u = (double) (*seed >> 11) / (1ull << 53);
+    const double a = map_cases[k].lo + u * (map_cases[k].hi - map_cases[k].lo);
+    return map_cases[k].logscale ? exp2(a) : a;
+}
+
+// Worst error of each path over a few million arguments, and that of libm
+// for reference; and the rounding functions, which must agree with libm
+// exactly, on halves and special values.
+static
+void
+check_map(void)
+{
+    enum { N = 1 << 22 };
+    Scalar *x = XNEW(Scalar, N);
+    Scalar *z = XNEW(Scalar, N);
+    const LinalgIsa best = linalg_isa_supported();
+    for (size_t k = 0; k < sizeof(map_cases) / sizeof(map_cases[0]); ++k) {
+        size_t seed = k;
+        for (size_t i = 0; i < N; ++i) {
+            x[i] = map_arg(k, &seed);
+        }
+        for (LinalgIsa isa = LINALG_ISA_GENERIC; isa <= best; ++isa) {
+            linalg_set_isa(isa);
+            linalg_map(map_cases[k].fn, z, x, N);
+            double worst = 0;
+            for (size_t i = 0; i < N; ++i) {
+                const double e = ulp_error(z[i], map_cases[k].ref(x[i]));
+                worst = e > worst ? e : worst;
+            }
+            printf("%s on [%g, %g]%s %-8s max error %.3f ulp\n",
+                   map_cases[k].name, map_cases[k].lo, map_cases[k].hi,
+                   map_cases[k].logscale ? " (log scale)" : "", linalg_isa_name(isa), worst);
+        }
+    }
+
+    static const Scalar specials[] = {
+        0.0, -0.0, 0.5, -0.5, 1.5, -1.5, 2.5, -2.5, 0.49999999999999994, -0.49999999999999994,
+        4503599627370495.5, -4503599627370495.5, 4503599627370497.0, 1e300, -1e300, 0x1p-1074,
+        INFINITY, -INFINITY, NAN, 1e-310, -1e-310, 709.8, -745.2, 1e7, -1e7, 1e22,
+    };
+    const size_t nspecials = sizeof(specials) / sizeof(specials[0]);
+    for (LinalgFn fn = LINALG_FN_SIN; fn <= LINALG_FN_ROUND; ++fn) {
+        Scalar ref[sizeof(specials) / sizeof(specials[0])];
+        linalg_set_isa(LINALG_ISA_GENERIC);
+        linalg_map(fn, ref, specials, nspecials);
+        for (LinalgIsa isa = LINALG_ISA_GENERIC + 1; isa <= best; ++isa) {
+            linalg_set_isa(isa);
+            linalg_map(fn, z, specials, nspecials);
+            const bool exact = fn >= LINALG_FN_FLOOR;
+            for (size_t i = 0; i < nspecials; ++i) {
+                const bool same = exact ? !memcmp(&z[i], &ref[i], sizeof(Scalar))
+                                        : ulp_error(z[i], ref[i]) <= 4;
+                if (!same) {
+                    printf("map %d %s at %.17g: %.17g, libm says %.17g  MISMATCH\n",
+                           (int) fn, linalg_isa_name(isa), specials[i], z[i], ref[i]);
+                }
+            }
+        }
+    }
+    linalg_set_isa(best);
+    free(x);
+    free(z);
+}
+
+typedef struct {
+    LinalgFn fn;
+    Scalar *x;
+    Scalar *z;
+    size_t n;
+} MapCtx;
+
+static
+void
+map_fn(void *ctx, size_t nreps)
+{
+    MapCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_map(c->fn, c->z, c->x, c->n);
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+bench_map(size_t n)
+{
+    static const char *const names[] = {
+        "sin", "cos", "tan", "asin", "acos", "atan", "exp", "log", "floor", "trunc", "ceil", "round",
+    };
+    MapCtx c = {.x = XNEW(Scalar, n), .z = XNEW(Scalar, n), .n = n};
+    for (size_t i = 0; i < n; ++i) {
+        // In the domain of everything, asin and log included.
+        c.x[i] = 0.001 + 0.998 * (Scalar) (i % 1000) / 1000;
+    }
+    const LinalgIsa best = linalg_isa_supported();
+    char name[64];
+    for (LinalgFn fn = LINALG_FN_SIN; fn <= LINALG_FN_ROUND; ++fn) {
+        c.fn = fn;
+        linalg_set_isa(LINALG_ISA_GENERIC);
+        const double base = n / bench_time(map_fn, &c, BENCH_MINTIME) / 1e6;
+        linalg_set_isa(best);
+        snprintf(name, sizeof(name), "%s %zu %s", names[fn], n, linalg_isa_name(best));
+        bench_compare(name, n / bench_time(map_fn, &c, BENCH_MINTIME) / 1e6, base, "Melem/s");
+    }
+    free(c.x);
+    free(c.z);
+}
+
+// The loop a script had to run before 'Sum': one accumulator, in order.
+static
+Scalar
+sum_naive(const Scalar *x, size_t n)
+{
+    Scalar r = 0;
+    for (size_t i = 0; i < n; ++i) {
+        r += x[i];
+    }
+    return r;
+}
+
+// Relative errors of sums of /n/ elements that do not add up exactly,
+// against long double, for every instruction set and for /sum_naive/.
+static
+void
+check_reduce(size_t n)
+{
+    Scalar *x = XNEW(Scalar, n);
+    long double ref = 0;
+    for (size_t i = 0; i < n; ++i) {
+        x[i] = 0.1 + (Scalar) (i % 1000) / 3;
+        ref += x[i];
+    }
+    const LinalgIsa best = linalg_isa_supported();
+    for (LinalgIsa isa = LINALG_ISA_GENERIC; isa <= best; ++isa) {
+        linalg_set_isa(isa);
+        const Scalar r = linalg_reduce(LINALG_RED_SUM, x, NULL, n);
+        printf("sum %zu %-8s relative error %.3g\n", n, linalg_isa_name(isa),
+               (double) fabsl((r - ref) / ref));
+    }
+    linalg_set_isa(best);
+    printf("sum %zu %-8s relative error %.3g\n", n, "naive",
+           (double) fabsl((sum_naive(x, n) - ref) / ref));
+    free(x);
+}
+
+typedef struct {
+    LinalgRed op;
+    const Scalar *x;
+    const Scalar *y;
+    Scalar *z;
+    unsigned m;
+    unsigned n;
+    // 0 for the whole, 1 for each column, 2 for each row.
+    unsigned dim;
+} RedCtx;
+
+static
+void
+reduce_fn(void *ctx, size_t nreps)
+{
+    RedCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        switch (c->dim) {
+        case 0:
+            bench_sink += linalg_reduce(c->op, c->x, c->y, (size_t) c->m * c->n);
+            break;
+        case 1:
+            linalg_reduce_cols(c->op, c->z, c->x, c->y, c->m, c->n);
+            bench_sink += c->z[0];
+            break;
+        case 2:
+            linalg_reduce_rows(c->op, c->z, c->x, c->y, c->m, c->n);
+            bench_sink += c->z[0];
+            break;
+        }
+    }
+}
+
+static
+void
+sum_naive_fn(void *ctx, size_t nreps)
+{
+    RedCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        bench_sink += sum_naive(c->x, (size_t) c->m * c->n);
+    }
+}
+
+// Whole-matrix reductions of /height/ x /width/ for every instruction set,
+// and sums along either dimension, against /sum_naive/.
+static
+void
+bench_reduce(unsigned height, unsigned width)
+{
+    const size_t n = (size_t) height * width;
+    Scalar *x = new_filled(n);
+    Scalar *y = new_filled(n);
+    Scalar *z = new_filled(height > width ? height : width);
+    RedCtx c = {.x = x, .y = y, .z = z, .m = height, .n = width};
+    const double gb = n * sizeof(Scalar) / 1e9;
+    const double base = gb / bench_time(sum_naive_fn, &c, BENCH_MINTIME);
+    static const struct {
+        const char *name;
+        LinalgRed op;
+    } ops[] = {
+        {"sum", LINALG_RED_SUM},
+        {"dot", LINALG_RED_DOT},
+        {"max", LINALG_RED_MAX},
+        {"norm", LINALG_RED_NORM},
+    };
+    char name[64];
+
+    const LinalgIsa best = linalg_isa_supported();
+    for (size_t k = 0; k < sizeof(ops) / sizeof(ops[0]); ++k) {
+        c.op = ops[k].op;
+        c.y = c.op == LINALG_RED_DOT ? y : NULL;
+        // DOT reads twice as much.
+        const double work = c.y ? 2 * gb : gb;
+        for (LinalgIsa isa = LINALG_ISA_GENERIC; isa <= best; ++isa) {
+            linalg_set_isa(isa);
+            snprintf(name, sizeof(name), "%s %ux%u %s", ops[k].name, height, width,
+                     linalg_isa_name(isa));
+            bench_compare(name, work / bench_time(reduce_fn, &c, BENCH_MINTIME), base, "GB/s");
+        }
+    }
+    linalg_set_isa(best);
+
+    c.op = LINALG_RED_SUM;
+    c.y = NULL;
+    for (c.dim = 1; c.dim <= 2; ++c.dim) {
+        snprintf(name, sizeof(name), "sum %ux%u along %s", height, width,
+                 c.dim == 1 ? "columns" : "rows");
+        bench_compare(name, gb / bench_time(reduce_fn, &c, BENCH_MINTIME), base, "GB/s");
+    }
+
+    free(x);
+    free(y);
+    free(z);
+}
+
+// n x n with uniform elements in [-1, 1): well conditioned, unlike
+// /new_filled/, and the same on every run.
+static
+Scalar *
+new_random(size_t n)
+{
+    Scalar *r = XNEW(Scalar, n * n);
+    uint_least64_t seed = 1;
+    for (size_t i = 0; i < n * n; ++i) {
+        seed = seed * 6364136223846793005u + 1442695040888963407u;
+        r[i] = (Scalar) (seed >> 11) / (1ull << 52) - 1;
+    }
+    return r;
+}
+
+// Unblocked elimination with the same pivoting, a row at a time, kept as a
+// baseline for /linalg_lu/.
+static
+void
+lu_naive(Scalar *a, unsigned n, unsigned *piv)
+{
+    for (size_t j = 0; j < n; ++j) {
+        size_t p = j;
+        for (size_t i = j + 1; i < n; ++i) {
+            if (fabs(a[i * n + j]) > fabs(a[p * n + j])) {
+                p = i;
+            }
+        }
+        piv[j] = p;
+        for (size_t c = 0; c < n; ++c) {
+            const Scalar t = a[j * n + c];
+            a[j * n + c] = a[p * n + c];
+            a[p * n + c] = t;
+        }
+        if (a[j * n + j] == 0) {
+            continue;
+        }
+        for (size_t i = j + 1; i < n; ++i) {
+            const Scalar l = a[i * n + j] /= a[j * n + j];
+            for (size_t c = j + 1; c < n; ++c) {
+                a[i * n + c] -= l * a[j * n + c];
+            }
+        }
+    }
+}
+
+typedef struct {
+    const Scalar *x;
+    Scalar *a;
+    unsigned *piv;
+    unsigned n;
+} LuCtx;
+
+static
+void
+lu_fn(void *ctx, size_t nreps)
+{
+    LuCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        memcpy(c->a, c->x, (size_t) c->n * c->n * sizeof(Scalar));
+        linalg_lu(c->a, c->n, c->piv, NULL);
+    }
+    bench_sink += c->a[0];
+}
+
+static
+void
+lu_naive_fn(void *ctx, size_t nreps)
+{
+    LuCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        memcpy(c->a, c->x, (size_t) c->n * c->n * sizeof(Scalar));
+        lu_naive(c->a, c->n, c->piv);
+    }
+    bench_sink += c->a[0];
+}
+
+// Backward errors of a solve and an inverse with /linalg_lu/, which should
+// be a modest multiple of DBL_EPSILON, and the condition estimate.
+static
+void
+check_lu(unsigned n)
+{
+    const size_t nn = (size_t) n * n;
+    Scalar *x = new_random(n);
+    Scalar *a = XNEW(Scalar, nn);
+    Scalar *inv = XNEW(Scalar, nn);
+    Scalar *b = XNEW(Scalar, n);
+    Scalar *sol = XNEW(Scalar, n);
+    unsigned *piv = XNEW(unsigned, n);
+    for (size_t i = 0; i < n; ++i) {
+        b[i] = sol[i] = (Scalar) i / n - 0.5;
+    }
+    memcpy(a, x, nn * sizeof(Scalar));
+    Scalar rcond;
+    linalg_lu(a, n, piv, &rcond);
+    linalg_lu_solve(a, piv, n, sol, 1);
+
+    // |b - x sol|_inf / (|x|_inf |sol|_inf)
+    double xnorm = 0, solnorm = 0, res = 0;
+    for (size_t i = 0; i < n; ++i) {
+        double row = 0, r = b[i];
+        for (size_t j = 0; j < n; ++j) {
+            row += fabs(x[i * n + j]);
+            r -= x[i * n + j] * sol[j];
+        }
+        xnorm = row > xnorm ? row : xnorm;
+        solnorm = fabs(sol[i]) > solnorm ? fabs(sol[i]) : solnorm;
+        res = fabs(r) > res ? fabs(r) : res;
+    }
+    const double solve_err = res / (xnorm * solnorm) / DBL_EPSILON;
+
+    // |x inv - I|_max / n
+    linalg_inv(inv, x, n);
+    linalg_gemm(a, x, inv, n, n, n);
+    double inv_err = 0;
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            const double d = fabs(a[i * n + j] - (i == j));
+            inv_err = d > inv_err ? d : inv_err;
+        }
+    }
+    inv_err /= n * DBL_EPSILON;
+
+    const int ok = solve_err < 10 * n && inv_err < 10 * n;
+    printf("lu %ux%u: solve residual %.2f eps, inverse residual %.2f n eps, rcond %.3g%s\n",
+           n, n, solve_err, inv_err, rcond, ok ? "" : "  MISMATCH");
+
+    free(x);
+    free(a);
+    free(inv);
+    free(b);
+    free(sol);
+    free(piv);
+}
+
+// Determinant of x[n x n] from /linalg_lu/, which /linalg_det/ skips for
+// small matrices; /a/ and /piv/ are work space.
+static
+Scalar
+det_lu(const Scalar *x, unsigned n, Scalar *a, unsigned *piv)
+{
+    memcpy(a, x, (size_t) n * n * sizeof(Scalar));
+    linalg_lu(a, n, piv, NULL);
+    Scalar r = 1;
+    for (size_t i = 0; i < n; ++i) {
+        r *= piv[i] == i ? a[i * n + i] : -a[i * n + i];
+    }
+    return r;
+}
+
+// The small-matrix kernels: products, sums and transpositions must give
+// the same bits as the general ones; determinants must agree with LU to
+// rounding, inverses must leave small residuals, and a singular matrix
+// must be refused.
+static
+void
+check_small(void)
+{
+    static const unsigned shapes[][3] = {
+        {1, 1, 1}, {2, 2, 2}, {3, 3, 3}, {4, 4, 4}, {1, 2, 2}, {2, 3, 2}, {4, 4, 1}, {3, 1, 3},
+    };
+    bool ok = true;
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); ++s) {
+        const unsigned m = shapes[s][0], n = shapes[s][1], p = shapes[s][2];
+        Scalar *x = new_random(4);
+        Scalar *y = new_filled(16);
+        Scalar z[16], ref[16];
+        linalg_gemm_small(z, x, y, m, n, p);
+        linalg_gemm(ref, x, y, m, n, p);
+        ok = ok && !memcmp(z, ref, (size_t) m * p * sizeof(Scalar));
+        linalg_add_small(z, x, y, m * n);
+        linalg_add(ref, x, y, (size_t) m * n);
+        ok = ok && !memcmp(z, ref, (size_t) m * n * sizeof(Scalar));
+        linalg_sub_small(z, x, y, m * n);
+        linalg_sub(ref, x, y, (size_t) m * n);
+        ok = ok && !memcmp(z, ref, (size_t) m * n * sizeof(Scalar));
+        linalg_transpose_small(z, x, n, 1, m, n);
+        linalg_transpose(ref, x, m, n);
+        ok = ok && !memcmp(z, ref, (size_t) m * n * sizeof(Scalar));
+        free(x);
+        free(y);
+    }
+    printf("small products, sums and transpositions vs general: %s\n", ok ? "same bits" : "MISMATCH");
+
+    for (unsigned n = 1; n <= 4; ++n) {
+        const size_t nn = (size_t) n * n;
+        Scalar *x = new_random(n);
+        Scalar a[16], inv[16];
+        unsigned piv[4];
+        const Scalar ref = det_lu(x, n, a, piv);
+        const double det_err = fabs(linalg_det(x, n) - ref) / (fabs(ref) * DBL_EPSILON);
+        bool inv_ok = linalg_inv(inv, x, n);
+        linalg_gemm(a, x, inv, n, n, n);
+        double inv_err = 0;
+        for (size_t i = 0; i < nn; ++i) {
+            const double d = fabs(a[i] - (i % (n + 1) == 0));
+            inv_err = d > inv_err ? d : inv_err;
+        }
+        inv_err /= n * DBL_EPSILON;
+        // Rows 1 and 2 equal.
+        if (n >= 2) {
+            memcpy(x + n, x, n * sizeof(Scalar));
+            inv_ok = inv_ok && !linalg_inv(inv, x, n) && linalg_det(x, n) == 0;
+        }
+        const bool n_ok = det_err < 10 * n && inv_err < 10 && inv_ok;
+        printf("small %ux%u: det vs LU %.2f eps, inverse residual %.2f n eps%s\n",
+               n, n, det_err, inv_err, n_ok ? "" : "  MISMATCH");
+        free(x);
+    }
+}
+
+typedef struct {
+    Scalar *x;
+    Scalar *y;
+    Scalar *z;
+    Scalar *a;
+    unsigned *piv;
+    unsigned n;
+} SmallCtx;
+
+static
+void
+small_gemm_fn(void *ctx, size_t nreps)
+{
+    SmallCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_gemm_small(c->z, c->x, c->y, c->n, c->n, c->n);
+        c->x[0] = c->z[0] * 1e-3;
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+small_gemm_base_fn(void *ctx, size_t nreps)
+{
+    SmallCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_gemm(c->z, c->x, c->y, c->n, c->n, c->n);
+        c->x[0] = c->z[0] * 1e-3;
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+small_add_fn(void *ctx, size_t nreps)
+{
+    SmallCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_add_small(c->z, c->x, c->y, c->n * c->n);
+        c->x[0] = c->z[0] * 1e-3;
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+small_add_base_fn(void *ctx, size_t nreps)
+{
+    SmallCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_add(c->z, c->x, c->y, (size_t) c->n * c->n);
+        c->x[0] = c->z[0] * 1e-3;
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+small_det_fn(void *ctx, size_t nreps)
+{
+    SmallCtx *c = ctx;
+    Scalar acc = 0;
+    for (size_t r = 0; r < nreps; ++r) {
+        acc += linalg_det(c->x, c->n);
+    }
+    bench_sink += acc;
+}
+
+static
+void
+small_det_base_fn(void *ctx, size_t nreps)
+{
+    SmallCtx *c = ctx;
+    Scalar acc = 0;
+    for (size_t r = 0; r < nreps; ++r) {
+        acc += det_lu(c->x, c->n, c->a, c->piv);
+    }
+    bench_sink += acc;
+}
+
+static
+void
+small_inv_fn(void *ctx, size_t nreps)
+{
+    SmallCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_inv(c->z, c->x, c->n);
+    }
+    bench_sink += c->z[0];
+}
+
+// What /linalg_inv/ does for larger matrices.
+static
+void
+small_inv_base_fn(void *ctx, size_t nreps)
+{
+    SmallCtx *c = ctx;
+    const unsigned n = c->n;
+    for (size_t r = 0; r < nreps; ++r) {
+        memcpy(c->a, c->x, (size_t) n * n * sizeof(Scalar));
+        Scalar rcond;
+        linalg_lu(c->a, n, c->piv, &rcond);
+        for (size_t i = 0; i < (size_t) n * n; ++i) {
+            c->z[i] = i % (n + 1) == 0;
+        }
+        linalg_lu_solve(c->a, c->piv, n, c->z, n);
+    }
+    bench_sink += c->z[0];
+}
+
+// The small-matrix kernels in millions of operations per second against
+// the general ones they stand in for.
+static
+void
+bench_small(unsigned n)
+{
+    SmallCtx c = {
+        .x = new_random(n),
+        .y = new_filled((size_t) n * n),
+        .z = new_filled((size_t) n * n),
+        .a = new_filled((size_t) n * n),
+        .piv = XNEW(unsigned, n),
+        .n = n,
+    };
+    static const struct {
+        const char *name;
+        void (*fn)(void *ctx, size_t nreps);
+        void (*base)(void *ctx, size_t nreps);
+    } ops[] = {
+        {"mul", small_gemm_fn, small_gemm_base_fn},
+        {"add", small_add_fn, small_add_base_fn},
+        {"det", small_det_fn, small_det_base_fn},
+        {"inv", small_inv_fn, small_inv_base_fn},
+    };
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "small %s %ux%u", ops[i].name, n, n);
+        const double base = 1e-6 / bench_time(ops[i].base, &c, BENCH_MINTIME);
+        bench_compare(name, 1e-6 / bench_time(ops[i].fn, &c, BENCH_MINTIME), base, "Mop/s");
+    }
+
+    free(c.x);
+    free(c.y);
+    free(c.z);
+    free(c.a);
+    free(c.piv);
+}
+
+// new_random(n) with its lower triangle mirrored: symmetric.
+static
+Scalar *
+new_symmetric(size_t n)
+{
+    Scalar *r = new_random(n);
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < i; ++j) {
+            r[j * n + i] = r[i * n + j];
+        }
+    }
+    return r;
+}
+
+static
+double
+max_abs(const Scalar *x, size_t n)
+{
+    double r = 0;
+    for (size_t i = 0; i < n; ++i) {
+        r = fabs(x[i]) > r ? fabs(x[i]) : r;
+    }
+    return r;
+}
+
+// max |x - y| / (/scale/ * DBL_EPSILON)
+static
+double
+max_diff(const Scalar *x, const Scalar *y, size_t n, double scale)
+{
+    double r = 0;
+    for (size_t i = 0; i < n; ++i) {
+        r = fabs(x[i] - y[i]) > r ? fabs(x[i] - y[i]) : r;
+    }
+    return r / (scale * DBL_EPSILON);
+}
+
+// max |x^T x - I| / (n * DBL_EPSILON), x[m x n]
+static
+double
+orth_error(const Scalar *x, unsigned m, unsigned n)
+{
+    Scalar *p = XNEW(Scalar, (size_t) n * n);
+    Scalar *id = XNEW(Scalar, (size_t) n * n);
+    linalg_gemm_strided(p, x, 1, n, x, n, 1, n, m, n);
+    for (size_t i = 0; i < (size_t) n * n; ++i) {
+        id[i] = i % (n + 1) == 0;
+    }
+    const double r = max_diff(p, id, (size_t) n * n, n);
+    free(p);
+    free(id);
+    return r;
+}
+
+// Backward errors of the Cholesky, QR, least-squares and symmetric
+// eigenvalue routines, in units of DBL_EPSILON times the norm of the input
+// (and of the dimension, for the orthogonality of Q and of the eigenvectors).
+static
+void
+check_factor(unsigned m, unsigned n)
+{
+    const size_t mn = (size_t) m * n;
+    const size_t nn = (size_t) n * n;
+    Scalar *x = new_random(m > n ? m : n);
+    Scalar *s = new_symmetric(n);
+    Scalar *q = XNEW(Scalar, mn > nn ? mn : nn);
+    Scalar *r = XNEW(Scalar, mn);
+    Scalar *p = XNEW(Scalar, mn > nn ? mn : nn);
+    Scalar *w = XNEW(Scalar, n);
+    Scalar *w2 = XNEW(Scalar, n);
+    Scalar *v = XNEW(Scalar, nn);
+    bool ok = true;
+
+    // s * s^T + n I is well inside the positive definite cone.
+    Scalar *spd = XNEW(Scalar, nn);
+    linalg_gemm(spd, s, s, n, n, n);
+    for (size_t i = 0; i < n; ++i) {
+        spd[i * n + i] += n;
+    }
+    memcpy(v, spd, nn * sizeof(Scalar));
+    ok = linalg_chol(v, n) && ok;
+    linalg_gemm_strided(p, v, n, 1, v, 1, n, n, n, n);
+    const double chol_err = max_diff(p, spd, nn, max_abs(spd, nn) * n);
+    printf("chol %ux%u: residual %.2f n eps\n", n, n, chol_err);
+    ok = ok && chol_err < 10;
+
+    // /x/ taken as m x n; Q is m x n and R n x n, or m x m and m x n.
+    const unsigned k = m < n ? m : n;
+    linalg_qr(q, r, x, m, n);
+    linalg_gemm(p, q, r, m, k, n);
+    const double qr_err = max_diff(p, x, mn, max_abs(x, mn) * k);
+    const double q_err = orth_error(q, m, k);
+    printf("qr %ux%u: residual %.2f k eps, orthogonality %.2f k eps\n", m, n, qr_err, q_err);
+    ok = ok && qr_err < 10 && q_err < 10;
+
+    if (m >= n) {
+        // The residual of a least-squares solution is orthogonal to the
+        // columns of /x/.
+        Scalar *b = XNEW(Scalar, m);
+        Scalar *z = XNEW(Scalar, n);
+        Scalar *res = XNEW(Scalar, m);
+        for (size_t i = 0; i < m; ++i) {
+            b[i] = (Scalar) i / m - 0.5;
+        }
+        ok = linalg_lstsq(z, x, b, m, n, 1) && ok;
+        linalg_gemm(res, x, z, m, n, 1);
+        for (size_t i = 0; i < m; ++i) {
+            res[i] = b[i] - res[i];
+        }
+        linalg_gemm_strided(w, x, 1, n, res, 1, 1, n, m, 1);
+        // Against what rounding /res/ alone would leave.
+        const double res_scale = max_abs(x, mn) * max_abs(z, n) * n + max_abs(b, m);
+        const double ls_err = max_abs(w, n) / (max_abs(x, mn) * res_scale * m * DBL_EPSILON);
+        printf("lstsq %ux%u: x^T residual %.2f m eps\n", m, n, ls_err);
+        ok = ok && ls_err < 10;
+        free(b);
+        free(z);
+        free(res);
+    }
+
+    // s v = v diag(w), v^T v = I, and the same values without vectors.
+    ok = linalg_eig_sym(w, v, s, n) && ok;
+    ok = linalg_eig_sym(w2, NULL, s, n) && ok;
+    linalg_gemm(p, s, v, n, n, n);
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            q[i * n + j] = v[i * n + j] * w[j];
+        }
+    }
+    const double eig_err = max_diff(p, q, nn, max_abs(s, nn) * n);
+    const double v_err = orth_error(v, n, n);
+    const double w_err = max_diff(w, w2, n, max_abs(w, n) * n);
+    bool sorted = true;
+    for (size_t i = 1; i < n; ++i) {
+        sorted = sorted && w[i - 1] <= w[i];
+    }
+    printf("eig %ux%u: residual %.2f n eps, orthogonality %.2f n eps, "
+           "values alone %.2f n eps%s\n", n, n, eig_err, v_err, w_err, sorted ? "" : ", unsorted");
+    ok = ok && eig_err < 10 && v_err < 10 && w_err < 10 && sorted;
+    if (!ok) {
+        printf("factorizations %ux%u  MISMATCH\n", m, n);
+    }
+
+    free(x);
+    free(s);
+    free(spd);
+    free(q);
+    free(r);
+    free(p);
+    free(w);
+    free(w2);
+    free(v);
+}
+
+// /linalg_lu/ in GFLOP/s (2/3 n^3 of them) against the multiply-add peak
+// and against /lu_naive/.
+static
+void
+bench_lu(unsigned n, double peak)
+{
+    LuCtx c = {
+        .x = new_random(n),
+        .a = XNEW(Scalar, (size_t) n * n),
+        .piv = XNEW(unsigned, n),
+        .n = n,
+    };
+    const double nflops = 2.0 / 3 * n * n * n;
+    const double base = nflops / bench_time(lu_naive_fn, &c, BENCH_MINTIME) / 1e9;
+    const double value = nflops / bench_time(lu_fn, &c, BENCH_MINTIME) / 1e9;
+    char name[64];
+    snprintf(name, sizeof(name), "lu %ux%u", n, n);
+    bench_report(name, value, peak, "GFLOP/s");
+    bench_compare(name, value, base, "GFLOP/s");
+
+    free((Scalar *) c.x);
+    free(c.a);
+    free(c.piv);
+}
+
+static
+void
+bench_stream(unsigned height, unsigned width)
+{
+    const size_t n = (size_t) height * width;
+    Ctx c = {
+        .x = new_filled(n),
+        .y = new_filled(n),
+        .z = new_filled(n),
+        .m = height, .n = width,
+    };
+    const size_t nbytes = n * sizeof(Scalar);
+    // the copy used for the peak moves 2 * nbytes through a 2 * nbytes set
+    const double peak = bench_peak_bandwidth(2 * nbytes) / 1e9;
+    char name[64];
+
+    snprintf(name, sizeof(name), "add %ux%u", height, width);
+    bench_report(name, 3 * nbytes / bench_time(add_fn, &c, BENCH_MINTIME) / 1e9, peak, "GB/s");
+
+    snprintf(name, sizeof(name), "scale %ux%u", height, width);
+    bench_report(name, 2 * nbytes / bench_time(scale_fn, &c, BENCH_MINTIME) / 1e9, peak, "GB/s");
+
+    snprintf(name, sizeof(name), "transpose %ux%u", height, width);
+    bench_report(name, 2 * nbytes / bench_time(transpose_fn, &c, BENCH_MINTIME) / 1e9,
+                 peak, "GB/s");
+
+    free(c.x);
+    free(c.y);
+    free(c.z);
+}
+
+typedef struct {
+    const Scalar *x;
+    Scalar *a;
+    Scalar *b;
+    unsigned n;
+} FactorCtx;
+
+static
+void
+chol_fn(void *ctx, size_t nreps)
+{
+    FactorCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        memcpy(c->a, c->x, (size_t) c->n * c->n * sizeof(Scalar));
+        linalg_chol(c->a, c->n);
+    }
+    bench_sink += c->a[0];
+}
+
+static
+void
+qr_fn(void *ctx, size_t nreps)
+{
+    FactorCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_qr(NULL, c->a, c->x, c->n, c->n);
+    }
+    bench_sink += c->a[0];
+}
+
+static
+void
+eigvals_fn(void *ctx, size_t nreps)
+{
+    FactorCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_eig_sym(c->a, NULL, c->x, c->n);
+    }
+    bench_sink += c->a[0];
+}
+
+static
+void
+eigvecs_fn(void *ctx, size_t nreps)
+{
+    FactorCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_eig_sym(c->a, c->b, c->x, c->n);
+    }
+    bench_sink += c->b[0];
+}
+
+// Cholesky (n^3 / 3 flops), QR giving R (4 n^3 / 3), symmetric
+// eigenvalues (4 n^3 / 3, for the reduction) and, if /vectors/, with
+// eigenvectors (about 9 n^3 in all) in GFLOP/s against the multiply-add
+// peak.
+static
+void
+bench_factor(unsigned n, bool vectors, double peak)
+{
+    const size_t nn = (size_t) n * n;
+    Scalar *s = new_symmetric(n);
+    Scalar *spd = XNEW(Scalar, nn);
+    linalg_gemm(spd, s, s, n, n, n);
+    for (size_t i = 0; i < n; ++i) {
+        spd[i * n + i] += n;
+    }
+    FactorCtx c = {.x = spd, .a = XNEW(Scalar, nn), .b = XNEW(Scalar, nn), .n = n};
+    const double n3 = (double) n * n * n;
+    char name[64];
+
+    snprintf(name, sizeof(name), "chol %ux%u", n, n);
+    bench_report(name, n3 / 3 / bench_time(chol_fn, &c, BENCH_MINTIME) / 1e9, peak, "GFLOP/s");
+    snprintf(name, sizeof(name), "qr %ux%u", n, n);
+    bench_report(name, 4 * n3 / 3 / bench_time(qr_fn, &c, BENCH_MINTIME) / 1e9, peak,
+                 "GFLOP/s");
+    c.x = s;
+    snprintf(name, sizeof(name), "eig %ux%u values", n, n);
+    bench_report(name, 4 * n3 / 3 / bench_time(eigvals_fn, &c, BENCH_MINTIME) / 1e9, peak,
+                 "GFLOP/s");
+    if (vectors) {
+        snprintf(name, sizeof(name), "eig %ux%u vectors", n, n);
+        bench_report(name, 9 * n3 / bench_time(eigvecs_fn, &c, BENCH_MINTIME) / 1e9, peak,
+                     "GFLOP/s");
+    }
+
+    free(s);
+    free(spd);
+    free(c.a);
+    free(c.b);
+}
+
+// The 5-point Laplacian on a k x k grid, in CSR form: what finite
+// differences give, 5 nonzeros to most rows, and the kind of matrix the
+// conjugate gradient method is for. The arrays are malloc'ed.
+static
+LinalgCsr
+new_laplacian(unsigned k)
+{
+    const size_t n = (size_t) k * k;
+    size_t *row = XNEW(size_t, n + 1);
+    unsigned *col = XNEW(unsigned, 5 * n);
+    Scalar *val = XNEW(Scalar, 5 * n);
+    size_t nnz = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const size_t r = i / k;
+        const size_t c = i % k;
+        row[i] = nnz;
+        // In ascending order of column.
+        const struct { bool on; size_t j; Scalar v; } nb[] = {
+            {r > 0, i - k, -1}, {c > 0, i - 1, -1}, {true, i, 4},
+            {c + 1 < k, i + 1, -1}, {r + 1 < k, i + k, -1},
+        };
+        for (size_t t = 0; t < 5; ++t) {
+            if (nb[t].on) {
+                col[nnz] = nb[t].j;
+                val[nnz] = nb[t].v;
+                ++nnz;
+            }
+        }
+    }
+    row[n] = nnz;
+    return (LinalgCsr) {.height = n, .width = n, .row = row, .col = col, .val = val};
+}
+
+static
+void
+free_csr(LinalgCsr a)
+{
+    free((void *) a.row);
+    free((void *) a.col);
+    free((void *) a.val);
+}
+
+// Products with a sparse operand against dense products of its dense copy
+// (which add the same terms in the same order, plus zeros), and the
+// residual of a conjugate gradient solution.
+static
+void
+check_sparse(unsigned k)
+{
+    const LinalgCsr a = new_laplacian(k);
+    const unsigned n = a.height;
+    enum { P = 3 };
+    Scalar *dense = XNEW0(Scalar, (size_t) n * n);
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t t = a.row[i]; t < a.row[i + 1]; ++t) {
+            dense[i * n + a.col[t]] = a.val[t];
+        }
+    }
+    Scalar *x = new_filled((size_t) n * P);
+    Scalar *ref = XNEW(Scalar, (size_t) n * P);
+    Scalar *z = XNEW(Scalar, (size_t) n * P);
+    size_t ndiffer = 0;
+
+    gemm_naive(ref, dense, x, n, n, P);
+    linalg_csr_mul(z, &a, x, P);
+    for (size_t i = 0; i < (size_t) n * P; ++i) {
+        ndiffer += z[i] != ref[i];
+    }
+    gemm_naive(ref, x, dense, P, n, n);
+    linalg_mul_csr(z, x, P, &a);
+    for (size_t i = 0; i < (size_t) n * P; ++i) {
+        ndiffer += z[i] != ref[i];
+    }
+    printf("csr %ux%u products vs dense: %zu differ%s\n", n, n, ndiffer,
+           ndiffer ? "  MISMATCH" : "");
+
+    // x = A^-1 b, then z = A x - b.
+    const Scalar tol = 1e-12;
+    memset(x, 0, n * sizeof(Scalar));
+    const unsigned it = linalg_csr_cg(x, &a, ref, tol, 10 * n);
+    linalg_csr_mul(z, &a, x, 1);
+    for (size_t i = 0; i < n; ++i) {
+        z[i] -= ref[i];
+    }
+    const double res = linalg_reduce(LINALG_RED_NORM, z, NULL, n) /
+                       linalg_reduce(LINALG_RED_NORM, ref, NULL, n);
+    printf("cg %ux%u: %u iterations, residual %.3g%s\n", n, n, it, res,
+           it <= 10 * n && res < 2 * tol ? "" : "  MISMATCH");
+
+    free_csr(a);
+    free(dense);
+    free(x);
+    free(ref);
+    free(z);
+}
+
+typedef struct {
+    LinalgCsr a;
+    // Row of each nonzero, for the triplet loop.
+    unsigned *rows;
+    Scalar *x;
+    Scalar *z;
+    unsigned p;
+} SparseCtx;
+
+static
+void
+csr_mul_fn(void *ctx, size_t nreps)
+{
+    SparseCtx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_csr_mul(c->z, &c->a, c->x, c->p);
+    }
+    bench_sink += c->z[0];
+}
+
+// The same product from (row, column, value) triplets, one at a time.
+static
+void
+coo_mul_fn(void *ctx, size_t nreps)
+{
+    SparseCtx *c = ctx;
+    const size_t nnz = c->a.row[c->a.height];
+    const size_t p = c->p;
+    for (size_t r = 0; r < nreps; ++r) {
+        memset(c->z, 0, (size_t) c->a.height * p * sizeof(Scalar));
+        for (size_t t = 0; t < nnz; ++t) {
+            for (size_t j = 0; j < p; ++j) {
+                c->z[c->rows[t] * p + j] += c->a.val[t] * c->x[c->a.col[t] * p + j];
+            }
+        }
+    }
+    bench_sink += c->z[0];
+}
+
+// The Laplacian on a k x k grid times a dense n x p matrix, in GB/s of the
+// sparse matrix read, against the streaming bandwidth for that much data
+// and against the triplet loop.
+static
+void
+bench_sparse(unsigned k, unsigned p)
+{
+    SparseCtx c = {.a = new_laplacian(k), .p = p};
+    const size_t n = c.a.height;
+    const size_t nnz = c.a.row[n];
+    c.rows = XNEW(unsigned, nnz);
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t t = c.a.row[i]; t < c.a.row[i + 1]; ++t) {
+            c.rows[t] = i;
+        }
+    }
+    c.x = new_filled(n * p);
+    c.z = new_filled(n * p);
+    const double nbytes = nnz * (sizeof(Scalar) + sizeof(unsigned)) + (n + 1) * sizeof(size_t);
+    char name[64];
+    snprintf(name, sizeof(name), "csr %zux%zu * %zux%u", n, n, n, p);
+    const double value = nbytes / bench_time(csr_mul_fn, &c, BENCH_MINTIME) / 1e9;
+    bench_report(name, value, bench_peak_bandwidth(nbytes) / 1e9, "GB/s");
+    bench_compare(name, value, nbytes / bench_time(coo_mul_fn, &c, BENCH_MINTIME) / 1e9, "GB/s");
+
+    free_csr(c.a);
+    free(c.rows);
+    free(c.x);
+    free(c.z);
+}
+
+int
+main(void)
+{
+    const double peak = bench_peak_flops() / 1e9;
+    check_gemm(37, 300, 29);
+    check_gemm(256, 256, 256);
+    check_gemm(1, 300, 29);
+    check_gemm(37, 300, 1);
+    check_gemm(1, 1001, 1);
+    check_gemm(1003, 2, 1);
+    check_transpose(37, 101);
+    check_transpose(133, 133);
+    check_map();
+    check_reduce(10000000);
+    check_small();
+    check_lu(100);
+    check_lu(1000);
+    check_factor(65, 65);
+    check_factor(300, 150);
+    check_factor(150, 300);
+    check_factor(1000, 1000);
+    check_sparse(30);
+
+    bench_gemm(2, 2, 2, peak);
+    bench_gemm(64, 64, 64, peak);
+    bench_gemm(256, 256, 256, peak);
+    bench_gemm(512, 512, 512, peak);
+    bench_gemm(1, 512, 512, peak);
+    bench_gemm(2048, 16, 2048, peak);
+
+    bench_gemv(4096, 4096, 1);
+    bench_gemv(1, 4096, 4096);
+    bench_gemv(100000, 16, 1);
+    bench_gemv(1, 100000, 16);
+
+    bench_gemm_trans(16, 16, 16);
+    bench_gemm_trans(256, 256, 256);
+    bench_gemm_trans(1024, 1024, 1024);
+    bench_gemm_trans(2048, 16, 2048);
+    bench_gemm_trans(2048, 2048, 1);
+    bench_gemm_trans(1, 2048, 2048);
+
+    bench_stream(64, 64);
+    bench_stream(512, 512);
+    bench_stream(2048, 2048);
+
+    bench_elementwise(1000000);
+    bench_elementwise(100000000);
+
+    bench_map(100000);
+
+    bench_reduce(1000, 1000);
+    bench_reduce(4000, 4000);
+    bench_reduce(100000, 8);
+
+    bench_small(2);
+    bench_small(3);
+    bench_small(4);
+
+    bench_sparse(100, 1);
+    bench_sparse(1000, 1);
+    bench_sparse(1000, 8);
+
+    bench_lu(64, peak);
+    bench_lu(256, peak);
+    bench_lu(1024, peak);
+    bench_lu(2048, peak);
+
+    bench_factor(256, true, peak);
+    bench_factor(1024, true, peak);
+    bench_factor(3000, false, peak);
+
+    bench_transpose(512, 512);
+    bench_transpose(2048, 2048);
+    bench_transpose(4096, 4096);
+    bench_transpose(1000, 3000);
+    return 0;
+}
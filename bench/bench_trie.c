@@ -0,0 +1,66 @@
+#include "bench.h"
+#include "../trie.h"
+
+// /trie_greedy_lookup/ on the operator set the interpreter registers,
+// reported as input bytes consumed per second against the streaming
+// bandwidth of an L1-resident buffer (the trie and input both fit there).
+
+static const char *ops[] = {
+    "-", "+", "*", "/", "%", "^", "~~", "!", "&&", "||",
+    "<", "<=", "==", "!=", ">", ">=", "=", ":=", "|",
+};
+
+enum { NOPS = sizeof(ops) / sizeof(ops[0]) };
+
+typedef struct {
+    Trie *t;
+    const char *buf;
+    size_t nbuf;
+} Ctx;
+
+static
+void
+lookup_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    size_t acc = 0;
+    for (size_t r = 0; r < nreps; ++r) {
+        for (size_t i = 0; i < c->nbuf;) {
+            void *data;
+            size_t len = 1;
+            acc += trie_greedy_lookup(c->t, c->buf + i, c->nbuf - i, &data, &len);
+            i += len;
+        }
+    }
+    bench_sink += acc;
+}
+
+int
+main(void)
+{
+    Trie *t = trie_new(TRIE_NRESERVE_DEFAULT);
+    for (size_t i = 0; i < NOPS; ++i) {
+        trie_insert(t, ops[i], LEX_KIND_OP, NULL);
+    }
+
+    enum { NBUF = 4096 };
+    char *buf = xmalloc(NBUF, 1);
+    size_t nbuf = 0;
+    for (size_t i = 0; nbuf + 2 < NBUF; ++i) {
+        const char *op = ops[(i * 7) % NOPS];
+        const size_t n = strlen(op);
+        memcpy(buf + nbuf, op, n);
+        nbuf += n;
+        // keep "<" followed by "=" from merging into "<=" etc.
+        buf[nbuf++] = ' ';
+    }
+
+    Ctx c = {.t = t, .buf = buf, .nbuf = nbuf};
+    const double peak = bench_peak_bandwidth(nbuf) / 1e6;
+    bench_report("trie_greedy_lookup", nbuf / bench_time(lookup_fn, &c, BENCH_MINTIME) / 1e6,
+                 peak, "MB/s");
+
+    free(buf);
+    trie_destroy(t);
+    return 0;
+}
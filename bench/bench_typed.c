@@ -0,0 +1,400 @@
+#include "bench.h"
+#include "../typed.h"
+#include "../linalg.h"
+
+#include <math.h>
+
+// Typed matrix kernels, for every instruction set the CPU supports:
+// float32 GEMM in GFLOP/s against the float32 multiply-add peak (twice the
+// double one) and against double GEMM; elementwise addition and comparison
+// with a scalar, in elements per second, against the same on doubles. Also
+// checks products, sums, comparisons (with scalars at and between the
+// values of each type, infinities and NaN), conversions and wrapping
+// integer arithmetic against the same computed in double.
+
+typedef struct {
+    Typed *x;
+    Typed *y;
+    Matrix *dx;
+    Matrix *dy;
+    Scalar a;
+} Ctx;
+
+// x[m x n] with small integers, whose products and sums of a few hundred
+// are exact in float32.
+static
+Matrix *
+new_filled(unsigned m, unsigned n)
+{
+    Matrix *r = matrix_new_uninit(m, n);
+    for (size_t i = 0; i < (size_t) m * n; ++i) {
+        r->elems[i] = (Scalar) (i * 7 % 11) - 5;
+    }
+    return r;
+}
+
+// The elements of /t/, as whichever type it has.
+static
+const void *
+elems_of(const Typed *t)
+{
+    return t->storage;
+}
+
+static
+void
+release(Typed *t)
+{
+    value_unref(MK_TYPED(t));
+}
+
+static
+bool
+same_as_dense(const Typed *t, const Matrix *m)
+{
+    Matrix *d = typed_to_matrix(t);
+    const bool r = linalg_eq(d->elems, m->elems, (size_t) m->height * m->width);
+    value_unref(MK_MAT(d));
+    return r;
+}
+
+static
+void
+check_mul(TypedElem elem, unsigned m, unsigned n, unsigned p)
+{
+    Matrix *dx = new_filled(m, n);
+    Matrix *dy = new_filled(n, p);
+    Typed *x = typed_from_matrix(elem, dx);
+    Typed *y = typed_from_matrix(elem, dy);
+    // What they came to, multiplied in double, and wrapped around for
+    // uint8 (the sums stay well within int32).
+    value_unref(MK_MAT(dx));
+    value_unref(MK_MAT(dy));
+    dx = typed_to_matrix(x);
+    dy = typed_to_matrix(y);
+    Matrix *ref = matrix_new_uninit(m, p);
+    linalg_gemm(ref->elems, dx->elems, dy->elems, m, n, p);
+    if (elem == TYPED_UINT8) {
+        for (size_t i = 0; i < (size_t) m * p; ++i) {
+            ref->elems[i] = fmod(ref->elems[i], 256);
+        }
+    }
+
+    const LinalgIsa best = linalg_isa_supported();
+    for (LinalgIsa isa = LINALG_ISA_GENERIC; isa <= best; ++isa) {
+        linalg_set_isa(isa);
+        Typed *z = typed_mul(x, y);
+        printf("%s gemm %ux%u * %ux%u %-8s vs double: %s\n", typed_kindname(elem), m, n, n, p,
+               linalg_isa_name(isa), same_as_dense(z, ref) ? "same" : "MISMATCH");
+        release(z);
+    }
+    linalg_set_isa(best);
+
+    release(x);
+    release(y);
+    value_unref(MK_MAT(dx));
+    value_unref(MK_MAT(dy));
+    value_unref(MK_MAT(ref));
+}
+
+// Values that sit at, next to and past the ends of the types, and between
+// their values.
+static const Scalar special[] = {
+    0, -0.0, 0.1, -0.5, 0.5, 1, 2.5, -3, 127, 254.5, 255, 255.5, 256, -1,
+    16777216, 16777217, 2147483647, 2147483647.5, 2147483648, -2147483648, -2147483649,
+    1e10, -1e10, 3.4028234663852886e38, 3.4028235677973366e38, 1e300, -1e300, 1e-300,
+    INFINITY, -INFINITY, NAN,
+};
+
+enum { NSPECIAL = sizeof(special) / sizeof(special[0]) };
+
+static
+bool
+holds(TypedCmp op, Scalar x, Scalar a)
+{
+    switch (op) {
+    case TYPED_LT:
+        return x < a;
+    case TYPED_LE:
+        return x <= a;
+    case TYPED_GT:
+        return x > a;
+    case TYPED_GE:
+        return x >= a;
+    }
+    UNREACHABLE();
+}
+
+// Every comparison of every special value, and of its neighbours, as each
+// type, with every special value and its neighbours as a scalar.
+static
+void
+check_compare(void)
+{
+    const unsigned n = 3 * NSPECIAL;
+    Matrix *d = matrix_new_uninit(1, n);
+    for (unsigned k = 0; k < NSPECIAL; ++k) {
+        d->elems[3 * k] = special[k];
+        d->elems[3 * k + 1] = nextafter(special[k], -INFINITY);
+        d->elems[3 * k + 2] = nextafter(special[k], INFINITY);
+    }
+
+    const LinalgIsa best = linalg_isa_supported();
+    for (LinalgIsa isa = LINALG_ISA_GENERIC; isa <= best; ++isa) {
+        linalg_set_isa(isa);
+        size_t nwrong = 0;
+        size_t ntried = 0;
+        for (int elem = -1; elem < TYPED_NELEMS; ++elem) {
+            // -1: the double ones.
+            Typed *x = elem < 0 ? NULL : typed_from_matrix(elem, d);
+            Matrix *xd = x ? typed_to_matrix(x) : d;
+            for (unsigned k = 0; k < n; ++k) {
+                const Scalar a = d->elems[k];
+                for (TypedCmp op = TYPED_LT; op <= TYPED_GE; ++op) {
+                    Typed *z = x ? typed_compare_scalar(op, x, a)
+                                 : typed_compare_dense_scalar(op, d, a);
+                    for (unsigned i = 0; i < n; ++i) {
+                        nwrong += ((const uint8_t *) elems_of(z))[i] != holds(op, xd->elems[i], a);
+                        ++ntried;
+                    }
+                    release(z);
+                }
+            }
+            if (x) {
+                release(x);
+                value_unref(MK_MAT(xd));
+            }
+        }
+        printf("compare with scalars %-8s: %zu of %zu wrong%s\n", linalg_isa_name(isa), nwrong,
+               ntried, nwrong ? "  MISMATCH" : "");
+    }
+    linalg_set_isa(best);
+    value_unref(MK_MAT(d));
+}
+
+// Conversions from double saturate (NaN giving 0) and wrap around in
+// arithmetic, as integers modulo 2^bits.
+static
+void
+check_convert(void)
+{
+    const unsigned n = NSPECIAL;
+    Matrix *d = matrix_new_uninit(1, n);
+    memcpy(d->elems, special, sizeof(special));
+
+    const LinalgIsa best = linalg_isa_supported();
+    for (LinalgIsa isa = LINALG_ISA_GENERIC; isa <= best; ++isa) {
+        linalg_set_isa(isa);
+        size_t nwrong = 0;
+        Typed *u = typed_from_matrix(TYPED_UINT8, d);
+        Typed *i = typed_from_matrix(TYPED_INT32, d);
+        Typed *f = typed_from_matrix(TYPED_FLOAT32, d);
+        Typed *uu = typed_add(u, u, false);
+        Typed *ii = typed_add(i, i, false);
+        for (unsigned k = 0; k < n; ++k) {
+            const Scalar v = special[k];
+            const Scalar tv = trunc(v);
+            const Scalar eu = v != v ? 0 : v <= 0 ? 0 : v >= 255 ? 255 : tv;
+            const Scalar ei = v != v ? 0 : v <= INT32_MIN ? INT32_MIN
+                            : v >= INT32_MAX ? INT32_MAX : tv;
+            const uint8_t gu = ((const uint8_t *) elems_of(u))[k];
+            const int32_t gi = ((const int32_t *) elems_of(i))[k];
+            const float gf = ((const float *) elems_of(f))[k];
+            nwrong += gu != eu;
+            nwrong += gi != ei;
+            nwrong += !(gf == (float) v || (gf != gf && v != v));
+            nwrong += ((const uint8_t *) elems_of(uu))[k] != (uint8_t) (2 * gu);
+            nwrong += ((const int32_t *) elems_of(ii))[k] !=
+                      (int32_t) (uint32_t) (2 * (uint32_t) gi);
+        }
+        printf("convert and wrap %-8s: %zu wrong%s\n", linalg_isa_name(isa), nwrong,
+               nwrong ? "  MISMATCH" : "");
+        release(u);
+        release(i);
+        release(f);
+        release(uu);
+        release(ii);
+    }
+    linalg_set_isa(best);
+    value_unref(MK_MAT(d));
+}
+
+// Sums through double are exact for small integers.
+static
+void
+check_reduce(size_t n)
+{
+    Matrix *d = new_filled(1, n);
+    for (int elem = 0; elem < TYPED_NELEMS; ++elem) {
+        Typed *x = typed_from_matrix(elem, d);
+        Matrix *xd = typed_to_matrix(x);
+        Scalar ref = 0;
+        for (size_t k = 0; k < n; ++k) {
+            ref += xd->elems[k];
+        }
+        const Scalar sum = typed_reduce(LINALG_RED_SUM, x);
+        printf("%s sum %zu: %s\n", typed_kindname(elem), n, sum == ref ? "same" : "MISMATCH");
+        release(x);
+        value_unref(MK_MAT(xd));
+    }
+    value_unref(MK_MAT(d));
+}
+
+static
+void
+gemm_double_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        Matrix *z = matrix_new_uninit(c->dx->height, c->dy->width);
+        linalg_gemm(z->elems, c->dx->elems, c->dy->elems, c->dx->height, c->dx->width,
+                    c->dy->width);
+        bench_sink += z->elems[0];
+        value_unref(MK_MAT(z));
+    }
+}
+
+static
+void
+gemm_typed_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        Typed *z = typed_mul(c->x, c->y);
+        bench_sink += ((const float *) elems_of(z))[0];
+        release(z);
+    }
+}
+
+static
+void
+bench_gemm(unsigned n, double peak)
+{
+    Ctx c = {.dx = new_filled(n, n), .dy = new_filled(n, n)};
+    c.x = typed_from_matrix(TYPED_FLOAT32, c.dx);
+    c.y = typed_from_matrix(TYPED_FLOAT32, c.dy);
+    const double nflops = 2.0 * n * n * n;
+    const double base = nflops / bench_time(gemm_double_fn, &c, BENCH_MINTIME) / 1e9;
+    char name[64];
+
+    const LinalgIsa best = linalg_isa_supported();
+    for (LinalgIsa isa = LINALG_ISA_GENERIC; isa <= best; ++isa) {
+        linalg_set_isa(isa);
+        snprintf(name, sizeof(name), "float32 gemm %ux%u %s", n, n, linalg_isa_name(isa));
+        const double value = nflops / bench_time(gemm_typed_fn, &c, BENCH_MINTIME) / 1e9;
+        if (isa == best) {
+            bench_report(name, value, 2 * peak, "GFLOP/s");
+        }
+        bench_compare(name, value, base, "GFLOP/s");
+    }
+    linalg_set_isa(best);
+
+    release(c.x);
+    release(c.y);
+    value_unref(MK_MAT(c.dx));
+    value_unref(MK_MAT(c.dy));
+}
+
+static
+void
+add_double_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    const size_t n = (size_t) c->dx->height * c->dx->width;
+    for (size_t r = 0; r < nreps; ++r) {
+        Matrix *z = matrix_new_uninit(c->dx->height, c->dx->width);
+        linalg_add(z->elems, c->dx->elems, c->dy->elems, n);
+        bench_sink += z->elems[0];
+        value_unref(MK_MAT(z));
+    }
+}
+
+static
+void
+add_typed_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        Typed *z = typed_add(c->x, c->y, false);
+        bench_sink += ((const uint8_t *) elems_of(z))[0];
+        release(z);
+    }
+}
+
+static
+void
+compare_double_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        Typed *z = typed_compare_dense_scalar(TYPED_GT, c->dx, c->a);
+        bench_sink += ((const uint8_t *) elems_of(z))[0];
+        release(z);
+    }
+}
+
+static
+void
+compare_typed_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        Typed *z = typed_compare_scalar(TYPED_GT, c->x, c->a);
+        bench_sink += ((const uint8_t *) elems_of(z))[0];
+        release(z);
+    }
+}
+
+// In Gelem/s, for each type against double.
+static
+void
+bench_elementwise(unsigned n)
+{
+    Ctx c = {.dx = new_filled(1, n), .dy = new_filled(1, n), .a = 0.5};
+    const double base_add = n / bench_time(add_double_fn, &c, BENCH_MINTIME) / 1e9;
+    const double base_cmp = n / bench_time(compare_double_fn, &c, BENCH_MINTIME) / 1e9;
+    char name[64];
+
+    const LinalgIsa best = linalg_isa_supported();
+    for (int elem = 0; elem < TYPED_NELEMS; ++elem) {
+        c.x = typed_from_matrix(elem, c.dx);
+        c.y = typed_from_matrix(elem, c.dy);
+        for (LinalgIsa isa = LINALG_ISA_GENERIC; isa <= best; ++isa) {
+            linalg_set_isa(isa);
+            snprintf(name, sizeof(name), "%s add %u %s", typed_kindname(elem), n,
+                     linalg_isa_name(isa));
+            bench_compare(name, n / bench_time(add_typed_fn, &c, BENCH_MINTIME) / 1e9,
+                          base_add, "Gelem/s");
+            snprintf(name, sizeof(name), "%s > a %u %s", typed_kindname(elem), n,
+                     linalg_isa_name(isa));
+            bench_compare(name, n / bench_time(compare_typed_fn, &c, BENCH_MINTIME) / 1e9,
+                          base_cmp, "Gelem/s");
+        }
+        linalg_set_isa(best);
+        release(c.x);
+        release(c.y);
+    }
+
+    value_unref(MK_MAT(c.dx));
+    value_unref(MK_MAT(c.dy));
+}
+
+int
+main(void)
+{
+    const double peak = bench_peak_flops() / 1e9;
+    for (int elem = 0; elem < TYPED_NELEMS; ++elem) {
+        check_mul(elem, 37, 300, 29);
+        check_mul(elem, 130, 131, 600);
+    }
+    check_compare();
+    check_convert();
+    check_reduce(100003);
+
+    bench_gemm(256, peak);
+    bench_gemm(512, peak);
+
+    bench_elementwise(1000000);
+    bench_elementwise(16000000);
+    return 0;
+}
@@ -0,0 +1,273 @@
+#include "bench.h"
+#include "../linalg.h"
+#include "../workers.h"
+#include "../osdep.h"
+
+// Scaling of the parallel matrix kernels from 1 thread to one per
+// processor ($CALC_THREADS overrides the maximum): GEMM in GFLOP/s, GEMV,
+// elementwise addition, transposition and reductions in GB/s, each next to
+// its own single-threaded figure. Also checks that reductions and
+// matrix-vector products give the same bits whatever the number of threads.
+
+typedef struct {
+    Scalar *x;
+    Scalar *y;
+    Scalar *z;
+    unsigned m;
+    unsigned n;
+    unsigned p;
+} Ctx;
+
+static
+Scalar *
+new_filled(size_t n)
+{
+    Scalar *r = XNEW(Scalar, n ? n : 1);
+    for (size_t i = 0; i < n; ++i) {
+        r[i] = (Scalar) (i % 17) / 16 - 0.5;
+    }
+    return r;
+}
+
+static
+void
+gemm_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_gemm(c->z, c->x, c->y, c->m, c->n, c->p);
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+add_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_add(c->z, c->x, c->y, (size_t) c->m * c->n);
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+transpose_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_transpose(c->z, c->x, c->m, c->n);
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+sum_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        bench_sink += linalg_reduce(LINALG_RED_SUM, c->x, NULL, (size_t) c->m * c->n);
+    }
+}
+
+static
+void
+colsum_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_reduce_cols(LINALG_RED_SUM, c->z, c->x, NULL, c->m, c->n);
+    }
+    bench_sink += c->z[0];
+}
+
+static
+void
+cumsum_fn(void *ctx, size_t nreps)
+{
+    Ctx *c = ctx;
+    for (size_t r = 0; r < nreps; ++r) {
+        linalg_cumsum(c->z, c->x, (size_t) c->m * c->n);
+    }
+    bench_sink += c->z[0];
+}
+
+typedef struct {
+    const char *name;
+    void (*fn)(void *ctx, size_t nreps);
+    unsigned m;
+    unsigned n;
+    unsigned p;
+    // Work per call, in /unit/s.
+    double work;
+    const char *unit;
+} Case;
+
+static
+void
+run_case(Case k, unsigned maxthreads)
+{
+    Ctx c = {
+        .x = new_filled((size_t) k.m * k.n),
+        .y = new_filled((size_t) k.n * (k.p ? k.p : k.n)),
+        .z = new_filled((size_t) k.m * (k.p ? k.p : k.n)),
+        .m = k.m, .n = k.n, .p = k.p,
+    };
+    double base = 0;
+    // 1, 2, 4, ..., and /maxthreads/ itself.
+    for (unsigned nthreads = 1; ; nthreads = 2 * nthreads < maxthreads ? 2 * nthreads : maxthreads) {
+        workers_global = workers_new(nthreads);
+        const double value = k.work / bench_time(k.fn, &c, BENCH_MINTIME);
+        workers_destroy(workers_global);
+        workers_global = NULL;
+        if (nthreads == 1) {
+            base = value;
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "%s x%u", k.name, nthreads);
+        bench_compare(name, value, base, k.unit);
+        if (nthreads == maxthreads) {
+            break;
+        }
+    }
+    free(c.x);
+    free(c.y);
+    free(c.z);
+}
+
+// Results of /op/ on x[m x n] as a whole, along rows and along columns,
+// and its cumulative sums, into /out/ (1 + m + n + m * n elements).
+static
+void
+reduce_all(Scalar *out, LinalgRed op, const Scalar *x, unsigned m, unsigned n)
+{
+    out[0] = linalg_reduce(op, x, x, (size_t) m * n);
+    linalg_reduce_rows(op, out + 1, x, x, m, n);
+    linalg_reduce_cols(op, out + 1 + m, x, x, m, n);
+    linalg_cumsum(out + 1 + m + n, x, (size_t) m * n);
+}
+
+static
+void
+check_reduce(unsigned m, unsigned n, unsigned maxthreads)
+{
+    const size_t nx = (size_t) m * n;
+    const size_t nout = 1 + m + n + nx;
+    Scalar *x = XNEW(Scalar, nx);
+    Scalar *ref = XNEW(Scalar, nout);
+    Scalar *out = XNEW(Scalar, nout);
+    // Magnitudes over a few orders, so that the order of the additions
+    // shows in the last bits.
+    uint_least64_t seed = 1;
+    for (size_t i = 0; i < nx; ++i) {
+        seed = seed * 6364136223846793005u + 1442695040888963407u;
+        x[i] = (Scalar) (seed >> 11) / (1ull << 53) * (1 + i % 1000) - 300;
+    }
+    static const LinalgRed ops[] = {LINALG_RED_SUM, LINALG_RED_DOT, LINALG_RED_NORM};
+    for (size_t k = 0; k < sizeof(ops) / sizeof(ops[0]); ++k) {
+        reduce_all(ref, ops[k], x, m, n);
+        for (unsigned nthreads = 2; nthreads <= maxthreads; nthreads *= 2) {
+            workers_global = workers_new(nthreads);
+            reduce_all(out, ops[k], x, m, n);
+            workers_destroy(workers_global);
+            workers_global = NULL;
+            size_t ndiffer = 0;
+            for (size_t i = 0; i < nout; ++i) {
+                ndiffer += memcmp(&out[i], &ref[i], sizeof(Scalar)) != 0;
+            }
+            printf("reduce %d %ux%u x%u vs x1: %zu differ%s\n",
+                   (int) ops[k], m, n, nthreads, ndiffer, ndiffer ? "  MISMATCH" : "");
+        }
+    }
+    free(x);
+    free(ref);
+    free(out);
+}
+
+// x[m x n] * v and w * x[m x n], for columns v and rows w, into /out/
+// (m + n elements).
+static
+void
+gemv_both(Scalar *out, const Scalar *x, const Scalar *v, const Scalar *w, unsigned m, unsigned n)
+{
+    linalg_gemm(out, x, v, m, n, 1);
+    linalg_gemm(out + m, w, x, 1, m, n);
+}
+
+static
+void
+check_gemv(unsigned m, unsigned n, unsigned maxthreads)
+{
+    const size_t nout = (size_t) m + n;
+    Scalar *x = XNEW(Scalar, (size_t) m * n);
+    Scalar *v = XNEW(Scalar, n);
+    Scalar *w = XNEW(Scalar, m);
+    Scalar *ref = XNEW(Scalar, nout);
+    Scalar *out = XNEW(Scalar, nout);
+    // Inexact products, so that fused and unfused multiply-adds differ.
+    uint_least64_t seed = 1;
+    for (size_t i = 0; i < (size_t) m * n; ++i) {
+        seed = seed * 6364136223846793005u + 1442695040888963407u;
+        x[i] = (Scalar) (seed >> 11) / (1ull << 53) - 0.5;
+    }
+    for (unsigned k = 0; k < n; ++k) {
+        v[k] = 1.0 / (k + 3);
+    }
+    for (unsigned i = 0; i < m; ++i) {
+        w[i] = 1.0 / (i + 7);
+    }
+    gemv_both(ref, x, v, w, m, n);
+    for (unsigned nthreads = 2; nthreads <= maxthreads; nthreads *= 2) {
+        workers_global = workers_new(nthreads);
+        gemv_both(out, x, v, w, m, n);
+        workers_destroy(workers_global);
+        workers_global = NULL;
+        size_t ndiffer = 0;
+        for (size_t i = 0; i < nout; ++i) {
+            ndiffer += memcmp(&out[i], &ref[i], sizeof(Scalar)) != 0;
+        }
+        printf("gemv %ux%u x%u vs x1: %zu differ%s\n", m, n, nthreads, ndiffer,
+               ndiffer ? "  MISMATCH" : "");
+    }
+    free(x);
+    free(v);
+    free(w);
+    free(ref);
+    free(out);
+}
+
+int
+main(void)
+{
+    unsigned maxthreads = osdep_ncpus();
+    const char *env = getenv("CALC_THREADS");
+    if (env && atoi(env) > 0) {
+        maxthreads = atoi(env);
+    }
+
+    check_reduce(1000, 3000, maxthreads);
+    check_gemv(300, 300, maxthreads);
+    check_gemv(1001, 333, maxthreads);
+
+    const Case cases[] = {
+        {"gemm 1024x1024 * 1024x1024", gemm_fn, 1024, 1024, 1024, 2.0 * 1024 * 1024 * 1024 / 1e9,
+         "GFLOP/s"},
+        {"gemm 64x2048 * 2048x64", gemm_fn, 64, 2048, 64, 2.0 * 64 * 2048 * 64 / 1e9, "GFLOP/s"},
+        {"gemv 65536x512 * 512x1", gemm_fn, 65536, 512, 1, 1.0 * 65536 * 512 * sizeof(Scalar) / 1e9,
+         "GB/s"},
+        {"add 2048x2048", add_fn, 2048, 2048, 0, 3.0 * 2048 * 2048 * sizeof(Scalar) / 1e9, "GB/s"},
+        {"transpose 2048x2048", transpose_fn, 2048, 2048, 0, 2.0 * 2048 * 2048 * sizeof(Scalar) / 1e9,
+         "GB/s"},
+        {"sum 2048x2048", sum_fn, 2048, 2048, 0, 1.0 * 2048 * 2048 * sizeof(Scalar) / 1e9, "GB/s"},
+        {"column sums 2048x2048", colsum_fn, 2048, 2048, 0, 1.0 * 2048 * 2048 * sizeof(Scalar) / 1e9,
+         "GB/s"},
+        {"cumsum 2048x2048", cumsum_fn, 2048, 2048, 0, 2.0 * 2048 * 2048 * sizeof(Scalar) / 1e9,
+         "GB/s"},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        run_case(cases[i], maxthreads);
+    }
+    return 0;
+}
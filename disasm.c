@@ -1,5 +1,31 @@
 #include "disasm.h"
 
+static
+void
+print_kinds(Instr in)
+{
+    static const char *names[] = {
+        [INDEX_SCALAR] = "scalar",
+        [INDEX_ALL] = "all",
+        [INDEX_RANGE] = "range",
+    };
+    for (unsigned i = 0; i < in.args.slice.nindices; ++i) {
+        printf("%s%s", i ? ", " : " \t(", names[in.args.slice.kinds[i]]);
+    }
+    printf(")%s\n", in.cmd == CMD_STORE_SLICE && in.args.slice.rebind ? " (rebind)" : "");
+}
+
+static
+void
+print_at(Instr in)
+{
+    if (in.args.at.checked) {
+        printf(" \t(checked %s%s)", in.args.at.checked & 1 ? "1" : "",
+               in.args.at.checked == 3 ? ", 2" : in.args.at.checked & 2 ? "2" : "");
+    }
+    printf("%s\n", in.args.at.rebind ? " \t(rebind)" : "");
+}
+
 void
 disasm_print(const Instr *chunk, size_t nchunk)
 {
@@ -33,10 +59,35 @@ disasm_print(const Instr *chunk, size_t nchunk)
             printf(CMDFMT "%u\n", "store_fast", in.args.index);
             break;
         case CMD_LOAD_AT:
-            printf(CMDFMT "%u\n", "load_at", in.args.nindices);
+            printf(CMDFMT "%u", "load_at", in.args.at.nindices);
+            print_at(in);
+            break;
+        case CMD_LOAD_AT1:
+        case CMD_LOAD_AT2:
+            printf(CMDFMT, in.cmd == CMD_LOAD_AT1 ? "load_at1" : "load_at2");
+            print_at(in);
             break;
         case CMD_STORE_AT:
-            printf(CMDFMT "%u\n", "store_at", in.args.nindices);
+            printf(CMDFMT "%u", "store_at", in.args.at.nindices);
+            print_at(in);
+            break;
+        case CMD_STORE_AT1:
+        case CMD_STORE_AT2:
+            printf(CMDFMT, in.cmd == CMD_STORE_AT1 ? "store_at1" : "store_at2");
+            print_at(in);
+            break;
+        case CMD_CHECK_BOUNDS:
+            printf(CMDFMT "%u, %s, " JMPFMT "\n", "check_bounds", in.args.bounds.index,
+                   in.args.bounds.dim == 0 ? "elements" : in.args.bounds.dim == 1 ? "rows" : "columns",
+                   JMPARG(in.args.bounds.offset));
+            break;
+        case CMD_LOAD_SLICE:
+            printf(CMDFMT "%u", "load_slice", in.args.slice.nindices);
+            print_kinds(in);
+            break;
+        case CMD_STORE_SLICE:
+            printf(CMDFMT "%u", "store_slice", in.args.slice.nindices);
+            print_kinds(in);
             break;
         case CMD_OP_UNARY:
             printf(CMDFMT "%p\n", "unary", *(void **) &in.args.unary);
@@ -44,6 +95,12 @@ disasm_print(const Instr *chunk, size_t nchunk)
         case CMD_OP_BINARY:
             printf(CMDFMT "%p\n", "binary", *(void **) &in.args.binary);
             break;
+        case CMD_OP_UNARY_LAZY:
+            printf(CMDFMT "%p\n", "unary_lazy", *(void **) &in.args.unary);
+            break;
+        case CMD_OP_BINARY_LAZY:
+            printf(CMDFMT "%p\n", "binary_lazy", *(void **) &in.args.binary);
+            break;
         case CMD_CALL:
             printf(CMDFMT "%u\n", "call", in.args.nargs);
             break;
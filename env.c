@@ -2,8 +2,13 @@
 #include "env.h"
 #include "func.h"
 #include "matrix.h"
+#include "sparse.h"
+#include "typed.h"
 #include "str.h"
 #include "vector.h"
+#include "stats.h"
+#include "alloc.h"
+#include "fuse.h"
 
 typedef struct {
     const Instr *site;
@@ -64,6 +69,84 @@ print_stackframe(const Instr *ip, const char *src, bool first)
             ip->args.nline);
 }
 
+// Copy on write, for an assignment to an element of the matrix in /*slot/
+// that goes back into the variable it was loaded from (see /rebind/ in
+// vm.h): that variable and /*slot/ hold a reference each, and views of it
+// one per borrower, which /matrix_own/ looks after. If anything else refers
+// to it, /*slot/ gets a copy to assign to instead. /nholders/ is 1 instead
+// of 2 if the variable no longer holds it (see /still_bound/).
+static inline
+void
+unshare(Value *slot, unsigned nholders)
+{
+    Matrix *m = AS_MAT(*slot);
+    if (m->gchdr.nrefs - m->nborrowers > nholders) {
+        *slot = MK_MAT(matrix_copy(m));
+        value_unref(MK_MAT(m));
+    }
+}
+
+// For a store with /rebind/: whether the variable that /back/, the next
+// instruction, stores the container back into still holds /v/, the
+// container. A function called for the subscripts or the value may have
+// assigned something else to a global, which must then stay; a local only
+// changes in its own function.
+static inline
+bool
+still_bound(Env *e, Instr back, Value v)
+{
+    if (back.cmd != CMD_STORE) {
+        return true;
+    }
+    STATS_INC(global_lookups);
+    const HtValue index = ht_get(e->gt, back.args.str.start, back.args.str.size);
+    if (index == HT_NO_VALUE) {
+        return false;
+    }
+    const Value cur = e->gs.data[index];
+    return cur.kind == v.kind && cur.as.gcobj == v.as.gcobj;
+}
+
+// If /v/ is a scalar from 1 to /n/, or /checked/ to be, stores it, counting
+// from 0, in /*k/.
+static inline
+bool
+fast_index(Value v, size_t n, bool checked, size_t *k)
+{
+    if (!checked && (v.kind != VAL_KIND_SCALAR || !(AS_SCL(v) >= 1 && AS_SCL(v) < n + 1.0))) {
+        return false;
+    }
+    *k = (size_t) AS_SCL(v) - 1;
+    return true;
+}
+
+// The element of /m/, a computed matrix, that the /nindices/ subscripts
+// /sub/ of a CMD_LOAD_AT1/2 or CMD_STORE_AT1/2 pick, if they are scalars in
+// range; else NULL, for the general case to sort out or raise an error.
+static inline
+Scalar *
+fast_elem(Matrix *m, const Value *sub, unsigned nindices, unsigned checked)
+{
+    size_t i;
+    size_t j;
+    if (nindices == 1) {
+        size_t k;
+        if (!fast_index(sub[0], (size_t) m->height * m->width, checked & 1, &k)) {
+            return NULL;
+        }
+        if (matrix_is_packed(m)) {
+            return m->elems + k;
+        }
+        i = k / m->width;
+        j = k % m->width;
+    } else if (!fast_index(sub[0], m->height, checked & 1, &i) ||
+               !fast_index(sub[1], m->width, checked & 2, &j))
+    {
+        return NULL;
+    }
+    return m->elems + i * m->rstride + j * m->cstride;
+}
+
 bool
 env_exec(Env *e, const char *src, const Instr *const chunk, size_t nchunk)
 {
@@ -109,10 +192,12 @@ env_exec(Env *e, const char *src, const Instr *const chunk, size_t nchunk)
 
     for (const Instr *site = chunk; ;) {
         Instr in = *site;
+        STATS_INC(instrs);
         switch (in.cmd) {
         case CMD_PRINT:
             {
                 Value v = stack.data[stack.size - 1];
+                value_force(v);
                 value_print(v);
 
                 value_unref(v);
@@ -133,6 +218,7 @@ env_exec(Env *e, const char *src, const Instr *const chunk, size_t nchunk)
 
         case CMD_LOAD:
             {
+                STATS_INC(global_lookups);
                 HtValue index = ht_get(e->gt, in.args.str.start, in.args.str.size);
                 if (index == HT_NO_VALUE) {
                     ERR("undefined variable '%.*s'", (int) in.args.str.size, in.args.str.start);
@@ -156,6 +242,8 @@ env_exec(Env *e, const char *src, const Instr *const chunk, size_t nchunk)
         case CMD_STORE:
             {
                 Value value = VECTOR_POP(stack);
+                value_force(value);
+                STATS_INC(global_lookups);
                 const HtValue res = ht_put(e->gt, in.args.str.start, in.args.str.size, e->gs.size);
                 if (res == e->gs.size) {
                     VECTOR_PUSH(e->gs, value);
@@ -170,29 +258,61 @@ env_exec(Env *e, const char *src, const Instr *const chunk, size_t nchunk)
             {
                 const size_t prev_pos = callstack.data[callstack.size - 1].stackpos;
                 const size_t index = prev_pos + in.args.index;
+                value_force(stack.data[stack.size - 1]);
                 value_unref(stack.data[index]);
                 stack.data[index] = VECTOR_POP(stack);
             }
             break;
 
+        case CMD_LOAD_AT1:
+        case CMD_LOAD_AT2:
+            {
+                const unsigned nindices = in.args.at.nindices;
+                Value *ptr = stack.data + stack.size - nindices - 1;
+                if (ptr[0].kind == VAL_KIND_MATRIX && !AS_MAT(ptr[0])->pending) {
+                    const Scalar *elem =
+                        fast_elem(AS_MAT(ptr[0]), ptr + 1, nindices, in.args.at.checked);
+                    if (elem) {
+                        const Scalar x = *elem;
+                        value_unref(ptr[0]);
+                        *ptr = MK_SCL(x);
+                        stack.size -= nindices;
+                        break;
+                    }
+                }
+            }
+            // fall through
         case CMD_LOAD_AT:
             {
-                const unsigned nindices = in.args.nindices;
+                const unsigned nindices = in.args.at.nindices;
                 Value *ptr = stack.data + stack.size - nindices - 1;
                 Value container = ptr[0];
-                if (container.kind != VAL_KIND_MATRIX) {
+                if (container.kind != VAL_KIND_MATRIX && container.kind != VAL_KIND_SPARSE &&
+                    container.kind != VAL_KIND_TYPED)
+                {
                     ERR("cannot index %s value", value_kindname(container.kind));
                 }
                 if (nindices > 2) {
                     ERR("number of indices is greater than 2");
                 }
-                Matrix *mat = AS_MAT(container);
+                value_force(container);
 
                 // <danger>
                 FLUSH();
-                Value result = nindices == 1
-                    ? matrix_get1(e, mat, ptr[1])
-                    : matrix_get2(e, mat, ptr[1], ptr[2]);
+                Value result;
+                if (container.kind == VAL_KIND_SPARSE) {
+                    result = nindices == 1
+                        ? sparse_get1(e, AS_SPARSE(container), ptr[1])
+                        : sparse_get2(e, AS_SPARSE(container), ptr[1], ptr[2]);
+                } else if (container.kind == VAL_KIND_TYPED) {
+                    result = nindices == 1
+                        ? typed_get1(e, AS_TYPED(container), ptr[1])
+                        : typed_get2(e, AS_TYPED(container), ptr[1], ptr[2]);
+                } else {
+                    result = nindices == 1
+                        ? matrix_get1(e, AS_MAT(container), ptr[1])
+                        : matrix_get2(e, AS_MAT(container), ptr[1], ptr[2]);
+                }
                 // </danger>
 
                 for (size_t i = 0; i < nindices + 1; ++i) {
@@ -203,18 +323,99 @@ env_exec(Env *e, const char *src, const Instr *const chunk, size_t nchunk)
             }
             break;
 
+        case CMD_LOAD_SLICE:
+            {
+                const unsigned nvalues = vm_slice_nvalues(in);
+                Value *ptr = stack.data + stack.size - nvalues - 1;
+                Value container = ptr[0];
+                if (container.kind == VAL_KIND_SPARSE || container.kind == VAL_KIND_TYPED) {
+                    ERR("cannot take a slice of a %s", value_kindname(container.kind));
+                }
+                if (container.kind != VAL_KIND_MATRIX) {
+                    ERR("cannot index %s value", value_kindname(container.kind));
+                }
+                value_force(container);
+
+                // <danger>
+                FLUSH();
+                Matrix *result = matrix_slice(
+                    e, AS_MAT(container), in.args.slice.nindices, in.args.slice.kinds, ptr + 1);
+                // </danger>
+
+                for (size_t i = 0; i < nvalues + 1; ++i) {
+                    value_unref(ptr[i]);
+                }
+                *ptr = MK_MAT(result);
+                stack.size -= nvalues;
+            }
+            break;
+
+        case CMD_STORE_AT1:
+        case CMD_STORE_AT2:
+            {
+                const unsigned nindices = in.args.at.nindices;
+                Value *ptr = stack.data + stack.size - nindices - 2;
+                // If the variable has been reassigned, the store goes to the
+                // container alone, and the store back is skipped; so does
+                // CMD_STORE_AT, falling through, which does not check again.
+                if (in.args.at.rebind && !still_bound(e, site[1], ptr[0])) {
+                    in.args.at.rebind = false;
+                    ++site;
+                    if (ptr[0].kind == VAL_KIND_MATRIX) {
+                        value_force(ptr[0]);
+                        unshare(ptr, 1);
+                    }
+                }
+                const bool rebind = in.args.at.rebind;
+                if (ptr[0].kind == VAL_KIND_MATRIX && ptr[nindices + 1].kind == VAL_KIND_SCALAR &&
+                    !AS_MAT(ptr[0])->pending)
+                {
+                    if (rebind) {
+                        unshare(ptr, 2);
+                    }
+                    Matrix *mat = AS_MAT(ptr[0]);
+                    Scalar *elem = matrix_is_owned(mat)
+                        ? fast_elem(mat, ptr + 1, nindices, in.args.at.checked)
+                        : NULL;
+                    if (elem) {
+                        *elem = AS_SCL(ptr[nindices + 1]);
+                        if (!rebind) {
+                            value_unref(ptr[0]);
+                        }
+                        stack.size -= nindices + 2 - rebind;
+                        break;
+                    }
+                }
+            }
+            // fall through
         case CMD_STORE_AT:
             {
-                const unsigned nindices = in.args.nindices;
+                const unsigned nindices = in.args.at.nindices;
                 Value *ptr = stack.data + stack.size - nindices - 2;
+                bool stale = false;
+                if (in.cmd == CMD_STORE_AT && in.args.at.rebind &&
+                    !still_bound(e, site[1], ptr[0]))
+                {
+                    in.args.at.rebind = false;
+                    ++site;
+                    stale = true;
+                }
+                const bool rebind = in.args.at.rebind;
                 Value container = ptr[0];
+                if (container.kind == VAL_KIND_SPARSE || container.kind == VAL_KIND_TYPED) {
+                    ERR("cannot assign to an element of a %s", value_kindname(container.kind));
+                }
                 if (container.kind != VAL_KIND_MATRIX) {
                     ERR("cannot index %s value", value_kindname(container.kind));
                 }
                 if (nindices > 2) {
                     ERR("number of indices is greater than 2");
                 }
-                Matrix *mat = AS_MAT(container);
+                value_force(container);
+                if (rebind || stale) {
+                    unshare(ptr, rebind ? 2 : 1);
+                }
+                Matrix *mat = AS_MAT(ptr[0]);
 
                 // <danger>
                 FLUSH();
@@ -225,14 +426,56 @@ env_exec(Env *e, const char *src, const Instr *const chunk, size_t nchunk)
                 }
                 // </danger>
 
-                for (size_t i = 0; i < nindices + 2; ++i) {
+                for (size_t i = rebind; i < nindices + 2; ++i) {
                     value_unref(ptr[i]);
                 }
-                stack.size -= nindices + 2;
+                stack.size -= nindices + 2 - rebind;
+            }
+            break;
+
+        case CMD_STORE_SLICE:
+            {
+                const unsigned nvalues = vm_slice_nvalues(in);
+                Value *ptr = stack.data + stack.size - nvalues - 2;
+                // As for CMD_STORE_AT.
+                bool stale = false;
+                if (in.args.slice.rebind && !still_bound(e, site[1], ptr[0])) {
+                    in.args.slice.rebind = false;
+                    ++site;
+                    stale = true;
+                }
+                const bool rebind = in.args.slice.rebind;
+                Value container = ptr[0];
+                if (container.kind == VAL_KIND_SPARSE || container.kind == VAL_KIND_TYPED) {
+                    ERR("cannot assign to an element of a %s", value_kindname(container.kind));
+                }
+                if (container.kind != VAL_KIND_MATRIX) {
+                    ERR("cannot index %s value", value_kindname(container.kind));
+                }
+                value_force(container);
+                value_force(ptr[nvalues + 1]);
+                if (rebind || stale) {
+                    unshare(ptr, rebind ? 2 : 1);
+                }
+                Matrix *mat = AS_MAT(ptr[0]);
+
+                // <danger>
+                FLUSH();
+                matrix_set_slice(e, mat, in.args.slice.nindices, in.args.slice.kinds, ptr + 1,
+                                 ptr[nvalues + 1]);
+                // </danger>
+
+                for (size_t i = rebind; i < nvalues + 2; ++i) {
+                    value_unref(ptr[i]);
+                }
+                stack.size -= nvalues + 2 - rebind;
             }
             break;
 
         case CMD_OP_UNARY:
+            value_force(stack.data[stack.size - 1]);
+            // fall through
+        case CMD_OP_UNARY_LAZY:
             {
                 Value v = stack.data[stack.size - 1];
 
@@ -246,10 +489,18 @@ env_exec(Env *e, const char *src, const Instr *const chunk, size_t nchunk)
             break;
 
         case CMD_OP_BINARY:
+            value_force(stack.data[stack.size - 2]);
+            value_force(stack.data[stack.size - 1]);
+            // fall through
+        case CMD_OP_BINARY_LAZY:
             {
                 Value v = stack.data[stack.size - 2];
                 Value w = stack.data[stack.size - 1];
 
+                // The handler may take over /v/ or /w/ if it is the only
+                // reference to it; then the result holds the extra reference
+                // that the unrefs below drop. See /Op/.
+
                 // <danger>
                 FLUSH();
                 stack.data[stack.size - 2] = in.args.binary(e, v, w);
@@ -265,6 +516,10 @@ env_exec(Env *e, const char *src, const Instr *const chunk, size_t nchunk)
             {
                 Value *ptr = stack.data + stack.size - in.args.nargs - 1;
                 Value func = ptr[0];
+                STATS_INC(calls);
+                for (unsigned i = 1; i <= in.args.nargs; ++i) {
+                    value_force(ptr[i]);
+                }
                 switch (func.kind) {
                 case VAL_KIND_CFUNC:
                     {
@@ -329,9 +584,33 @@ env_exec(Env *e, const char *src, const Instr *const chunk, size_t nchunk)
             site += in.args.offset;
             continue;
 
+        case CMD_CHECK_BOUNDS:
+            {
+                const size_t prev_pos = callstack.data[callstack.size - 1].stackpos;
+                const Value c = stack.data[prev_pos + in.args.bounds.index];
+                const Value lo = stack.data[stack.size - 2];
+                const Value hi = stack.data[stack.size - 1];
+                bool ok = false;
+                if (c.kind == VAL_KIND_MATRIX && !AS_MAT(c)->pending &&
+                    lo.kind == VAL_KIND_SCALAR && hi.kind == VAL_KIND_SCALAR)
+                {
+                    const Matrix *m = AS_MAT(c);
+                    const size_t n = in.args.bounds.dim == 0 ? (size_t) m->height * m->width
+                                   : in.args.bounds.dim == 1 ? m->height
+                                   : m->width;
+                    ok = AS_SCL(lo) >= 1 && AS_SCL(hi) < n + 1.0;
+                }
+                value_unref(lo);
+                value_unref(hi);
+                stack.size -= 2;
+                site += ok ? 1 : in.args.bounds.offset;
+            }
+            continue;
+
         case CMD_JUMP_UNLESS:
             {
                 Value condition = stack.data[stack.size - 1];
+                value_force(condition);
                 if (!value_is_truthy(condition)) {
                     site += in.args.offset;
                 } else {
@@ -367,6 +646,7 @@ env_exec(Env *e, const char *src, const Instr *const chunk, size_t nchunk)
             {
                 Callsite prev = VECTOR_POP(callstack);
                 Value result = VECTOR_POP(stack);
+                value_force(result);
 
                 for (size_t i = prev.stackpos - 1; i < stack.size; ++i) {
                     value_unref(stack.data[i]);
@@ -380,7 +660,9 @@ env_exec(Env *e, const char *src, const Instr *const chunk, size_t nchunk)
             continue;
 
         case CMD_QUARK:
-            // do nothing
+            // Scratch buffers never outlive the instruction that allocated
+            // them, so a line boundary is as good a point as any.
+            scratch_reset();
             break;
         }
 
@@ -420,6 +702,7 @@ stop:
 void
 env_throw(Env *e, const char *fmt, ...)
 {
+    STATS_INC(throws);
     va_list vl;
     va_start(vl, fmt);
     vsnprintf(e->err, sizeof(e->err), fmt, vl);
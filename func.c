@@ -1,10 +1,13 @@
 #include "func.h"
 #include "vector.h"
+#include "stats.h"
+#include "alloc.h"
 
 Func *
 func_new(unsigned nargs, unsigned nlocals, const char *src, const Instr *chunk, size_t nchunk)
 {
-    Func *f = xmalloc(sizeof(Func) + nchunk * sizeof(Instr), 1);
+    Func *f = heap_alloc(func_nbytes(nchunk));
+    stats_on_alloc(STATS_OBJ_FUNC, func_nbytes(nchunk));
     f->gchdr.nrefs = 1;
     f->nargs = nargs;
     f->nlocals = nlocals;
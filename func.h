@@ -15,6 +15,13 @@ typedef struct {
     Instr chunk[];
 } Func;
 
+INHEADER
+size_t
+func_nbytes(size_t nchunk)
+{
+    return sizeof(Func) + nchunk * sizeof(Instr);
+}
+
 Func *
 func_new(unsigned nargs, unsigned nlocals, const char *src, const Instr *chunk, size_t nchunk);
 
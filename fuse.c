@@ -0,0 +1,320 @@
+#include "fuse.h"
+#include "alloc.h"
+#include "stats.h"
+#include "workers.h"
+#include "linalg.h"
+
+enum {
+    BLOCK = 512,
+    // Evaluation is split across /workers_global/ in ranges of at least
+    // this many blocks.
+    PAR_MIN_BLOCKS = 64,
+};
+
+typedef struct {
+    unsigned nops;
+    unsigned nleaves;
+    unsigned depth;
+} Shape;
+
+static
+Shape
+shape_of(Matrix *m)
+{
+    Fusion *f = m->pending;
+    if (!f) {
+        return (Shape) {.nops = 1, .nleaves = 1, .depth = 1};
+    }
+    Shape s = {.nops = f->nops, .nleaves = f->nleaves};
+    unsigned d = 0;
+    for (unsigned i = 0; i < f->nops; ++i) {
+        switch (f->ops[i].kind) {
+        case FUSE_LEAF:
+            if (++d > s.depth) {
+                s.depth = d;
+            }
+            break;
+        case FUSE_ADD:
+        case FUSE_SUB:
+            --d;
+            break;
+        default:
+            break;
+        }
+    }
+    return s;
+}
+
+static inline
+Fusion *
+fusion_new(void)
+{
+    Fusion *f = heap_alloc(sizeof(Fusion));
+    f->nops = 0;
+    f->nleaves = 0;
+    return f;
+}
+
+static inline
+void
+push_op(Fusion *f, FuseOp op)
+{
+    assert(f->nops < FUSE_MAXOPS);
+    f->ops[f->nops++] = op;
+}
+
+// Takes over a reference to /leaf/.
+static inline
+unsigned char
+add_leaf(Fusion *f, Matrix *leaf)
+{
+    for (unsigned i = 0; i < f->nleaves; ++i) {
+        if (f->leaves[i] == leaf) {
+            --leaf->gchdr.nrefs;
+            return i;
+        }
+    }
+    assert(f->nleaves < FUSE_MAXLEAVES);
+    f->leaves[f->nleaves] = leaf;
+    return f->nleaves++;
+}
+
+// Appends the postfix program computing operand /m/ to /f/, whose result is
+// going to be stored in /dst/.
+static
+void
+append_operand(Fusion *f, Matrix *dst, Matrix *m)
+{
+    Fusion *g = m->pending;
+    if (g) {
+        // /m/ is either /dst/ or a dying temporary; in both cases its
+        // program can be moved over.
+        unsigned char map[FUSE_MAXLEAVES];
+        for (unsigned i = 0; i < g->nleaves; ++i) {
+            map[i] = add_leaf(f, g->leaves[i]);
+        }
+        for (unsigned i = 0; i < g->nops; ++i) {
+            FuseOp op = g->ops[i];
+            if (op.kind == FUSE_LEAF) {
+                if (op.leaf != FUSE_LEAF_SELF) {
+                    op.leaf = map[op.leaf];
+                } else if (m != dst) {
+                    // /m/'s buffer still holds the operand; keep /m/ alive
+                    // as a plain leaf.
+                    ++m->gchdr.nrefs;
+                    op.leaf = add_leaf(f, m);
+                }
+            }
+            push_op(f, op);
+        }
+        m->pending = NULL;
+        heap_free(g, sizeof(Fusion));
+    } else if (m == dst) {
+        push_op(f, (FuseOp) {.kind = FUSE_LEAF, .leaf = FUSE_LEAF_SELF});
+    } else {
+        ++m->gchdr.nrefs;
+        push_op(f, (FuseOp) {.kind = FUSE_LEAF, .leaf = add_leaf(f, m)});
+    }
+}
+
+// A pending matrix that is not a dying temporary can not have its program
+// moved; compute it first. (The VM forces values before they can be
+// shared, so this is only a safety net.)
+static inline
+void
+settle(Matrix *m)
+{
+    if (m->pending && m->gchdr.nrefs != 1) {
+        fuse_eval(m);
+    }
+}
+
+static
+Matrix *
+pick_dst(Matrix *x, Matrix *y)
+{
+    // A matrix that borrows its elements may share them; see /matrix_reuse/.
+    Matrix *dst;
+    if (x->pending && x->gchdr.nrefs == 1) {
+        dst = x;
+    } else if (y && y->pending && y->gchdr.nrefs == 1) {
+        dst = y;
+    } else if (x->gchdr.nrefs == 1 && !x->owner) {
+        dst = x;
+    } else if (y && y->gchdr.nrefs == 1 && !y->owner) {
+        dst = y;
+    } else {
+        return matrix_new_uninit(x->height, x->width);
+    }
+    // See /matrix_reuse/.
+    ++dst->gchdr.nrefs;
+    return dst;
+}
+
+static
+Matrix *
+build(FuseOp op, Matrix *x, Matrix *y)
+{
+    settle(x);
+    if (y) {
+        settle(y);
+    }
+
+    Shape sx = shape_of(x);
+    Shape sy = y ? shape_of(y) : (Shape) {0};
+    if (sx.nops + sy.nops + 1 > FUSE_MAXOPS ||
+        sx.nleaves + sy.nleaves > FUSE_MAXLEAVES ||
+        sx.depth > FUSE_MAXDEPTH ||
+        sy.depth + 1 > FUSE_MAXDEPTH)
+    {
+        // Too long a program; compute what there is and start over.
+        if (x->pending) {
+            fuse_eval(x);
+        }
+        if (y && y->pending) {
+            fuse_eval(y);
+        }
+    }
+
+    Matrix *dst = pick_dst(x, y);
+    Fusion *f = fusion_new();
+    append_operand(f, dst, x);
+    if (y) {
+        append_operand(f, dst, y);
+    }
+    push_op(f, op);
+    dst->pending = f;
+    return dst;
+}
+
+Matrix *
+fuse_binary(FuseOpKind kind, Value a, Value b)
+{
+    return build((FuseOp) {.kind = kind}, AS_MAT(a), AS_MAT(b));
+}
+
+Matrix *
+fuse_unary(FuseOpKind kind, Scalar scalar, Value a)
+{
+    return build((FuseOp) {.kind = kind, .scalar = scalar}, AS_MAT(a), NULL);
+}
+
+static const LinalgElt elt_ops[] = {
+    [FUSE_ADD]   = LINALG_ELT_ADD,
+    [FUSE_SUB]   = LINALG_ELT_SUB,
+    [FUSE_NEG]   = LINALG_ELT_NEG,
+    [FUSE_SCALE] = LINALG_ELT_SCALE,
+};
+
+typedef struct {
+    const Fusion *f;
+    Scalar *dst;
+    // The elements of each leaf if it is packed; NULL if it is a strided
+    // view, which /gather/ reads from /f->leaves/ instead.
+    const Scalar *leaves[FUSE_MAXLEAVES];
+    size_t n;
+    // Whether to write the result with non-temporal stores.
+    bool stream;
+} EvalCtx;
+
+// Copies elements [/start/, /start/ + /len/) of /m/, counting row after
+// row, to /out/.
+static
+void
+gather(Scalar *out, const Matrix *m, size_t start, size_t len)
+{
+    size_t i = start / m->width;
+    size_t j = start % m->width;
+    const Scalar *row = m->elems + i * m->rstride;
+    for (size_t k = 0; k < len; ++k) {
+        out[k] = row[j * m->cstride];
+        if (++j == m->width) {
+            j = 0;
+            row += m->rstride;
+        }
+    }
+}
+
+// Blocks [/begin/, /end/) of the result.
+static
+void
+eval_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    const EvalCtx *c = ctx;
+    const Fusion *f = c->f;
+    const size_t n = c->n < end * BLOCK ? c->n : end * BLOCK;
+
+    Scalar bufs[FUSE_MAXDEPTH][BLOCK];
+    Scalar gathered[FUSE_MAXLEAVES][BLOCK];
+    const Scalar *stack[FUSE_MAXDEPTH];
+
+    for (size_t start = begin * BLOCK; start < n; start += BLOCK) {
+        const size_t len = n - start < BLOCK ? n - start : BLOCK;
+        for (unsigned i = 0; i < f->nleaves; ++i) {
+            if (!c->leaves[i]) {
+                gather(gathered[i], f->leaves[i], start, len);
+            }
+        }
+        unsigned d = 0;
+        for (unsigned i = 0; i < f->nops; ++i) {
+            const FuseOp op = f->ops[i];
+            if (op.kind == FUSE_LEAF) {
+                if (op.leaf == FUSE_LEAF_SELF) {
+                    stack[d++] = c->dst + start;
+                } else if (c->leaves[op.leaf]) {
+                    stack[d++] = c->leaves[op.leaf] + start;
+                } else {
+                    stack[d++] = gathered[op.leaf];
+                }
+                continue;
+            }
+            // The last operation writes straight into the result. All of the
+            // operands of this block have been read by then, so it is fine
+            // if one of them is the result itself.
+            const bool last = i + 1 == f->nops;
+            const bool binary = op.kind == FUSE_ADD || op.kind == FUSE_SUB;
+            const unsigned top = binary ? d - 2 : d - 1;
+            Scalar *out = last ? c->dst + start : bufs[top];
+            linalg_elt(elt_ops[op.kind], out, stack[top], binary ? stack[d - 1] : NULL, op.scalar,
+                       len, last && c->stream);
+            stack[top] = out;
+            d = top + 1;
+        }
+    }
+}
+
+void
+fuse_eval(Matrix *m)
+{
+    Fusion *f = m->pending;
+    EvalCtx c = {.f = f, .dst = m->elems, .n = (size_t) m->height * m->width};
+    c.stream = c.n >= LINALG_STREAM_MIN;
+
+    for (unsigned i = 0; i < f->nleaves; ++i) {
+        const Matrix *leaf = f->leaves[i];
+        assert(!leaf->pending);
+        c.leaves[i] = matrix_is_packed(leaf) ? leaf->elems : NULL;
+    }
+
+    uint_least64_t nflops = 0;
+    for (unsigned i = 0; i < f->nops; ++i) {
+        nflops += f->ops[i].kind != FUSE_LEAF;
+    }
+    STATS_ADD(flops, nflops * c.n);
+
+    workers_for((c.n + BLOCK - 1) / BLOCK, PAR_MIN_BLOCKS, eval_range, &c);
+
+    fuse_drop(m);
+}
+
+void
+fuse_drop(Matrix *m)
+{
+    Fusion *f = m->pending;
+    m->pending = NULL;
+    for (unsigned i = 0; i < f->nleaves; ++i) {
+        value_unref(MK_MAT(f->leaves[i]));
+    }
+    heap_free(f, sizeof(Fusion));
+}
@@ -0,0 +1,90 @@
+#ifndef fuse_h_
+#define fuse_h_
+
+#include "common.h"
+#include "value.h"
+#include "matrix.h"
+
+// Deferred elementwise matrix expressions.
+//
+// An elementwise operator on large matrices does not compute its result
+// right away. It returns a matrix whose elements are not there yet, and
+// whose /pending/ field holds a small postfix program over the operands.
+// Another elementwise operator applied to such a temporary extends the
+// program instead of making a pass over memory; the elements are computed
+// in one blocked loop when the value is observed -- the VM forces every
+// value that goes anywhere but to an operator marked /lazy/ (see /Op/).
+
+enum {
+    FUSE_MIN_ELEMS = 4096,
+    FUSE_MAXOPS = 24,
+    FUSE_MAXLEAVES = 8,
+    FUSE_MAXDEPTH = 8,
+};
+
+typedef enum {
+    FUSE_LEAF,      // push leaf /leaf/
+    FUSE_ADD,
+    FUSE_SUB,
+    FUSE_NEG,
+    FUSE_SCALE,     // multiply by /scalar/
+} FuseOpKind;
+
+// Leaf index standing for the destination matrix itself: its buffer still
+// holds an operand's elements (it is a reused temporary), and it can not
+// hold a reference to itself.
+#define FUSE_LEAF_SELF ((unsigned char) -1)
+
+typedef struct {
+    unsigned char kind;
+    unsigned char leaf;
+    Scalar scalar;
+} FuseOp;
+
+typedef struct Fusion {
+    unsigned char nops;
+    unsigned char nleaves;
+    FuseOp ops[FUSE_MAXOPS];
+    Matrix *leaves[FUSE_MAXLEAVES];
+} Fusion;
+
+// Whether an elementwise operation on /x/ (and /y/, which may be NULL)
+// should be deferred rather than computed. Operands that are not packed
+// (see /matrix_is_packed/) always go through here, since the evaluation
+// loop is what reads them in place.
+INHEADER
+bool
+fuse_wanted(Matrix *x, Matrix *y)
+{
+    return x->pending || (y && y->pending) ||
+           !matrix_is_packed(x) || (y && !matrix_is_packed(y)) ||
+           (size_t) x->height * x->width >= FUSE_MIN_ELEMS;
+}
+
+// /kind/ is FUSE_ADD or FUSE_SUB; /a/ and /b/ are matrices of equal
+// dimensions, borrowed as operator handlers borrow their arguments.
+Matrix *
+fuse_binary(FuseOpKind kind, Value a, Value b);
+
+// /kind/ is FUSE_NEG or FUSE_SCALE (by /scalar/).
+Matrix *
+fuse_unary(FuseOpKind kind, Scalar scalar, Value a);
+
+// Computes the elements of /m/ and releases its program.
+void
+fuse_eval(Matrix *m);
+
+// Releases the program of /m/ without computing anything.
+void
+fuse_drop(Matrix *m);
+
+INHEADER
+void
+value_force(Value v)
+{
+    if (v.kind == VAL_KIND_MATRIX && AS_MAT(v)->pending) {
+        fuse_eval(AS_MAT(v));
+    }
+}
+
+#endif
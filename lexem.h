@@ -19,6 +19,7 @@ typedef enum {
     LEX_KIND_COMMA,
     LEX_KIND_SEMICOLON,
     LEX_KIND_EQ,
+    LEX_KIND_COLON,
     LEX_KIND_COLON_EQ,
     LEX_KIND_BAR,
 
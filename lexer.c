@@ -58,6 +58,7 @@ lexer_new(Trie *opreg)
     };
 
     trie_insert(opreg, "=",  LEX_KIND_EQ,       NULL);
+    trie_insert(opreg, ":",  LEX_KIND_COLON,    NULL);
     trie_insert(opreg, ":=", LEX_KIND_COLON_EQ, NULL);
     trie_insert(opreg, "|",  LEX_KIND_BAR,      NULL);
 
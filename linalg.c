@@ -0,0 +1,4245 @@
+#include "linalg.h"
+#include "stats.h"
+#include "alloc.h"
+#include "workers.h"
+
+#include <math.h>
+#include <float.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define LINALG_X86 1
+#   include <immintrin.h>
+#endif
+
+static
+size_t
+div_ceil(size_t a, size_t b)
+{
+    return (a + b - 1) / b;
+}
+
+static
+size_t
+round_up(size_t a, size_t b)
+{
+    return div_ceil(a, b) * b;
+}
+
+// Elementwise kernels and transposition are split across /workers_global/
+// in ranges of at least this many elements.
+enum { PAR_MIN = 1 << 15 };
+
+// Elementwise kernels
+//
+// One loop per instruction set covers all of /LinalgElt/, with the
+// operation switched on outside of it. Large results are written with
+// non-temporal stores (see /LINALG_STREAM_MIN/), which need an aligned
+// destination: the first few elements are done one at a time to get
+// there. The SIMD paths give the same bits as the scalar one.
+
+typedef void (*EltKernel)(LinalgElt op, Scalar *z, const Scalar *x, const Scalar *y, Scalar a,
+                          size_t n, bool stream);
+
+static
+void
+elt_generic(LinalgElt op, Scalar *z, const Scalar *x, const Scalar *y, Scalar a, size_t n,
+            bool stream)
+{
+    (void) stream;
+    switch (op) {
+    case LINALG_ELT_ADD:
+        for (size_t i = 0; i < n; ++i) {
+            z[i] = x[i] + y[i];
+        }
+        break;
+    case LINALG_ELT_SUB:
+        for (size_t i = 0; i < n; ++i) {
+            z[i] = x[i] - y[i];
+        }
+        break;
+    case LINALG_ELT_NEG:
+        for (size_t i = 0; i < n; ++i) {
+            z[i] = -x[i];
+        }
+        break;
+    case LINALG_ELT_SCALE:
+        for (size_t i = 0; i < n; ++i) {
+            z[i] = a * x[i];
+        }
+        break;
+    }
+}
+
+static
+bool
+eq_generic(const Scalar *x, const Scalar *y, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        if (x[i] != y[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static
+bool
+any_generic(const Scalar *x, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        if (x[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static
+bool
+all_generic(const Scalar *x, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        if (!x[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Number of leading elements of /z/ to do one at a time so that the rest
+// starts at a multiple of /align/ bytes (at most /n/).
+static inline
+size_t
+head_for(const Scalar *z, size_t align, size_t n)
+{
+    const size_t head = (align - (uintptr_t) z % align) % align / sizeof(Scalar);
+    return head < n ? head : n;
+}
+
+#ifdef LINALG_X86
+
+// The vector loop of an /elt_*/ kernel over [/head/, /body/), writing
+// /EXPR_/ (of /i/) with /STREAM_/ or /STOREU_/. Expects /op/, /z/, /x/,
+// /y/, /head/, /body/, /stream/ and the constants /va/ and /sign/.
+#define ELT_BODY(W_, STREAM_, STOREU_, LOADU_, ADD_, SUB_, MUL_, XOR_) \
+    do { \
+        switch (op) { \
+        case LINALG_ELT_ADD: \
+            ELT_LOOP_(W_, STREAM_, STOREU_, ADD_(LOADU_(x + i), LOADU_(y + i))); \
+            break; \
+        case LINALG_ELT_SUB: \
+            ELT_LOOP_(W_, STREAM_, STOREU_, SUB_(LOADU_(x + i), LOADU_(y + i))); \
+            break; \
+        case LINALG_ELT_NEG: \
+            ELT_LOOP_(W_, STREAM_, STOREU_, XOR_(LOADU_(x + i), sign)); \
+            break; \
+        case LINALG_ELT_SCALE: \
+            ELT_LOOP_(W_, STREAM_, STOREU_, MUL_(va, LOADU_(x + i))); \
+            break; \
+        } \
+    } while (0)
+
+#define ELT_LOOP_(W_, STREAM_, STOREU_, EXPR_) \
+    do { \
+        if (stream) { \
+            for (size_t i = head; i < body; i += (W_)) { \
+                STREAM_(z + i, EXPR_); \
+            } \
+        } else { \
+            for (size_t i = head; i < body; i += (W_)) { \
+                STOREU_(z + i, EXPR_); \
+            } \
+        } \
+    } while (0)
+
+__attribute__((target("sse2")))
+static
+void
+elt_sse2(LinalgElt op, Scalar *z, const Scalar *x, const Scalar *y, Scalar a, size_t n,
+         bool stream)
+{
+    const size_t head = stream ? head_for(z, 16, n) : 0;
+    const size_t body = head + (n - head) / 2 * 2;
+    const __m128d va = _mm_set1_pd(a);
+    const __m128d sign = _mm_set1_pd(-0.0);
+    elt_generic(op, z, x, y, a, head, false);
+    ELT_BODY(2, _mm_stream_pd, _mm_storeu_pd, _mm_loadu_pd,
+             _mm_add_pd, _mm_sub_pd, _mm_mul_pd, _mm_xor_pd);
+    if (stream) {
+        _mm_sfence();
+    }
+    elt_generic(op, z + body, x + body, y ? y + body : NULL, a, n - body, false);
+}
+
+__attribute__((target("avx")))
+static
+void
+elt_avx(LinalgElt op, Scalar *z, const Scalar *x, const Scalar *y, Scalar a, size_t n,
+        bool stream)
+{
+    const size_t head = stream ? head_for(z, 32, n) : 0;
+    const size_t body = head + (n - head) / 4 * 4;
+    // /elt_generic/ is not VEX-encoded, and running it with the upper
+    // halves of the registers in use costs more than a small call itself:
+    // nothing 256-bit may be live across it.
+    elt_generic(op, z, x, y, a, head, false);
+    const __m256d va = _mm256_set1_pd(a);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    ELT_BODY(4, _mm256_stream_pd, _mm256_storeu_pd, _mm256_loadu_pd,
+             _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_xor_pd);
+    if (stream) {
+        _mm_sfence();
+    }
+    _mm256_zeroupper();
+    elt_generic(op, z + body, x + body, y ? y + body : NULL, a, n - body, false);
+}
+
+#undef ELT_LOOP_
+#undef ELT_BODY
+
+// The scans below test a few vectors at a time and return as soon as a
+// group has a hit; != is the unordered compare, so a NaN counts as
+// different from everything, and as nonzero, as it does in C.
+
+__attribute__((target("sse2")))
+static
+bool
+eq_sse2(const Scalar *x, const Scalar *y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128d d0 = _mm_cmpneq_pd(_mm_loadu_pd(x + i),     _mm_loadu_pd(y + i));
+        const __m128d d1 = _mm_cmpneq_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(y + i + 2));
+        const __m128d d2 = _mm_cmpneq_pd(_mm_loadu_pd(x + i + 4), _mm_loadu_pd(y + i + 4));
+        const __m128d d3 = _mm_cmpneq_pd(_mm_loadu_pd(x + i + 6), _mm_loadu_pd(y + i + 6));
+        if (_mm_movemask_pd(_mm_or_pd(_mm_or_pd(d0, d1), _mm_or_pd(d2, d3)))) {
+            return false;
+        }
+    }
+    return eq_generic(x + i, y + i, n - i);
+}
+
+__attribute__((target("avx")))
+static
+bool
+eq_avx(const Scalar *x, const Scalar *y, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256d d0 = _mm256_cmp_pd(_mm256_loadu_pd(x + i),      _mm256_loadu_pd(y + i),
+                                         _CMP_NEQ_UQ);
+        const __m256d d1 = _mm256_cmp_pd(_mm256_loadu_pd(x + i + 4),  _mm256_loadu_pd(y + i + 4),
+                                         _CMP_NEQ_UQ);
+        const __m256d d2 = _mm256_cmp_pd(_mm256_loadu_pd(x + i + 8),  _mm256_loadu_pd(y + i + 8),
+                                         _CMP_NEQ_UQ);
+        const __m256d d3 = _mm256_cmp_pd(_mm256_loadu_pd(x + i + 12), _mm256_loadu_pd(y + i + 12),
+                                         _CMP_NEQ_UQ);
+        if (_mm256_movemask_pd(_mm256_or_pd(_mm256_or_pd(d0, d1), _mm256_or_pd(d2, d3)))) {
+            return false;
+        }
+    }
+    return eq_generic(x + i, y + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static
+bool
+any_sse2(const Scalar *x, size_t n)
+{
+    const __m128d zero = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128d d0 = _mm_cmpneq_pd(_mm_loadu_pd(x + i),     zero);
+        const __m128d d1 = _mm_cmpneq_pd(_mm_loadu_pd(x + i + 2), zero);
+        const __m128d d2 = _mm_cmpneq_pd(_mm_loadu_pd(x + i + 4), zero);
+        const __m128d d3 = _mm_cmpneq_pd(_mm_loadu_pd(x + i + 6), zero);
+        if (_mm_movemask_pd(_mm_or_pd(_mm_or_pd(d0, d1), _mm_or_pd(d2, d3)))) {
+            return true;
+        }
+    }
+    return any_generic(x + i, n - i);
+}
+
+__attribute__((target("avx")))
+static
+bool
+any_avx(const Scalar *x, size_t n)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256d d0 = _mm256_cmp_pd(_mm256_loadu_pd(x + i),      zero, _CMP_NEQ_UQ);
+        const __m256d d1 = _mm256_cmp_pd(_mm256_loadu_pd(x + i + 4),  zero, _CMP_NEQ_UQ);
+        const __m256d d2 = _mm256_cmp_pd(_mm256_loadu_pd(x + i + 8),  zero, _CMP_NEQ_UQ);
+        const __m256d d3 = _mm256_cmp_pd(_mm256_loadu_pd(x + i + 12), zero, _CMP_NEQ_UQ);
+        if (_mm256_movemask_pd(_mm256_or_pd(_mm256_or_pd(d0, d1), _mm256_or_pd(d2, d3)))) {
+            return true;
+        }
+    }
+    return any_generic(x + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static
+bool
+all_sse2(const Scalar *x, size_t n)
+{
+    const __m128d zero = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128d d0 = _mm_cmpeq_pd(_mm_loadu_pd(x + i),     zero);
+        const __m128d d1 = _mm_cmpeq_pd(_mm_loadu_pd(x + i + 2), zero);
+        const __m128d d2 = _mm_cmpeq_pd(_mm_loadu_pd(x + i + 4), zero);
+        const __m128d d3 = _mm_cmpeq_pd(_mm_loadu_pd(x + i + 6), zero);
+        if (_mm_movemask_pd(_mm_or_pd(_mm_or_pd(d0, d1), _mm_or_pd(d2, d3)))) {
+            return false;
+        }
+    }
+    return all_generic(x + i, n - i);
+}
+
+__attribute__((target("avx")))
+static
+bool
+all_avx(const Scalar *x, size_t n)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256d d0 = _mm256_cmp_pd(_mm256_loadu_pd(x + i),      zero, _CMP_EQ_OQ);
+        const __m256d d1 = _mm256_cmp_pd(_mm256_loadu_pd(x + i + 4),  zero, _CMP_EQ_OQ);
+        const __m256d d2 = _mm256_cmp_pd(_mm256_loadu_pd(x + i + 8),  zero, _CMP_EQ_OQ);
+        const __m256d d3 = _mm256_cmp_pd(_mm256_loadu_pd(x + i + 12), zero, _CMP_EQ_OQ);
+        if (_mm256_movemask_pd(_mm256_or_pd(_mm256_or_pd(d0, d1), _mm256_or_pd(d2, d3)))) {
+            return false;
+        }
+    }
+    return all_generic(x + i, n - i);
+}
+
+#endif
+
+static const EltKernel elt_kernels[] = {
+    [LINALG_ISA_GENERIC] = elt_generic,
+#ifdef LINALG_X86
+    [LINALG_ISA_SSE2]    = elt_sse2,
+    [LINALG_ISA_AVX2]    = elt_avx,
+    [LINALG_ISA_FMA]     = elt_avx,
+#endif
+};
+
+static bool (*const eq_kernels[])(const Scalar *x, const Scalar *y, size_t n) = {
+    [LINALG_ISA_GENERIC] = eq_generic,
+#ifdef LINALG_X86
+    [LINALG_ISA_SSE2]    = eq_sse2,
+    [LINALG_ISA_AVX2]    = eq_avx,
+    [LINALG_ISA_FMA]     = eq_avx,
+#endif
+};
+
+static bool (*const any_kernels[])(const Scalar *x, size_t n) = {
+    [LINALG_ISA_GENERIC] = any_generic,
+#ifdef LINALG_X86
+    [LINALG_ISA_SSE2]    = any_sse2,
+    [LINALG_ISA_AVX2]    = any_avx,
+    [LINALG_ISA_FMA]     = any_avx,
+#endif
+};
+
+static bool (*const all_kernels[])(const Scalar *x, size_t n) = {
+    [LINALG_ISA_GENERIC] = all_generic,
+#ifdef LINALG_X86
+    [LINALG_ISA_SSE2]    = all_sse2,
+    [LINALG_ISA_AVX2]    = all_avx,
+    [LINALG_ISA_FMA]     = all_avx,
+#endif
+};
+
+void
+linalg_elt(LinalgElt op, Scalar *z, const Scalar *x, const Scalar *y, Scalar a, size_t n,
+           bool stream)
+{
+    elt_kernels[linalg_isa()](op, z, x, y, a, n, stream);
+}
+
+typedef struct {
+    EltKernel kernel;
+    LinalgElt op;
+    Scalar *z;
+    const Scalar *x;
+    const Scalar *y;
+    Scalar a;
+    bool stream;
+} EltCtx;
+
+static
+void
+elt_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    EltCtx *c = ctx;
+    c->kernel(c->op, c->z + begin, c->x + begin, c->y ? c->y + begin : NULL, c->a, end - begin,
+              c->stream);
+}
+
+static
+void
+elt_run(LinalgElt op, Scalar *z, const Scalar *x, const Scalar *y, Scalar a, size_t n)
+{
+    STATS_ADD(flops, n);
+    EltCtx c = {
+        .kernel = elt_kernels[linalg_isa()],
+        .op = op,
+        .z = z, .x = x, .y = y, .a = a,
+        // In place, the destination lines are in cache already.
+        .stream = n >= LINALG_STREAM_MIN && z != x && z != y,
+    };
+    workers_for(n, PAR_MIN, elt_range, &c);
+}
+
+void
+linalg_add(Scalar *z, const Scalar *x, const Scalar *y, size_t n)
+{
+    elt_run(LINALG_ELT_ADD, z, x, y, 0, n);
+}
+
+void
+linalg_sub(Scalar *z, const Scalar *x, const Scalar *y, size_t n)
+{
+    elt_run(LINALG_ELT_SUB, z, x, y, 0, n);
+}
+
+void
+linalg_neg(Scalar *z, const Scalar *x, size_t n)
+{
+    elt_run(LINALG_ELT_NEG, z, x, NULL, 0, n);
+}
+
+void
+linalg_scale(Scalar *z, Scalar a, const Scalar *x, size_t n)
+{
+    elt_run(LINALG_ELT_SCALE, z, x, NULL, a, n);
+}
+
+bool
+linalg_eq(const Scalar *x, const Scalar *y, size_t n)
+{
+    return eq_kernels[linalg_isa()](x, y, n);
+}
+
+bool
+linalg_any(const Scalar *x, size_t n)
+{
+    return any_kernels[linalg_isa()](x, n);
+}
+
+bool
+linalg_all(const Scalar *x, size_t n)
+{
+    return all_kernels[linalg_isa()](x, n);
+}
+
+// Elementwise functions
+//
+// The FMA path evaluates exp, log, sin and cos four at a time: a
+// Cody-Waite argument reduction, then a polynomial. exp uses the degree-13
+// Taylor polynomial on [-ln 2 / 2, ln 2 / 2] and scales by 2^n in two
+// steps, so that subnormal results are rounded once. log and the sin and
+// cos kernels are those of fdlibm. Arguments the reductions were not made
+// for -- zero, negative, subnormal or non-finite for log, |x| > 2^20 or
+// non-finite for sin and cos -- go to libm, one lane at a time. The AVX2
+// and FMA paths round with ROUNDPD, which gives exactly what libm does.
+// Everything else calls libm.
+//
+// A tail shorter than a vector goes through the vector code too, padded,
+// so that an element gets the same bits whichever thread's range it falls
+// in.
+
+enum { MAP_PAR_MIN = 1 << 12 };
+
+typedef void (*MapKernel)(LinalgFn fn, Scalar *z, const Scalar *x, size_t n);
+
+static Scalar (*const libm_fns[])(Scalar) = {
+    [LINALG_FN_SIN]   = sin,
+    [LINALG_FN_COS]   = cos,
+    [LINALG_FN_TAN]   = tan,
+    [LINALG_FN_ASIN]  = asin,
+    [LINALG_FN_ACOS]  = acos,
+    [LINALG_FN_ATAN]  = atan,
+    [LINALG_FN_EXP]   = exp,
+    [LINALG_FN_LOG]   = log,
+    [LINALG_FN_FLOOR] = floor,
+    [LINALG_FN_TRUNC] = trunc,
+    [LINALG_FN_CEIL]  = ceil,
+    [LINALG_FN_ROUND] = round,
+};
+
+static
+void
+map_generic(LinalgFn fn, Scalar *z, const Scalar *x, size_t n)
+{
+    Scalar (*f)(Scalar) = libm_fns[fn];
+    for (size_t i = 0; i < n; ++i) {
+        z[i] = f(x[i]);
+    }
+}
+
+#ifdef LINALG_X86
+
+// z[i] = F_(x[i]) for i < n, with F_ taking and returning an __m256d.
+#define MAP_AVX_(F_) \
+    do { \
+        size_t i = 0; \
+        for (; i + 4 <= n; i += 4) { \
+            _mm256_storeu_pd(z + i, F_(_mm256_loadu_pd(x + i))); \
+        } \
+        if (i < n) { \
+            Scalar buf[4] = {1, 1, 1, 1}; \
+            memcpy(buf, x + i, (n - i) * sizeof(Scalar)); \
+            _mm256_storeu_pd(buf, F_(_mm256_loadu_pd(buf))); \
+            memcpy(z + i, buf, (n - i) * sizeof(Scalar)); \
+        } \
+    } while (0)
+
+__attribute__((target("avx")))
+static inline
+__m256d
+vfloor_avx(__m256d x)
+{
+    return _mm256_round_pd(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+}
+
+__attribute__((target("avx")))
+static inline
+__m256d
+vceil_avx(__m256d x)
+{
+    return _mm256_round_pd(x, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC);
+}
+
+__attribute__((target("avx")))
+static inline
+__m256d
+vtrunc_avx(__m256d x)
+{
+    return _mm256_round_pd(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+}
+
+// Halfway cases away from zero, like round(): there is no such rounding
+// mode, so truncate and step away from zero if what was cut off (exactly
+// representable) is at least a half.
+__attribute__((target("avx")))
+static inline
+__m256d
+vround_avx(__m256d x)
+{
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d t = vtrunc_avx(x);
+    const __m256d cut = _mm256_andnot_pd(sign, _mm256_sub_pd(x, t));
+    const __m256d up = _mm256_cmp_pd(cut, _mm256_set1_pd(0.5), _CMP_GE_OQ);
+    const __m256d step = _mm256_or_pd(_mm256_and_pd(x, sign), _mm256_set1_pd(1.0));
+    // Blended rather than adding 0 where not /up/, which would turn -0 into 0.
+    return _mm256_blendv_pd(t, _mm256_add_pd(t, step), up);
+}
+
+__attribute__((target("avx")))
+static
+void
+map_avx(LinalgFn fn, Scalar *z, const Scalar *x, size_t n)
+{
+    switch (fn) {
+    case LINALG_FN_FLOOR:
+        MAP_AVX_(vfloor_avx);
+        break;
+    case LINALG_FN_CEIL:
+        MAP_AVX_(vceil_avx);
+        break;
+    case LINALG_FN_TRUNC:
+        MAP_AVX_(vtrunc_avx);
+        break;
+    case LINALG_FN_ROUND:
+        MAP_AVX_(vround_avx);
+        break;
+    default:
+        map_generic(fn, z, x, n);
+        break;
+    }
+}
+
+// Recomputes the lanes of /r/ that are set in /mask/ (a movemask of the
+// lanes of /x/) with libm's /f/.
+__attribute__((target("avx")))
+static
+__m256d
+fix_lanes(__m256d r, __m256d x, int mask, Scalar (*f)(Scalar))
+{
+    Scalar xs[4];
+    Scalar rs[4];
+    _mm256_storeu_pd(xs, x);
+    _mm256_storeu_pd(rs, r);
+    for (int i = 0; i < 4; ++i) {
+        if (mask & (1 << i)) {
+            rs[i] = f(xs[i]);
+        }
+    }
+    return _mm256_loadu_pd(rs);
+}
+
+#define MAGIC 0x1.8p52
+
+// 2^n for integral /n/ in [-1022, 1023].
+__attribute__((target("avx2,fma")))
+static inline
+__m256d
+vpow2_fma(__m256d n)
+{
+    const __m256d magic = _mm256_set1_pd(MAGIC);
+    const __m256i i = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(n, magic)),
+                                       _mm256_castpd_si256(magic));
+    return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(i, _mm256_set1_epi64x(1023)), 52));
+}
+
+__attribute__((target("avx2,fma")))
+static inline
+__m256d
+vexp_fma(__m256d x)
+{
+    const __m256d magic = _mm256_set1_pd(MAGIC);
+    // Past these, the result is 0 or infinity anyway; NaNs go through.
+    x = _mm256_min_pd(_mm256_set1_pd(710.0), x);
+    x = _mm256_max_pd(_mm256_set1_pd(-746.0), x);
+
+    const __m256d n = _mm256_sub_pd(_mm256_fmadd_pd(x, _mm256_set1_pd(1.4426950408889634), magic),
+                                    magic);
+    __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(0.6931471805599453), x);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(2.3190468138462996e-17), r);
+
+    static const double inv_fact[] = {
+        1.6059043836821613e-10, 2.08767569878681e-09, 2.505210838544172e-08,
+        2.755731922398589e-07, 2.7557319223985893e-06, 2.48015873015873e-05,
+        0.0001984126984126984, 0.001388888888888889, 0.008333333333333333,
+        0.041666666666666664, 0.16666666666666666, 0.5, 1.0, 1.0,
+    };
+    __m256d p = _mm256_set1_pd(inv_fact[0]);
+    for (size_t k = 1; k < sizeof(inv_fact) / sizeof(inv_fact[0]); ++k) {
+        p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(inv_fact[k]));
+    }
+
+    // n is in [-1076, 1024]; both halves of it are in range for vpow2_fma.
+    const __m256d n1 = _mm256_round_pd(_mm256_mul_pd(n, _mm256_set1_pd(0.5)),
+                                       _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    const __m256d n2 = _mm256_sub_pd(n, n1);
+    return _mm256_mul_pd(_mm256_mul_pd(p, vpow2_fma(n1)), vpow2_fma(n2));
+}
+
+__attribute__((target("avx2,fma")))
+static inline
+__m256d
+vlog_fma(__m256d x)
+{
+    const __m256d special = _mm256_or_pd(
+        _mm256_cmp_pd(x, _mm256_set1_pd(0x1p-1022), _CMP_NGE_UQ),
+        _mm256_cmp_pd(x, _mm256_set1_pd(INFINITY), _CMP_EQ_OQ));
+    const int mask = _mm256_movemask_pd(special);
+    const __m256d magic = _mm256_set1_pd(MAGIC);
+
+    // x = 2^k * m, m in [sqrt(2) / 2, sqrt(2)).
+    const __m256i bits = _mm256_castpd_si256(x);
+    __m256d m = _mm256_castsi256_pd(_mm256_or_si256(
+        _mm256_and_si256(bits, _mm256_set1_epi64x(0x000fffffffffffff)),
+        _mm256_set1_epi64x(0x3ff0000000000000)));
+    __m256d k = _mm256_sub_pd(
+        _mm256_castsi256_pd(_mm256_add_epi64(_mm256_srli_epi64(bits, 52), _mm256_castpd_si256(magic))),
+        _mm256_set1_pd(MAGIC + 1023));
+    const __m256d big = _mm256_cmp_pd(m, _mm256_set1_pd(1.4142135623730951), _CMP_GT_OQ);
+    m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+    k = _mm256_add_pd(k, _mm256_and_pd(big, _mm256_set1_pd(1.0)));
+
+    const __m256d f = _mm256_sub_pd(m, _mm256_set1_pd(1.0));
+    const __m256d s = _mm256_div_pd(f, _mm256_add_pd(_mm256_set1_pd(2.0), f));
+    const __m256d z = _mm256_mul_pd(s, s);
+    const __m256d w = _mm256_mul_pd(z, z);
+    __m256d t1 = _mm256_fmadd_pd(w, _mm256_set1_pd(1.531383769920937332e-01),
+                                 _mm256_set1_pd(2.222219843214978396e-01));
+    t1 = _mm256_fmadd_pd(w, t1, _mm256_set1_pd(3.999999999940941908e-01));
+    t1 = _mm256_mul_pd(w, t1);
+    __m256d t2 = _mm256_fmadd_pd(w, _mm256_set1_pd(1.479819860511658591e-01),
+                                 _mm256_set1_pd(1.818357216161805012e-01));
+    t2 = _mm256_fmadd_pd(w, t2, _mm256_set1_pd(2.857142874366239149e-01));
+    t2 = _mm256_fmadd_pd(w, t2, _mm256_set1_pd(6.666666666666735130e-01));
+    t2 = _mm256_mul_pd(z, t2);
+    const __m256d rr = _mm256_add_pd(t1, t2);
+    const __m256d hfsq = _mm256_mul_pd(_mm256_set1_pd(0.5), _mm256_mul_pd(f, f));
+
+    // k ln2_hi - ((hfsq - (s (hfsq + R) + k ln2_lo)) - f)
+    const __m256d lo = _mm256_fmadd_pd(s, _mm256_add_pd(hfsq, rr),
+                                       _mm256_mul_pd(k, _mm256_set1_pd(1.90821492927058770002e-10)));
+    const __m256d r = _mm256_fmsub_pd(k, _mm256_set1_pd(6.93147180369123816490e-01),
+                                      _mm256_sub_pd(_mm256_sub_pd(hfsq, lo), f));
+    return mask ? fix_lanes(r, x, mask, log) : r;
+}
+
+// sin(x), or cos(x) if /cosine/: cos(x) = sin(x + pi/2), one quadrant on.
+__attribute__((target("avx2,fma")))
+static inline
+__m256d
+vsincos_fma(__m256d x, bool cosine)
+{
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d ax = _mm256_andnot_pd(sign, x);
+    const int mask = _mm256_movemask_pd(_mm256_cmp_pd(ax, _mm256_set1_pd(0x1p20), _CMP_NLE_UQ));
+    const __m256d magic = _mm256_set1_pd(MAGIC);
+
+    // x = n pi/2 + r, |r| <= pi/4 (give or take a rounding), with pi/2
+    // in three parts.
+    const __m256d kn = _mm256_fmadd_pd(x, _mm256_set1_pd(0.6366197723675814), magic);
+    const __m256d n = _mm256_sub_pd(kn, magic);
+    __m256i q = _mm256_sub_epi64(_mm256_castpd_si256(kn), _mm256_castpd_si256(magic));
+    if (cosine) {
+        q = _mm256_add_epi64(q, _mm256_set1_epi64x(1));
+    }
+    __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(1.5707963267948966), x);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(6.123233995736766e-17), r);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(-1.4973849048591698e-33), r);
+    const __m256d z = _mm256_mul_pd(r, r);
+
+    // __kernel_sin: r + r^3 (S1 + z (S2 + ... + z S6))
+    __m256d ps = _mm256_fmadd_pd(z, _mm256_set1_pd(1.58969099521155010221e-10),
+                                 _mm256_set1_pd(-2.50507602534068634195e-08));
+    ps = _mm256_fmadd_pd(z, ps, _mm256_set1_pd(2.75573137070700676789e-06));
+    ps = _mm256_fmadd_pd(z, ps, _mm256_set1_pd(-1.98412698298579493134e-04));
+    ps = _mm256_fmadd_pd(z, ps, _mm256_set1_pd(8.33333333332248946124e-03));
+    ps = _mm256_fmadd_pd(z, ps, _mm256_set1_pd(-1.66666666666666324348e-01));
+    __m256d sn = _mm256_fmadd_pd(_mm256_mul_pd(z, r), ps, r);
+    if (!cosine) {
+        // For tiny |x| that is x itself, down to the sign of a zero.
+        const __m256d tiny = _mm256_cmp_pd(ax, _mm256_set1_pd(0x1p-27), _CMP_LT_OQ);
+        sn = _mm256_blendv_pd(sn, x, tiny);
+    }
+
+    // __kernel_cos: w + (((1 - w) - z/2) + z R), w = 1 - z/2
+    __m256d pc = _mm256_fmadd_pd(z, _mm256_set1_pd(-1.13596475577881948265e-11),
+                                 _mm256_set1_pd(2.08757232129817482790e-09));
+    pc = _mm256_fmadd_pd(z, pc, _mm256_set1_pd(-2.75573143513906633035e-07));
+    pc = _mm256_fmadd_pd(z, pc, _mm256_set1_pd(2.48015872894767294178e-05));
+    pc = _mm256_fmadd_pd(z, pc, _mm256_set1_pd(-1.38888888888741095749e-03));
+    pc = _mm256_fmadd_pd(z, pc, _mm256_set1_pd(4.16666666666666019037e-02));
+    pc = _mm256_mul_pd(z, pc);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d hz = _mm256_mul_pd(_mm256_set1_pd(0.5), z);
+    const __m256d w = _mm256_sub_pd(one, hz);
+    const __m256d cs = _mm256_add_pd(w, _mm256_fmadd_pd(z, pc, _mm256_sub_pd(_mm256_sub_pd(one, w), hz)));
+
+    // Quadrant q: sin r, cos r, -sin r, -cos r.
+    const __m256i odd = _mm256_cmpeq_epi64(_mm256_and_si256(q, _mm256_set1_epi64x(1)),
+                                           _mm256_set1_epi64x(1));
+    const __m256d flip = _mm256_castsi256_pd(
+        _mm256_slli_epi64(_mm256_and_si256(q, _mm256_set1_epi64x(2)), 62));
+    const __m256d res = _mm256_xor_pd(_mm256_blendv_pd(sn, cs, _mm256_castsi256_pd(odd)), flip);
+    return mask ? fix_lanes(res, x, mask, cosine ? cos : sin) : res;
+}
+
+__attribute__((target("avx2,fma")))
+static inline
+__m256d
+vsin_fma(__m256d x)
+{
+    return vsincos_fma(x, false);
+}
+
+__attribute__((target("avx2,fma")))
+static inline
+__m256d
+vcos_fma(__m256d x)
+{
+    return vsincos_fma(x, true);
+}
+
+#undef MAGIC
+
+__attribute__((target("avx2,fma")))
+static
+void
+map_fma(LinalgFn fn, Scalar *z, const Scalar *x, size_t n)
+{
+    switch (fn) {
+    case LINALG_FN_EXP:
+        MAP_AVX_(vexp_fma);
+        break;
+    case LINALG_FN_LOG:
+        MAP_AVX_(vlog_fma);
+        break;
+    case LINALG_FN_SIN:
+        MAP_AVX_(vsin_fma);
+        break;
+    case LINALG_FN_COS:
+        MAP_AVX_(vcos_fma);
+        break;
+    default:
+        map_avx(fn, z, x, n);
+        break;
+    }
+}
+
+#undef MAP_AVX_
+
+#endif
+
+static const MapKernel map_kernels[] = {
+    [LINALG_ISA_GENERIC] = map_generic,
+#ifdef LINALG_X86
+    [LINALG_ISA_SSE2]    = map_generic,
+    [LINALG_ISA_AVX2]    = map_avx,
+    [LINALG_ISA_FMA]     = map_fma,
+#endif
+};
+
+typedef struct {
+    MapKernel kernel;
+    LinalgFn fn;
+    Scalar *z;
+    const Scalar *x;
+} MapCtx;
+
+static
+void
+map_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    MapCtx *c = ctx;
+    c->kernel(c->fn, c->z + begin, c->x + begin, end - begin);
+}
+
+void
+linalg_map(LinalgFn fn, Scalar *z, const Scalar *x, size_t n)
+{
+    STATS_ADD(flops, n);
+    MapCtx c = {.kernel = map_kernels[linalg_isa()], .fn = fn, .z = z, .x = x};
+    workers_for(n, MAP_PAR_MIN, map_range, &c);
+}
+
+// Reductions
+//
+// A vector is cut into chunks of RED_CHUNK elements, wherever it starts
+// and however many threads there are, and a chunk into leaves of RED_LEAF.
+// A leaf is reduced by one kernel call, with several vector accumulators
+// folded in a fixed order at the end; leaves are combined pairwise into
+// chunk results, and those pairwise again, on the calling thread. Columns
+// are reduced the same way, 128 rows at a time, with a whole row of
+// accumulators. The paths for different instruction sets may differ in the
+// last few places, but the number of threads never changes a bit.
+//
+// Cumulative sums cannot be taken pairwise, so they are compensated
+// instead: chunk totals come first, then each chunk is scanned from the
+// (compensated) sum of the totals before it.
+//
+// NORM is a sum of squares as far as the kernels are concerned, of
+// a * x[i] for a scale /a/; see /red_norm/.
+
+enum {
+    // Enough for the kernels to amortize their setup; with 16 lanes, each
+    // still adds up only 64 elements in a row.
+    RED_LEAF = 1 << 10,
+    RED_CHUNK = 1 << 14,
+    // Rows and columns of the blocks /linalg_reduce_cols/ hands to a thread
+    // (and columns for /linalg_cumsum_cols/).
+    RED_ROWS = 1 << 7,
+    RED_PANEL = RED_CHUNK / RED_ROWS,
+};
+
+// Reduces as much of x[n] as suits the kernel, stores how much that was in
+// /*done/, and leaves the rest to /red_tail/. Does not do ANY and ALL.
+typedef Scalar (*RedKernel)(LinalgRed op, const Scalar *x, const Scalar *y, Scalar a, size_t n,
+                            size_t *done);
+
+static inline
+Scalar
+red_identity(LinalgRed op)
+{
+    switch (op) {
+    case LINALG_RED_PROD:
+    case LINALG_RED_ALL:
+        return 1;
+    case LINALG_RED_MIN:
+        return INFINITY;
+    case LINALG_RED_MAX:
+        return -INFINITY;
+    default:
+        return 0;
+    }
+}
+
+// MIN and MAX take /a/ if it is NaN, and /b/ if that is.
+static inline
+Scalar
+red_combine(LinalgRed op, Scalar a, Scalar b)
+{
+    switch (op) {
+    case LINALG_RED_PROD:
+        return a * b;
+    case LINALG_RED_MIN:
+        return a < b || a != a ? a : b;
+    case LINALG_RED_MAX:
+        return a > b || a != a ? a : b;
+    case LINALG_RED_ANY:
+        return a || b;
+    case LINALG_RED_ALL:
+        return a && b;
+    default:
+        return a + b;
+    }
+}
+
+// v[0] op ... op v[k - 1], pairwise; k > 0.
+static
+Scalar
+red_fold(LinalgRed op, const Scalar *v, size_t k)
+{
+    if (k == 1) {
+        return v[0];
+    }
+    return red_combine(op, red_fold(op, v, k / 2), red_fold(op, v + k / 2, k - k / 2));
+}
+
+// One element at a time, for what the kernels leave over.
+static
+Scalar
+red_tail(LinalgRed op, const Scalar *x, const Scalar *y, Scalar a, size_t n)
+{
+    Scalar r = red_identity(op);
+    switch (op) {
+    case LINALG_RED_SUM:
+        for (size_t i = 0; i < n; ++i) {
+            r += x[i];
+        }
+        break;
+    case LINALG_RED_DOT:
+        for (size_t i = 0; i < n; ++i) {
+            r += x[i] * y[i];
+        }
+        break;
+    case LINALG_RED_NORM:
+        for (size_t i = 0; i < n; ++i) {
+            const Scalar t = a * x[i];
+            r += t * t;
+        }
+        break;
+    case LINALG_RED_PROD:
+        for (size_t i = 0; i < n; ++i) {
+            r *= x[i];
+        }
+        break;
+    default:
+        for (size_t i = 0; i < n; ++i) {
+            r = red_combine(op, r, x[i]);
+        }
+        break;
+    }
+    return r;
+}
+
+// The body of a /red_*/ kernel, in terms of V_* macros for vectors of /T_/
+// with /W_/ lanes: four accumulators over as much of /x/ as they cover,
+// combined into one and then across its lanes. V_MIN and V_MAX, like MINPD
+// and MAXPD, drop a NaN in their second operand, so NaNs are watched for
+// separately. (The kernels call nothing that is not inlined: code that is
+// not VEX-encoded would run with a penalty on every instruction while the
+// upper halves of the registers are in use.)
+#define RED_BODY(T_, W_) \
+    const T_ va = V_SET1(a); \
+    T_ nan = V_SET1(0); \
+    size_t i = 0; \
+    Scalar r; \
+    switch (op) { \
+    case LINALG_RED_SUM: \
+        RED_LOOP_(T_, W_, V_ADD, A_ = V_ADD(A_, V_LOAD(x + I_))); \
+        break; \
+    case LINALG_RED_DOT: \
+        RED_LOOP_(T_, W_, V_ADD, A_ = V_MADD(V_LOAD(x + I_), V_LOAD(y + I_), A_)); \
+        break; \
+    case LINALG_RED_NORM: \
+        RED_LOOP_(T_, W_, V_ADD, \
+                  A_ = V_MADD(V_MUL(va, V_LOAD(x + I_)), V_MUL(va, V_LOAD(x + I_)), A_)); \
+        break; \
+    case LINALG_RED_PROD: \
+        RED_LOOP_(T_, W_, V_MUL, A_ = V_MUL(A_, V_LOAD(x + I_))); \
+        break; \
+    case LINALG_RED_MIN: \
+        RED_LOOP_(T_, W_, V_MIN, (A_ = V_MIN(A_, V_LOAD(x + I_)), \
+                                  nan = V_OR(nan, V_UNORD(V_LOAD(x + I_))))); \
+        break; \
+    case LINALG_RED_MAX: \
+        RED_LOOP_(T_, W_, V_MAX, (A_ = V_MAX(A_, V_LOAD(x + I_)), \
+                                  nan = V_OR(nan, V_UNORD(V_LOAD(x + I_))))); \
+        break; \
+    default: \
+        UNREACHABLE(); \
+    } \
+    *done = i; \
+    return r
+
+// Runs STEP_, a statement on the accumulator /A_/ and the index /I_/, over
+// [/i/, ...), and leaves the result, combined with COMBINE_, in /r/ (NaN if
+// /nan/ has any lane set).
+#define RED_LOOP_(T_, W_, COMBINE_, STEP_) \
+    do { \
+        T_ acc0 = V_SET1(red_identity(op)); \
+        T_ acc1 = acc0; \
+        T_ acc2 = acc0; \
+        T_ acc3 = acc0; \
+        for (; i + 4 * (W_) <= n; i += 4 * (W_)) { \
+            RED_STEP_(T_, acc0, i, STEP_); \
+            RED_STEP_(T_, acc1, i + (W_), STEP_); \
+            RED_STEP_(T_, acc2, i + 2 * (W_), STEP_); \
+            RED_STEP_(T_, acc3, i + 3 * (W_), STEP_); \
+        } \
+        acc0 = COMBINE_(COMBINE_(acc0, acc1), COMBINE_(acc2, acc3)); \
+        Scalar lanes_[W_]; \
+        V_STORE(lanes_, acc0); \
+        if (V_MOVEMASK(nan)) { \
+            *done = n; \
+            return NAN; \
+        } \
+        r = lanes_[0]; \
+        for (int k_ = 1; k_ < (W_); ++k_) { \
+            r = red_combine(op, r, lanes_[k_]); \
+        } \
+    } while (0)
+
+#define RED_STEP_(T_, ACC_, IDX_, STEP_) \
+    do { \
+        const size_t I_ = (IDX_); \
+        T_ A_ = (ACC_); \
+        STEP_; \
+        (ACC_) = A_; \
+    } while (0)
+
+// Scalars as one-lane vectors, with MINPD and MAXPD semantics.
+#define V_SET1(V_)          (V_)
+#define V_LOAD(P_)          (*(P_))
+#define V_STORE(P_, V_)     ((void) (*(P_) = (V_)))
+#define V_ADD(A_, B_)       ((A_) + (B_))
+#define V_MUL(A_, B_)       ((A_) * (B_))
+#define V_MADD(A_, B_, C_)  ((C_) + (A_) * (B_))
+#define V_MIN(A_, B_)       ((A_) < (B_) ? (A_) : (B_))
+#define V_MAX(A_, B_)       ((A_) > (B_) ? (A_) : (B_))
+#define V_OR(A_, B_)        ((A_) || (B_))
+#define V_UNORD(V_)         ((V_) != (V_))
+#define V_MOVEMASK(V_)      ((V_) != 0)
+
+static
+Scalar
+red_generic(LinalgRed op, const Scalar *x, const Scalar *y, Scalar a, size_t n,
+            size_t *done)
+{
+    RED_BODY(Scalar, 1);
+}
+
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef V_MUL
+#undef V_MADD
+#undef V_MIN
+#undef V_MAX
+#undef V_OR
+#undef V_UNORD
+#undef V_MOVEMASK
+
+#ifdef LINALG_X86
+
+#define V_SET1      _mm_set1_pd
+#define V_LOAD      _mm_loadu_pd
+#define V_STORE     _mm_storeu_pd
+#define V_ADD       _mm_add_pd
+#define V_MUL       _mm_mul_pd
+#define V_MADD(A_, B_, C_) _mm_add_pd(C_, _mm_mul_pd(A_, B_))
+#define V_MIN       _mm_min_pd
+#define V_MAX       _mm_max_pd
+#define V_OR        _mm_or_pd
+#define V_UNORD(V_) _mm_cmpunord_pd(V_, V_)
+#define V_MOVEMASK  _mm_movemask_pd
+
+__attribute__((target("sse2")))
+static
+Scalar
+red_sse2(LinalgRed op, const Scalar *x, const Scalar *y, Scalar a, size_t n,
+         size_t *done)
+{
+    RED_BODY(__m128d, 2);
+}
+
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef V_MUL
+#undef V_MADD
+#undef V_MIN
+#undef V_MAX
+#undef V_OR
+#undef V_UNORD
+#undef V_MOVEMASK
+
+#define V_SET1      _mm256_set1_pd
+#define V_LOAD      _mm256_loadu_pd
+#define V_STORE     _mm256_storeu_pd
+#define V_ADD       _mm256_add_pd
+#define V_MUL       _mm256_mul_pd
+#define V_MIN       _mm256_min_pd
+#define V_MAX       _mm256_max_pd
+#define V_OR        _mm256_or_pd
+#define V_UNORD(V_) _mm256_cmp_pd(V_, V_, _CMP_UNORD_Q)
+#define V_MOVEMASK  _mm256_movemask_pd
+
+#define V_MADD(A_, B_, C_) _mm256_add_pd(C_, _mm256_mul_pd(A_, B_))
+
+__attribute__((target("avx")))
+static
+Scalar
+red_avx(LinalgRed op, const Scalar *x, const Scalar *y, Scalar a, size_t n,
+        size_t *done)
+{
+    RED_BODY(__m256d, 4);
+}
+
+#undef V_MADD
+#define V_MADD _mm256_fmadd_pd
+
+__attribute__((target("avx2,fma")))
+static
+Scalar
+red_fma(LinalgRed op, const Scalar *x, const Scalar *y, Scalar a, size_t n,
+        size_t *done)
+{
+    RED_BODY(__m256d, 4);
+}
+
+#undef V_MADD
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef V_MUL
+#undef V_MIN
+#undef V_MAX
+#undef V_OR
+#undef V_UNORD
+#undef V_MOVEMASK
+
+#endif
+
+#undef RED_STEP_
+#undef RED_LOOP_
+#undef RED_BODY
+
+// Reduces the columns of x[h x w] (row stride /ld/) into s[j], as many of
+// them as suits the kernel, from the left; returns how many that was. The
+// rest, and ANY and ALL, are left to /red_cols_tail/.
+typedef size_t (*RedColsKernel)(LinalgRed op, Scalar *s, const Scalar *x, const Scalar *y,
+                                size_t ld, size_t h, size_t w);
+
+static
+size_t
+red_cols_generic(LinalgRed op, Scalar *s, const Scalar *x, const Scalar *y, size_t ld,
+                 size_t h, size_t w)
+{
+    (void) op;
+    (void) s;
+    (void) x;
+    (void) y;
+    (void) ld;
+    (void) h;
+    (void) w;
+    return 0;
+}
+
+#ifdef LINALG_X86
+
+// The body of a /red_cols_*/ kernel: 4 * /W_/ columns at a time, with four
+// accumulators that go down the rows, then /W_/ at a time with one; the
+// NaNs seen in each lane are OR-ed into it at the end (all ones is a NaN).
+#define RED_COLS_BODY(T_, W_) \
+    const T_ id = V_SET1(red_identity(op)); \
+    const T_ zero = V_SET1(0); \
+    size_t j = 0; \
+    for (; j + 4 * (W_) <= w; j += 4 * (W_)) { \
+        T_ acc0 = id, acc1 = id, acc2 = id, acc3 = id; \
+        T_ nan0 = zero, nan1 = zero, nan2 = zero, nan3 = zero; \
+        RED_COLS_SWITCH_(T_, W_, RED_COLS_LOOP4_); \
+        V_STORE(s + j, V_OR(acc0, nan0)); \
+        V_STORE(s + j + (W_), V_OR(acc1, nan1)); \
+        V_STORE(s + j + 2 * (W_), V_OR(acc2, nan2)); \
+        V_STORE(s + j + 3 * (W_), V_OR(acc3, nan3)); \
+    } \
+    for (; j + (W_) <= w; j += (W_)) { \
+        T_ acc0 = id; \
+        T_ nan0 = zero; \
+        RED_COLS_SWITCH_(T_, W_, RED_COLS_LOOP1_); \
+        V_STORE(s + j, V_OR(acc0, nan0)); \
+    } \
+    return j
+
+// Runs LOOP_ with the step for /op/.
+#define RED_COLS_SWITCH_(T_, W_, LOOP_) \
+    switch (op) { \
+    case LINALG_RED_SUM: \
+        LOOP_(T_, W_, A_ = V_ADD(A_, V_LOAD(x + I_))); \
+        break; \
+    case LINALG_RED_DOT: \
+        LOOP_(T_, W_, A_ = V_MADD(V_LOAD(x + I_), V_LOAD(y + I_), A_)); \
+        break; \
+    case LINALG_RED_NORM: \
+        LOOP_(T_, W_, A_ = V_MADD(V_LOAD(x + I_), V_LOAD(x + I_), A_)); \
+        break; \
+    case LINALG_RED_PROD: \
+        LOOP_(T_, W_, A_ = V_MUL(A_, V_LOAD(x + I_))); \
+        break; \
+    case LINALG_RED_MIN: \
+        LOOP_(T_, W_, (A_ = V_MIN(A_, V_LOAD(x + I_)), N_ = V_OR(N_, V_UNORD(V_LOAD(x + I_))))); \
+        break; \
+    case LINALG_RED_MAX: \
+        LOOP_(T_, W_, (A_ = V_MAX(A_, V_LOAD(x + I_)), N_ = V_OR(N_, V_UNORD(V_LOAD(x + I_))))); \
+        break; \
+    default: \
+        return 0; \
+    }
+
+// Run STEP_, a statement on the accumulator /A_/, its NaN mask /N_/ and the
+// index /I_/, down the rows.
+#define RED_COLS_LOOP4_(T_, W_, STEP_) \
+    for (size_t i = 0; i < h; ++i) { \
+        RED_COLS_STEP_(T_, acc0, nan0, i * ld + j, STEP_); \
+        RED_COLS_STEP_(T_, acc1, nan1, i * ld + j + (W_), STEP_); \
+        RED_COLS_STEP_(T_, acc2, nan2, i * ld + j + 2 * (W_), STEP_); \
+        RED_COLS_STEP_(T_, acc3, nan3, i * ld + j + 3 * (W_), STEP_); \
+    }
+
+#define RED_COLS_LOOP1_(T_, W_, STEP_) \
+    for (size_t i = 0; i < h; ++i) { \
+        RED_COLS_STEP_(T_, acc0, nan0, i * ld + j, STEP_); \
+    }
+
+#define RED_COLS_STEP_(T_, ACC_, NAN_, IDX_, STEP_) \
+    do { \
+        const size_t I_ = (IDX_); \
+        T_ A_ = (ACC_); \
+        T_ N_ = (NAN_); \
+        STEP_; \
+        (ACC_) = A_; \
+        (NAN_) = N_; \
+    } while (0)
+
+#define V_SET1      _mm_set1_pd
+#define V_LOAD      _mm_loadu_pd
+#define V_STORE     _mm_storeu_pd
+#define V_ADD       _mm_add_pd
+#define V_MUL       _mm_mul_pd
+#define V_MADD(A_, B_, C_) _mm_add_pd(C_, _mm_mul_pd(A_, B_))
+#define V_MIN       _mm_min_pd
+#define V_MAX       _mm_max_pd
+#define V_OR        _mm_or_pd
+#define V_UNORD(V_) _mm_cmpunord_pd(V_, V_)
+
+__attribute__((target("sse2")))
+static
+size_t
+red_cols_sse2(LinalgRed op, Scalar *s, const Scalar *x, const Scalar *y, size_t ld, size_t h,
+              size_t w)
+{
+    RED_COLS_BODY(__m128d, 2);
+}
+
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef V_MUL
+#undef V_MADD
+#undef V_MIN
+#undef V_MAX
+#undef V_OR
+#undef V_UNORD
+
+#define V_SET1      _mm256_set1_pd
+#define V_LOAD      _mm256_loadu_pd
+#define V_STORE     _mm256_storeu_pd
+#define V_ADD       _mm256_add_pd
+#define V_MUL       _mm256_mul_pd
+#define V_MIN       _mm256_min_pd
+#define V_MAX       _mm256_max_pd
+#define V_OR        _mm256_or_pd
+#define V_UNORD(V_) _mm256_cmp_pd(V_, V_, _CMP_UNORD_Q)
+
+#define V_MADD(A_, B_, C_) _mm256_add_pd(C_, _mm256_mul_pd(A_, B_))
+
+__attribute__((target("avx")))
+static
+size_t
+red_cols_avx(LinalgRed op, Scalar *s, const Scalar *x, const Scalar *y, size_t ld, size_t h,
+             size_t w)
+{
+    RED_COLS_BODY(__m256d, 4);
+}
+
+#undef V_MADD
+#define V_MADD _mm256_fmadd_pd
+
+__attribute__((target("avx2,fma")))
+static
+size_t
+red_cols_fma(LinalgRed op, Scalar *s, const Scalar *x, const Scalar *y, size_t ld, size_t h,
+             size_t w)
+{
+    RED_COLS_BODY(__m256d, 4);
+}
+
+#undef V_MADD
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef V_MUL
+#undef V_MIN
+#undef V_MAX
+#undef V_OR
+#undef V_UNORD
+#undef RED_COLS_STEP_
+#undef RED_COLS_LOOP1_
+#undef RED_COLS_LOOP4_
+#undef RED_COLS_SWITCH_
+#undef RED_COLS_BODY
+
+#endif
+
+static const RedColsKernel red_cols_kernels[] = {
+    [LINALG_ISA_GENERIC] = red_cols_generic,
+#ifdef LINALG_X86
+    [LINALG_ISA_SSE2]    = red_cols_sse2,
+    [LINALG_ISA_AVX2]    = red_cols_avx,
+    [LINALG_ISA_FMA]     = red_cols_fma,
+#endif
+};
+
+static const RedKernel red_kernels[] = {
+    [LINALG_ISA_GENERIC] = red_generic,
+#ifdef LINALG_X86
+    [LINALG_ISA_SSE2]    = red_sse2,
+    [LINALG_ISA_AVX2]    = red_avx,
+    [LINALG_ISA_FMA]     = red_fma,
+#endif
+};
+
+// Pairwise over the leaves of x[n], n <= RED_CHUNK.
+static
+Scalar
+red_leaves(RedKernel kernel, LinalgRed op, const Scalar *x, const Scalar *y, Scalar a, size_t n)
+{
+    if (n <= RED_LEAF) {
+        size_t done;
+        const Scalar r = kernel(op, x, y, a, n, &done);
+        return red_combine(op, r, red_tail(op, x + done, y ? y + done : NULL, a, n - done));
+    }
+    const size_t half = div_ceil(n, RED_LEAF) / 2 * RED_LEAF;
+    return red_combine(op, red_leaves(kernel, op, x, y, a, half),
+                       red_leaves(kernel, op, x + half, y ? y + half : NULL, a, n - half));
+}
+
+// Pairwise over the chunks of x[n]: the same tree /red_fold/ makes of the
+// chunk results.
+static
+Scalar
+red_chunks(RedKernel kernel, LinalgRed op, const Scalar *x, const Scalar *y, Scalar a, size_t n)
+{
+    if (n <= RED_CHUNK) {
+        return red_leaves(kernel, op, x, y, a, n);
+    }
+    const size_t half = div_ceil(n, RED_CHUNK) / 2 * RED_CHUNK;
+    return red_combine(op, red_chunks(kernel, op, x, y, a, half),
+                       red_chunks(kernel, op, x + half, y ? y + half : NULL, a, n - half));
+}
+
+typedef struct {
+    RedKernel kernel;
+    LinalgRed op;
+    const Scalar *x;
+    const Scalar *y;
+    Scalar a;
+    size_t n;
+    // One result per chunk.
+    Scalar *partial;
+} RedCtx;
+
+static
+void
+red_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    RedCtx *c = ctx;
+    for (size_t k = begin; k < end; ++k) {
+        const size_t off = k * RED_CHUNK;
+        const size_t len = c->n - off < RED_CHUNK ? c->n - off : RED_CHUNK;
+        c->partial[k] = red_leaves(c->kernel, c->op, c->x + off, c->y ? c->y + off : NULL, c->a,
+                                   len);
+    }
+}
+
+// /red_chunks/, with the chunks split across /workers_global/ if /par/.
+static
+Scalar
+red_run(LinalgRed op, const Scalar *x, const Scalar *y, Scalar a, size_t n, bool par)
+{
+    const RedKernel kernel = red_kernels[linalg_isa()];
+    if (!par || n <= RED_CHUNK) {
+        return red_chunks(kernel, op, x, y, a, n);
+    }
+    const size_t nchunks = div_ceil(n, RED_CHUNK);
+    RedCtx c = {
+        .kernel = kernel,
+        .op = op,
+        .x = x, .y = y, .a = a, .n = n,
+        .partial = scratch_alloc(nchunks * sizeof(Scalar)),
+    };
+    workers_for(nchunks, div_ceil(PAR_MIN, RED_CHUNK), red_range, &c);
+    const Scalar r = red_fold(op, c.partial, nchunks);
+    scratch_free(c.partial, nchunks * sizeof(Scalar));
+    return r;
+}
+
+// Whether the sum of squares /ss/ can be trusted to give a norm: it did
+// not overflow, and is too large to have lost anything to underflow.
+static inline
+bool
+red_ss_ok(Scalar ss)
+{
+    return (ss >= DBL_MIN && ss <= DBL_MAX) || ss != ss;
+}
+
+// The scale that brings /amax/, the largest magnitude in a vector with
+// an untrustworthy sum of squares, near 1, as 2^-/*e/, so that scaling is
+// exact.
+static inline
+Scalar
+red_norm_scale(Scalar amax, int *e)
+{
+    *e = ilogb(amax);
+    // 2^1022 is the largest power of 2 that is finite, but even the
+    // smallest subnormal times it is a normal number.
+    if (*e < DBL_MIN_EXP - 1) {
+        *e = DBL_MIN_EXP - 1;
+    }
+    return ldexp(1, -*e);
+}
+
+static
+Scalar
+red_norm(const Scalar *x, size_t n, bool par)
+{
+    const Scalar ss = red_run(LINALG_RED_NORM, x, NULL, 1, n, par);
+    if (red_ss_ok(ss)) {
+        return sqrt(ss);
+    }
+    // Overflowed, or underflowed (or all zero): again, with every element
+    // scaled so that the largest is near 1.
+    Scalar amax = 0;
+    for (size_t i = 0; i < n; ++i) {
+        amax = fabs(x[i]) > amax ? fabs(x[i]) : amax;
+    }
+    if (amax == 0 || isinf(amax)) {
+        return amax;
+    }
+    int e;
+    const Scalar a = red_norm_scale(amax, &e);
+    return ldexp(sqrt(red_run(LINALG_RED_NORM, x, NULL, a, n, par)), e);
+}
+
+static
+Scalar
+red_one(LinalgRed op, const Scalar *x, const Scalar *y, size_t n, bool par)
+{
+    switch (op) {
+    case LINALG_RED_ANY:
+        return linalg_any(x, n);
+    case LINALG_RED_ALL:
+        return linalg_all(x, n);
+    case LINALG_RED_NORM:
+        return red_norm(x, n, par);
+    default:
+        return red_run(op, x, y, 1, n, par);
+    }
+}
+
+static inline
+uint_least64_t
+red_flops(LinalgRed op, size_t n)
+{
+    return op == LINALG_RED_DOT || op == LINALG_RED_NORM ? 2 * (uint_least64_t) n : n;
+}
+
+Scalar
+linalg_reduce(LinalgRed op, const Scalar *x, const Scalar *y, size_t n)
+{
+    STATS_ADD(flops, red_flops(op, n));
+    return red_one(op, x, y, n, true);
+}
+
+typedef struct {
+    LinalgRed op;
+    Scalar *z;
+    const Scalar *x;
+    const Scalar *y;
+    size_t m;
+    size_t n;
+    // For /linalg_reduce_cols/: the number of blocks of rows, each with its
+    // own row of /z/, and of RED_PANEL columns in each.
+    size_t nblocks;
+    size_t npanels;
+    RedKernel kernel;
+    RedColsKernel cols_kernel;
+    // For /linalg_cumsum_cols/: compensations, one per column.
+    Scalar *comp;
+} RedLinesCtx;
+
+static
+void
+red_rows_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    RedLinesCtx *c = ctx;
+    // What /red_one/ would do, without going through it for every row.
+    const bool direct = c->n <= RED_LEAF && c->op != LINALG_RED_NORM &&
+                        c->op != LINALG_RED_ANY && c->op != LINALG_RED_ALL;
+    for (size_t i = begin; i < end; ++i) {
+        const Scalar *x = c->x + i * c->n;
+        const Scalar *y = c->y ? c->y + i * c->n : NULL;
+        c->z[i] = direct ? red_leaves(c->kernel, c->op, x, y, 1, c->n)
+                         : red_one(c->op, x, y, c->n, false);
+    }
+}
+
+void
+linalg_reduce_rows(LinalgRed op, Scalar *z, const Scalar *x, const Scalar *y, unsigned m,
+                   unsigned n)
+{
+    if (m == 1) {
+        z[0] = linalg_reduce(op, x, y, n);
+        return;
+    }
+    STATS_ADD(flops, red_flops(op, (size_t) m * n));
+    RedLinesCtx c = {
+        .op = op,
+        .z = z, .x = x, .y = y, .m = m, .n = n,
+        .kernel = red_kernels[linalg_isa()],
+    };
+    workers_for(m, div_ceil(PAR_MIN, n ? n : 1), red_rows_range, &c);
+}
+
+// s[j] = /op/ over column j of x[h x w] (row stride /ld/), one column at
+// a time.
+static
+void
+red_cols_tail(LinalgRed op, Scalar *s, const Scalar *x, const Scalar *y, size_t ld, size_t h,
+              size_t w)
+{
+    const Scalar id = red_identity(op);
+    for (size_t j = 0; j < w; ++j) {
+        s[j] = id;
+    }
+    for (size_t i = 0; i < h; ++i) {
+        const Scalar *xi = x + i * ld;
+        switch (op) {
+        case LINALG_RED_SUM:
+            for (size_t j = 0; j < w; ++j) {
+                s[j] += xi[j];
+            }
+            break;
+        case LINALG_RED_DOT:
+            for (size_t j = 0; j < w; ++j) {
+                s[j] += xi[j] * y[i * ld + j];
+            }
+            break;
+        case LINALG_RED_NORM:
+            for (size_t j = 0; j < w; ++j) {
+                s[j] += xi[j] * xi[j];
+            }
+            break;
+        case LINALG_RED_PROD:
+            for (size_t j = 0; j < w; ++j) {
+                s[j] *= xi[j];
+            }
+            break;
+        default:
+            for (size_t j = 0; j < w; ++j) {
+                s[j] = red_combine(op, s[j], xi[j]);
+            }
+            break;
+        }
+    }
+}
+
+static
+void
+red_cols_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    RedLinesCtx *c = ctx;
+    for (size_t k = begin; k < end; ++k) {
+        const size_t i0 = k / c->npanels * RED_ROWS;
+        const size_t j0 = k % c->npanels * RED_PANEL;
+        const size_t off = i0 * c->n + j0;
+        Scalar *s = c->z + k / c->npanels * c->n + j0;
+        const Scalar *x = c->x + off;
+        const Scalar *y = c->y ? c->y + off : NULL;
+        const size_t h = c->m - i0 < RED_ROWS ? c->m - i0 : RED_ROWS;
+        const size_t w = c->n - j0 < RED_PANEL ? c->n - j0 : RED_PANEL;
+        const size_t done = c->cols_kernel(c->op, s, x, y, c->n, h, w);
+        red_cols_tail(c->op, s + done, x + done, y ? y + done : NULL, c->n, h, w - done);
+    }
+}
+
+// Folds rows [0, /k/) of p[k x n] into row 0, pairwise, as /red_fold/
+// would each column.
+static
+void
+red_fold_rows(LinalgRed op, Scalar *p, size_t k, size_t n)
+{
+    if (k == 1) {
+        return;
+    }
+    red_fold_rows(op, p, k / 2, n);
+    red_fold_rows(op, p + k / 2 * n, k - k / 2, n);
+    const Scalar *q = p + k / 2 * n;
+    for (size_t j = 0; j < n; ++j) {
+        p[j] = red_combine(op, p[j], q[j]);
+    }
+}
+
+void
+linalg_reduce_cols(LinalgRed op, Scalar *z, const Scalar *x, const Scalar *y, unsigned m,
+                   unsigned n)
+{
+    if (n == 1) {
+        z[0] = linalg_reduce(op, x, y, m);
+        return;
+    }
+    if (!m) {
+        const Scalar id = op == LINALG_RED_NORM ? 0 : red_identity(op);
+        for (size_t j = 0; j < n; ++j) {
+            z[j] = id;
+        }
+        return;
+    }
+    STATS_ADD(flops, red_flops(op, (size_t) m * n));
+    const size_t nblocks = div_ceil(m, RED_ROWS);
+    const size_t nbytes = nblocks * n * sizeof(Scalar);
+    RedLinesCtx c = {
+        .op = op,
+        .z = nblocks == 1 ? z : scratch_alloc(nbytes),
+        .x = x, .y = y, .m = m, .n = n,
+        .nblocks = nblocks,
+        .npanels = div_ceil(n, RED_PANEL),
+        .cols_kernel = red_cols_kernels[linalg_isa()],
+    };
+    const size_t leaf = (m < RED_ROWS ? m : RED_ROWS) * (n < RED_PANEL ? n : RED_PANEL);
+    workers_for(nblocks * c.npanels, div_ceil(PAR_MIN, leaf), red_cols_range, &c);
+    if (nblocks > 1) {
+        red_fold_rows(op, c.z, nblocks, n);
+        memcpy(z, c.z, n * sizeof(Scalar));
+        scratch_free(c.z, nbytes);
+    }
+    if (op != LINALG_RED_NORM) {
+        return;
+    }
+    for (size_t j = 0; j < n; ++j) {
+        if (red_ss_ok(z[j])) {
+            z[j] = sqrt(z[j]);
+            continue;
+        }
+        // As in /red_norm/, one column at a time: this is rare.
+        Scalar amax = 0;
+        for (size_t i = 0; i < m; ++i) {
+            amax = fabs(x[i * n + j]) > amax ? fabs(x[i * n + j]) : amax;
+        }
+        if (amax == 0 || isinf(amax)) {
+            z[j] = amax;
+            continue;
+        }
+        int e;
+        const Scalar a = red_norm_scale(amax, &e);
+        Scalar ss = 0;
+        for (size_t i = 0; i < m; ++i) {
+            const Scalar t = a * x[i * n + j];
+            ss += t * t;
+        }
+        z[j] = ldexp(sqrt(ss), e);
+    }
+}
+
+// Adds /v/ to the sum /*s/ with compensation /*c/. An infinite sum is left
+// uncompensated: the compensation would come out NaN.
+static inline
+void
+kahan_add(Scalar *s, Scalar *c, Scalar v)
+{
+    const Scalar y = v - *c;
+    const Scalar t = *s + y;
+    *c = isfinite(t) ? (t - *s) - y : 0;
+    *s = t;
+}
+
+typedef struct {
+    Scalar *z;
+    const Scalar *x;
+    size_t n;
+    // Per chunk: the total, then the compensated sum of the totals before
+    // it, and its compensation.
+    Scalar *total;
+    Scalar *start;
+    Scalar *comp;
+} CumsumCtx;
+
+static
+void
+cumsum_totals_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    CumsumCtx *c = ctx;
+    const RedKernel kernel = red_kernels[linalg_isa()];
+    for (size_t k = begin; k < end; ++k) {
+        const size_t off = k * RED_CHUNK;
+        const size_t len = c->n - off < RED_CHUNK ? c->n - off : RED_CHUNK;
+        c->total[k] = red_leaves(kernel, LINALG_RED_SUM, c->x + off, NULL, 1, len);
+    }
+}
+
+static
+void
+cumsum_scan(Scalar *z, const Scalar *x, size_t n, Scalar s, Scalar comp)
+{
+    for (size_t i = 0; i < n; ++i) {
+        kahan_add(&s, &comp, x[i]);
+        z[i] = s;
+    }
+}
+
+static
+void
+cumsum_scan_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    CumsumCtx *c = ctx;
+    for (size_t k = begin; k < end; ++k) {
+        const size_t off = k * RED_CHUNK;
+        const size_t len = c->n - off < RED_CHUNK ? c->n - off : RED_CHUNK;
+        cumsum_scan(c->z + off, c->x + off, len, c->start[k], c->comp[k]);
+    }
+}
+
+void
+linalg_cumsum(Scalar *z, const Scalar *x, size_t n)
+{
+    STATS_ADD(flops, n);
+    if (n <= RED_CHUNK) {
+        cumsum_scan(z, x, n, 0, 0);
+        return;
+    }
+    const size_t nchunks = div_ceil(n, RED_CHUNK);
+    const size_t nbytes = 3 * nchunks * sizeof(Scalar);
+    Scalar *bufs = scratch_alloc(nbytes);
+    CumsumCtx c = {
+        .z = z, .x = x, .n = n,
+        .total = bufs,
+        .start = bufs + nchunks,
+        .comp = bufs + 2 * nchunks,
+    };
+    const size_t grain = div_ceil(PAR_MIN, RED_CHUNK);
+    // The last chunk's total is never needed.
+    workers_for(nchunks - 1, grain, cumsum_totals_range, &c);
+    Scalar s = 0;
+    Scalar comp = 0;
+    for (size_t k = 0; k < nchunks; ++k) {
+        c.start[k] = s;
+        c.comp[k] = comp;
+        if (k + 1 < nchunks) {
+            kahan_add(&s, &comp, c.total[k]);
+        }
+    }
+    workers_for(nchunks, grain, cumsum_scan_range, &c);
+    scratch_free(bufs, nbytes);
+}
+
+static
+void
+cumsum_rows_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    RedLinesCtx *c = ctx;
+    for (size_t i = begin; i < end; ++i) {
+        cumsum_scan(c->z + i * c->n, c->x + i * c->n, c->n, 0, 0);
+    }
+}
+
+void
+linalg_cumsum_rows(Scalar *z, const Scalar *x, unsigned m, unsigned n)
+{
+    if (m == 1) {
+        linalg_cumsum(z, x, n);
+        return;
+    }
+    STATS_ADD(flops, (size_t) m * n);
+    RedLinesCtx c = {.z = z, .x = x, .m = m, .n = n};
+    workers_for(m, div_ceil(PAR_MIN, n ? n : 1), cumsum_rows_range, &c);
+}
+
+// Panels [/begin/, /end/) of RED_PANEL columns, top to bottom.
+static
+void
+cumsum_cols_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    RedLinesCtx *c = ctx;
+    const size_t j0 = begin * RED_PANEL;
+    const size_t j1 = end * RED_PANEL < c->n ? end * RED_PANEL : c->n;
+    Scalar *comp = c->comp;
+    for (size_t j = j0; j < j1; ++j) {
+        c->z[j] = c->x[j];
+        comp[j] = 0;
+    }
+    for (size_t i = 1; i < c->m; ++i) {
+        const Scalar *prev = c->z + (i - 1) * c->n;
+        Scalar *zi = c->z + i * c->n;
+        const Scalar *xi = c->x + i * c->n;
+        for (size_t j = j0; j < j1; ++j) {
+            Scalar s = prev[j];
+            kahan_add(&s, &comp[j], xi[j]);
+            zi[j] = s;
+        }
+    }
+}
+
+void
+linalg_cumsum_cols(Scalar *z, const Scalar *x, unsigned m, unsigned n)
+{
+    if (n == 1) {
+        linalg_cumsum(z, x, m);
+        return;
+    }
+    STATS_ADD(flops, (size_t) m * n);
+    RedLinesCtx c = {
+        .z = z, .x = x, .m = m, .n = n,
+        .comp = scratch_alloc(n * sizeof(Scalar)),
+    };
+    const size_t npanels = div_ceil(n, RED_PANEL);
+    workers_for(npanels, div_ceil(PAR_MIN, (size_t) m * RED_PANEL), cumsum_cols_range, &c);
+    scratch_free(c.comp, n * sizeof(Scalar));
+}
+
+// GEMM
+//
+// The classic Goto/BLIS scheme: /y/ is packed into KC x NR column panels,
+// /x/ into MC x KC blocks of MR-row panels, and an MR x NR register-tiled
+// micro-kernel multiplies a pair of panels. KC x NR of /y/ stays in L1,
+// MC x KC of /x/ in L2, KC x NC of /y/ in L3.
+//
+// Every path accumulates each element in the same order (k ascending
+// within a KC block, blocks added to the result in order), so the generic,
+// SSE2 and AVX2 paths give bit-identical results. The FMA path rounds once
+// per multiply-add instead of twice, and so may differ in the last place.
+
+enum {
+    GEMM_MR = 4,
+    GEMM_NR = 8,
+    GEMM_KC = 256,
+    GEMM_MC = 96,
+    GEMM_NC = 2048,
+    // Below this many multiply-adds, packing costs more than it saves.
+    GEMM_SMALL = 16 * 16 * 16,
+    // Below this many, so does waking up other threads.
+    GEMM_PAR_MIN = 64 * 64 * 64,
+};
+
+// c[MR x NR] (row stride /ldc/) += a[MR x kc] * b[kc x NR], with /a/ and
+// /b/ packed.
+typedef void (*GemmKernel)(size_t kc, const Scalar *a, const Scalar *b, Scalar *c, size_t ldc);
+
+static
+void
+kernel_generic(size_t kc, const Scalar *a, const Scalar *b, Scalar *c, size_t ldc)
+{
+    Scalar acc[GEMM_MR][GEMM_NR] = {{0}};
+    for (size_t k = 0; k < kc; ++k) {
+        for (unsigned i = 0; i < GEMM_MR; ++i) {
+            const Scalar aik = a[k * GEMM_MR + i];
+            for (unsigned j = 0; j < GEMM_NR; ++j) {
+                acc[i][j] += aik * b[k * GEMM_NR + j];
+            }
+        }
+    }
+    for (unsigned i = 0; i < GEMM_MR; ++i) {
+        for (unsigned j = 0; j < GEMM_NR; ++j) {
+            c[i * ldc + j] += acc[i][j];
+        }
+    }
+}
+
+#ifdef LINALG_X86
+
+__attribute__((target("sse2")))
+static
+void
+kernel_sse2(size_t kc, const Scalar *a, const Scalar *b, Scalar *c, size_t ldc)
+{
+    // 4 x 8 would take all 16 registers for accumulators; do it as two
+    // 4 x 4 halves instead.
+    for (unsigned h = 0; h < GEMM_NR; h += 4) {
+        __m128d c00 = _mm_setzero_pd(), c01 = _mm_setzero_pd();
+        __m128d c10 = _mm_setzero_pd(), c11 = _mm_setzero_pd();
+        __m128d c20 = _mm_setzero_pd(), c21 = _mm_setzero_pd();
+        __m128d c30 = _mm_setzero_pd(), c31 = _mm_setzero_pd();
+        for (size_t k = 0; k < kc; ++k) {
+            const __m128d b0 = _mm_loadu_pd(b + k * GEMM_NR + h);
+            const __m128d b1 = _mm_loadu_pd(b + k * GEMM_NR + h + 2);
+            const Scalar *ak = a + k * GEMM_MR;
+            __m128d ai;
+            ai = _mm_set1_pd(ak[0]);
+            c00 = _mm_add_pd(c00, _mm_mul_pd(ai, b0));
+            c01 = _mm_add_pd(c01, _mm_mul_pd(ai, b1));
+            ai = _mm_set1_pd(ak[1]);
+            c10 = _mm_add_pd(c10, _mm_mul_pd(ai, b0));
+            c11 = _mm_add_pd(c11, _mm_mul_pd(ai, b1));
+            ai = _mm_set1_pd(ak[2]);
+            c20 = _mm_add_pd(c20, _mm_mul_pd(ai, b0));
+            c21 = _mm_add_pd(c21, _mm_mul_pd(ai, b1));
+            ai = _mm_set1_pd(ak[3]);
+            c30 = _mm_add_pd(c30, _mm_mul_pd(ai, b0));
+            c31 = _mm_add_pd(c31, _mm_mul_pd(ai, b1));
+        }
+#define UPD(I_, J_, R_) \
+        _mm_storeu_pd(c + (I_) * ldc + h + (J_), \
+                      _mm_add_pd(_mm_loadu_pd(c + (I_) * ldc + h + (J_)), R_))
+        UPD(0, 0, c00); UPD(0, 2, c01);
+        UPD(1, 0, c10); UPD(1, 2, c11);
+        UPD(2, 0, c20); UPD(2, 2, c21);
+        UPD(3, 0, c30); UPD(3, 2, c31);
+#undef UPD
+    }
+}
+
+// Same body for AVX2 and FMA, differing only in how a multiply-add is done.
+#define KERNEL_AVX_BODY(MADD_) \
+    do { \
+        __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd(); \
+        __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd(); \
+        __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd(); \
+        __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd(); \
+        for (size_t k = 0; k < kc; ++k) { \
+            const __m256d b0 = _mm256_loadu_pd(b + k * GEMM_NR); \
+            const __m256d b1 = _mm256_loadu_pd(b + k * GEMM_NR + 4); \
+            const Scalar *ak = a + k * GEMM_MR; \
+            __m256d ai; \
+            ai = _mm256_broadcast_sd(ak + 0); \
+            c00 = MADD_(ai, b0, c00); c01 = MADD_(ai, b1, c01); \
+            ai = _mm256_broadcast_sd(ak + 1); \
+            c10 = MADD_(ai, b0, c10); c11 = MADD_(ai, b1, c11); \
+            ai = _mm256_broadcast_sd(ak + 2); \
+            c20 = MADD_(ai, b0, c20); c21 = MADD_(ai, b1, c21); \
+            ai = _mm256_broadcast_sd(ak + 3); \
+            c30 = MADD_(ai, b0, c30); c31 = MADD_(ai, b1, c31); \
+        } \
+        _mm256_storeu_pd(c + 0 * ldc,     _mm256_add_pd(_mm256_loadu_pd(c + 0 * ldc),     c00)); \
+        _mm256_storeu_pd(c + 0 * ldc + 4, _mm256_add_pd(_mm256_loadu_pd(c + 0 * ldc + 4), c01)); \
+        _mm256_storeu_pd(c + 1 * ldc,     _mm256_add_pd(_mm256_loadu_pd(c + 1 * ldc),     c10)); \
+        _mm256_storeu_pd(c + 1 * ldc + 4, _mm256_add_pd(_mm256_loadu_pd(c + 1 * ldc + 4), c11)); \
+        _mm256_storeu_pd(c + 2 * ldc,     _mm256_add_pd(_mm256_loadu_pd(c + 2 * ldc),     c20)); \
+        _mm256_storeu_pd(c + 2 * ldc + 4, _mm256_add_pd(_mm256_loadu_pd(c + 2 * ldc + 4), c21)); \
+        _mm256_storeu_pd(c + 3 * ldc,     _mm256_add_pd(_mm256_loadu_pd(c + 3 * ldc),     c30)); \
+        _mm256_storeu_pd(c + 3 * ldc + 4, _mm256_add_pd(_mm256_loadu_pd(c + 3 * ldc + 4), c31)); \
+    } while (0)
+
+#define MADD_AVX2(A_, B_, C_) _mm256_add_pd(C_, _mm256_mul_pd(A_, B_))
+#define MADD_FMA(A_, B_, C_)  _mm256_fmadd_pd(A_, B_, C_)
+
+__attribute__((target("avx2")))
+static
+void
+kernel_avx2(size_t kc, const Scalar *a, const Scalar *b, Scalar *c, size_t ldc)
+{
+    KERNEL_AVX_BODY(MADD_AVX2);
+}
+
+__attribute__((target("avx2,fma")))
+static
+void
+kernel_fma(size_t kc, const Scalar *a, const Scalar *b, Scalar *c, size_t ldc)
+{
+    KERNEL_AVX_BODY(MADD_FMA);
+}
+
+#undef MADD_FMA
+#undef MADD_AVX2
+#undef KERNEL_AVX_BODY
+
+#endif
+
+static const GemmKernel kernels[] = {
+    [LINALG_ISA_GENERIC] = kernel_generic,
+#ifdef LINALG_X86
+    [LINALG_ISA_SSE2]    = kernel_sse2,
+    [LINALG_ISA_AVX2]    = kernel_avx2,
+    [LINALG_ISA_FMA]     = kernel_fma,
+#endif
+};
+
+static LinalgIsa isa_supported = (LinalgIsa) -1;
+static LinalgIsa isa_current;
+
+LinalgIsa
+linalg_isa_supported(void)
+{
+    if (isa_supported == (LinalgIsa) -1) {
+        isa_supported = LINALG_ISA_GENERIC;
+#ifdef LINALG_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2")) {
+            isa_supported = LINALG_ISA_SSE2;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            isa_supported = LINALG_ISA_AVX2;
+            if (__builtin_cpu_supports("fma")) {
+                isa_supported = LINALG_ISA_FMA;
+            }
+        }
+#endif
+        isa_current = isa_supported;
+    }
+    return isa_supported;
+}
+
+LinalgIsa
+linalg_isa(void)
+{
+    (void) linalg_isa_supported();
+    return isa_current;
+}
+
+LinalgIsa
+linalg_set_isa(LinalgIsa isa)
+{
+    const LinalgIsa max = linalg_isa_supported();
+    return isa_current = isa > max ? max : isa;
+}
+
+const char *
+linalg_isa_name(LinalgIsa isa)
+{
+    switch (isa) {
+    case LINALG_ISA_GENERIC:
+        return "generic";
+    case LINALG_ISA_SSE2:
+        return "sse2";
+    case LINALG_ISA_AVX2:
+        return "avx2";
+    case LINALG_ISA_FMA:
+        return "fma";
+    }
+    UNREACHABLE();
+}
+
+// The operands of the packing routines are strided: element (i, j) of /x/
+// is x[i * rsx + j * csx], and likewise for /y/.
+
+static
+void
+pack_x(Scalar *dst, const Scalar *x, size_t rsx, size_t csx, size_t mc, size_t kc)
+{
+    for (size_t ir = 0; ir < mc; ir += GEMM_MR) {
+        const size_t mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+        for (size_t k = 0; k < kc; ++k) {
+            size_t i = 0;
+            for (; i < mr; ++i) {
+                *dst++ = x[(ir + i) * rsx + k * csx];
+            }
+            for (; i < GEMM_MR; ++i) {
+                *dst++ = 0;
+            }
+        }
+    }
+}
+
+static
+void
+pack_y(Scalar *dst, const Scalar *y, size_t rsy, size_t csy, size_t kc, size_t nc)
+{
+    for (size_t jr = 0; jr < nc; jr += GEMM_NR) {
+        const size_t nr = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+        for (size_t k = 0; k < kc; ++k) {
+            const Scalar *src = y + k * rsy + jr * csy;
+            size_t j = 0;
+            if (csy == 1) {
+                for (; j < nr; ++j) {
+                    *dst++ = src[j];
+                }
+            } else {
+                for (; j < nr; ++j) {
+                    *dst++ = src[j * csy];
+                }
+            }
+            for (; j < GEMM_NR; ++j) {
+                *dst++ = 0;
+            }
+        }
+    }
+}
+
+static
+void
+gemm_small(Scalar *z, size_t ldz, bool update, const Scalar *x, size_t rsx, size_t csx,
+           const Scalar *y, size_t rsy, size_t csy, unsigned m, unsigned n, unsigned p)
+{
+    for (unsigned i = 0; i < m; ++i) {
+        for (unsigned j = 0; j < p; ++j) {
+            Scalar elem = 0;
+            for (unsigned k = 0; k < n; ++k) {
+                elem += x[i * rsx + k * csx] * y[k * rsy + j * csy];
+            }
+            Scalar *dst = &z[i * ldz + j];
+            *dst = update ? *dst - elem : elem;
+        }
+    }
+}
+
+typedef struct {
+    GemmKernel kernel;
+    Scalar *z;
+    // Row stride of /z/; if /update/, the product is subtracted from /z/
+    // rather than stored in it.
+    size_t ldz;
+    bool update;
+    const Scalar *x;
+    const Scalar *y;
+    size_t rsx, csx, rsy, csy;
+    size_t m, n, p;
+    // Tiles of the result handed out to threads: /tm/ x /tn/, /nbj/ of them
+    // across.
+    size_t tm, tn, nbj;
+    // Per-thread packing buffers of /nx/ and /ny/ elements.
+    Scalar *px;
+    Scalar *py;
+    size_t nx, ny;
+} GemmCtx;
+
+static
+void
+gemm_tile(GemmCtx *g, size_t i0, size_t i1, size_t j0, size_t j1, Scalar *px, Scalar *py)
+{
+    const size_t n = g->n;
+    const size_t ldz = g->ldz;
+    Scalar *z = g->z;
+
+    if (!g->update) {
+        for (size_t i = i0; i < i1; ++i) {
+            memset(z + i * ldz + j0, 0, (j1 - j0) * sizeof(Scalar));
+        }
+    }
+
+    for (size_t jc = j0; jc < j1; jc += GEMM_NC) {
+        const size_t nc = j1 - jc < GEMM_NC ? j1 - jc : GEMM_NC;
+        for (size_t pc = 0; pc < n; pc += GEMM_KC) {
+            const size_t kc = n - pc < GEMM_KC ? n - pc : GEMM_KC;
+            pack_y(py, g->y + pc * g->rsy + jc * g->csy, g->rsy, g->csy, kc, nc);
+            for (size_t ic = i0; ic < i1; ic += GEMM_MC) {
+                const size_t mc = i1 - ic < GEMM_MC ? i1 - ic : GEMM_MC;
+                pack_x(px, g->x + ic * g->rsx + pc * g->csx, g->rsx, g->csx, mc, kc);
+                if (g->update) {
+                    // The kernels only add.
+                    for (size_t k = 0; k < round_up(mc, GEMM_MR) * kc; ++k) {
+                        px[k] = -px[k];
+                    }
+                }
+                for (size_t jr = 0; jr < nc; jr += GEMM_NR) {
+                    const size_t nr = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+                    for (size_t ir = 0; ir < mc; ir += GEMM_MR) {
+                        const size_t mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+                        const Scalar *pa = px + ir * kc;
+                        const Scalar *pb = py + jr * kc;
+                        Scalar *c = z + (ic + ir) * ldz + jc + jr;
+                        if (mr == GEMM_MR && nr == GEMM_NR) {
+                            g->kernel(kc, pa, pb, c, ldz);
+                        } else {
+                            // Edge tile: run the full kernel on a copy.
+                            Scalar tmp[GEMM_MR * GEMM_NR];
+                            for (size_t i = 0; i < GEMM_MR; ++i) {
+                                for (size_t j = 0; j < GEMM_NR; ++j) {
+                                    tmp[i * GEMM_NR + j] = i < mr && j < nr ? c[i * ldz + j] : 0;
+                                }
+                            }
+                            g->kernel(kc, pa, pb, tmp, GEMM_NR);
+                            for (size_t i = 0; i < mr; ++i) {
+                                for (size_t j = 0; j < nr; ++j) {
+                                    c[i * ldz + j] = tmp[i * GEMM_NR + j];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+static
+void
+gemm_tiles(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    GemmCtx *g = ctx;
+    for (size_t t = begin; t < end; ++t) {
+        const size_t i0 = t / g->nbj * g->tm;
+        const size_t j0 = t % g->nbj * g->tn;
+        const size_t i1 = g->m - i0 < g->tm ? g->m : i0 + g->tm;
+        const size_t j1 = g->p - j0 < g->tn ? g->p : j0 + g->tn;
+        gemm_tile(g, i0, i1, j0, j1, g->px + self * g->nx, g->py + self * g->ny);
+    }
+}
+
+// GEMV
+//
+// A product with a single row or column reads each element of the matrix
+// once, so it runs at memory speed and GEMM's packing is pure overhead.
+// Two kernels cover the shapes, by which way the matrix is contiguous: dot
+// products of its rows with the vector, several rows at a time sharing the
+// loads of the vector (rows transposed in registers so that each SIMD lane
+// is one row); or its rows scaled by the vector's elements and added up,
+// in strips of the result that stay in L1.
+//
+// Either way every element of the result is a single sum taken in k order,
+// as in /gemm_small/, so the generic, SSE2 and AVX2 paths give the same
+// bits, a transposed view gives the same bits as a transposed copy, and
+// splitting the rows or strips across threads changes nothing.
+
+enum {
+    // Columns of the result per strip in the axpy kernels (4 KiB).
+    GEMV_STRIP = 512,
+    // Rows per block of the dot kernels. Threads take whole blocks: the
+    // AVX2 and FMA kernels do the rows left over after their blocks of
+    // eight one at a time, which with FMA rounds differently.
+    GEMV_BLOCK = 8,
+};
+
+// out[r] = x[r * ldx + (0 .. n)] . v[0 .. n], for r < rows
+typedef void (*GemvDotKernel)(Scalar *out, const Scalar *x, size_t ldx, const Scalar *v, size_t n,
+                              size_t rows);
+
+// out[j] += a[k] * y[k * ldy + j] for k < n in order, for j < p
+typedef void (*GemvAxpyKernel)(Scalar *out, const Scalar *a, const Scalar *y, size_t ldy, size_t n,
+                               size_t p);
+
+static
+void
+gemv_dot_generic(Scalar *out, const Scalar *x, size_t ldx, const Scalar *v, size_t n, size_t rows)
+{
+    for (size_t r = 0; r < rows; ++r) {
+        const Scalar *xr = x + r * ldx;
+        Scalar s = 0;
+        for (size_t k = 0; k < n; ++k) {
+            s += xr[k] * v[k];
+        }
+        out[r] = s;
+    }
+}
+
+static
+void
+gemv_axpy_generic(Scalar *out, const Scalar *a, const Scalar *y, size_t ldy, size_t n, size_t p)
+{
+    for (size_t k = 0; k < n; ++k) {
+        const Scalar ak = a[k];
+        const Scalar *yk = y + k * ldy;
+        for (size_t j = 0; j < p; ++j) {
+            out[j] += ak * yk[j];
+        }
+    }
+}
+
+#ifdef LINALG_X86
+
+// Two rows at a time, in two pairs to have two chains of additions going.
+__attribute__((target("sse2")))
+static
+void
+gemv_dot_sse2(Scalar *out, const Scalar *x, size_t ldx, const Scalar *v, size_t n, size_t rows)
+{
+    const size_t n2 = n & ~(size_t) 1;
+    size_t r = 0;
+    for (; r + 4 <= rows; r += 4) {
+        const Scalar *x0 = x + r * ldx, *x1 = x0 + ldx, *x2 = x1 + ldx, *x3 = x2 + ldx;
+        __m128d s01 = _mm_setzero_pd(), s23 = _mm_setzero_pd();
+        for (size_t k = 0; k < n2; k += 2) {
+            const __m128d v0 = _mm_set1_pd(v[k]), v1 = _mm_set1_pd(v[k + 1]);
+            const __m128d a0 = _mm_loadu_pd(x0 + k), a1 = _mm_loadu_pd(x1 + k);
+            const __m128d a2 = _mm_loadu_pd(x2 + k), a3 = _mm_loadu_pd(x3 + k);
+            s01 = _mm_add_pd(s01, _mm_mul_pd(_mm_unpacklo_pd(a0, a1), v0));
+            s23 = _mm_add_pd(s23, _mm_mul_pd(_mm_unpacklo_pd(a2, a3), v0));
+            s01 = _mm_add_pd(s01, _mm_mul_pd(_mm_unpackhi_pd(a0, a1), v1));
+            s23 = _mm_add_pd(s23, _mm_mul_pd(_mm_unpackhi_pd(a2, a3), v1));
+        }
+        if (n2 < n) {
+            const __m128d vk = _mm_set1_pd(v[n2]);
+            s01 = _mm_add_pd(s01, _mm_mul_pd(_mm_set_pd(x1[n2], x0[n2]), vk));
+            s23 = _mm_add_pd(s23, _mm_mul_pd(_mm_set_pd(x3[n2], x2[n2]), vk));
+        }
+        _mm_storeu_pd(out + r, s01);
+        _mm_storeu_pd(out + r + 2, s23);
+    }
+    gemv_dot_generic(out + r, x + r * ldx, ldx, v, n, rows - r);
+}
+
+__attribute__((target("sse2")))
+static
+void
+gemv_axpy_sse2(Scalar *out, const Scalar *a, const Scalar *y, size_t ldy, size_t n, size_t p)
+{
+    const size_t p2 = p & ~(size_t) 1;
+    size_t k = 0;
+    // Four rows per pass over /out/.
+    for (; k + 4 <= n; k += 4) {
+        const Scalar *y0 = y + k * ldy, *y1 = y0 + ldy, *y2 = y1 + ldy, *y3 = y2 + ldy;
+        const __m128d a0 = _mm_set1_pd(a[k]), a1 = _mm_set1_pd(a[k + 1]);
+        const __m128d a2 = _mm_set1_pd(a[k + 2]), a3 = _mm_set1_pd(a[k + 3]);
+        for (size_t j = 0; j < p2; j += 2) {
+            __m128d o = _mm_loadu_pd(out + j);
+            o = _mm_add_pd(o, _mm_mul_pd(a0, _mm_loadu_pd(y0 + j)));
+            o = _mm_add_pd(o, _mm_mul_pd(a1, _mm_loadu_pd(y1 + j)));
+            o = _mm_add_pd(o, _mm_mul_pd(a2, _mm_loadu_pd(y2 + j)));
+            o = _mm_add_pd(o, _mm_mul_pd(a3, _mm_loadu_pd(y3 + j)));
+            _mm_storeu_pd(out + j, o);
+        }
+        if (p2 < p) {
+            out[p2] += a[k] * y0[p2];
+            out[p2] += a[k + 1] * y1[p2];
+            out[p2] += a[k + 2] * y2[p2];
+            out[p2] += a[k + 3] * y3[p2];
+        }
+    }
+    gemv_axpy_generic(out, a + k, y + k * ldy, ldy, n - k, p);
+}
+
+// Same bodies for AVX2 and FMA, differing only in how a multiply-add is
+// done. The dot kernel takes eight rows at a time, as two groups of four
+// transposed 4 x 4.
+#define GEMV_DOT_AVX_BODY(MADD_) \
+    do { \
+        const size_t n4 = n & ~(size_t) 3; \
+        size_t r = 0; \
+        for (; r + 8 <= rows; r += 8) { \
+            const Scalar *x0 = x + r * ldx; \
+            __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd(); \
+            for (size_t k = 0; k < n4; k += 4) { \
+                __m256d c00, c01, c02, c03, c10, c11, c12, c13; \
+                GEMV_TRANSPOSE4(c00, c01, c02, c03, x0 + k, ldx); \
+                GEMV_TRANSPOSE4(c10, c11, c12, c13, x0 + 4 * ldx + k, ldx); \
+                __m256d vk = _mm256_broadcast_sd(v + k); \
+                s0 = MADD_(c00, vk, s0); s1 = MADD_(c10, vk, s1); \
+                vk = _mm256_broadcast_sd(v + k + 1); \
+                s0 = MADD_(c01, vk, s0); s1 = MADD_(c11, vk, s1); \
+                vk = _mm256_broadcast_sd(v + k + 2); \
+                s0 = MADD_(c02, vk, s0); s1 = MADD_(c12, vk, s1); \
+                vk = _mm256_broadcast_sd(v + k + 3); \
+                s0 = MADD_(c03, vk, s0); s1 = MADD_(c13, vk, s1); \
+            } \
+            for (size_t k = n4; k < n; ++k) { \
+                const Scalar *xk = x0 + k; \
+                const __m256d vk = _mm256_broadcast_sd(v + k); \
+                s0 = MADD_(_mm256_set_pd(xk[3 * ldx], xk[2 * ldx], xk[ldx], xk[0]), vk, s0); \
+                xk += 4 * ldx; \
+                s1 = MADD_(_mm256_set_pd(xk[3 * ldx], xk[2 * ldx], xk[ldx], xk[0]), vk, s1); \
+            } \
+            _mm256_storeu_pd(out + r, s0); \
+            _mm256_storeu_pd(out + r + 4, s1); \
+        } \
+        for (; r < rows; ++r) { \
+            const Scalar *xr = x + r * ldx; \
+            Scalar s = 0; \
+            for (size_t k = 0; k < n; ++k) { \
+                s += xr[k] * v[k]; \
+            } \
+            out[r] = s; \
+        } \
+    } while (0)
+
+// C0_ .. C3_ = columns of the 4 x 4 block at P_ (row stride LD_).
+#define GEMV_TRANSPOSE4(C0_, C1_, C2_, C3_, P_, LD_) \
+    do { \
+        const __m256d r0_ = _mm256_loadu_pd((P_)); \
+        const __m256d r1_ = _mm256_loadu_pd((P_) + (LD_)); \
+        const __m256d r2_ = _mm256_loadu_pd((P_) + 2 * (LD_)); \
+        const __m256d r3_ = _mm256_loadu_pd((P_) + 3 * (LD_)); \
+        const __m256d t0_ = _mm256_unpacklo_pd(r0_, r1_); \
+        const __m256d t1_ = _mm256_unpackhi_pd(r0_, r1_); \
+        const __m256d t2_ = _mm256_unpacklo_pd(r2_, r3_); \
+        const __m256d t3_ = _mm256_unpackhi_pd(r2_, r3_); \
+        C0_ = _mm256_permute2f128_pd(t0_, t2_, 0x20); \
+        C1_ = _mm256_permute2f128_pd(t1_, t3_, 0x20); \
+        C2_ = _mm256_permute2f128_pd(t0_, t2_, 0x31); \
+        C3_ = _mm256_permute2f128_pd(t1_, t3_, 0x31); \
+    } while (0)
+
+#define GEMV_AXPY_AVX_BODY(MADD_) \
+    do { \
+        const size_t p4 = p & ~(size_t) 3; \
+        size_t k = 0; \
+        for (; k + 4 <= n; k += 4) { \
+            const Scalar *y0 = y + k * ldy, *y1 = y0 + ldy, *y2 = y1 + ldy, *y3 = y2 + ldy; \
+            const __m256d a0 = _mm256_broadcast_sd(a + k), a1 = _mm256_broadcast_sd(a + k + 1); \
+            const __m256d a2 = _mm256_broadcast_sd(a + k + 2), a3 = _mm256_broadcast_sd(a + k + 3); \
+            for (size_t j = 0; j < p4; j += 4) { \
+                __m256d o = _mm256_loadu_pd(out + j); \
+                o = MADD_(a0, _mm256_loadu_pd(y0 + j), o); \
+                o = MADD_(a1, _mm256_loadu_pd(y1 + j), o); \
+                o = MADD_(a2, _mm256_loadu_pd(y2 + j), o); \
+                o = MADD_(a3, _mm256_loadu_pd(y3 + j), o); \
+                _mm256_storeu_pd(out + j, o); \
+            } \
+            for (size_t j = p4; j < p; ++j) { \
+                out[j] += a[k] * y0[j]; \
+                out[j] += a[k + 1] * y1[j]; \
+                out[j] += a[k + 2] * y2[j]; \
+                out[j] += a[k + 3] * y3[j]; \
+            } \
+        } \
+        for (; k < n; ++k) { \
+            const Scalar *yk = y + k * ldy; \
+            const __m256d ak = _mm256_broadcast_sd(a + k); \
+            for (size_t j = 0; j < p4; j += 4) { \
+                _mm256_storeu_pd(out + j, MADD_(ak, _mm256_loadu_pd(yk + j), _mm256_loadu_pd(out + j))); \
+            } \
+            for (size_t j = p4; j < p; ++j) { \
+                out[j] += a[k] * yk[j]; \
+            } \
+        } \
+    } while (0)
+
+#define MADD_AVX2(A_, B_, C_) _mm256_add_pd(C_, _mm256_mul_pd(A_, B_))
+#define MADD_FMA(A_, B_, C_)  _mm256_fmadd_pd(A_, B_, C_)
+
+__attribute__((target("avx2")))
+static
+void
+gemv_dot_avx2(Scalar *out, const Scalar *x, size_t ldx, const Scalar *v, size_t n, size_t rows)
+{
+    GEMV_DOT_AVX_BODY(MADD_AVX2);
+}
+
+__attribute__((target("avx2,fma")))
+static
+void
+gemv_dot_fma(Scalar *out, const Scalar *x, size_t ldx, const Scalar *v, size_t n, size_t rows)
+{
+    GEMV_DOT_AVX_BODY(MADD_FMA);
+}
+
+__attribute__((target("avx2")))
+static
+void
+gemv_axpy_avx2(Scalar *out, const Scalar *a, const Scalar *y, size_t ldy, size_t n, size_t p)
+{
+    GEMV_AXPY_AVX_BODY(MADD_AVX2);
+}
+
+__attribute__((target("avx2,fma")))
+static
+void
+gemv_axpy_fma(Scalar *out, const Scalar *a, const Scalar *y, size_t ldy, size_t n, size_t p)
+{
+    GEMV_AXPY_AVX_BODY(MADD_FMA);
+}
+
+#undef MADD_FMA
+#undef MADD_AVX2
+#undef GEMV_AXPY_AVX_BODY
+#undef GEMV_TRANSPOSE4
+#undef GEMV_DOT_AVX_BODY
+
+#endif
+
+static const GemvDotKernel gemv_dot_kernels[] = {
+    [LINALG_ISA_GENERIC] = gemv_dot_generic,
+#ifdef LINALG_X86
+    [LINALG_ISA_SSE2]    = gemv_dot_sse2,
+    [LINALG_ISA_AVX2]    = gemv_dot_avx2,
+    [LINALG_ISA_FMA]     = gemv_dot_fma,
+#endif
+};
+
+static const GemvAxpyKernel gemv_axpy_kernels[] = {
+    [LINALG_ISA_GENERIC] = gemv_axpy_generic,
+#ifdef LINALG_X86
+    [LINALG_ISA_SSE2]    = gemv_axpy_sse2,
+    [LINALG_ISA_AVX2]    = gemv_axpy_avx2,
+    [LINALG_ISA_FMA]     = gemv_axpy_fma,
+#endif
+};
+
+typedef struct {
+    GemvDotKernel dot;
+    GemvAxpyKernel axpy;
+    Scalar *out;
+    // The matrix, with rows (for /dot/) or columns (for /axpy/) of the
+    // result /ld/ apart.
+    const Scalar *mat;
+    size_t ld;
+    const Scalar *vec;
+    size_t n;
+    size_t nout;
+} GemvCtx;
+
+// Blocks [/begin/, /end/) of GEMV_BLOCK elements of the result.
+static
+void
+gemv_dot_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    GemvCtx *c = ctx;
+    const size_t i0 = begin * GEMV_BLOCK;
+    const size_t i1 = end * GEMV_BLOCK < c->nout ? end * GEMV_BLOCK : c->nout;
+    c->dot(c->out + i0, c->mat + i0 * c->ld, c->ld, c->vec, c->n, i1 - i0);
+}
+
+// Strips [/begin/, /end/) of GEMV_STRIP elements of the result.
+static
+void
+gemv_axpy_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    GemvCtx *c = ctx;
+    const size_t j0 = begin * GEMV_STRIP;
+    const size_t j1 = end * GEMV_STRIP < c->nout ? end * GEMV_STRIP : c->nout;
+    memset(c->out + j0, 0, (j1 - j0) * sizeof(Scalar));
+    c->axpy(c->out + j0, c->vec, c->mat + j0, c->ld, c->n, j1 - j0);
+}
+
+// /gemm/ for p == 1 or m == 1, n > 0, provided the matrix operand is
+// contiguous along its rows or its columns; returns false, having done
+// nothing, otherwise.
+static
+bool
+gemv(Scalar *z, size_t ldz, bool update, const Scalar *x, size_t rsx, size_t csx,
+     const Scalar *y, size_t rsy, size_t csy, unsigned m, unsigned n, unsigned p)
+{
+    GemvCtx c = {.n = n};
+    bool dot;
+    size_t inc;
+    size_t incz;
+    if (p == 1) {
+        // z[m] = x[m x n] * y[n]
+        if (csx == 1) {
+            dot = true;
+            c.ld = rsx;
+        } else if (rsx == 1) {
+            dot = false;
+            c.ld = csx;
+        } else {
+            return false;
+        }
+        c.mat = x;
+        c.vec = y;
+        inc = rsy;
+        c.nout = m;
+        incz = ldz;
+    } else if (m == 1) {
+        // z[p] = x[n] * y[n x p]
+        if (rsy == 1) {
+            dot = true;
+            c.ld = csy;
+        } else if (csy == 1) {
+            dot = false;
+            c.ld = rsy;
+        } else {
+            return false;
+        }
+        c.mat = y;
+        c.vec = x;
+        inc = csx;
+        c.nout = p;
+        incz = 1;
+    } else {
+        return false;
+    }
+
+    // A strided vector is gathered first.
+    const size_t nvec = inc == 1 ? 0 : n;
+    Scalar *vec = NULL;
+    if (nvec) {
+        vec = scratch_alloc(nvec * sizeof(Scalar));
+        for (size_t k = 0; k < n; ++k) {
+            vec[k] = c.vec[k * inc];
+        }
+        c.vec = vec;
+    }
+    const size_t nout = update || incz != 1 ? c.nout : 0;
+    c.out = nout ? scratch_alloc(nout * sizeof(Scalar)) : z;
+
+    if (dot) {
+        c.dot = gemv_dot_kernels[linalg_isa()];
+        workers_for(div_ceil(c.nout, GEMV_BLOCK), div_ceil(PAR_MIN, (size_t) n * GEMV_BLOCK),
+                    gemv_dot_range, &c);
+    } else {
+        c.axpy = gemv_axpy_kernels[linalg_isa()];
+        workers_for(div_ceil(c.nout, GEMV_STRIP), div_ceil(PAR_MIN, (size_t) n * GEMV_STRIP),
+                    gemv_axpy_range, &c);
+    }
+
+    if (nout) {
+        for (size_t i = 0; i < nout; ++i) {
+            Scalar *dst = &z[i * incz];
+            *dst = update ? *dst - c.out[i] : c.out[i];
+        }
+        scratch_free(c.out, nout * sizeof(Scalar));
+    }
+    if (nvec) {
+        scratch_free(vec, nvec * sizeof(Scalar));
+    }
+    return true;
+}
+
+void
+linalg_gemm(Scalar *z, const Scalar *x, const Scalar *y, unsigned m, unsigned n, unsigned p)
+{
+    linalg_gemm_strided(z, x, n, 1, y, p, 1, m, n, p);
+}
+
+// z[m x p] (row stride /ldz/) = x[m x n] * y[n x p], or, if /update/,
+// z -= x * y. Counts no flops.
+static
+void
+gemm(Scalar *z, size_t ldz, bool update, const Scalar *x, size_t rsx, size_t csx,
+     const Scalar *y, size_t rsy, size_t csy, unsigned m, unsigned n, unsigned p)
+{
+    const uint_least64_t nmadds = (uint_least64_t) m * n * p;
+    if (!nmadds) {
+        if (!update) {
+            for (size_t i = 0; i < m; ++i) {
+                memset(z + i * ldz, 0, (size_t) p * sizeof(Scalar));
+            }
+        }
+        return;
+    }
+    if ((m == 1 || p == 1) && gemv(z, ldz, update, x, rsx, csx, y, rsy, csy, m, n, p)) {
+        return;
+    }
+    if (nmadds <= GEMM_SMALL) {
+        gemm_small(z, ldz, update, x, rsx, csx, y, rsy, csy, m, n, p);
+        return;
+    }
+
+    GemmCtx g = {
+        .kernel = kernels[linalg_isa()],
+        .z = z, .ldz = ldz, .update = update, .x = x, .y = y,
+        .rsx = rsx, .csx = csx, .rsy = rsy, .csy = csy,
+        .m = m, .n = n, .p = p,
+        .tm = m,
+        .tn = p,
+    };
+
+    // Cut the result into at least two tiles per thread: first by rows,
+    // which keeps the panels of /y/ long, then by columns if there are too
+    // few rows.
+    const unsigned nthreads = nmadds < GEMM_PAR_MIN ? 1 : workers_count();
+    if (nthreads > 1) {
+        const size_t want = 2 * (size_t) nthreads;
+        const size_t nbi = div_ceil(m, GEMM_MR) < want ? div_ceil(m, GEMM_MR) : want;
+        g.tm = round_up(div_ceil(m, nbi), GEMM_MR);
+        const size_t nbj = div_ceil(want, div_ceil(m, g.tm));
+        const size_t tn = round_up(div_ceil(p, nbj), GEMM_NR);
+        g.tn = tn < 8 * GEMM_NR ? 8 * GEMM_NR : tn;
+    }
+    g.nbj = div_ceil(p, g.tn);
+    const size_t ntiles = div_ceil(m, g.tm) * g.nbj;
+
+    g.nx = (size_t) GEMM_MC * GEMM_KC;
+    g.ny = (size_t) GEMM_KC * round_up(g.tn < GEMM_NC ? g.tn : GEMM_NC, GEMM_NR);
+    // Any thread may end up with any tile.
+    const unsigned nbufs = ntiles > 1 ? nthreads : 1;
+    g.px = scratch_alloc(nbufs * g.nx * sizeof(Scalar));
+    g.py = scratch_alloc(nbufs * g.ny * sizeof(Scalar));
+
+    workers_run(workers_global, ntiles, 1, gemm_tiles, &g);
+
+    scratch_free(g.py, nbufs * g.ny * sizeof(Scalar));
+    scratch_free(g.px, nbufs * g.nx * sizeof(Scalar));
+}
+
+void
+linalg_gemm_strided(Scalar *z, const Scalar *x, size_t rsx, size_t csx, const Scalar *y,
+                    size_t rsy, size_t csy, unsigned m, unsigned n, unsigned p)
+{
+    STATS_ADD(flops, 2 * (uint_least64_t) m * n * p);
+    gemm(z, p, false, x, rsx, csx, y, rsy, csy, m, n, p);
+}
+
+// Small matrices
+//
+// Elementwise operations are a switch into a run of statements, one per
+// element; products of square matrices are written out whole. Every
+// element of a product starts from 0 and adds the products in k order, as
+// /gemm_small/ and the GEMV kernels do, so the bits are the same.
+
+// Z_[i] = X_[i] OP_ Y_[i] for i < N_, N_ <= 16.
+#define SMALL_ELT(OP_, Z_, X_, Y_, N_) \
+    do { \
+        switch (N_) { \
+        case 16: Z_[15] = X_[15] OP_ Y_[15]; /* fallthrough */ \
+        case 15: Z_[14] = X_[14] OP_ Y_[14]; /* fallthrough */ \
+        case 14: Z_[13] = X_[13] OP_ Y_[13]; /* fallthrough */ \
+        case 13: Z_[12] = X_[12] OP_ Y_[12]; /* fallthrough */ \
+        case 12: Z_[11] = X_[11] OP_ Y_[11]; /* fallthrough */ \
+        case 11: Z_[10] = X_[10] OP_ Y_[10]; /* fallthrough */ \
+        case 10: Z_[9]  = X_[9]  OP_ Y_[9];  /* fallthrough */ \
+        case 9:  Z_[8]  = X_[8]  OP_ Y_[8];  /* fallthrough */ \
+        case 8:  Z_[7]  = X_[7]  OP_ Y_[7];  /* fallthrough */ \
+        case 7:  Z_[6]  = X_[6]  OP_ Y_[6];  /* fallthrough */ \
+        case 6:  Z_[5]  = X_[5]  OP_ Y_[5];  /* fallthrough */ \
+        case 5:  Z_[4]  = X_[4]  OP_ Y_[4];  /* fallthrough */ \
+        case 4:  Z_[3]  = X_[3]  OP_ Y_[3];  /* fallthrough */ \
+        case 3:  Z_[2]  = X_[2]  OP_ Y_[2];  /* fallthrough */ \
+        case 2:  Z_[1]  = X_[1]  OP_ Y_[1];  /* fallthrough */ \
+        case 1:  Z_[0]  = X_[0]  OP_ Y_[0];  /* fallthrough */ \
+        case 0:  break; \
+        default: UNREACHABLE(); \
+        } \
+    } while (0)
+
+void
+linalg_add_small(Scalar *z, const Scalar *x, const Scalar *y, unsigned n)
+{
+    STATS_ADD(flops, n);
+    SMALL_ELT(+, z, x, y, n);
+}
+
+void
+linalg_sub_small(Scalar *z, const Scalar *x, const Scalar *y, unsigned n)
+{
+    STATS_ADD(flops, n);
+    SMALL_ELT(-, z, x, y, n);
+}
+
+#undef SMALL_ELT
+
+// Element (I_, J_) of the product of two N_ x N_ matrices.
+#define SMALL_DOT2(I_, J_) \
+    z[(I_) * 2 + (J_)] = 0 + x[(I_) * 2] * y[(J_)] + x[(I_) * 2 + 1] * y[2 + (J_)]
+#define SMALL_DOT3(I_, J_) \
+    z[(I_) * 3 + (J_)] = 0 + x[(I_) * 3] * y[(J_)] + x[(I_) * 3 + 1] * y[3 + (J_)] + \
+                         x[(I_) * 3 + 2] * y[6 + (J_)]
+#define SMALL_DOT4(I_, J_) \
+    z[(I_) * 4 + (J_)] = 0 + x[(I_) * 4] * y[(J_)] + x[(I_) * 4 + 1] * y[4 + (J_)] + \
+                         x[(I_) * 4 + 2] * y[8 + (J_)] + x[(I_) * 4 + 3] * y[12 + (J_)]
+
+static
+void
+gemm2(Scalar *z, const Scalar *x, const Scalar *y)
+{
+    SMALL_DOT2(0, 0); SMALL_DOT2(0, 1);
+    SMALL_DOT2(1, 0); SMALL_DOT2(1, 1);
+}
+
+static
+void
+gemm3(Scalar *z, const Scalar *x, const Scalar *y)
+{
+    SMALL_DOT3(0, 0); SMALL_DOT3(0, 1); SMALL_DOT3(0, 2);
+    SMALL_DOT3(1, 0); SMALL_DOT3(1, 1); SMALL_DOT3(1, 2);
+    SMALL_DOT3(2, 0); SMALL_DOT3(2, 1); SMALL_DOT3(2, 2);
+}
+
+static
+void
+gemm4(Scalar *z, const Scalar *x, const Scalar *y)
+{
+    SMALL_DOT4(0, 0); SMALL_DOT4(0, 1); SMALL_DOT4(0, 2); SMALL_DOT4(0, 3);
+    SMALL_DOT4(1, 0); SMALL_DOT4(1, 1); SMALL_DOT4(1, 2); SMALL_DOT4(1, 3);
+    SMALL_DOT4(2, 0); SMALL_DOT4(2, 1); SMALL_DOT4(2, 2); SMALL_DOT4(2, 3);
+    SMALL_DOT4(3, 0); SMALL_DOT4(3, 1); SMALL_DOT4(3, 2); SMALL_DOT4(3, 3);
+}
+
+#undef SMALL_DOT4
+#undef SMALL_DOT3
+#undef SMALL_DOT2
+
+void
+linalg_gemm_small(Scalar *z, const Scalar *x, const Scalar *y, unsigned m, unsigned n, unsigned p)
+{
+    STATS_ADD(flops, 2 * (uint_least64_t) m * n * p);
+    if (m == n && n == p) {
+        switch (n) {
+        case 2:
+            gemm2(z, x, y);
+            return;
+        case 3:
+            gemm3(z, x, y);
+            return;
+        case 4:
+            gemm4(z, x, y);
+            return;
+        }
+    }
+    gemm_small(z, p, false, x, n, 1, y, p, 1, m, n, p);
+}
+
+void
+linalg_transpose_small(Scalar *y, const Scalar *x, size_t rsx, size_t csx, unsigned height,
+                       unsigned width)
+{
+    if (height == width && rsx == width && csx == 1) {
+        switch (width) {
+        case 2:
+            y[0] = x[0]; y[1] = x[2];
+            y[2] = x[1]; y[3] = x[3];
+            return;
+        case 3:
+            y[0] = x[0]; y[1] = x[3]; y[2] = x[6];
+            y[3] = x[1]; y[4] = x[4]; y[5] = x[7];
+            y[6] = x[2]; y[7] = x[5]; y[8] = x[8];
+            return;
+        case 4:
+            y[0]  = x[0]; y[1]  = x[4]; y[2]  = x[8];  y[3]  = x[12];
+            y[4]  = x[1]; y[5]  = x[5]; y[6]  = x[9];  y[7]  = x[13];
+            y[8]  = x[2]; y[9]  = x[6]; y[10] = x[10]; y[11] = x[14];
+            y[12] = x[3]; y[13] = x[7]; y[14] = x[11]; y[15] = x[15];
+            return;
+        }
+    }
+    for (size_t j = 0; j < width; ++j) {
+        for (size_t i = 0; i < height; ++i) {
+            *y++ = x[i * rsx + j * csx];
+        }
+    }
+}
+
+// Powers
+
+void
+linalg_pow(Scalar *z, const Scalar *x, unsigned n, uint_least64_t k, Scalar *work)
+{
+    const size_t nn = (size_t) n * n;
+    if (k == 0) {
+        memset(z, 0, nn * sizeof(Scalar));
+        for (size_t i = 0; i < n; ++i) {
+            z[i * n + i] = 1;
+        }
+        return;
+    }
+
+    // Left to right over the bits of /k/ below the top one: square, then
+    // multiply by /x/ if the bit is set. The products alternate between
+    // /z/ and /work/, starting with whichever makes the last one land in
+    // /z/.
+    unsigned top = 0;
+    unsigned nbits = 0;
+    for (unsigned i = 0; i < 64; ++i) {
+        if (k >> i & 1) {
+            top = i;
+            ++nbits;
+        }
+    }
+    const unsigned nprods = top + nbits - 1;
+    if (!nprods) {
+        memcpy(z, x, nn * sizeof(Scalar));
+        return;
+    }
+    Scalar *bufs[2] = {z, work};
+    const Scalar *cur = x;
+    unsigned done = 0;
+    for (unsigned bit = top; bit-- > 0; ) {
+        Scalar *dst = bufs[(nprods - 1 - done++) % 2];
+        linalg_gemm(dst, cur, cur, n, n, n);
+        cur = dst;
+        if (k >> bit & 1) {
+            dst = bufs[(nprods - 1 - done++) % 2];
+            linalg_gemm(dst, cur, x, n, n, n);
+            cur = dst;
+        }
+    }
+}
+
+// LU factorization
+//
+// Right-looking and blocked, as LAPACK's dgetrf: a panel of LU_BLOCK
+// columns is factored one column at a time with partial pivoting, the
+// matching rows of U are solved for, and their product with the panel is
+// subtracted from the trailing matrix by /gemm/. That update is where
+// nearly all the time of a large factorization goes, and it runs at the
+// speed, and on the threads, of a matrix product. Triangular solves with
+// many right-hand sides are blocked the same way.
+
+enum {
+    LU_BLOCK = 64,
+    // Panels this narrow are factored a column at a time.
+    LU_LEAF = 8,
+    // Steps of the condition estimator; it rarely needs more than two.
+    RCOND_MAXITER = 5,
+};
+
+// y[n] -= a * x[n]
+static inline
+void
+row_sub_scaled(Scalar *y, Scalar a, const Scalar *x, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        y[i] -= a * x[i];
+    }
+}
+
+static inline
+void
+swap_rows(Scalar *x, Scalar *y, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        const Scalar t = x[i];
+        x[i] = y[i];
+        y[i] = t;
+    }
+}
+
+// b[m x k] (row stride /ldb/) = L^-1 * b, with L the unit lower triangle of
+// l[m x m] (row stride /ldl/).
+static
+void
+trsm_lower_unit(const Scalar *l, size_t ldl, Scalar *b, size_t ldb, size_t m, size_t k)
+{
+    for (size_t i0 = 0; i0 < m; i0 += LU_BLOCK) {
+        const size_t i1 = m - i0 < LU_BLOCK ? m : i0 + LU_BLOCK;
+        // What the rows solved so far contribute, then the block itself.
+        gemm(b + i0 * ldb, ldb, true, l + i0 * ldl, ldl, 1, b, ldb, 1, i1 - i0, i0, k);
+        for (size_t i = i0 + 1; i < i1; ++i) {
+            for (size_t j = i0; j < i; ++j) {
+                if (l[i * ldl + j] != 0) {
+                    row_sub_scaled(b + i * ldb, l[i * ldl + j], b + j * ldb, k);
+                }
+            }
+        }
+    }
+}
+
+// b[m x k] (row stride /ldb/) = U^-1 * b, with U the upper triangle of
+// u[m x m] (row stride /ldu/).
+static
+void
+trsm_upper(const Scalar *u, size_t ldu, Scalar *b, size_t ldb, size_t m, size_t k)
+{
+    for (size_t i1 = m, i0; i1 > 0; i1 = i0) {
+        i0 = i1 > LU_BLOCK ? i1 - LU_BLOCK : 0;
+        gemm(b + i0 * ldb, ldb, true, u + i0 * ldu + i1, ldu, 1, b + i1 * ldb, ldb, 1, i1 - i0,
+             m - i1, k);
+        for (size_t i = i1; i-- > i0; ) {
+            for (size_t j = i + 1; j < i1; ++j) {
+                if (u[i * ldu + j] != 0) {
+                    row_sub_scaled(b + i * ldb, u[i * ldu + j], b + j * ldb, k);
+                }
+            }
+            const Scalar d = u[i * ldu + i];
+            for (size_t c = 0; c < k; ++c) {
+                b[i * ldb + c] /= d;
+            }
+        }
+    }
+}
+
+// Factors columns [j0, j1) of a[n x n], from row j0 down, swapping whole
+// rows; returns false if a pivot is zero. Recursively, halving the columns,
+// so that most of the work in a panel, too, is done by /gemm/.
+static
+bool
+lu_panel(Scalar *a, size_t n, size_t j0, size_t j1, unsigned *piv)
+{
+    if (j1 - j0 > LU_LEAF) {
+        const size_t mid = j0 + (j1 - j0) / 2;
+        const bool ok = lu_panel(a, n, j0, mid, piv);
+        trsm_lower_unit(a + j0 * n + j0, n, a + j0 * n + mid, n, mid - j0, j1 - mid);
+        gemm(a + mid * n + mid, n, true, a + mid * n + j0, n, 1, a + j0 * n + mid, n, 1,
+             n - mid, mid - j0, j1 - mid);
+        return lu_panel(a, n, mid, j1, piv) && ok;
+    }
+
+    bool ok = true;
+    for (size_t j = j0; j < j1; ++j) {
+        size_t p = j;
+        Scalar max = fabs(a[j * n + j]);
+        for (size_t i = j + 1; i < n; ++i) {
+            if (fabs(a[i * n + j]) > max) {
+                max = fabs(a[i * n + j]);
+                p = i;
+            }
+        }
+        piv[j] = p;
+        if (p != j) {
+            swap_rows(a + j * n, a + p * n, n);
+        }
+        const Scalar d = a[j * n + j];
+        if (d == 0) {
+            // The rest of the column is zero too: nothing to eliminate.
+            ok = false;
+            continue;
+        }
+        for (size_t i = j + 1; i < n; ++i) {
+            const Scalar l = a[i * n + j] /= d;
+            if (l != 0) {
+                row_sub_scaled(a + i * n + j + 1, l, a + j * n + j + 1, j1 - j - 1);
+            }
+        }
+    }
+    return ok;
+}
+
+static
+void
+lu_solve(const Scalar *lu, const unsigned *piv, size_t n, Scalar *b, size_t k)
+{
+    for (size_t i = 0; i < n; ++i) {
+        if (piv[i] != i) {
+            swap_rows(b + i * k, b + piv[i] * k, k);
+        }
+    }
+    trsm_lower_unit(lu, n, b, k, n, k);
+    trsm_upper(lu, n, b, k, n, k);
+}
+
+// b[n] = A^-T * b: A = P^T L U, so U^T L^T P b' = b.
+static
+void
+lu_solve_transposed(const Scalar *lu, const unsigned *piv, size_t n, Scalar *b)
+{
+    // Both by columns of the transposition, which are rows of /lu/.
+    for (size_t j = 0; j < n; ++j) {
+        b[j] /= lu[j * n + j];
+        for (size_t i = j + 1; i < n; ++i) {
+            b[i] -= lu[j * n + i] * b[j];
+        }
+    }
+    for (size_t j = n; j-- > 0; ) {
+        for (size_t i = 0; i < j; ++i) {
+            b[i] -= lu[j * n + i] * b[j];
+        }
+    }
+    for (size_t i = n; i-- > 0; ) {
+        const Scalar t = b[i];
+        b[i] = b[piv[i]];
+        b[piv[i]] = t;
+    }
+}
+
+// Largest sum of the magnitudes of a column of a[n x n].
+static
+Scalar
+norm1(const Scalar *a, size_t n)
+{
+    Scalar *sums = scratch_alloc(n * sizeof(Scalar));
+    memset(sums, 0, n * sizeof(Scalar));
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            sums[j] += fabs(a[i * n + j]);
+        }
+    }
+    Scalar r = 0;
+    for (size_t j = 0; j < n; ++j) {
+        // Not /fmax/: a NaN must come out.
+        r = sums[j] > r || sums[j] != sums[j] ? sums[j] : r;
+    }
+    scratch_free(sums, n * sizeof(Scalar));
+    return r;
+}
+
+// 1 / (||A||_1 ||A^-1||_1), A = P^T L U, by Hager's estimator (LAPACK's
+// dgecon does much the same): ||A^-1 x||_1 is convex in /x/, so its maximum
+// over the unit ball of the 1-norm is at some e_j; climb towards it from
+// the centre along the gradient, sign(A^-1 x)^T A^-1, for a few steps.
+static
+Scalar
+lu_rcond(const Scalar *lu, const unsigned *piv, size_t n, Scalar anorm)
+{
+    if (!n) {
+        return 1;
+    }
+    Scalar *x = scratch_alloc(2 * n * sizeof(Scalar));
+    Scalar *g = x + n;
+    for (size_t i = 0; i < n; ++i) {
+        x[i] = 1.0 / n;
+    }
+    Scalar est = 0;
+    size_t vertex = n;
+    for (unsigned iter = 0; iter < RCOND_MAXITER; ++iter) {
+        lu_solve(lu, piv, n, x, 1);
+        Scalar norm = 0;
+        for (size_t i = 0; i < n; ++i) {
+            norm += fabs(x[i]);
+        }
+        if (iter && !(norm > est)) {
+            break;
+        }
+        est = norm;
+        for (size_t i = 0; i < n; ++i) {
+            g[i] = x[i] < 0 ? -1 : 1;
+        }
+        lu_solve_transposed(lu, piv, n, g);
+        size_t j = 0;
+        for (size_t i = 1; i < n; ++i) {
+            if (fabs(g[i]) > fabs(g[j])) {
+                j = i;
+            }
+        }
+        if (j == vertex) {
+            break;
+        }
+        vertex = j;
+        memset(x, 0, n * sizeof(Scalar));
+        x[j] = 1;
+    }
+    scratch_free(x, 2 * n * sizeof(Scalar));
+    return 1 / (anorm * est);
+}
+
+bool
+linalg_lu(Scalar *a, unsigned n, unsigned *piv, Scalar *rcond)
+{
+    const Scalar anorm = rcond ? norm1(a, n) : 0;
+    STATS_ADD(flops, 2 * (uint_least64_t) n * n * n / 3);
+
+    bool ok = true;
+    for (size_t j0 = 0; j0 < n; j0 += LU_BLOCK) {
+        const size_t j1 = n - j0 < LU_BLOCK ? n : j0 + LU_BLOCK;
+        ok = lu_panel(a, n, j0, j1, piv) && ok;
+        if (j1 < n) {
+            trsm_lower_unit(a + j0 * n + j0, n, a + j0 * n + j1, n, j1 - j0, n - j1);
+            gemm(a + j1 * n + j1, n, true, a + j1 * n + j0, n, 1, a + j0 * n + j1, n, 1,
+                 n - j1, j1 - j0, n - j1);
+        }
+    }
+    if (rcond) {
+        *rcond = ok ? lu_rcond(a, piv, n, anorm) : 0;
+    }
+    return ok;
+}
+
+void
+linalg_lu_solve(const Scalar *lu, const unsigned *piv, unsigned n, Scalar *b, unsigned k)
+{
+    STATS_ADD(flops, 2 * (uint_least64_t) n * n * k);
+    lu_solve(lu, piv, n, b, k);
+}
+
+// Up to 4 x 4, determinants and inverses by cofactors: no pivoting, but
+// no factorization, scratch or loops either. Singularity is still judged by
+// the condition number, which at this size is cheap to get exactly.
+enum { SMALL_LU_MAX = 4 };
+
+// The 2 x 2 minors of rows 0 and 1 (s), and of rows 2 and 3 (c), of a
+// 4 x 4 /a/: s[0] is that of columns 0 and 1, then (0, 2), (0, 3), (1, 2),
+// (1, 3) and (2, 3); c runs the other way, c[5] being that of columns 0
+// and 1.
+static
+void
+minors4(Scalar *s, Scalar *c, const Scalar *a)
+{
+    s[0] = a[0] * a[5] - a[4] * a[1];
+    s[1] = a[0] * a[6] - a[4] * a[2];
+    s[2] = a[0] * a[7] - a[4] * a[3];
+    s[3] = a[1] * a[6] - a[5] * a[2];
+    s[4] = a[1] * a[7] - a[5] * a[3];
+    s[5] = a[2] * a[7] - a[6] * a[3];
+    c[5] = a[10] * a[15] - a[14] * a[11];
+    c[4] = a[9] * a[15] - a[13] * a[11];
+    c[3] = a[9] * a[14] - a[13] * a[10];
+    c[2] = a[8] * a[15] - a[12] * a[11];
+    c[1] = a[8] * a[14] - a[12] * a[10];
+    c[0] = a[8] * a[13] - a[12] * a[9];
+}
+
+static
+Scalar
+det_small(const Scalar *a, unsigned n)
+{
+    Scalar s[6], c[6];
+    switch (n) {
+    case 0:
+        return 1;
+    case 1:
+        return a[0];
+    case 2:
+        return a[0] * a[3] - a[1] * a[2];
+    case 3:
+        return a[0] * (a[4] * a[8] - a[5] * a[7]) - a[1] * (a[3] * a[8] - a[5] * a[6]) +
+               a[2] * (a[3] * a[7] - a[4] * a[6]);
+    case 4:
+        minors4(s, c, a);
+        return s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0];
+    }
+    UNREACHABLE();
+}
+
+// z = adjugate of a[n x n] over /det/.
+static
+void
+inv_small(Scalar *z, const Scalar *a, unsigned n, Scalar det)
+{
+    const Scalar r = 1 / det;
+    Scalar s[6], c[6];
+    switch (n) {
+    case 0:
+        break;
+    case 1:
+        z[0] = r;
+        break;
+    case 2:
+        z[0] = a[3] * r;  z[1] = -a[1] * r;
+        z[2] = -a[2] * r; z[3] = a[0] * r;
+        break;
+    case 3:
+        z[0] = (a[4] * a[8] - a[5] * a[7]) * r;
+        z[1] = (a[2] * a[7] - a[1] * a[8]) * r;
+        z[2] = (a[1] * a[5] - a[2] * a[4]) * r;
+        z[3] = (a[5] * a[6] - a[3] * a[8]) * r;
+        z[4] = (a[0] * a[8] - a[2] * a[6]) * r;
+        z[5] = (a[2] * a[3] - a[0] * a[5]) * r;
+        z[6] = (a[3] * a[7] - a[4] * a[6]) * r;
+        z[7] = (a[1] * a[6] - a[0] * a[7]) * r;
+        z[8] = (a[0] * a[4] - a[1] * a[3]) * r;
+        break;
+    case 4:
+        minors4(s, c, a);
+        z[0]  = ( a[5] * c[5] - a[6] * c[4] + a[7] * c[3]) * r;
+        z[1]  = (-a[1] * c[5] + a[2] * c[4] - a[3] * c[3]) * r;
+        z[2]  = ( a[13] * s[5] - a[14] * s[4] + a[15] * s[3]) * r;
+        z[3]  = (-a[9] * s[5] + a[10] * s[4] - a[11] * s[3]) * r;
+        z[4]  = (-a[4] * c[5] + a[6] * c[2] - a[7] * c[1]) * r;
+        z[5]  = ( a[0] * c[5] - a[2] * c[2] + a[3] * c[1]) * r;
+        z[6]  = (-a[12] * s[5] + a[14] * s[2] - a[15] * s[1]) * r;
+        z[7]  = ( a[8] * s[5] - a[10] * s[2] + a[11] * s[1]) * r;
+        z[8]  = ( a[4] * c[4] - a[5] * c[2] + a[7] * c[0]) * r;
+        z[9]  = (-a[0] * c[4] + a[1] * c[2] - a[3] * c[0]) * r;
+        z[10] = ( a[12] * s[4] - a[13] * s[2] + a[15] * s[0]) * r;
+        z[11] = (-a[8] * s[4] + a[9] * s[2] - a[11] * s[0]) * r;
+        z[12] = (-a[4] * c[3] + a[5] * c[1] - a[6] * c[0]) * r;
+        z[13] = ( a[0] * c[3] - a[1] * c[1] + a[2] * c[0]) * r;
+        z[14] = (-a[12] * s[3] + a[13] * s[1] - a[14] * s[0]) * r;
+        z[15] = ( a[8] * s[3] - a[9] * s[1] + a[10] * s[0]) * r;
+        break;
+    default:
+        UNREACHABLE();
+    }
+    // Not -0 for a zero cofactor.
+    for (size_t i = 0; i < (size_t) n * n; ++i) {
+        z[i] += 0;
+    }
+}
+
+// /norm1/ without the scratch buffer.
+static
+Scalar
+norm1_small(const Scalar *a, unsigned n)
+{
+    Scalar r = 0;
+    for (size_t j = 0; j < n; ++j) {
+        Scalar sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += fabs(a[i * n + j]);
+        }
+        r = sum > r || sum != sum ? sum : r;
+    }
+    return r;
+}
+
+Scalar
+linalg_det(const Scalar *x, unsigned n)
+{
+    if (n <= SMALL_LU_MAX) {
+        STATS_ADD(flops, 2 * (uint_least64_t) n * n * n / 3);
+        // Not -0 for a singular matrix.
+        return det_small(x, n) + 0;
+    }
+    const size_t nn = (size_t) n * n;
+    Scalar *a = scratch_alloc(nn * sizeof(Scalar));
+    unsigned *piv = scratch_alloc(n * sizeof(unsigned));
+    memcpy(a, x, nn * sizeof(Scalar));
+    linalg_lu(a, n, piv, NULL);
+    Scalar r = 1;
+    for (size_t i = 0; i < n; ++i) {
+        r *= piv[i] == i ? a[i * n + i] : -a[i * n + i];
+    }
+    // Not -0 for a singular matrix.
+    r += 0;
+    scratch_free(piv, n * sizeof(unsigned));
+    scratch_free(a, nn * sizeof(Scalar));
+    return r;
+}
+
+bool
+linalg_inv(Scalar *z, const Scalar *x, unsigned n)
+{
+    if (n <= SMALL_LU_MAX) {
+        STATS_ADD(flops, 8 * (uint_least64_t) n * n * n / 3);
+        const Scalar det = det_small(x, n);
+        if (det == 0) {
+            return false;
+        }
+        inv_small(z, x, n, det);
+        return 1 / (norm1_small(x, n) * norm1_small(z, n)) >= LINALG_RCOND_MIN;
+    }
+    const size_t nn = (size_t) n * n;
+    Scalar *a = scratch_alloc(nn * sizeof(Scalar));
+    unsigned *piv = scratch_alloc(n * sizeof(unsigned));
+    memcpy(a, x, nn * sizeof(Scalar));
+    Scalar rcond;
+    const bool ok = linalg_lu(a, n, piv, &rcond) && rcond >= LINALG_RCOND_MIN;
+    if (ok) {
+        memset(z, 0, nn * sizeof(Scalar));
+        for (size_t i = 0; i < n; ++i) {
+            z[i * n + i] = 1;
+        }
+        linalg_lu_solve(a, piv, n, z, n);
+    }
+    scratch_free(piv, n * sizeof(unsigned));
+    scratch_free(a, nn * sizeof(Scalar));
+    return ok;
+}
+
+// Cholesky, QR and symmetric eigenproblems
+//
+// Cholesky works on the row-major lower triangle directly, blocked like the
+// LU factorization. The rest is built on Householder reflectors, and works,
+// as LAPACK does, on column-major copies, where a reflector is a contiguous
+// column; moving the operands in and the results out is a transposition,
+// next to nothing beside the O(n^3) work. Reflectors are applied QR_BLOCK
+// at a time as I - V T V^T (the "compact WY" form), which is three products
+// by /gemm/. The reduction to tridiagonal form delays its updates the same
+// way (LAPACK's dsytrd), though half of its work remains products of the
+// trailing matrix by a vector.
+
+enum {
+    CHOL_BLOCK = 64,
+    QR_BLOCK = 32,
+    TRD_BLOCK = 32,
+    // Implicit QL steps allowed per eigenvalue before giving up.
+    EIG_MAXITER = 30,
+};
+
+// Counts no flops.
+static inline
+Scalar
+dot(const Scalar *x, const Scalar *y, size_t n)
+{
+    return red_run(LINALG_RED_DOT, x, y, 1, n, false);
+}
+
+// Column-major /gemm/: z[m x n] (leading dimension /ldz/) = op(x) * op(y),
+// op(x) being x[m x k], or its transposition if /tx/, and likewise for /y/.
+static
+void
+gemm_cm(Scalar *z, size_t ldz, bool update, const Scalar *x, size_t ldx, bool tx,
+        const Scalar *y, size_t ldy, bool ty, size_t m, size_t n, size_t k)
+{
+    // Row-major, that is z^T = op(y)^T * op(x)^T.
+    gemm(z, ldz, update, y, ty ? 1 : ldy, ty ? ldy : 1, x, tx ? 1 : ldx, tx ? ldx : 1, n, k, m);
+}
+
+bool
+linalg_chol(Scalar *a, unsigned n)
+{
+    STATS_ADD(flops, (uint_least64_t) n * n * n / 3);
+    for (size_t k0 = 0; k0 < n; k0 += CHOL_BLOCK) {
+        const size_t k1 = n - k0 < CHOL_BLOCK ? n : k0 + CHOL_BLOCK;
+        // The diagonal block, and then, with the same formula, L21 =
+        // A21 * L11^-T below it: columns left of /k0/ have already been
+        // subtracted.
+        for (size_t i = k0; i < n; ++i) {
+            Scalar *ai = a + i * n;
+            const size_t jend = i < k1 ? i : k1;
+            for (size_t j = k0; j < jend; ++j) {
+                const Scalar *aj = a + j * n;
+                ai[j] = (ai[j] - dot(ai + k0, aj + k0, j - k0)) / aj[j];
+            }
+            if (i < k1) {
+                const Scalar s = ai[i] - dot(ai + k0, ai + k0, i - k0);
+                if (!(s > 0)) {
+                    return false;
+                }
+                ai[i] = sqrt(s);
+            }
+        }
+        // The lower triangle of A22 -= L21 * L21^T, a band of rows at a
+        // time, each up to the diagonal.
+        for (size_t i0 = k1; i0 < n; i0 += CHOL_BLOCK) {
+            const size_t i1 = n - i0 < CHOL_BLOCK ? n : i0 + CHOL_BLOCK;
+            gemm(a + i0 * n + k1, n, true, a + i0 * n + k0, n, 1, a + k1 * n + k0, 1, n,
+                 i1 - i0, k1 - k0, i1 - k1);
+        }
+    }
+    for (size_t i = 0; i < n; ++i) {
+        memset(a + i * n + i + 1, 0, (n - i - 1) * sizeof(Scalar));
+    }
+    return true;
+}
+
+// Householder reflector I - tau v v^T, v[0] = 1, that maps x[n] to
+// beta e_0; /beta/ goes to x[0] and the rest of /v/ over the rest of /x/.
+// Returns /tau/, 0 if /x/ needs no reflecting.
+static
+Scalar
+house(Scalar *x, size_t n)
+{
+    const Scalar xnorm = n > 1 ? red_norm(x + 1, n - 1, false) : 0;
+    if (xnorm == 0) {
+        return 0;
+    }
+    const Scalar alpha = x[0];
+    const Scalar beta = -copysign(hypot(alpha, xnorm), alpha);
+    const Scalar s = 1 / (alpha - beta);
+    for (size_t i = 1; i < n; ++i) {
+        x[i] *= s;
+    }
+    x[0] = beta;
+    return (beta - alpha) / beta;
+}
+
+// c[m x n] (column-major, leading dimension /ldc/) = (I - tau v v^T) * c.
+static
+void
+house_apply(const Scalar *v, Scalar tau, Scalar *c, size_t ldc, size_t m, size_t n)
+{
+    if (tau == 0) {
+        return;
+    }
+    for (size_t j = 0; j < n; ++j) {
+        row_sub_scaled(c + j * ldc, tau * dot(v, c + j * ldc, m), v, m);
+    }
+}
+
+// For the /k/ reflectors stored below the diagonal of a[m x k] (column-major,
+// leading dimension /lda/) and their /tau/s, the V[m x k] (leading dimension
+// /m/) and upper triangular T[k x k] of H_0 H_1 ... H_(k-1) = I - V T V^T,
+// V with its ones and zeros written out (LAPACK's dlarft).
+static
+void
+block_reflector(Scalar *v, Scalar *t, const Scalar *a, size_t lda, const Scalar *tau, size_t m,
+                size_t k)
+{
+    for (size_t j = 0; j < k; ++j) {
+        Scalar *vj = v + j * m;
+        memset(vj, 0, j * sizeof(Scalar));
+        vj[j] = 1;
+        memcpy(vj + j + 1, a + j * lda + j + 1, (m - j - 1) * sizeof(Scalar));
+    }
+    for (size_t j = 0; j < k; ++j) {
+        Scalar *tj = t + j * k;
+        // T(0:j, j) = -tau_j * T(0:j, 0:j) * V(:, 0:j)^T * v_j
+        for (size_t i = 0; i < j; ++i) {
+            tj[i] = -tau[j] * dot(v + i * m + j, v + j * m + j, m - j);
+        }
+        for (size_t i = 0; i < j; ++i) {
+            Scalar s = 0;
+            for (size_t l = i; l < j; ++l) {
+                s += t[l * k + i] * tj[l];
+            }
+            tj[i] = s;
+        }
+        tj[j] = tau[j];
+        memset(tj + j + 1, 0, (k - j - 1) * sizeof(Scalar));
+    }
+}
+
+// c[m x n] (column-major, leading dimension /ldc/) = H * c, or H^T * c if
+// /trans/, with H = I - V T V^T from /block_reflector/.
+static
+void
+block_apply(const Scalar *v, const Scalar *t, bool trans, Scalar *c, size_t ldc, size_t m,
+            size_t n, size_t k)
+{
+    Scalar *w1 = scratch_alloc(2 * k * n * sizeof(Scalar));
+    Scalar *w2 = w1 + k * n;
+    gemm_cm(w1, k, false, v, m, true, c, ldc, false, k, n, m);
+    gemm_cm(w2, k, false, t, k, trans, w1, k, false, k, n, k);
+    gemm_cm(c, ldc, true, v, m, false, w2, k, false, m, n, k);
+    scratch_free(w1, 2 * k * n * sizeof(Scalar));
+}
+
+// Householder QR of a[m x n] (column-major, leading dimension /lda/), in
+// place, as LAPACK's dgeqrf: R on and above the diagonal, the reflectors
+// below it, and their min(m, n) /tau/s.
+static
+void
+qr_factor(Scalar *a, size_t lda, size_t m, size_t n, Scalar *tau)
+{
+    const size_t k = m < n ? m : n;
+    Scalar *v = scratch_alloc((m * QR_BLOCK + QR_BLOCK * QR_BLOCK) * sizeof(Scalar));
+    Scalar *t = v + m * QR_BLOCK;
+    for (size_t j = 0; j < k; j += QR_BLOCK) {
+        const size_t jb = k - j < QR_BLOCK ? k - j : QR_BLOCK;
+        // The panel, a reflector at a time; then the rest, all at once.
+        for (size_t i = j; i < j + jb; ++i) {
+            Scalar *col = a + i * lda + i;
+            tau[i] = house(col, m - i);
+            const Scalar beta = col[0];
+            col[0] = 1;
+            house_apply(col, tau[i], col + lda, lda, m - i, j + jb - i - 1);
+            col[0] = beta;
+        }
+        if (j + jb < n) {
+            block_reflector(v, t, a + j * lda + j, lda, tau + j, m - j, jb);
+            block_apply(v, t, true, a + (j + jb) * lda + j, lda, m - j, n - j - jb, jb);
+        }
+    }
+    scratch_free(v, (m * QR_BLOCK + QR_BLOCK * QR_BLOCK) * sizeof(Scalar));
+}
+
+// q[m x kq] (column-major, leading dimension /ldq/), kq >= k, = the first
+// /kq/ columns of H_0 H_1 ... H_(k-1), from the reflectors of /qr_factor/
+// (LAPACK's dorgqr).
+static
+void
+qr_form_q(Scalar *q, size_t ldq, size_t m, size_t kq, const Scalar *a, size_t lda,
+          const Scalar *tau, size_t k)
+{
+    for (size_t j = 0; j < kq; ++j) {
+        memset(q + j * ldq, 0, m * sizeof(Scalar));
+        q[j * ldq + j] = 1;
+    }
+    Scalar *v = scratch_alloc((m * QR_BLOCK + QR_BLOCK * QR_BLOCK) * sizeof(Scalar));
+    Scalar *t = v + m * QR_BLOCK;
+    // Last block first; the columns of /q/ left of a block are still those
+    // of the identity there, and stay so.
+    for (size_t j = div_ceil(k, QR_BLOCK) * QR_BLOCK; j > 0; ) {
+        j -= QR_BLOCK;
+        const size_t jb = k - j < QR_BLOCK ? k - j : QR_BLOCK;
+        block_reflector(v, t, a + j * lda + j, lda, tau + j, m - j, jb);
+        block_apply(v, t, false, q + j * ldq + j, ldq, m - j, kq - j, jb);
+    }
+    scratch_free(v, (m * QR_BLOCK + QR_BLOCK * QR_BLOCK) * sizeof(Scalar));
+}
+
+void
+linalg_qr(Scalar *q, Scalar *r, const Scalar *x, unsigned m, unsigned n)
+{
+    const size_t k = m < n ? m : n;
+    STATS_ADD(flops, 2 * (uint_least64_t) m * n * k - (uint_least64_t) (m + n) * k * k +
+                     2 * (uint_least64_t) k * k * k / 3);
+    const size_t mn = (size_t) m * n;
+    Scalar *a = scratch_alloc(mn * sizeof(Scalar));
+    Scalar *tau = scratch_alloc(k * sizeof(Scalar));
+    linalg_transpose(a, x, m, n);
+    qr_factor(a, m, m, n, tau);
+    if (r) {
+        for (size_t i = 0; i < k; ++i) {
+            for (size_t j = 0; j < n; ++j) {
+                r[i * n + j] = j >= i ? a[j * m + i] : 0;
+            }
+        }
+    }
+    if (q) {
+        STATS_ADD(flops, 2 * (uint_least64_t) m * k * k - 2 * (uint_least64_t) k * k * k / 3);
+        Scalar *qc = scratch_alloc(m * k * sizeof(Scalar));
+        qr_form_q(qc, m, m, k, a, m, tau, k);
+        linalg_transpose(q, qc, k, m);
+        scratch_free(qc, m * k * sizeof(Scalar));
+    }
+    scratch_free(tau, k * sizeof(Scalar));
+    scratch_free(a, mn * sizeof(Scalar));
+}
+
+bool
+linalg_lstsq(Scalar *z, const Scalar *x, const Scalar *b, unsigned m, unsigned n, unsigned k)
+{
+    STATS_ADD(flops, 2 * (uint_least64_t) m * n * n - 2 * (uint_least64_t) n * n * n / 3 +
+                     (4 * (uint_least64_t) m * n + (uint_least64_t) n * n) * k);
+    const size_t mn = (size_t) m * n;
+    const size_t mk = (size_t) m * k;
+    Scalar *a = scratch_alloc(mn * sizeof(Scalar));
+    Scalar *tau = scratch_alloc(n * sizeof(Scalar));
+    Scalar *c = scratch_alloc(mk * sizeof(Scalar));
+    Scalar *r = scratch_alloc((size_t) n * n * sizeof(Scalar));
+    linalg_transpose(a, x, m, n);
+    qr_factor(a, m, m, n, tau);
+
+    // Without pivoting, a rank-deficient /x/ still shows as a small
+    // diagonal element of R.
+    Scalar rmax = 0;
+    for (size_t i = 0; i < n; ++i) {
+        rmax = fabs(a[i * m + i]) > rmax ? fabs(a[i * m + i]) : rmax;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        ok = ok && fabs(a[i * m + i]) > rmax * m * DBL_EPSILON;
+    }
+
+    if (ok) {
+        // R * z = the first n rows of Q^T * b.
+        linalg_transpose(c, b, m, k);
+        Scalar *v = scratch_alloc((m * QR_BLOCK + QR_BLOCK * QR_BLOCK) * sizeof(Scalar));
+        Scalar *t = v + m * QR_BLOCK;
+        for (size_t j = 0; j < n; j += QR_BLOCK) {
+            const size_t jb = n - j < QR_BLOCK ? n - j : QR_BLOCK;
+            block_reflector(v, t, a + j * m + j, m, tau + j, m - j, jb);
+            block_apply(v, t, true, c + j, m, m - j, k, jb);
+        }
+        scratch_free(v, (m * QR_BLOCK + QR_BLOCK * QR_BLOCK) * sizeof(Scalar));
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < k; ++j) {
+                z[i * k + j] = c[j * m + i];
+            }
+            for (size_t j = i; j < n; ++j) {
+                r[i * n + j] = a[j * m + i];
+            }
+        }
+        trsm_upper(r, n, z, k, n, k);
+    }
+    scratch_free(r, (size_t) n * n * sizeof(Scalar));
+    scratch_free(c, mk * sizeof(Scalar));
+    scratch_free(tau, n * sizeof(Scalar));
+    scratch_free(a, mn * sizeof(Scalar));
+    return ok;
+}
+
+// Reduces columns [0, nb) of the symmetric a[m x m] (column-major, both
+// triangles, leading dimension /lda/) to tridiagonal form, leaving the rest
+// to be updated by A -= V W^T + W V^T, with V the reflectors below the
+// subdiagonal (their leading ones written out) and W[m x nb] (leading
+// dimension /ldw/) computed here; as LAPACK's dlatrd, whose steps the
+// comments follow.
+static
+void
+trd_panel(Scalar *a, size_t lda, size_t m, size_t nb, Scalar *e, Scalar *tau, Scalar *w,
+          size_t ldw)
+{
+    for (size_t i = 0; i < nb; ++i) {
+        Scalar *ai = a + i * lda;
+        Scalar *wi = w + i * ldw;
+        // A(i:m, i) -= V(i:m, 0:i) * W(i, 0:i)^T + W(i:m, 0:i) * V(i, 0:i)^T
+        for (size_t j = 0; j < i; ++j) {
+            row_sub_scaled(ai + i, w[j * ldw + i], a + j * lda + i, m - i);
+            row_sub_scaled(ai + i, a[j * lda + i], w + j * ldw + i, m - i);
+        }
+        const size_t len = m - i - 1;
+        tau[i] = house(ai + i + 1, len);
+        e[i] = ai[i + 1];
+        ai[i + 1] = 1;
+        const Scalar *v = ai + i + 1;
+        Scalar *wv = wi + i + 1;
+        // W(i+1:m, i) = A(i+1:m, i+1:m) * v, the columns of a symmetric
+        // matrix being its rows
+        for (size_t r = 0; r < len; ++r) {
+            wv[r] = dot(a + (i + 1 + r) * lda + i + 1, v, len);
+        }
+        // ... - V * (W^T * v) - W * (V^T * v), over the first /i/ columns
+        for (size_t j = 0; j < i; ++j) {
+            row_sub_scaled(wv, dot(w + j * ldw + i + 1, v, len), a + j * lda + i + 1, len);
+        }
+        for (size_t j = 0; j < i; ++j) {
+            row_sub_scaled(wv, dot(a + j * lda + i + 1, v, len), w + j * ldw + i + 1, len);
+        }
+        for (size_t r = 0; r < len; ++r) {
+            wv[r] *= tau[i];
+        }
+        row_sub_scaled(wv, 0.5 * tau[i] * dot(wv, v, len), v, len);
+    }
+}
+
+// The same, a rank-2 update at a time, for all the columns (LAPACK's
+// dsytd2); also stores the diagonal in d[m].
+static
+void
+trd_unblocked(Scalar *a, size_t lda, size_t m, Scalar *d, Scalar *e, Scalar *tau)
+{
+    Scalar *w = scratch_alloc(m * sizeof(Scalar));
+    for (size_t i = 0; i + 1 < m; ++i) {
+        Scalar *ai = a + i * lda;
+        const size_t len = m - i - 1;
+        tau[i] = house(ai + i + 1, len);
+        e[i] = ai[i + 1];
+        if (tau[i] != 0) {
+            ai[i + 1] = 1;
+            const Scalar *v = ai + i + 1;
+            for (size_t r = 0; r < len; ++r) {
+                w[r] = tau[i] * dot(a + (i + 1 + r) * lda + i + 1, v, len);
+            }
+            row_sub_scaled(w, 0.5 * tau[i] * dot(w, v, len), v, len);
+            for (size_t c = 0; c < len; ++c) {
+                Scalar *col = a + (i + 1 + c) * lda + i + 1;
+                row_sub_scaled(col, w[c], v, len);
+                row_sub_scaled(col, v[c], w, len);
+            }
+            ai[i + 1] = e[i];
+        }
+        d[i] = ai[i];
+    }
+    d[m - 1] = a[(m - 1) * lda + m - 1];
+    scratch_free(w, m * sizeof(Scalar));
+}
+
+// Q^T a Q = the tridiagonal matrix with diagonal d[n] and off-diagonal
+// e[n - 1], for the symmetric a[n x n] (column-major, both triangles),
+// n > 0; Q = H_0 ... H_(n-2), H_i having its reflector below the
+// subdiagonal of column /i/ of /a/ and its factor in tau[i]. Sets e[n-1]
+// to 0.
+static
+void
+trd(Scalar *a, size_t n, Scalar *d, Scalar *e, Scalar *tau)
+{
+    const size_t nb = TRD_BLOCK;
+    Scalar *w = scratch_alloc(n * nb * sizeof(Scalar));
+    size_t k = 0;
+    for (; n - k > 2 * nb; k += nb) {
+        const size_t m = n - k;
+        trd_panel(a + k * n + k, n, m, nb, e + k, tau + k, w, n);
+        Scalar *a22 = a + (k + nb) * n + k + nb;
+        const Scalar *v2 = a + k * n + k + nb;
+        gemm_cm(a22, n, true, v2, n, false, w + nb, n, true, m - nb, m - nb, nb);
+        gemm_cm(a22, n, true, w + nb, n, false, v2, n, true, m - nb, m - nb, nb);
+        for (size_t j = k; j < k + nb; ++j) {
+            a[j * n + j + 1] = e[j];
+            d[j] = a[j * n + j];
+        }
+    }
+    trd_unblocked(a + k * n + k, n, n - k, d + k, e + k, tau + k);
+    e[n - 1] = 0;
+    scratch_free(w, n * nb * sizeof(Scalar));
+}
+
+// Rotates columns /x/ and /y/: x' = c x - s y, y' = s x + c y.
+static inline
+void
+rotate(Scalar *x, Scalar *y, Scalar c, Scalar s, size_t n)
+{
+    for (size_t k = 0; k < n; ++k) {
+        const Scalar h = y[k];
+        y[k] = s * x[k] + c * h;
+        x[k] = c * x[k] - s * h;
+    }
+}
+
+// Eigenvalues, into d[n], of the symmetric tridiagonal matrix with
+// diagonal d[n] and off-diagonal e[n] (e[n-1] = 0, destroyed), by the
+// implicit QL method with Wilkinson shifts (EISPACK's tql2); and, if /z/
+// (n x n, column-major) is not NULL, the rotations applied to its columns.
+// Returns false if an eigenvalue takes more than EIG_MAXITER steps.
+static
+bool
+tql2(Scalar *d, Scalar *e, size_t n, Scalar *z)
+{
+    Scalar f = 0;
+    Scalar tst1 = 0;
+    for (size_t l = 0; l < n; ++l) {
+        const Scalar t = fabs(d[l]) + fabs(e[l]);
+        tst1 = t > tst1 ? t : tst1;
+        size_t m = l;
+        while (m + 1 < n && !(fabs(e[m]) <= DBL_EPSILON * tst1)) {
+            ++m;
+        }
+        unsigned iter = 0;
+        while (m > l && !(fabs(e[l]) <= DBL_EPSILON * tst1)) {
+            if (++iter > EIG_MAXITER) {
+                return false;
+            }
+            // Shift by the eigenvalue of the leading 2 x 2 closer to d[l].
+            const Scalar g = d[l];
+            Scalar p = (d[l + 1] - g) / (2 * e[l]);
+            const Scalar r = copysign(hypot(p, 1), p);
+            d[l] = e[l] / (p + r);
+            d[l + 1] = e[l] * (p + r);
+            const Scalar dl1 = d[l + 1];
+            const Scalar h = g - d[l];
+            for (size_t i = l + 2; i < n; ++i) {
+                d[i] -= h;
+            }
+            f += h;
+
+            // Chase the bulge up from /m/.
+            p = d[m];
+            Scalar c = 1, c2 = 1, c3 = 1;
+            Scalar s = 0, s2 = 0;
+            const Scalar el1 = e[l + 1];
+            for (size_t i = m; i-- > l; ) {
+                c3 = c2;
+                c2 = c;
+                s2 = s;
+                const Scalar gi = c * e[i];
+                const Scalar hi = c * p;
+                const Scalar ri = hypot(p, e[i]);
+                e[i + 1] = s * ri;
+                s = e[i] / ri;
+                c = p / ri;
+                p = c * d[i] - s * gi;
+                d[i + 1] = hi + s * (c * gi + s * d[i]);
+                if (z) {
+                    rotate(z + i * n, z + (i + 1) * n, c, s, n);
+                }
+            }
+            p = -s * s2 * c3 * el1 * e[l] / dl1;
+            e[l] = s * p;
+            d[l] = c * p;
+        }
+        d[l] += f;
+        e[l] = 0;
+    }
+    return true;
+}
+
+bool
+linalg_eig_sym(Scalar *w, Scalar *v, const Scalar *x, unsigned n)
+{
+    if (!n) {
+        return true;
+    }
+    const size_t nn = (size_t) n * n;
+    STATS_ADD(flops, 4 * (uint_least64_t) n * n * n / 3);
+    Scalar *a = scratch_alloc(nn * sizeof(Scalar));
+    Scalar *e = scratch_alloc(n * sizeof(Scalar));
+    Scalar *tau = scratch_alloc(n * sizeof(Scalar));
+    Scalar *z = v ? scratch_alloc(nn * sizeof(Scalar)) : NULL;
+    // Both triangles from the lower one of /x/ (the upper one of /a/, read
+    // as row-major).
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j <= i; ++j) {
+            a[i * n + j] = a[j * n + i] = x[i * n + j];
+        }
+    }
+    trd(a, n, w, e, tau);
+    if (z) {
+        // Q = 1 (+) the Q of a QR factorization whose reflectors are those
+        // below the subdiagonal.
+        STATS_ADD(flops, 4 * (uint_least64_t) n * n * n / 3);
+        memset(z, 0, n * sizeof(Scalar));
+        z[0] = 1;
+        for (size_t j = 1; j < n; ++j) {
+            z[j * n] = 0;
+        }
+        qr_form_q(z + n + 1, n, n - 1, n - 1, a + 1, n, tau, n - 1 ? n - 2 : 0);
+    }
+    const bool ok = tql2(w, e, n, z);
+    if (ok) {
+        // Ascending, by selection: O(n^2) either way.
+        for (size_t i = 0; i + 1 < n; ++i) {
+            size_t k = i;
+            for (size_t j = i + 1; j < n; ++j) {
+                k = w[j] < w[k] ? j : k;
+            }
+            if (k != i) {
+                const Scalar t = w[i];
+                w[i] = w[k];
+                w[k] = t;
+                if (z) {
+                    swap_rows(z + i * n, z + k * n, n);
+                }
+            }
+        }
+        if (z) {
+            linalg_transpose(v, z, n, n);
+        }
+    }
+    if (z) {
+        scratch_free(z, nn * sizeof(Scalar));
+    }
+    scratch_free(tau, n * sizeof(Scalar));
+    scratch_free(e, n * sizeof(Scalar));
+    scratch_free(a, nn * sizeof(Scalar));
+    return ok;
+}
+
+// Sparse matrices
+//
+// A CSR matrix times a dense one goes a row of the former at a time, each
+// nonzero scaling a row of the latter into a row of the result; on the
+// other side, each element of a row of the dense matrix scales a row of
+// the sparse one. Either way every element of the result is a sum taken in
+// one fixed order, and rows are split across threads by how many nonzeros
+// they hold on average, which is all the work there is.
+
+typedef struct {
+    Scalar *z;
+    const LinalgCsr *a;
+    const Scalar *x;
+    size_t p;
+} CsrCtx;
+
+// Rows [/begin/, /end/) of z = a * x.
+static
+void
+csr_mul_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    CsrCtx *c = ctx;
+    const LinalgCsr *a = c->a;
+    const size_t p = c->p;
+    for (size_t i = begin; i < end; ++i) {
+        if (p == 1) {
+            Scalar s = 0;
+            for (size_t k = a->row[i]; k < a->row[i + 1]; ++k) {
+                s += a->val[k] * c->x[a->col[k]];
+            }
+            c->z[i] = s;
+            continue;
+        }
+        Scalar *zi = c->z + i * p;
+        memset(zi, 0, p * sizeof(Scalar));
+        for (size_t k = a->row[i]; k < a->row[i + 1]; ++k) {
+            const Scalar v = a->val[k];
+            const Scalar *xk = c->x + a->col[k] * p;
+            for (size_t j = 0; j < p; ++j) {
+                zi[j] += v * xk[j];
+            }
+        }
+    }
+}
+
+// Counts no flops.
+static
+void
+csr_mul(Scalar *z, const LinalgCsr *a, const Scalar *x, unsigned p)
+{
+    CsrCtx c = {.z = z, .a = a, .x = x, .p = p};
+    const size_t nnz = a->row[a->height];
+    const size_t per_row = a->height ? nnz * p / a->height + 1 : 1;
+    workers_for(a->height, div_ceil(PAR_MIN, per_row), csr_mul_range, &c);
+}
+
+void
+linalg_csr_mul(Scalar *z, const LinalgCsr *a, const Scalar *x, unsigned p)
+{
+    STATS_ADD(flops, 2 * a->row[a->height] * p);
+    csr_mul(z, a, x, p);
+}
+
+// Rows [/begin/, /end/) of z[m x n] = x[m x k] * a[k x n]; /c->p/ is /k/.
+static
+void
+mul_csr_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    CsrCtx *c = ctx;
+    const LinalgCsr *a = c->a;
+    const size_t n = a->width;
+    for (size_t i = begin; i < end; ++i) {
+        Scalar *zi = c->z + i * n;
+        const Scalar *xi = c->x + i * c->p;
+        memset(zi, 0, n * sizeof(Scalar));
+        for (size_t k = 0; k < c->p; ++k) {
+            const Scalar u = xi[k];
+            for (size_t l = a->row[k]; l < a->row[k + 1]; ++l) {
+                zi[a->col[l]] += u * a->val[l];
+            }
+        }
+    }
+}
+
+void
+linalg_mul_csr(Scalar *z, const Scalar *x, unsigned m, const LinalgCsr *a)
+{
+    const size_t nnz = a->row[a->height];
+    STATS_ADD(flops, 2 * nnz * m);
+    CsrCtx c = {.z = z, .a = a, .x = x, .p = a->height};
+    workers_for(m, div_ceil(PAR_MIN, nnz + a->width + 1), mul_csr_range, &c);
+}
+
+unsigned
+linalg_csr_cg(Scalar *x, const LinalgCsr *a, const Scalar *b, Scalar tol, unsigned maxit)
+{
+    const size_t n = a->height;
+    const size_t nnz = a->row[n];
+    const size_t nbytes = 5 * n * sizeof(Scalar);
+    Scalar *buf = scratch_alloc(nbytes);
+    Scalar *dinv = buf;
+    Scalar *r = buf + n;
+    Scalar *z = buf + 2 * n;
+    Scalar *p = buf + 3 * n;
+    Scalar *q = buf + 4 * n;
+    unsigned it = maxit + 1;
+
+    for (size_t i = 0; i < n; ++i) {
+        const size_t k = linalg_csr_find(a, i, i);
+        if (k == SIZE_MAX || !(a->val[k] > 0)) {
+            goto done;
+        }
+        dinv[i] = 1 / a->val[k];
+    }
+    // r = b - a x, z = the preconditioned r, p = z.
+    csr_mul(q, a, x, 1);
+    for (size_t i = 0; i < n; ++i) {
+        r[i] = b[i] - q[i];
+        p[i] = z[i] = dinv[i] * r[i];
+    }
+    STATS_ADD(flops, 2 * nnz + 2 * n);
+    const Scalar bound = tol * linalg_reduce(LINALG_RED_NORM, b, NULL, n);
+    Scalar rz = linalg_reduce(LINALG_RED_DOT, r, z, n);
+
+    for (unsigned k = 0; k <= maxit; ++k) {
+        if (linalg_reduce(LINALG_RED_NORM, r, NULL, n) <= bound) {
+            it = k;
+            break;
+        }
+        if (k == maxit) {
+            break;
+        }
+        csr_mul(q, a, p, 1);
+        const Scalar pq = linalg_reduce(LINALG_RED_DOT, p, q, n);
+        if (!(pq > 0)) {
+            // Not positive definite (or NaNs all around).
+            break;
+        }
+        const Scalar alpha = rz / pq;
+        for (size_t i = 0; i < n; ++i) {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+            z[i] = dinv[i] * r[i];
+        }
+        const Scalar rz_next = linalg_reduce(LINALG_RED_DOT, r, z, n);
+        const Scalar beta = rz_next / rz;
+        rz = rz_next;
+        for (size_t i = 0; i < n; ++i) {
+            p[i] = z[i] + beta * p[i];
+        }
+        STATS_ADD(flops, 2 * nnz + 7 * n);
+    }
+
+done:
+    scratch_free(buf, nbytes);
+    return it;
+}
+
+// Transposition
+//
+// Out of place, the result is written in bands of TRANS_BAND rows, top to
+// bottom, each band left to right: a handful of sequential write streams,
+// which the hardware prefetcher follows, and one column of cache lines of
+// the source being read at a time, which stays in cache until the next
+// band has used the rest of each line. In place, square matrices are
+// transposed by swapping TRANS_TILE x TRANS_TILE tiles through a buffer in
+// L1. Either way the elements move in 4 x 4 blocks, in registers where the
+// CPU allows it.
+//
+// (A cache-oblivious recursive split, and wider bands, did worse: they
+// write short pieces of many rows at a time, and the write misses are what
+// dominate.)
+
+enum {
+    TRANS_BAND = 4,
+    TRANS_TILE = 32,
+};
+
+// trans_block_*: y[j * ldy + i] = x[i * ldx + j] for i, j < 4. They read
+// all of /x/ before writing /y/.
+
+static
+void
+trans_block_generic(Scalar *y, size_t ldy, const Scalar *x, size_t ldx)
+{
+    Scalar t[4][4];
+    for (unsigned i = 0; i < 4; ++i) {
+        for (unsigned j = 0; j < 4; ++j) {
+            t[j][i] = x[i * ldx + j];
+        }
+    }
+    for (unsigned j = 0; j < 4; ++j) {
+        for (unsigned i = 0; i < 4; ++i) {
+            y[j * ldy + i] = t[j][i];
+        }
+    }
+}
+
+#ifdef LINALG_X86
+
+__attribute__((target("sse2")))
+static
+void
+trans_block_sse2(Scalar *y, size_t ldy, const Scalar *x, size_t ldx)
+{
+    // Four 2 x 2 blocks, each an unpack pair.
+    __m128d r[4][2];
+    for (unsigned i = 0; i < 4; ++i) {
+        r[i][0] = _mm_loadu_pd(x + i * ldx);
+        r[i][1] = _mm_loadu_pd(x + i * ldx + 2);
+    }
+    for (unsigned bi = 0; bi < 4; bi += 2) {
+        for (unsigned bj = 0; bj < 2; ++bj) {
+            const __m128d a = r[bi][bj];
+            const __m128d b = r[bi + 1][bj];
+            _mm_storeu_pd(y + (2 * bj) * ldy + bi, _mm_unpacklo_pd(a, b));
+            _mm_storeu_pd(y + (2 * bj + 1) * ldy + bi, _mm_unpackhi_pd(a, b));
+        }
+    }
+}
+
+__attribute__((target("avx")))
+static
+void
+trans_block_avx(Scalar *y, size_t ldy, const Scalar *x, size_t ldx)
+{
+    const __m256d r0 = _mm256_loadu_pd(x);
+    const __m256d r1 = _mm256_loadu_pd(x + ldx);
+    const __m256d r2 = _mm256_loadu_pd(x + 2 * ldx);
+    const __m256d r3 = _mm256_loadu_pd(x + 3 * ldx);
+    // t0 = x00 x10 x02 x12, t1 = x01 x11 x03 x13, and so on.
+    const __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+    const __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+    const __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+    const __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+    // Stored in 16-byte halves: the elements of a matrix are only 16-byte
+    // aligned, and a 32-byte store that straddles a cache line costs more
+    // than two that do not.
+#define STORE_HALVES(P_, V_) \
+    do { \
+        const __m256d v_ = (V_); \
+        _mm_storeu_pd((P_),     _mm256_castpd256_pd128(v_)); \
+        _mm_storeu_pd((P_) + 2, _mm256_extractf128_pd(v_, 1)); \
+    } while (0)
+    STORE_HALVES(y,           _mm256_permute2f128_pd(t0, t2, 0x20));
+    STORE_HALVES(y + ldy,     _mm256_permute2f128_pd(t1, t3, 0x20));
+    STORE_HALVES(y + 2 * ldy, _mm256_permute2f128_pd(t0, t2, 0x31));
+    STORE_HALVES(y + 3 * ldy, _mm256_permute2f128_pd(t1, t3, 0x31));
+#undef STORE_HALVES
+}
+
+#endif
+
+// y[j * ldy + i] = x[i * ldx + j] for i < h, j < 4, with /h/ a multiple of
+// 4: one strip of 4 columns of /x/, a block at a time.
+typedef void (*TransStrip)(Scalar *y, size_t ldy, const Scalar *x, size_t ldx, size_t h);
+
+static
+void
+trans_strip_generic(Scalar *y, size_t ldy, const Scalar *x, size_t ldx, size_t h)
+{
+    for (size_t i = 0; i < h; i += 4) {
+        trans_block_generic(y + i, ldy, x + i * ldx, ldx);
+    }
+}
+
+#ifdef LINALG_X86
+
+__attribute__((target("sse2")))
+static
+void
+trans_strip_sse2(Scalar *y, size_t ldy, const Scalar *x, size_t ldx, size_t h)
+{
+    for (size_t i = 0; i < h; i += 4) {
+        trans_block_sse2(y + i, ldy, x + i * ldx, ldx);
+    }
+}
+
+__attribute__((target("avx")))
+static
+void
+trans_strip_avx(Scalar *y, size_t ldy, const Scalar *x, size_t ldx, size_t h)
+{
+    for (size_t i = 0; i < h; i += 4) {
+        trans_block_avx(y + i, ldy, x + i * ldx, ldx);
+    }
+}
+
+#endif
+
+static
+TransStrip
+trans_strip(void)
+{
+    switch (linalg_isa()) {
+#ifdef LINALG_X86
+    case LINALG_ISA_FMA:
+    case LINALG_ISA_AVX2:
+        return trans_strip_avx;
+    case LINALG_ISA_SSE2:
+        return trans_strip_sse2;
+#endif
+    default:
+        return trans_strip_generic;
+    }
+}
+
+// y[j * ldy + i] = x[i * ldx + j] for i < h, j < w.
+static
+void
+trans_tile(Scalar *y, size_t ldy, const Scalar *x, size_t ldx, size_t h, size_t w, TransStrip strip)
+{
+    const size_t h4 = h & ~(size_t) 3;
+    const size_t w4 = w & ~(size_t) 3;
+    for (size_t j = 0; j < w4; j += 4) {
+        strip(y + j * ldy, ldy, x + j, ldx, h4);
+    }
+    for (size_t i = 0; i < h; ++i) {
+        for (size_t j = i < h4 ? w4 : 0; j < w; ++j) {
+            y[j * ldy + i] = x[i * ldx + j];
+        }
+    }
+}
+
+typedef struct {
+    Scalar *y;
+    const Scalar *x;
+    size_t height;
+    size_t width;
+    TransStrip strip;
+} TransposeCtx;
+
+// Bands [/begin/, /end/) of the result.
+static
+void
+transpose_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    TransposeCtx *c = ctx;
+    for (size_t b = begin; b < end; ++b) {
+        const size_t i0 = b * TRANS_BAND;
+        const size_t nrows = c->width - i0 < TRANS_BAND ? c->width - i0 : TRANS_BAND;
+        trans_tile(c->y + i0 * c->height, c->height, c->x + i0, c->width, c->height, nrows, c->strip);
+    }
+}
+
+void
+linalg_transpose(Scalar *y, const Scalar *x, unsigned height, unsigned width)
+{
+    TransposeCtx c = {.y = y, .x = x, .height = height, .width = width, .strip = trans_strip()};
+    const size_t min = height ? div_ceil(PAR_MIN, (size_t) TRANS_BAND * height) : 1;
+    workers_for(div_ceil(width, TRANS_BAND), min, transpose_range, &c);
+}
+
+typedef struct {
+    Scalar *x;
+    size_t n;
+    TransStrip strip;
+} TransposeSquareCtx;
+
+// Tile rows [/begin/, /end/): swaps each of their tiles on or right of the
+// diagonal with its mirror image.
+static
+void
+transpose_square_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    TransposeSquareCtx *c = ctx;
+    const size_t n = c->n;
+    Scalar tmp[TRANS_TILE * TRANS_TILE];
+    for (size_t ti = begin; ti < end; ++ti) {
+        const size_t i0 = ti * TRANS_TILE;
+        const size_t h = n - i0 < TRANS_TILE ? n - i0 : TRANS_TILE;
+        for (size_t j0 = i0; j0 < n; j0 += TRANS_TILE) {
+            const size_t w = n - j0 < TRANS_TILE ? n - j0 : TRANS_TILE;
+            // a = x[i0.., j0..] (h x w), b = x[j0.., i0..] (w x h); a = b',
+            // b = a'. For a tile on the diagonal, a and b are the same.
+            Scalar *a = c->x + i0 * n + j0;
+            Scalar *b = c->x + j0 * n + i0;
+            for (size_t i = 0; i < h; ++i) {
+                memcpy(tmp + i * TRANS_TILE, a + i * n, w * sizeof(Scalar));
+            }
+            if (a != b) {
+                trans_tile(a, n, b, n, w, h, c->strip);
+            }
+            trans_tile(b, n, tmp, TRANS_TILE, h, w, c->strip);
+        }
+    }
+}
+
+void
+linalg_transpose_square(Scalar *x, unsigned n)
+{
+    TransposeSquareCtx c = {.x = x, .n = n, .strip = trans_strip()};
+    const size_t ntiles = div_ceil(n, TRANS_TILE);
+    const size_t min = n ? div_ceil(PAR_MIN, (size_t) TRANS_TILE * n) : 1;
+    workers_for(ntiles, min, transpose_square_range, &c);
+}
+
@@ -0,0 +1,317 @@
+#ifndef linalg_h_
+#define linalg_h_
+
+#include "common.h"
+#include "value.h"
+
+#include <float.h>
+
+// Raw kernels over row-major arrays of scalars. They know nothing about
+// /Matrix/ or /Value/, so that they can be benchmarked and replaced
+// independently of the interpreter.
+
+typedef enum {
+    LINALG_ELT_ADD,     // z = x + y
+    LINALG_ELT_SUB,     // z = x - y
+    LINALG_ELT_NEG,     // z = -x
+    LINALG_ELT_SCALE,   // z = a * x
+} LinalgElt;
+
+enum {
+    // Elementwise results of at least this many elements are written with
+    // non-temporal stores: they would not stay in cache anyway, and going
+    // around it saves reading each line of the destination before writing
+    // it.
+    LINALG_STREAM_MIN = 1 << 20,
+};
+
+// One of the above on n elements, on the calling thread and not counted in
+// /stats/, for callers that split and count the work themselves; /y/ is
+// only read by ADD and SUB, /a/ only by SCALE. /stream/ asks for
+// non-temporal stores, and only pays off if the whole result is large.
+void
+linalg_elt(LinalgElt op, Scalar *z, const Scalar *x, const Scalar *y, Scalar a, size_t n,
+           bool stream);
+
+void
+linalg_add(Scalar *z, const Scalar *x, const Scalar *y, size_t n);
+
+void
+linalg_sub(Scalar *z, const Scalar *x, const Scalar *y, size_t n);
+
+void
+linalg_neg(Scalar *z, const Scalar *x, size_t n);
+
+void
+linalg_scale(Scalar *z, Scalar a, const Scalar *x, size_t n);
+
+typedef enum {
+    LINALG_FN_SIN,
+    LINALG_FN_COS,
+    LINALG_FN_TAN,
+    LINALG_FN_ASIN,
+    LINALG_FN_ACOS,
+    LINALG_FN_ATAN,
+    LINALG_FN_EXP,
+    LINALG_FN_LOG,
+    LINALG_FN_FLOOR,
+    LINALG_FN_TRUNC,
+    LINALG_FN_CEIL,
+    LINALG_FN_ROUND,
+} LinalgFn;
+
+// z[i] = fn(x[i]) for i < n; /z/ may be /x/. With LINALG_ISA_FMA, exp,
+// log, sin and cos are computed by polynomial approximations, with errors
+// under 1 unit in the last place for exp and log, and under 1.5 for sin
+// and cos (as measured by bench_linalg against long double; libm's are
+// within 0.52). Everything else gives exactly what libm does.
+void
+linalg_map(LinalgFn fn, Scalar *z, const Scalar *x, size_t n);
+
+typedef enum {
+    LINALG_RED_SUM,
+    LINALG_RED_PROD,
+    LINALG_RED_MIN,
+    LINALG_RED_MAX,
+    LINALG_RED_DOT,     // sum of x[i] * y[i]
+    LINALG_RED_NORM,    // square root of the sum of x[i]^2
+    LINALG_RED_ANY,     // 1 if any x[i] is nonzero, else 0
+    LINALG_RED_ALL,     // 1 if every x[i] is nonzero, else 0
+} LinalgRed;
+
+// /op/ over x[n] (and y[n], only read by DOT). Sums and products are taken
+// pairwise, so that rounding errors grow with log n rather than n; the
+// norm does not overflow or underflow unless the result does; MIN and MAX
+// are NaN if any element is. An empty /x/ gives 0, 1, +inf, -inf, 0, 0, 0
+// and 1 respectively. Large inputs are split across /workers_global/ in
+// pieces that do not depend on the number of threads, so neither does the
+// result.
+Scalar
+linalg_reduce(LinalgRed op, const Scalar *x, const Scalar *y, size_t n);
+
+// z[i] = /op/ over row i of x[m x n] (and y[m x n]), for i < m; each the
+// same as /linalg_reduce/ on that row alone.
+void
+linalg_reduce_rows(LinalgRed op, Scalar *z, const Scalar *x, const Scalar *y, unsigned m,
+                   unsigned n);
+
+// z[j] = /op/ over column j of x[m x n] (and y[m x n]), for j < n, just as
+// accurate, and also independent of the number of threads.
+void
+linalg_reduce_cols(LinalgRed op, Scalar *z, const Scalar *x, const Scalar *y, unsigned m,
+                   unsigned n);
+
+// z[i] = x[0] + ... + x[i] for i < n, with compensated (Kahan) summation;
+// /z/ may be /x/. Split across threads like /linalg_reduce/, with the same
+// guarantee.
+void
+linalg_cumsum(Scalar *z, const Scalar *x, size_t n);
+
+// The same along each row, or down each column, of x[m x n].
+void
+linalg_cumsum_rows(Scalar *z, const Scalar *x, unsigned m, unsigned n);
+
+void
+linalg_cumsum_cols(Scalar *z, const Scalar *x, unsigned m, unsigned n);
+
+// Instruction set used by the kernels that are dispatched at run time.
+typedef enum {
+    LINALG_ISA_GENERIC,
+    LINALG_ISA_SSE2,
+    LINALG_ISA_AVX2,
+    LINALG_ISA_FMA,
+} LinalgIsa;
+
+// The best instruction set the CPU supports.
+LinalgIsa
+linalg_isa_supported(void);
+
+// The instruction set in use; defaults to /linalg_isa_supported()/.
+LinalgIsa
+linalg_isa(void);
+
+// Selects an instruction set, clamped to what is supported; returns the
+// one selected.
+LinalgIsa
+linalg_set_isa(LinalgIsa isa);
+
+const char *
+linalg_isa_name(LinalgIsa isa);
+
+// z[m x p] = x[m x n] * y[n x p]
+void
+linalg_gemm(Scalar *z, const Scalar *x, const Scalar *y, unsigned m, unsigned n, unsigned p);
+
+// The same, with element (i, j) of /x/ at x[i * rsx + j * csx] and that of
+// /y/ at y[i * rsy + j * csy]; a transposed operand costs nothing extra, as
+// it only changes the order in which the packing step reads it.
+void
+linalg_gemm_strided(Scalar *z, const Scalar *x, size_t rsx, size_t csx, const Scalar *y,
+                    size_t rsy, size_t csy, unsigned m, unsigned n, unsigned p);
+
+// Kernels for matrices of at most LINALG_SMALL elements (4 x 4 and under,
+// as used for geometry and linear recurrences), where the dispatch,
+// threading and blocking of the general ones cost more than the arithmetic.
+// Square 2 x 2, 3 x 3 and 4 x 4 operands get fully unrolled code. Operands
+// are packed, and results are the same bits as from the general kernels.
+#define LINALG_SMALL 16
+
+INHEADER
+bool
+linalg_is_small(unsigned height, unsigned width)
+{
+    return (size_t) height * width <= LINALG_SMALL;
+}
+
+// z[n] = x[n] + y[n], n <= LINALG_SMALL
+void
+linalg_add_small(Scalar *z, const Scalar *x, const Scalar *y, unsigned n);
+
+// z[n] = x[n] - y[n], n <= LINALG_SMALL
+void
+linalg_sub_small(Scalar *z, const Scalar *x, const Scalar *y, unsigned n);
+
+// z[m x p] = x[m x n] * y[n x p], all three small; /z/ must not overlap
+// /x/ or /y/.
+void
+linalg_gemm_small(Scalar *z, const Scalar *x, const Scalar *y, unsigned m, unsigned n, unsigned p);
+
+// y[width x height] = transposition of x[height x width], small, with
+// element (i, j) of /x/ at x[i * rsx + j * csx].
+void
+linalg_transpose_small(Scalar *y, const Scalar *x, size_t rsx, size_t csx, unsigned height,
+                       unsigned width);
+
+// z[n x n] = x[n x n] ^ k by binary exponentiation, with /work/ (n x n)
+// as the only other buffer, whatever /k/ is; /z/ and /work/ must not
+// overlap /x/.
+void
+linalg_pow(Scalar *z, const Scalar *x, unsigned n, uint_least64_t k, Scalar *work);
+
+// Factors a[n x n] in place into P * a = L * U by blocked elimination with
+// partial pivoting: /a/ ends up holding U on and above its diagonal and L,
+// whose diagonal is all ones, below it. Step i swapped rows i and piv[i].
+// Returns false if a pivot is zero, in which case /a/ is still a valid
+// factorization, but U is singular. If /rcond/ is not NULL, stores in it
+// an estimate (within a small factor, and 0 if singular) of the reciprocal
+// of the condition number of /a/ in the 1-norm.
+bool
+linalg_lu(Scalar *a, unsigned n, unsigned *piv, Scalar *rcond);
+
+// Below this /rcond/, a matrix is singular to working precision: solving
+// with it leaves no significant digit of the solution.
+#define LINALG_RCOND_MIN DBL_EPSILON
+
+// b[n x k] = A^-1 * b, with /lu/ and /piv/ the factorization of A by
+// /linalg_lu/, which must have returned true.
+void
+linalg_lu_solve(const Scalar *lu, const unsigned *piv, unsigned n, Scalar *b, unsigned k);
+
+// Determinant of x[n x n], from its LU factorization, or by cofactors for
+// n <= 4.
+Scalar
+linalg_det(const Scalar *x, unsigned n);
+
+// z[n x n] = inverse of x[n x n]; returns false, leaving /z/ unspecified,
+// if /x/ is singular to working precision. For n <= 4, the adjugate over
+// the determinant, with the exact condition number in place of the
+// estimate.
+bool
+linalg_inv(Scalar *z, const Scalar *x, unsigned n);
+
+// Factors the symmetric positive definite a[n x n] into L * L^T, reading
+// only its lower triangle, and replaces it with L (zeros above the
+// diagonal). Returns false, leaving /a/ unspecified, if /a/ is not positive
+// definite.
+bool
+linalg_chol(Scalar *a, unsigned n);
+
+// x[m x n] = Q * R by Householder reflections, with k = min(m, n) and
+// Q[m x k] having orthonormal columns, R[k x n] upper triangular; either
+// of /q/ and /r/ may be NULL if not wanted.
+void
+linalg_qr(Scalar *q, Scalar *r, const Scalar *x, unsigned m, unsigned n);
+
+// z[n x k] = the least-squares solution of x[m x n] * z = b[m x k], m >= n,
+// by QR factorization of /x/. Returns false, leaving /z/ unspecified, if /x/
+// is rank-deficient to working precision.
+bool
+linalg_lstsq(Scalar *z, const Scalar *x, const Scalar *b, unsigned m, unsigned n, unsigned k);
+
+// Eigenvalues w[n], in ascending order, of the symmetric x[n x n], of
+// which only the lower triangle is read; and, if /v/ is not NULL, the
+// orthonormal eigenvectors as the columns of v[n x n], in the same order.
+// By reduction to tridiagonal form and the implicit QL method. Returns
+// false, leaving /w/ and /v/ unspecified, if the latter fails to converge.
+bool
+linalg_eig_sym(Scalar *w, Scalar *v, const Scalar *x, unsigned n);
+
+// A sparse matrix in compressed sparse row form: the nonzeros of row i are
+// val[k], in column col[k], for row[i] <= k < row[i + 1], in ascending
+// order of column. Explicit zeros are allowed.
+typedef struct {
+    unsigned height;
+    unsigned width;
+    const size_t *row;
+    const unsigned *col;
+    const Scalar *val;
+} LinalgCsr;
+
+// Index into /a->val/ of element (i, j), or SIZE_MAX if it is not stored.
+INHEADER
+size_t
+linalg_csr_find(const LinalgCsr *a, unsigned i, unsigned j)
+{
+    size_t lo = a->row[i];
+    size_t hi = a->row[i + 1];
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (a->col[mid] < j) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < a->row[i + 1] && a->col[lo] == j ? lo : SIZE_MAX;
+}
+
+// z[m x p] = a[m x n] * x[n x p]; split across threads by rows, each
+// element of /z/ a single sum taken in column order, so that the number
+// of threads changes nothing.
+void
+linalg_csr_mul(Scalar *z, const LinalgCsr *a, const Scalar *x, unsigned p);
+
+// z[m x n] = x[m x k] * a[k x n], likewise.
+void
+linalg_mul_csr(Scalar *z, const Scalar *x, unsigned m, const LinalgCsr *a);
+
+// Solves a * x = b, for the symmetric positive definite a[n x n] and b[n],
+// by the conjugate gradient method with a Jacobi (diagonal) preconditioner,
+// starting from the /x/ given, until the norm of the residual is at most
+// /tol/ times that of /b/. Returns the number of iterations taken, or
+// /maxit/ + 1 if that was not enough, or if /a/ turned out not to be
+// positive definite; /x/ then holds the last iterate.
+unsigned
+linalg_csr_cg(Scalar *x, const LinalgCsr *a, const Scalar *b, Scalar tol, unsigned maxit);
+
+// y[width x height] = transposition of x[height x width]
+void
+linalg_transpose(Scalar *y, const Scalar *x, unsigned height, unsigned width);
+
+// x[n x n] = transposition of x[n x n]
+void
+linalg_transpose_square(Scalar *x, unsigned n);
+
+// These three stop at the first element that settles the answer.
+bool
+linalg_eq(const Scalar *x, const Scalar *y, size_t n);
+
+// Whether any of the /n/ elements is nonzero (a NaN is).
+bool
+linalg_any(const Scalar *x, size_t n);
+
+// Whether all of them are.
+bool
+linalg_all(const Scalar *x, size_t n);
+
+#endif
@@ -6,10 +6,16 @@
 #include "env.h"
 #include "value.h"
 #include "matrix.h"
+#include "sparse.h"
+#include "typed.h"
+#include "matio.h"
+#include "linalg.h"
+#include "fuse.h"
 #include "func.h"
 #include "str.h"
 #include "disasm.h"
 #include "osdep.h"
+#include "stats.h"
 
 #include <math.h>
 #include <unistd.h>
@@ -38,6 +44,247 @@ eqdim(Matrix *x, Matrix *y)
     return x->height == y->height && x->width == y->width;
 }
 
+// Destination for an elementwise operation on two matrices of equal
+// dimensions: one of the operands if it is a dying temporary, a new matrix
+// otherwise.
+static inline
+Matrix *
+result_for(Value a, Value b)
+{
+    Matrix *z = matrix_reuse(a);
+    if (!z && !(z = matrix_reuse(b))) {
+        z = matrix_new_uninit(AS_MAT(a)->height, AS_MAT(a)->width);
+    }
+    return z;
+}
+
+// Whether /a/ and /b/ are two sparse matrices, or a sparse and a dense one
+// in either order: the operands that mix in /add_sparse/ and /mul_sparse/.
+static inline
+bool
+sparse_operands(Value a, Value b)
+{
+    return (a.kind == VAL_KIND_SPARSE &&
+            (b.kind == VAL_KIND_SPARSE || b.kind == VAL_KIND_MATRIX)) ||
+           (a.kind == VAL_KIND_MATRIX && b.kind == VAL_KIND_SPARSE);
+}
+
+// Height and width of the sparse, typed or dense matrix in /v/.
+static inline
+void
+dims_of(Value v, unsigned *height, unsigned *width)
+{
+    if (v.kind == VAL_KIND_SPARSE) {
+        *height = AS_SPARSE(v)->height;
+        *width = AS_SPARSE(v)->width;
+    } else if (v.kind == VAL_KIND_TYPED) {
+        *height = AS_TYPED(v)->height;
+        *width = AS_TYPED(v)->width;
+    } else {
+        *height = AS_MAT(v)->height;
+        *width = AS_MAT(v)->width;
+    }
+}
+
+// /a/ + /b/, or /a/ - /b/ if /subtract/, for /sparse_operands/: sparse if
+// both are, else dense.
+static
+Value
+add_sparse(Env *e, Value a, Value b, bool subtract)
+{
+    unsigned ha, wa, hb, wb;
+    dims_of(a, &ha, &wa);
+    dims_of(b, &hb, &wb);
+    if (ha != hb || wa != wb) {
+        env_throw(e, "matrices unconformable for %s", subtract ? "subtraction" : "addition");
+    }
+    if (a.kind == VAL_KIND_SPARSE && b.kind == VAL_KIND_SPARSE) {
+        return MK_SPARSE(sparse_add(AS_SPARSE(a), AS_SPARSE(b), subtract));
+    }
+    // The sparse operand is added into the dense one, or its negation.
+    const bool dense_first = a.kind == VAL_KIND_MATRIX;
+    const Value d = dense_first ? a : b;
+    Matrix *x = AS_MAT(d);
+    value_force(d);
+    matrix_pack(x);
+    const size_t n = (size_t) x->height * x->width;
+    Matrix *z = matrix_reuse(d);
+    if (!z) {
+        z = matrix_new_uninit(x->height, x->width);
+        memcpy(z->elems, x->elems, n * sizeof(Scalar));
+    }
+    if (dense_first) {
+        sparse_add_to_dense(z->elems, AS_SPARSE(b), subtract ? -1 : 1);
+    } else {
+        if (subtract) {
+            linalg_neg(z->elems, z->elems, n);
+        }
+        sparse_add_to_dense(z->elems, AS_SPARSE(a), 1);
+    }
+    return MK_MAT(z);
+}
+
+// /a/ * /b/ for /sparse_operands/: sparse if both are, else dense.
+static
+Value
+mul_sparse(Env *e, Value a, Value b)
+{
+    unsigned ha, wa, hb, wb;
+    dims_of(a, &ha, &wa);
+    dims_of(b, &hb, &wb);
+    if (wa != hb) {
+        env_throw(e, "matrices unconformable for multiplication");
+    }
+    if (a.kind == VAL_KIND_SPARSE && b.kind == VAL_KIND_SPARSE) {
+        return MK_SPARSE(sparse_mul(AS_SPARSE(a), AS_SPARSE(b)));
+    }
+    const Value d = a.kind == VAL_KIND_MATRIX ? a : b;
+    Matrix *x = AS_MAT(d);
+    value_force(d);
+    matrix_pack(x);
+    Matrix *z = matrix_new_uninit(ha, wb);
+    if (a.kind == VAL_KIND_SPARSE) {
+        const LinalgCsr s = sparse_csr(AS_SPARSE(a));
+        linalg_csr_mul(z->elems, &s, x->elems, wb);
+    } else {
+        const LinalgCsr s = sparse_csr(AS_SPARSE(b));
+        linalg_mul_csr(z->elems, x->elems, ha, &s);
+    }
+    return MK_MAT(z);
+}
+
+// Whether /a/ and /b/ are two typed matrices, or a typed and a dense one
+// in either order: the operands that mix in /add_typed/ and /mul_typed/.
+static inline
+bool
+typed_operands(Value a, Value b)
+{
+    return (a.kind == VAL_KIND_TYPED &&
+            (b.kind == VAL_KIND_TYPED || b.kind == VAL_KIND_MATRIX)) ||
+           (a.kind == VAL_KIND_MATRIX && b.kind == VAL_KIND_TYPED);
+}
+
+// /v/, with a reference of its own; a typed matrix converted to a dense one.
+static
+Value
+as_dense(Value v)
+{
+    if (v.kind == VAL_KIND_TYPED) {
+        return MK_MAT(typed_to_matrix(AS_TYPED(v)));
+    }
+    value_ref(v);
+    return v;
+}
+
+// /fn/ on /a/ and /b/ as dense matrices: what operations on a typed matrix
+// come to when the types only meet in double (see /typed_promote/). /fn/
+// must not throw.
+static
+Value
+on_dense(Env *e, Value (*fn)(Env *e, Value a, Value b), Value a, Value b)
+{
+    const Value x = as_dense(a);
+    const Value y = as_dense(b);
+    const Value r = fn(e, x, y);
+    value_unref(x);
+    value_unref(y);
+    return r;
+}
+
+// /x/ as /elem/, with a reference of its own.
+static
+Typed *
+as_elem(TypedElem elem, Typed *x)
+{
+    if (x->elem == elem) {
+        ++x->gchdr.nrefs;
+        return x;
+    }
+    return typed_convert(elem, x);
+}
+
+// Sets /*x/ and /*y/ to the typed matrices in /a/ and /b/ converted to the
+// type they promote to, each with a reference of its own; returns false,
+// and sets nothing, if that is double.
+static
+bool
+promote(Value a, Value b, Typed **x, Typed **y)
+{
+    TypedElem elem;
+    if (!typed_promote(AS_TYPED(a)->elem, AS_TYPED(b)->elem, &elem)) {
+        return false;
+    }
+    *x = as_elem(elem, AS_TYPED(a));
+    *y = as_elem(elem, AS_TYPED(b));
+    return true;
+}
+
+static
+Value
+X_plus(Env *e, Value a, Value b);
+
+static
+Value
+X_bminus(Env *e, Value minuend, Value subtrahend);
+
+static
+Value
+X_mul(Env *e, Value a, Value b);
+
+// /a/ + /b/, or /a/ - /b/ if /subtract/, for /typed_operands/.
+static
+Value
+add_typed(Env *e, Value a, Value b, bool subtract)
+{
+    unsigned ha, wa, hb, wb;
+    dims_of(a, &ha, &wa);
+    dims_of(b, &hb, &wb);
+    if (ha != hb || wa != wb) {
+        env_throw(e, "matrices unconformable for %s", subtract ? "subtraction" : "addition");
+    }
+    Typed *x, *y;
+    if (a.kind != VAL_KIND_TYPED || b.kind != VAL_KIND_TYPED || !promote(a, b, &x, &y)) {
+        return on_dense(e, subtract ? X_bminus : X_plus, a, b);
+    }
+    Typed *z = typed_add(x, y, subtract);
+    value_unref(MK_TYPED(x));
+    value_unref(MK_TYPED(y));
+    return MK_TYPED(z);
+}
+
+// /a/ * /b/ for /typed_operands/.
+static
+Value
+mul_typed(Env *e, Value a, Value b)
+{
+    unsigned ha, wa, hb, wb;
+    dims_of(a, &ha, &wa);
+    dims_of(b, &hb, &wb);
+    if (wa != hb) {
+        env_throw(e, "matrices unconformable for multiplication");
+    }
+    Typed *x, *y;
+    if (a.kind != VAL_KIND_TYPED || b.kind != VAL_KIND_TYPED || !promote(a, b, &x, &y)) {
+        return on_dense(e, X_mul, a, b);
+    }
+    Typed *z = typed_mul(x, y);
+    value_unref(MK_TYPED(x));
+    value_unref(MK_TYPED(y));
+    return MK_TYPED(z);
+}
+
+// The scalar /s/ times the typed matrix /t/: typed if /typed_scalar_fits/,
+// else dense.
+static
+Value
+scale_typed(Env *e, Value s, Value t)
+{
+    if (!typed_scalar_fits(AS_TYPED(t)->elem, AS_SCL(s))) {
+        return on_dense(e, X_mul, s, t);
+    }
+    return MK_TYPED(typed_scale(AS_SCL(s), AS_TYPED(t)));
+}
+
 static
 Value
 X_uminus(Env *e, Value a)
@@ -48,13 +295,20 @@ X_uminus(Env *e, Value a)
     case VAL_KIND_MATRIX:
         {
             Matrix *x = AS_MAT(a);
-            Matrix *y = matrix_new(x->height, x->width);
-            const size_t n = x->height * x->width;
-            for (size_t i = 0; i < n; ++i) {
-                y->elems[i] = -x->elems[i];
+            if (fuse_wanted(x, NULL)) {
+                return MK_MAT(fuse_unary(FUSE_NEG, 0, a));
             }
+            Matrix *y = matrix_reuse(a);
+            if (!y) {
+                y = matrix_new_uninit(x->height, x->width);
+            }
+            linalg_neg(y->elems, x->elems, (size_t) x->height * x->width);
             return MK_MAT(y);
         }
+    case VAL_KIND_SPARSE:
+        return MK_SPARSE(sparse_scale(-1, a));
+    case VAL_KIND_TYPED:
+        return MK_TYPED(typed_neg(AS_TYPED(a)));
     default:
         env_throw(e, "cannot negate %s value", value_kindname(a.kind));
     }
@@ -62,276 +316,1283 @@ X_uminus(Env *e, Value a)
 
 static
 Value
-X_bminus(Env *e, Value minuend, Value subtrahend)
+X_bminus(Env *e, Value minuend, Value subtrahend)
+{
+    if (minuend.kind == VAL_KIND_MATRIX && subtrahend.kind == VAL_KIND_MATRIX) {
+        Matrix *x = AS_MAT(minuend);
+        Matrix *y = AS_MAT(subtrahend);
+        if (!eqdim(x, y)) {
+            env_throw(e, "matrices unconformable for subtraction");
+        }
+        if (fuse_wanted(x, y)) {
+            return MK_MAT(fuse_binary(FUSE_SUB, minuend, subtrahend));
+        }
+        Matrix *z = result_for(minuend, subtrahend);
+        if (linalg_is_small(x->height, x->width)) {
+            linalg_sub_small(z->elems, x->elems, y->elems, x->height * x->width);
+        } else {
+            linalg_sub(z->elems, x->elems, y->elems, (size_t) x->height * x->width);
+        }
+        return MK_MAT(z);
+    } else if (minuend.kind == VAL_KIND_SCALAR && subtrahend.kind == VAL_KIND_SCALAR) {
+        return MK_SCL(AS_SCL(minuend) - AS_SCL(subtrahend));
+    } else if (sparse_operands(minuend, subtrahend)) {
+        return add_sparse(e, minuend, subtrahend, true);
+    } else if (typed_operands(minuend, subtrahend)) {
+        return add_typed(e, minuend, subtrahend, true);
+    } else {
+        env_throw(e, "cannot subtract %s from %s",
+                  value_kindname(subtrahend.kind), value_kindname(minuend.kind));
+    }
+}
+
+static
+Value
+X_plus(Env *e, Value a, Value b)
+{
+    if (a.kind == VAL_KIND_MATRIX && b.kind == VAL_KIND_MATRIX) {
+        Matrix *x = AS_MAT(a);
+        Matrix *y = AS_MAT(b);
+        if (!eqdim(x, y)) {
+            env_throw(e, "matrices unconformable for addition");
+        }
+        if (fuse_wanted(x, y)) {
+            return MK_MAT(fuse_binary(FUSE_ADD, a, b));
+        }
+        Matrix *z = result_for(a, b);
+        if (linalg_is_small(x->height, x->width)) {
+            linalg_add_small(z->elems, x->elems, y->elems, x->height * x->width);
+        } else {
+            linalg_add(z->elems, x->elems, y->elems, (size_t) x->height * x->width);
+        }
+        return MK_MAT(z);
+    } else if (a.kind == VAL_KIND_SCALAR && b.kind == VAL_KIND_SCALAR) {
+        return MK_SCL(a.as.scalar + b.as.scalar);
+    } else if (sparse_operands(a, b)) {
+        return add_sparse(e, a, b, false);
+    } else if (typed_operands(a, b)) {
+        return add_typed(e, a, b, false);
+    } else {
+        env_throw(e, "cannot add %s to %s", value_kindname(a.kind), value_kindname(b.kind));
+    }
+}
+
+static inline
+Value
+sbym(Value s, Value m)
+{
+    Matrix *x = AS_MAT(m);
+    const Scalar a = s.as.scalar;
+    if (fuse_wanted(x, NULL)) {
+        return MK_MAT(fuse_unary(FUSE_SCALE, a, m));
+    }
+    Matrix *y = matrix_reuse(m);
+    if (!y) {
+        y = matrix_new_uninit(x->height, x->width);
+    }
+    linalg_scale(y->elems, a, x->elems, (size_t) x->height * x->width);
+    return MK_MAT(y);
+}
+
+static
+Value
+X_mul(Env *e, Value a, Value b)
+{
+    if (a.kind == VAL_KIND_MATRIX && b.kind == VAL_KIND_MATRIX) {
+        Matrix *x = AS_MAT(a);
+        Matrix *y = AS_MAT(b);
+        if (x->width != y->height) {
+            env_throw(e, "matrices unconformable for multiplication");
+        }
+        value_force(a);
+        value_force(b);
+        Matrix *z = matrix_new_uninit(x->height, y->width);
+        if (linalg_is_small(x->height, x->width) && linalg_is_small(y->height, y->width) &&
+            linalg_is_small(z->height, z->width) && matrix_is_packed(x) && matrix_is_packed(y))
+        {
+            linalg_gemm_small(z->elems, x->elems, y->elems, x->height, x->width, y->width);
+        } else {
+            linalg_gemm_strided(z->elems, x->elems, x->rstride, x->cstride, y->elems, y->rstride,
+                                y->cstride, x->height, x->width, y->width);
+        }
+        return MK_MAT(z);
+    } else if (a.kind == VAL_KIND_SCALAR && b.kind == VAL_KIND_SCALAR) {
+        return MK_SCL(a.as.scalar * b.as.scalar);
+    } else if (a.kind == VAL_KIND_SCALAR && b.kind == VAL_KIND_MATRIX) {
+        return sbym(a, b);
+    } else if (a.kind == VAL_KIND_MATRIX && b.kind == VAL_KIND_SCALAR) {
+        return sbym(b, a);
+    } else if (sparse_operands(a, b)) {
+        return mul_sparse(e, a, b);
+    } else if (a.kind == VAL_KIND_SCALAR && b.kind == VAL_KIND_SPARSE) {
+        return MK_SPARSE(sparse_scale(AS_SCL(a), b));
+    } else if (a.kind == VAL_KIND_SPARSE && b.kind == VAL_KIND_SCALAR) {
+        return MK_SPARSE(sparse_scale(AS_SCL(b), a));
+    } else if (typed_operands(a, b)) {
+        return mul_typed(e, a, b);
+    } else if (a.kind == VAL_KIND_SCALAR && b.kind == VAL_KIND_TYPED) {
+        return scale_typed(e, a, b);
+    } else if (a.kind == VAL_KIND_TYPED && b.kind == VAL_KIND_SCALAR) {
+        return scale_typed(e, b, a);
+    } else {
+        env_throw(e, "cannot multiply %s by %s", value_kindname(a.kind), value_kindname(b.kind));
+    }
+}
+
+static
+Value
+X_div(Env *e, Value a, Value b)
+{
+    if (a.kind != VAL_KIND_SCALAR || b.kind != VAL_KIND_SCALAR) {
+        env_throw(e, "cannot divide %s by %s", value_kindname(a.kind), value_kindname(b.kind));
+    }
+    return MK_SCL(a.as.scalar / b.as.scalar);
+}
+
+static
+Value
+X_mod(Env *e, Value a, Value b)
+{
+    if (a.kind != VAL_KIND_SCALAR || b.kind != VAL_KIND_SCALAR) {
+        env_throw(e, "cannot calculate remainder of %s divided by %s",
+                  value_kindname(a.kind), value_kindname(b.kind));
+    }
+    return MK_SCL(fmod(a.as.scalar, b.as.scalar));
+}
+
+static inline
+bool
+is_matrix(Value v)
+{
+    return v.kind == VAL_KIND_MATRIX || v.kind == VAL_KIND_TYPED;
+}
+
+// /a/ /op/ /b/, elementwise, for a dense or typed matrix and a scalar or
+// another matrix of the same dimensions, in either order: a UINT8 mask.
+// Mixed types compare as the type they promote to, or as doubles.
+static
+Typed *
+compare_matrix(Env *e, TypedCmp op, Value a, Value b)
+{
+    if (!(is_matrix(a) && (is_matrix(b) || b.kind == VAL_KIND_SCALAR)) &&
+        !(a.kind == VAL_KIND_SCALAR && is_matrix(b)))
+    {
+        env_throw(e, "cannot compare %s and %s", value_kindname(a.kind), value_kindname(b.kind));
+    }
+    if (a.kind == VAL_KIND_SCALAR) {
+        // a < M is M > a, and so on.
+        static const TypedCmp flipped[] = {
+            [TYPED_LT] = TYPED_GT,
+            [TYPED_LE] = TYPED_GE,
+            [TYPED_GT] = TYPED_LT,
+            [TYPED_GE] = TYPED_LE,
+        };
+        return compare_matrix(e, flipped[op], b, a);
+    }
+    if (b.kind == VAL_KIND_SCALAR) {
+        if (a.kind == VAL_KIND_TYPED) {
+            return typed_compare_scalar(op, AS_TYPED(a), AS_SCL(b));
+        }
+        matrix_pack(AS_MAT(a));
+        return typed_compare_dense_scalar(op, AS_MAT(a), AS_SCL(b));
+    }
+    unsigned ha, wa, hb, wb;
+    dims_of(a, &ha, &wa);
+    dims_of(b, &hb, &wb);
+    if (ha != hb || wa != wb) {
+        env_throw(e, "matrices unconformable for comparison");
+    }
+    Typed *x, *y;
+    if (a.kind == VAL_KIND_TYPED && b.kind == VAL_KIND_TYPED && promote(a, b, &x, &y)) {
+        Typed *z = typed_compare(op, x, y);
+        value_unref(MK_TYPED(x));
+        value_unref(MK_TYPED(y));
+        return z;
+    }
+    const Value dx = as_dense(a);
+    const Value dy = as_dense(b);
+    matrix_pack(AS_MAT(dx));
+    matrix_pack(AS_MAT(dy));
+    Typed *z = typed_compare_dense(op, AS_MAT(dx), AS_MAT(dy));
+    value_unref(dx);
+    value_unref(dy);
+    return z;
+}
+
+#define DECLCOMP(Op_, Name_, Cmp_) \
+    static \
+    Value \
+    X_ ## Name_(Env *e, Value a, Value b) \
+    { \
+        if (a.kind == VAL_KIND_SCALAR && b.kind == VAL_KIND_SCALAR) { \
+            return MK_SCL(a.as.scalar Op_ b.as.scalar); \
+        } \
+        return MK_TYPED(compare_matrix(e, Cmp_, a, b)); \
+    }
+DECLCOMP(<,  lt, TYPED_LT)
+DECLCOMP(<=, le, TYPED_LE)
+DECLCOMP(>,  gt, TYPED_GT)
+DECLCOMP(>=, ge, TYPED_GE)
+
+// /x/ and /y/ are of equal dimensions.
+static
+bool
+mat_eq(const Matrix *x, const Matrix *y)
+{
+    if (matrix_is_packed(x) && matrix_is_packed(y)) {
+        return linalg_eq(x->elems, y->elems, (size_t) x->height * x->width);
+    }
+    for (size_t i = 0; i < x->height; ++i) {
+        for (size_t j = 0; j < x->width; ++j) {
+            if (matrix_at(x, i, j) != matrix_at(y, i, j)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Whether /a/ and /b/, a sparse and a dense matrix in either order, have
+// equal dimensions and elements.
+static
+bool
+sparse_dense_eq(Value a, Value b)
+{
+    const Sparse *s = AS_SPARSE(a.kind == VAL_KIND_SPARSE ? a : b);
+    const Matrix *m = AS_MAT(a.kind == VAL_KIND_SPARSE ? b : a);
+    return s->height == m->height && s->width == m->width && sparse_eq_dense(s, m);
+}
+
+// Whether /a/ and /b/, matrices of two different kinds (dense, sparse or
+// typed), have equal dimensions and elements. A typed one is compared as
+// the dense matrix of its elements.
+static
+bool
+mixed_eq(Value a, Value b)
+{
+    unsigned ha, wa, hb, wb;
+    dims_of(a, &ha, &wa);
+    dims_of(b, &hb, &wb);
+    if (ha != hb || wa != wb) {
+        return false;
+    }
+    if (a.kind != VAL_KIND_TYPED && b.kind != VAL_KIND_TYPED) {
+        return sparse_dense_eq(a, b);
+    }
+    const Value x = as_dense(a);
+    const Value y = as_dense(b);
+    const bool r = x.kind == y.kind ? mat_eq(AS_MAT(x), AS_MAT(y)) : sparse_dense_eq(x, y);
+    value_unref(x);
+    value_unref(y);
+    return r;
+}
+
+// Whether /a/ and /b/, values of two different kinds, are matrices that
+// /mixed_eq/ compares.
+static inline
+bool
+mixed_matrices(Value a, Value b)
+{
+    return (is_matrix(a) || a.kind == VAL_KIND_SPARSE) &&
+           (is_matrix(b) || b.kind == VAL_KIND_SPARSE);
+}
+
+static
+Value
+X_eq(Env *e, Value a, Value b)
+{
+    (void) e;
+    if (a.kind != b.kind) {
+        return MK_SCL(mixed_matrices(a, b) && mixed_eq(a, b));
+    }
+    switch (a.kind) {
+    case VAL_KIND_NIL:
+        return MK_SCL(1);
+    case VAL_KIND_SCALAR:
+        return MK_SCL(a.as.scalar == b.as.scalar);
+    case VAL_KIND_MATRIX:
+        {
+            Matrix *x = AS_MAT(a);
+            Matrix *y = AS_MAT(b);
+            if (!eqdim(x, y)) {
+                return MK_SCL(0);
+            }
+            return MK_SCL(mat_eq(x, y));
+        }
+        break;
+    case VAL_KIND_CFUNC:
+        return MK_SCL(a.as.cfunc == b.as.cfunc);
+    case VAL_KIND_FUNC:
+        return MK_SCL(a.as.gcobj == b.as.gcobj);
+    case VAL_KIND_STR:
+        return MK_SCL(str_eq(AS_STR(a), AS_STR(b)));
+    case VAL_KIND_SPARSE:
+        {
+            Sparse *x = AS_SPARSE(a);
+            Sparse *y = AS_SPARSE(b);
+            return MK_SCL(x->height == y->height && x->width == y->width && sparse_eq(x, y));
+        }
+    case VAL_KIND_TYPED:
+        {
+            Typed *x = AS_TYPED(a);
+            Typed *y = AS_TYPED(b);
+            return MK_SCL(x->height == y->height && x->width == y->width && typed_eq(x, y));
+        }
+    }
+    UNREACHABLE();
+}
+
+static
+Value
+X_ne(Env *e, Value a, Value b)
+{
+    (void) e;
+    if (a.kind != b.kind) {
+        return MK_SCL(!(mixed_matrices(a, b) && mixed_eq(a, b)));
+    }
+    switch (a.kind) {
+    case VAL_KIND_NIL:
+        return MK_SCL(0);
+    case VAL_KIND_SCALAR:
+        return MK_SCL(a.as.scalar != b.as.scalar);
+    case VAL_KIND_MATRIX:
+        {
+            Matrix *x = AS_MAT(a);
+            Matrix *y = AS_MAT(b);
+            if (!eqdim(x, y)) {
+                return MK_SCL(1);
+            }
+            return MK_SCL(!mat_eq(x, y));
+        }
+        break;
+    case VAL_KIND_CFUNC:
+        return MK_SCL(a.as.cfunc != b.as.cfunc);
+    case VAL_KIND_FUNC:
+        return MK_SCL(a.as.gcobj != b.as.gcobj);
+    case VAL_KIND_STR:
+        return MK_SCL(!str_eq(AS_STR(a), AS_STR(b)));
+    case VAL_KIND_SPARSE:
+        {
+            Sparse *x = AS_SPARSE(a);
+            Sparse *y = AS_SPARSE(b);
+            return MK_SCL(x->height != y->height || x->width != y->width || !sparse_eq(x, y));
+        }
+    case VAL_KIND_TYPED:
+        {
+            Typed *x = AS_TYPED(a);
+            Typed *y = AS_TYPED(b);
+            return MK_SCL(x->height != y->height || x->width != y->width || !typed_eq(x, y));
+        }
+    }
+    UNREACHABLE();
+}
+
+static
+Value
+X_not(Env *e, Value a)
+{
+    (void) e;
+    return MK_SCL(!value_is_truthy(a));
+}
+
+static
+Value
+X_and(Env *e, Value a, Value b)
+{
+    (void) e;
+    return MK_SCL(value_is_truthy(a) && value_is_truthy(b));
+}
+
+static
+Value
+X_or(Env *e, Value a, Value b)
+{
+    (void) e;
+    return MK_SCL(value_is_truthy(a) || value_is_truthy(b));
+}
+
+// /k/-th power of the square matrix /x/, for integral /k/.
+static
+Matrix *
+mat_pow(Env *e, Matrix *x, Scalar k)
+{
+    if (x->height != x->width) {
+        env_throw(e, "only square matrices can be raised to a power");
+    }
+    if (k != floor(k) || !(fabs(k) < 0x1p63)) {
+        env_throw(e, "matrix can only be raised to an integer power");
+    }
+    const unsigned n = x->height;
+    const size_t nbytes = (size_t) n * n * sizeof(Scalar);
+    matrix_pack(x);
+
+    Matrix *z = matrix_new_uninit(n, n);
+    Scalar *work = scratch_alloc(nbytes);
+    if (k < 0) {
+        Scalar *inv = scratch_alloc(nbytes);
+        if (!linalg_inv(inv, x->elems, n)) {
+            value_unref(MK_MAT(z));
+            env_throw(e, "matrix is singular and has no negative powers");
+        }
+        linalg_pow(z->elems, inv, n, -k, work);
+        scratch_free(inv, nbytes);
+    } else {
+        linalg_pow(z->elems, x->elems, n, k, work);
+    }
+    scratch_free(work, nbytes);
+    return z;
+}
+
+static
+Value
+X_pow(Env *e, Value a, Value b)
+{
+    if (a.kind == VAL_KIND_MATRIX && b.kind == VAL_KIND_SCALAR) {
+        return MK_MAT(mat_pow(e, AS_MAT(a), AS_SCL(b)));
+    }
+    if (a.kind != VAL_KIND_SCALAR || b.kind != VAL_KIND_SCALAR) {
+        env_throw(e, "cannot raise %s to power of %s",
+                  value_kindname(a.kind), value_kindname(b.kind));
+    }
+    return MK_SCL(pow(a.as.scalar, b.as.scalar));
+}
+
+// /fn/ applied to each element of the matrix in /a/.
+static
+Value
+map_matrix(LinalgFn fn, Value a)
+{
+    Matrix *x = AS_MAT(a);
+    matrix_pack(x);
+    Matrix *z = matrix_reuse(a);
+    if (!z) {
+        z = matrix_new_uninit(x->height, x->width);
+    }
+    linalg_map(fn, z->elems, x->elems, (size_t) x->height * x->width);
+    return MK_MAT(z);
+}
+
+// Throws for /name/ applied to /v/, which is not a dense matrix.
+ATTR_NORETURN
+static
+void
+dense_expected(Env *e, const char *name, Value v)
+{
+    if (v.kind == VAL_KIND_TYPED) {
+        env_throw(e, "'%s' cannot be applied to a %s (convert it with 'Double')", name,
+                  value_kindname(v.kind));
+    }
+    env_throw(e, "'%s' can only be applied to a matrix", name);
+}
+
+// /map_matrix/ on the elements of the typed matrix in /a/, as doubles.
+static
+Value
+map_typed(LinalgFn fn, Value a)
+{
+    const Value d = as_dense(a);
+    const Value r = map_matrix(fn, d);
+    value_unref(d);
+    return r;
+}
+
+#define DECL1(Name_, Fn_) \
+    static \
+    Value \
+    X_ ## Name_(Env *e, const Value *args, unsigned nargs) \
+    { \
+        if (nargs != 1) { \
+            env_throw(e, "'%s' expects exactly one argument", #Name_); \
+        } \
+        switch (args[0].kind) { \
+        case VAL_KIND_SCALAR: \
+            return MK_SCL(Name_(args[0].as.scalar)); \
+        case VAL_KIND_MATRIX: \
+            return map_matrix(Fn_, args[0]); \
+        case VAL_KIND_TYPED: \
+            return map_typed(Fn_, args[0]); \
+        default: \
+            env_throw(e, "'%s' can only be applied to a scalar or a matrix", #Name_); \
+        } \
+    }
+
+DECL1(sin,   LINALG_FN_SIN)
+DECL1(cos,   LINALG_FN_COS)
+DECL1(tan,   LINALG_FN_TAN)
+DECL1(asin,  LINALG_FN_ASIN)
+DECL1(acos,  LINALG_FN_ACOS)
+DECL1(atan,  LINALG_FN_ATAN)
+DECL1(exp,   LINALG_FN_EXP)
+DECL1(log,   LINALG_FN_LOG)
+DECL1(floor, LINALG_FN_FLOOR)
+DECL1(trunc, LINALG_FN_TRUNC)
+DECL1(ceil,  LINALG_FN_CEIL)
+DECL1(round, LINALG_FN_ROUND)
+
+// Whether /x/ is a view of the transposition of a packed matrix: a
+// reduction can then run on that one, rows and columns swapped, without
+// moving anything.
+static inline
+bool
+is_packed_transposition(const Matrix *x)
+{
+    return !matrix_is_packed(x) && x->rstride == 1 && x->cstride == x->height;
+}
+
+// The dimension argument of the reductions: 1 to reduce each column, giving
+// a row, 2 to reduce each row, giving a column.
+static
+unsigned
+red_dim(Env *e, const char *name, Value v)
+{
+    if (v.kind != VAL_KIND_SCALAR || (v.as.scalar != 1 && v.as.scalar != 2)) {
+        env_throw(e, "'%s': dimension must be 1 or 2", name);
+    }
+    return v.as.scalar;
+}
+
+// /op/ over the whole matrix in args[0] (and args[1], for DOT), or along
+// the dimension given after it; the mean of the elements if /mean/.
+static
+Value
+reduce(Env *e, const char *name, LinalgRed op, bool mean, const Value *args, unsigned nargs)
+{
+    const unsigned nmats = op == LINALG_RED_DOT ? 2 : 1;
+    if (nargs != nmats && nargs != nmats + 1) {
+        env_throw(e, "'%s' expects %u or %u arguments", name, nmats, nmats + 1);
+    }
+    for (unsigned i = 0; i < nmats; ++i) {
+        if (!is_matrix(args[i])) {
+            env_throw(e, "'%s' can only be applied to %s", name,
+                      nmats == 1 ? "a matrix" : "matrices");
+        }
+    }
+    const unsigned dim = nargs > nmats ? red_dim(e, name, args[nmats]) : 0;
+    // The sum and product of no elements are 0 and 1, but they have no
+    // minimum, maximum or mean.
+    if (!dim && (mean || op == LINALG_RED_MIN || op == LINALG_RED_MAX)) {
+        unsigned height, width;
+        dims_of(args[0], &height, &width);
+        if (!height) {
+            env_throw(e, "'%s': empty matrix", name);
+        }
+    }
+    if (args[0].kind == VAL_KIND_TYPED || args[nmats - 1].kind == VAL_KIND_TYPED) {
+        if (nmats == 1 && !dim && op != LINALG_RED_NORM) {
+            const Typed *t = AS_TYPED(args[0]);
+            const Scalar r = typed_reduce(op, t);
+            return MK_SCL(mean ? r / ((size_t) t->height * t->width) : r);
+        }
+        // The rest goes through double.
+        if (nmats == 2) {
+            unsigned hx, wx, hy, wy;
+            dims_of(args[0], &hx, &wx);
+            dims_of(args[1], &hy, &wy);
+            if (hx != hy || wx != wy) {
+                env_throw(e, "'%s': matrices must have equal dimensions", name);
+            }
+        }
+        Value dense[3];
+        for (unsigned i = 0; i < nargs; ++i) {
+            dense[i] = i < nmats ? as_dense(args[i]) : args[i];
+        }
+        const Value r = reduce(e, name, op, mean, dense, nargs);
+        for (unsigned i = 0; i < nmats; ++i) {
+            value_unref(dense[i]);
+        }
+        return r;
+    }
+    Matrix *x = AS_MAT(args[0]);
+    Matrix *y = nmats == 2 ? AS_MAT(args[1]) : NULL;
+    if (y && !eqdim(x, y)) {
+        env_throw(e, "'%s': matrices must have equal dimensions", name);
+    }
+
+    bool swapped = is_packed_transposition(x) && (!y || is_packed_transposition(y));
+    if (!swapped) {
+        matrix_pack(x);
+        if (y) {
+            matrix_pack(y);
+        }
+    }
+    const Scalar *ye = y ? y->elems : NULL;
+    const size_t count = (size_t) x->height * x->width;
+
+    if (!dim) {
+        const Scalar r = linalg_reduce(op, x->elems, ye, count);
+        return MK_SCL(mean ? r / count : r);
+    }
+    if (!count) {
+        return MK_MAT(matrix_new(0, 0));
+    }
+    Matrix *z = dim == 1 ? matrix_new_uninit(1, x->width) : matrix_new_uninit(x->height, 1);
+    // In the order the elements are stored in, m x n.
+    const unsigned m = swapped ? x->width : x->height;
+    const unsigned n = swapped ? x->height : x->width;
+    if ((dim == 2) != swapped) {
+        linalg_reduce_rows(op, z->elems, x->elems, ye, m, n);
+    } else {
+        linalg_reduce_cols(op, z->elems, x->elems, ye, m, n);
+    }
+    if (mean) {
+        const Scalar len = dim == 1 ? x->height : x->width;
+        const size_t nz = (size_t) z->height * z->width;
+        for (size_t i = 0; i < nz; ++i) {
+            z->elems[i] /= len;
+        }
+    }
+    return MK_MAT(z);
+}
+
+#define DECLRED(Name_, Op_, Mean_) \
+    static \
+    Value \
+    X_ ## Name_(Env *e, const Value *args, unsigned nargs) \
+    { \
+        return reduce(e, #Name_, Op_, Mean_, args, nargs); \
+    }
+
+DECLRED(Sum,  LINALG_RED_SUM,  false)
+DECLRED(Prod, LINALG_RED_PROD, false)
+DECLRED(Min,  LINALG_RED_MIN,  false)
+DECLRED(Max,  LINALG_RED_MAX,  false)
+DECLRED(Mean, LINALG_RED_SUM,  true)
+DECLRED(Dot,  LINALG_RED_DOT,  false)
+DECLRED(Norm, LINALG_RED_NORM, false)
+DECLRED(Any,  LINALG_RED_ANY,  false)
+DECLRED(All,  LINALG_RED_ALL,  false)
+
+static
+Value
+X_CumSum(Env *e, const Value *args, unsigned nargs)
+{
+    if (nargs != 1 && nargs != 2) {
+        env_throw(e, "'CumSum' expects 1 or 2 arguments");
+    }
+    if (args[0].kind != VAL_KIND_MATRIX) {
+        dense_expected(e, "CumSum", args[0]);
+    }
+    const unsigned dim = nargs == 2 ? red_dim(e, "CumSum", args[1]) : 0;
+    Matrix *x = AS_MAT(args[0]);
+    matrix_pack(x);
+    Matrix *z = matrix_reuse(args[0]);
+    if (!z) {
+        z = matrix_new_uninit(x->height, x->width);
+    }
+    switch (dim) {
+    case 0:
+        linalg_cumsum(z->elems, x->elems, (size_t) x->height * x->width);
+        break;
+    case 1:
+        linalg_cumsum_cols(z->elems, x->elems, x->height, x->width);
+        break;
+    case 2:
+        linalg_cumsum_rows(z->elems, x->elems, x->height, x->width);
+        break;
+    }
+    return MK_MAT(z);
+}
+
+// The square matrix in /v/, packed.
+static
+Matrix *
+square_arg(Env *e, const char *name, Value v)
+{
+    if (v.kind != VAL_KIND_MATRIX) {
+        dense_expected(e, name, v);
+    }
+    Matrix *x = AS_MAT(v);
+    if (x->height != x->width) {
+        env_throw(e, "'%s': matrix must be square", name);
+    }
+    matrix_pack(x);
+    return x;
+}
+
+// The factor a decomposition is asked for by name: one of the letters in
+// /parts/, as a string.
+static
+char
+part_arg(Env *e, const char *name, Value v, const char *parts)
+{
+    Str *s = v.kind == VAL_KIND_STR ? AS_STR(v) : NULL;
+    if (!s || s->ndata != 1 || !s->data[0] || !strchr(parts, s->data[0])) {
+        char list[64];
+        size_t len = 0;
+        for (const char *p = parts; *p; ++p) {
+            const char *sep = p == parts ? "" : p[1] ? ", " : " or ";
+            len += snprintf(list + len, sizeof(list) - len, "%s\"%c\"", sep, *p);
+        }
+        env_throw(e, "'%s': second argument must be %s", name, list);
+    }
+    return s->data[0];
+}
+
+static
+Value
+X_Det(Env *e, const Value *args, unsigned nargs)
+{
+    if (nargs != 1) {
+        env_throw(e, "'Det' expects exactly one argument");
+    }
+    Matrix *x = square_arg(e, "Det", args[0]);
+    return MK_SCL(linalg_det(x->elems, x->height));
+}
+
+static
+Value
+X_Inv(Env *e, const Value *args, unsigned nargs)
+{
+    if (nargs != 1) {
+        env_throw(e, "'Inv' expects exactly one argument");
+    }
+    Matrix *x = square_arg(e, "Inv", args[0]);
+    Matrix *z = matrix_new_uninit(x->height, x->width);
+    if (!linalg_inv(z->elems, x->elems, x->height)) {
+        value_unref(MK_MAT(z));
+        env_throw(e, "'Inv': matrix is singular to working precision");
+    }
+    return MK_MAT(z);
+}
+
+// X such that A * X = B.
+static
+Value
+X_Solve(Env *e, const Value *args, unsigned nargs)
+{
+    if (nargs != 2) {
+        env_throw(e, "'Solve' expects exactly two arguments");
+    }
+    Matrix *a = square_arg(e, "Solve", args[0]);
+    if (args[1].kind != VAL_KIND_MATRIX) {
+        env_throw(e, "'Solve' can only be applied to matrices");
+    }
+    Matrix *b = AS_MAT(args[1]);
+    const unsigned n = a->height;
+    if (b->height != n) {
+        env_throw(e, "'Solve': matrices unconformable");
+    }
+
+    const size_t nn = (size_t) n * n;
+    Scalar *lu = scratch_alloc(nn * sizeof(Scalar));
+    unsigned *piv = scratch_alloc(n * sizeof(unsigned));
+    memcpy(lu, a->elems, nn * sizeof(Scalar));
+    Scalar rcond;
+    if (!linalg_lu(lu, n, piv, &rcond) || !(rcond >= LINALG_RCOND_MIN)) {
+        env_throw(e, "'Solve': matrix is singular to working precision");
+    }
+
+    matrix_pack(b);
+    Matrix *z = matrix_reuse(args[1]);
+    if (!z) {
+        z = matrix_new_uninit(b->height, b->width);
+        memcpy(z->elems, b->elems, (size_t) b->height * b->width * sizeof(Scalar));
+    }
+    linalg_lu_solve(lu, piv, n, z->elems, z->width);
+    scratch_free(piv, n * sizeof(unsigned));
+    scratch_free(lu, nn * sizeof(Scalar));
+    return MK_MAT(z);
+}
+
+// The factors of P * A = L * U: all of them in one matrix, L below the
+// diagonal (which is L's, all ones, left out) and U on and above it, or
+// the one named by the second argument.
+static
+Value
+X_LU(Env *e, const Value *args, unsigned nargs)
+{
+    if (nargs != 1 && nargs != 2) {
+        env_throw(e, "'LU' expects 1 or 2 arguments");
+    }
+    Matrix *x = square_arg(e, "LU", args[0]);
+    const char part = nargs == 2 ? part_arg(e, "LU", args[1], "LUP") : 0;
+    const unsigned n = x->height;
+    Matrix *z = matrix_new_uninit(n, n);
+    unsigned *piv = scratch_alloc(n * sizeof(unsigned));
+    memcpy(z->elems, x->elems, (size_t) n * n * sizeof(Scalar));
+    linalg_lu(z->elems, n, piv, NULL);
+
+    Scalar *f = z->elems;
+    switch (part) {
+    case 'L':
+        for (size_t i = 0; i < n; ++i) {
+            f[i * n + i] = 1;
+            memset(f + i * n + i + 1, 0, (n - i - 1) * sizeof(Scalar));
+        }
+        break;
+    case 'U':
+        for (size_t i = 0; i < n; ++i) {
+            memset(f + i * n, 0, i * sizeof(Scalar));
+        }
+        break;
+    case 'P':
+        {
+            // Row i of P * A is row perm[i] of A.
+            unsigned *perm = scratch_alloc(n * sizeof(unsigned));
+            for (unsigned i = 0; i < n; ++i) {
+                perm[i] = i;
+            }
+            for (unsigned i = 0; i < n; ++i) {
+                const unsigned t = perm[i];
+                perm[i] = perm[piv[i]];
+                perm[piv[i]] = t;
+            }
+            memset(f, 0, (size_t) n * n * sizeof(Scalar));
+            for (size_t i = 0; i < n; ++i) {
+                f[i * n + perm[i]] = 1;
+            }
+            scratch_free(perm, n * sizeof(unsigned));
+        }
+        break;
+    }
+    scratch_free(piv, n * sizeof(unsigned));
+    return MK_MAT(z);
+}
+
+// L such that A = L * Trans(L), from the lower triangle of A.
+static
+Value
+X_Chol(Env *e, const Value *args, unsigned nargs)
+{
+    if (nargs != 1) {
+        env_throw(e, "'Chol' expects exactly one argument");
+    }
+    Matrix *x = square_arg(e, "Chol", args[0]);
+    Matrix *z = matrix_reuse(args[0]);
+    if (!z) {
+        z = matrix_new_uninit(x->height, x->width);
+        memcpy(z->elems, x->elems, (size_t) x->height * x->width * sizeof(Scalar));
+    }
+    if (!linalg_chol(z->elems, z->height)) {
+        value_unref(MK_MAT(z));
+        env_throw(e, "'Chol': matrix is not positive definite");
+    }
+    return MK_MAT(z);
+}
+
+// R, or the factor named by the second argument, of A = Q * R, with Q
+// having orthonormal columns, as many as A has rows or columns, whichever
+// is fewer.
+static
+Value
+X_QR(Env *e, const Value *args, unsigned nargs)
+{
+    if (nargs != 1 && nargs != 2) {
+        env_throw(e, "'QR' expects 1 or 2 arguments");
+    }
+    if (args[0].kind != VAL_KIND_MATRIX) {
+        dense_expected(e, "QR", args[0]);
+    }
+    const char part = nargs == 2 ? part_arg(e, "QR", args[1], "QR") : 'R';
+    Matrix *x = AS_MAT(args[0]);
+    matrix_pack(x);
+    const unsigned k = x->height < x->width ? x->height : x->width;
+    if (!k) {
+        return MK_MAT(matrix_new(0, 0));
+    }
+    Matrix *z = part == 'Q' ? matrix_new_uninit(x->height, k) : matrix_new_uninit(k, x->width);
+    linalg_qr(part == 'Q' ? z->elems : NULL, part == 'R' ? z->elems : NULL, x->elems,
+              x->height, x->width);
+    return MK_MAT(z);
+}
+
+// X minimizing the norm of A * X - B, for A with at least as many rows as
+// columns.
+static
+Value
+X_LstSq(Env *e, const Value *args, unsigned nargs)
+{
+    if (nargs != 2) {
+        env_throw(e, "'LstSq' expects exactly two arguments");
+    }
+    if (args[0].kind != VAL_KIND_MATRIX || args[1].kind != VAL_KIND_MATRIX) {
+        env_throw(e, "'LstSq' can only be applied to matrices");
+    }
+    Matrix *a = AS_MAT(args[0]);
+    Matrix *b = AS_MAT(args[1]);
+    if (a->height != b->height) {
+        env_throw(e, "'LstSq': matrices unconformable");
+    }
+    if (a->height < a->width) {
+        env_throw(e, "'LstSq': matrix must have at least as many rows as columns");
+    }
+    if (!a->width) {
+        return MK_MAT(matrix_new(0, 0));
+    }
+    matrix_pack(a);
+    matrix_pack(b);
+    Matrix *z = matrix_new_uninit(a->width, b->width);
+    if (!linalg_lstsq(z->elems, a->elems, b->elems, a->height, a->width, b->width)) {
+        value_unref(MK_MAT(z));
+        env_throw(e, "'LstSq': matrix is rank-deficient to working precision");
+    }
+    return MK_MAT(z);
+}
+
+// The eigenvalues of a symmetric matrix, from its lower triangle, as a
+// column in ascending order; or, given "V", the eigenvectors, as the
+// columns of a matrix, in the same order.
+static
+Value
+X_Eig(Env *e, const Value *args, unsigned nargs)
 {
-    if (minuend.kind == VAL_KIND_MATRIX && subtrahend.kind == VAL_KIND_MATRIX) {
-        Matrix *x = AS_MAT(minuend);
-        Matrix *y = AS_MAT(subtrahend);
-        if (!eqdim(x, y)) {
-            env_throw(e, "matrices unconformable for subtraction");
-        }
-        Matrix *z = matrix_new(x->height, x->width);
-        const size_t n = x->height * x->width;
-        for (size_t i = 0; i < n; ++i) {
-            z->elems[i] = x->elems[i] - y->elems[i];
-        }
-        return MK_MAT(z);
-    } else if (minuend.kind == VAL_KIND_SCALAR && subtrahend.kind == VAL_KIND_SCALAR) {
-        return MK_SCL(AS_SCL(minuend) - AS_SCL(subtrahend));
-    } else {
-        env_throw(e, "cannot subtract %s from %s",
-                  value_kindname(subtrahend.kind), value_kindname(minuend.kind));
+    if (nargs != 1 && nargs != 2) {
+        env_throw(e, "'Eig' expects 1 or 2 arguments");
+    }
+    Matrix *x = square_arg(e, "Eig", args[0]);
+    const bool vectors = nargs == 2 && part_arg(e, "Eig", args[1], "V");
+    const unsigned n = x->height;
+    if (!n) {
+        return MK_MAT(matrix_new(0, 0));
     }
+    Matrix *z = vectors ? matrix_new_uninit(n, n) : matrix_new_uninit(n, 1);
+    Scalar *w = vectors ? scratch_alloc(n * sizeof(Scalar)) : z->elems;
+    if (!linalg_eig_sym(w, vectors ? z->elems : NULL, x->elems, n)) {
+        value_unref(MK_MAT(z));
+        env_throw(e, "'Eig': eigenvalues did not converge");
+    }
+    if (vectors) {
+        scratch_free(w, n * sizeof(Scalar));
+    }
+    return MK_MAT(z);
 }
 
+// A dimension of a sparse matrix, given as /v/.
 static
-Value
-X_plus(Env *e, Value a, Value b)
+unsigned
+sparse_dim_arg(Env *e, Value v)
 {
-    if (a.kind == VAL_KIND_MATRIX && b.kind == VAL_KIND_MATRIX) {
-        Matrix *x = AS_MAT(a);
-        Matrix *y = AS_MAT(b);
-        if (!eqdim(x, y)) {
-            env_throw(e, "matrices unconformable for addition");
-        }
-        Matrix *z = matrix_new(x->height, x->width);
-        const size_t n = x->height * x->width;
-        for (size_t i = 0; i < n; ++i) {
-            z->elems[i] = x->elems[i] + y->elems[i];
-        }
-        return MK_MAT(z);
-    } else if (a.kind == VAL_KIND_SCALAR && b.kind == VAL_KIND_SCALAR) {
-        return MK_SCL(a.as.scalar + b.as.scalar);
-    } else {
-        env_throw(e, "cannot add %s to %s", value_kindname(a.kind), value_kindname(b.kind));
+    if (v.kind != VAL_KIND_SCALAR || !(v.as.scalar >= 0 && v.as.scalar <= UINT_MAX) ||
+        v.as.scalar != floor(v.as.scalar))
+    {
+        env_throw(e, "'Sparse': dimensions must be nonnegative integers");
     }
+    return v.as.scalar;
 }
 
-static inline
-Value
-sbym(Value s, Value m)
+// The largest of the /n/ row (or column) numbers in /x/, as a dimension;
+// 0 if there are none, and an error if one is not a valid number.
+static
+unsigned
+sparse_max_index(Env *e, const char *what, const Scalar *x, size_t n)
 {
-    Matrix *x = AS_MAT(m);
-    const Scalar a = s.as.scalar;
-    Matrix *y = matrix_new(x->height, x->width);
-    const size_t n = x->height * x->width;
+    Scalar r = 0;
     for (size_t i = 0; i < n; ++i) {
-        y->elems[i] = a * x->elems[i];
+        if (!(x[i] >= 1 && x[i] <= UINT_MAX) || x[i] != floor(x[i])) {
+            env_throw(e, "%s number out of range", what);
+        }
+        if (x[i] > r) {
+            r = x[i];
+        }
     }
-    return MK_MAT(y);
+    return r;
 }
 
+// The sparse matrix with V(k) at (I(k), J(k)), given I, J and V of as many
+// elements, and optionally its height and width (else, as many rows and
+// columns as the indices call for); or the nonzeros of a dense matrix.
 static
 Value
-X_mul(Env *e, Value a, Value b)
+X_Sparse(Env *e, const Value *args, unsigned nargs)
 {
-    if (a.kind == VAL_KIND_MATRIX && b.kind == VAL_KIND_MATRIX) {
-        Matrix *x = AS_MAT(a);
-        Matrix *y = AS_MAT(b);
-        if (x->width != y->height) {
-            env_throw(e, "matrices unconformable for multiplication");
+    if (nargs == 1) {
+        if (args[0].kind != VAL_KIND_MATRIX) {
+            dense_expected(e, "Sparse", args[0]);
         }
-        const unsigned m = x->height;
-        const unsigned n = x->width;
-        const unsigned p = y->width;
-        Matrix *z = matrix_new(m, p);
-        for (unsigned i = 0; i < m; ++i) {
-            for (unsigned j = 0; j < p; ++j) {
-                Scalar elem = 0;
-                for (unsigned k = 0; k < n; ++k) {
-                    elem += x->elems[i * n + k] * y->elems[k * p + j];
-                }
-                z->elems[i * p + j] = elem;
-            }
+        return MK_SPARSE(sparse_from_matrix(AS_MAT(args[0])));
+    }
+    if (nargs != 3 && nargs != 5) {
+        env_throw(e, "'Sparse' expects 1, 3 or 5 arguments");
+    }
+    for (unsigned i = 0; i < 3; ++i) {
+        if (args[i].kind != VAL_KIND_MATRIX) {
+            env_throw(e, "'Sparse': indices and values must be matrices");
         }
-        return MK_MAT(z);
-    } else if (a.kind == VAL_KIND_SCALAR && b.kind == VAL_KIND_SCALAR) {
-        return MK_SCL(a.as.scalar * b.as.scalar);
-    } else if (a.kind == VAL_KIND_SCALAR && b.kind == VAL_KIND_MATRIX) {
-        return sbym(a, b);
-    } else if (a.kind == VAL_KIND_MATRIX && b.kind == VAL_KIND_SCALAR) {
-        return sbym(b, a);
+    }
+    Matrix *ri = AS_MAT(args[0]);
+    Matrix *ci = AS_MAT(args[1]);
+    Matrix *x = AS_MAT(args[2]);
+    const size_t n = (size_t) x->height * x->width;
+    if ((size_t) ri->height * ri->width != n || (size_t) ci->height * ci->width != n) {
+        env_throw(e, "'Sparse': indices and values must have as many elements");
+    }
+    matrix_pack(ri);
+    matrix_pack(ci);
+    matrix_pack(x);
+    unsigned height, width;
+    if (nargs == 5) {
+        height = sparse_dim_arg(e, args[3]);
+        width = sparse_dim_arg(e, args[4]);
     } else {
-        env_throw(e, "cannot multiply %s by %s", value_kindname(a.kind), value_kindname(b.kind));
+        height = sparse_max_index(e, "row", ri->elems, n);
+        width = sparse_max_index(e, "column", ci->elems, n);
+    }
+    if ((height == 0) != (width == 0)) {
+        env_throw(e, "invalid matrix dimensions");
     }
+    return MK_SPARSE(sparse_from_triplets(e, ri->elems, ci->elems, x->elems, n, height, width));
 }
 
 static
 Value
-X_div(Env *e, Value a, Value b)
+X_Full(Env *e, const Value *args, unsigned nargs)
 {
-    if (a.kind != VAL_KIND_SCALAR || b.kind != VAL_KIND_SCALAR) {
-        env_throw(e, "cannot divide %s by %s", value_kindname(a.kind), value_kindname(b.kind));
+    if (nargs != 1) {
+        env_throw(e, "'Full' expects exactly one argument");
     }
-    return MK_SCL(a.as.scalar / b.as.scalar);
+    if (args[0].kind != VAL_KIND_SPARSE) {
+        env_throw(e, "'Full' can only be applied to a sparse matrix");
+    }
+    return MK_MAT(sparse_to_matrix(e, AS_SPARSE(args[0])));
 }
 
+// The dense or typed matrix in args[0] as /elem/ (see /typed_from_matrix/).
 static
 Value
-X_mod(Env *e, Value a, Value b)
+to_typed(Env *e, const char *name, TypedElem elem, const Value *args, unsigned nargs)
 {
-    if (a.kind != VAL_KIND_SCALAR || b.kind != VAL_KIND_SCALAR) {
-        env_throw(e, "cannot calculate remainder of %s divided by %s",
-                  value_kindname(a.kind), value_kindname(b.kind));
+    if (nargs != 1) {
+        env_throw(e, "'%s' expects exactly one argument", name);
+    }
+    switch (args[0].kind) {
+    case VAL_KIND_MATRIX:
+        return MK_TYPED(typed_from_matrix(elem, AS_MAT(args[0])));
+    case VAL_KIND_TYPED:
+        return MK_TYPED(as_elem(elem, AS_TYPED(args[0])));
+    default:
+        env_throw(e, "'%s' can only be applied to a matrix", name);
     }
-    return MK_SCL(fmod(a.as.scalar, b.as.scalar));
 }
 
-#define DECLCOMP(Op_, Name_) \
+#define DECLTYPED(Name_, Elem_) \
     static \
     Value \
-    X_ ## Name_(Env *e, Value a, Value b) \
+    X_ ## Name_(Env *e, const Value *args, unsigned nargs) \
     { \
-        if (a.kind != VAL_KIND_SCALAR || b.kind != VAL_KIND_SCALAR) { \
-            env_throw(e, "cannot compare %s and %s", \
-                      value_kindname(a.kind), value_kindname(b.kind)); \
-        } \
-        return MK_SCL(a.as.scalar Op_ b.as.scalar); \
+        return to_typed(e, #Name_, Elem_, args, nargs); \
     }
-DECLCOMP(<,  lt)
-DECLCOMP(<=, le)
-DECLCOMP(>,  gt)
-DECLCOMP(>=, ge)
+
+DECLTYPED(UInt8,   TYPED_UINT8)
+DECLTYPED(Int32,   TYPED_INT32)
+DECLTYPED(Float32, TYPED_FLOAT32)
 
 static
 Value
-X_eq(Env *e, Value a, Value b)
+X_Double(Env *e, const Value *args, unsigned nargs)
 {
-    (void) e;
-    if (a.kind != b.kind) {
-        return MK_SCL(0);
+    if (nargs != 1) {
+        env_throw(e, "'Double' expects exactly one argument");
     }
-    switch (a.kind) {
-    case VAL_KIND_NIL:
-        return MK_SCL(1);
-    case VAL_KIND_SCALAR:
-        return MK_SCL(a.as.scalar == b.as.scalar);
-    case VAL_KIND_MATRIX:
-        {
-            Matrix *x = AS_MAT(a);
-            Matrix *y = AS_MAT(b);
-            if (!eqdim(x, y)) {
-                return MK_SCL(0);
-            }
-            const size_t nelems = x->height * x->width;
-            for (size_t i = 0; i < nelems; ++i) {
-                if (x->elems[i] != y->elems[i]) {
-                    return MK_SCL(0);
-                }
-            }
-            return MK_SCL(1);
-        }
-        break;
-    case VAL_KIND_CFUNC:
-        return MK_SCL(a.as.cfunc == b.as.cfunc);
-    case VAL_KIND_FUNC:
-        return MK_SCL(a.as.gcobj == b.as.gcobj);
-    case VAL_KIND_STR:
-        return MK_SCL(str_eq(AS_STR(a), AS_STR(b)));
+    if (!is_matrix(args[0])) {
+        env_throw(e, "'Double' can only be applied to a matrix");
     }
-    UNREACHABLE();
+    return as_dense(args[0]);
+}
+
+// Copies the file name in /v/, a string, to /buf/ as a C string.
+static
+void
+path_arg(Env *e, const char *name, Value v, char *buf)
+{
+    if (v.kind != VAL_KIND_STR) {
+        env_throw(e, "'%s': file name must be a string", name);
+    }
+    const Str *s = AS_STR(v);
+    if (!s->ndata || s->ndata >= MATIO_PATH_MAX || memchr(s->data, '\0', s->ndata)) {
+        env_throw(e, "'%s': invalid file name", name);
+    }
+    memcpy(buf, s->data, s->ndata);
+    buf[s->ndata] = '\0';
 }
 
 static
 Value
-X_ne(Env *e, Value a, Value b)
+X_Save(Env *e, const Value *args, unsigned nargs)
 {
-    (void) e;
-    if (a.kind != b.kind) {
-        return MK_SCL(1);
+    if (nargs != 2) {
+        env_throw(e, "'Save' expects exactly two arguments");
     }
-    switch (a.kind) {
-    case VAL_KIND_NIL:
-        return MK_SCL(0);
-    case VAL_KIND_SCALAR:
-        return MK_SCL(a.as.scalar != b.as.scalar);
-    case VAL_KIND_MATRIX:
-        {
-            Matrix *x = AS_MAT(a);
-            Matrix *y = AS_MAT(b);
-            if (!eqdim(x, y)) {
-                return MK_SCL(1);
-            }
-            const size_t nelems = x->height * x->width;
-            for (size_t i = 0; i < nelems; ++i) {
-                if (x->elems[i] != y->elems[i]) {
-                    return MK_SCL(1);
-                }
-            }
-            return MK_SCL(0);
-        }
-        break;
-    case VAL_KIND_CFUNC:
-        return MK_SCL(a.as.cfunc != b.as.cfunc);
-    case VAL_KIND_FUNC:
-        return MK_SCL(a.as.gcobj != b.as.gcobj);
-    case VAL_KIND_STR:
-        return MK_SCL(!str_eq(AS_STR(a), AS_STR(b)));
+    if (args[0].kind != VAL_KIND_MATRIX) {
+        env_throw(e, "'Save': first argument must be a matrix");
     }
-    UNREACHABLE();
+    char path[MATIO_PATH_MAX];
+    path_arg(e, "Save", args[1], path);
+    matio_save(e, AS_MAT(args[0]), path);
+    return MK_NIL();
 }
 
 static
 Value
-X_not(Env *e, Value a)
+X_Load(Env *e, const Value *args, unsigned nargs)
 {
-    (void) e;
-    return MK_SCL(!value_is_truthy(a));
+    if (nargs != 1) {
+        env_throw(e, "'Load' expects exactly one argument");
+    }
+    char path[MATIO_PATH_MAX];
+    path_arg(e, "Load", args[0], path);
+    return MK_MAT(matio_load(e, path));
 }
 
 static
 Value
-X_and(Env *e, Value a, Value b)
+X_SaveNpy(Env *e, const Value *args, unsigned nargs)
 {
-    (void) e;
-    return MK_SCL(value_is_truthy(a) && value_is_truthy(b));
+    if (nargs != 2) {
+        env_throw(e, "'SaveNpy' expects exactly two arguments");
+    }
+    if (args[0].kind != VAL_KIND_MATRIX) {
+        env_throw(e, "'SaveNpy': first argument must be a matrix");
+    }
+    char path[MATIO_PATH_MAX];
+    path_arg(e, "SaveNpy", args[1], path);
+    matio_save_npy(e, AS_MAT(args[0]), path);
+    return MK_NIL();
 }
 
 static
 Value
-X_or(Env *e, Value a, Value b)
+X_LoadNpy(Env *e, const Value *args, unsigned nargs)
 {
-    (void) e;
-    return MK_SCL(value_is_truthy(a) || value_is_truthy(b));
+    if (nargs != 1) {
+        env_throw(e, "'LoadNpy' expects exactly one argument");
+    }
+    char path[MATIO_PATH_MAX];
+    path_arg(e, "LoadNpy", args[0], path);
+    return MK_MAT(matio_load_npy(e, path));
+}
+
+// The options of 'ReadCsv' and 'WriteCsv', a string of letters: "t" for
+// tabs between fields instead of commas, and, if /header/ is not NULL, "h"
+// for a header line.
+static
+void
+csv_opts(Env *e, const char *name, Value v, char *sep, bool *header)
+{
+    if (v.kind != VAL_KIND_STR) {
+        env_throw(e, "'%s': options must be a string", name);
+    }
+    const Str *s = AS_STR(v);
+    for (size_t i = 0; i < s->ndata; ++i) {
+        if (s->data[i] == 't') {
+            *sep = '\t';
+        } else if (s->data[i] == 'h' && header) {
+            *header = true;
+        } else {
+            env_throw(e, "'%s': unknown option '%c'", name, s->data[i]);
+        }
+    }
 }
 
 static
 Value
-X_pow(Env *e, Value a, Value b)
+X_ReadCsv(Env *e, const Value *args, unsigned nargs)
 {
-    if (a.kind != VAL_KIND_SCALAR || b.kind != VAL_KIND_SCALAR) {
-        env_throw(e, "cannot raise %s to power of %s",
-                  value_kindname(a.kind), value_kindname(b.kind));
+    if (nargs != 1 && nargs != 2) {
+        env_throw(e, "'ReadCsv' expects one or two arguments");
     }
-    return MK_SCL(pow(a.as.scalar, b.as.scalar));
+    char path[MATIO_PATH_MAX];
+    path_arg(e, "ReadCsv", args[0], path);
+    char sep = ',';
+    bool header = false;
+    if (nargs == 2) {
+        csv_opts(e, "ReadCsv", args[1], &sep, &header);
+    }
+    return MK_MAT(matio_read_csv(e, path, sep, header));
 }
 
-#define DECL1(Name_) \
-    static \
-    Value \
-    X_ ## Name_(Env *e, const Value *args, unsigned nargs) \
-    { \
-        if (nargs != 1) { \
-            env_throw(e, "'%s' expects exactly one argument", #Name_); \
-        } \
-        if (args[0].kind != VAL_KIND_SCALAR) { \
-            env_throw(e, "'%s' can only be applied to a scalar", #Name_); \
-        } \
-        return MK_SCL(Name_(args[0].as.scalar)); \
+static
+Value
+X_WriteCsv(Env *e, const Value *args, unsigned nargs)
+{
+    if (nargs != 2 && nargs != 3) {
+        env_throw(e, "'WriteCsv' expects two or three arguments");
+    }
+    if (args[0].kind != VAL_KIND_MATRIX) {
+        env_throw(e, "'WriteCsv': first argument must be a matrix");
+    }
+    char path[MATIO_PATH_MAX];
+    path_arg(e, "WriteCsv", args[1], path);
+    char sep = ',';
+    if (nargs == 3) {
+        csv_opts(e, "WriteCsv", args[2], &sep, NULL);
+    }
+    matio_write_csv(e, AS_MAT(args[0]), path, sep);
+    return MK_NIL();
+}
+
+// X such that A * X = B, for a sparse symmetric positive definite A, by
+// the conjugate gradient method, each column of B on its own; optionally
+// to a relative residual other than 1e-10, and in at most some other
+// number of iterations than 10 times the size of A.
+static
+Value
+X_SolveSparse(Env *e, const Value *args, unsigned nargs)
+{
+    if (nargs < 2 || nargs > 4) {
+        env_throw(e, "'SolveSparse' expects 2 to 4 arguments");
+    }
+    if (args[0].kind != VAL_KIND_SPARSE || args[1].kind != VAL_KIND_MATRIX) {
+        env_throw(e, "'SolveSparse' can only be applied to a sparse and a dense matrix");
+    }
+    const Sparse *a = AS_SPARSE(args[0]);
+    Matrix *b = AS_MAT(args[1]);
+    const unsigned n = a->height;
+    if (a->width != n) {
+        env_throw(e, "'SolveSparse': matrix must be square");
+    }
+    if (b->height != n) {
+        env_throw(e, "'SolveSparse': matrices unconformable");
+    }
+    Scalar tol = 1e-10;
+    if (nargs > 2) {
+        if (args[2].kind != VAL_KIND_SCALAR || !(args[2].as.scalar > 0)) {
+            env_throw(e, "'SolveSparse': tolerance must be a positive scalar");
+        }
+        tol = args[2].as.scalar;
+    }
+    unsigned maxit = (uint_least64_t) 10 * n < UINT_MAX ? 10 * n : UINT_MAX - 1;
+    if (nargs > 3) {
+        const Value v = args[3];
+        if (v.kind != VAL_KIND_SCALAR || !(v.as.scalar >= 0 && v.as.scalar < UINT_MAX) ||
+            v.as.scalar != floor(v.as.scalar))
+        {
+            env_throw(e, "'SolveSparse': iteration limit must be a nonnegative integer");
+        }
+        maxit = v.as.scalar;
     }
 
-DECL1(sin)
-DECL1(cos)
-DECL1(tan)
-DECL1(asin)
-DECL1(acos)
-DECL1(atan)
-DECL1(exp)
-DECL1(log)
-DECL1(floor)
-DECL1(trunc)
-DECL1(ceil)
-DECL1(round)
+    matrix_pack(b);
+    const unsigned k = b->width;
+    Matrix *z = matrix_new(n, k);
+    const LinalgCsr s = sparse_csr(a);
+    Scalar *col = k > 1 ? scratch_alloc(2 * (size_t) n * sizeof(Scalar)) : NULL;
+    for (size_t j = 0; j < k; ++j) {
+        Scalar *xj = k > 1 ? col : z->elems;
+        const Scalar *bj = b->elems;
+        if (k > 1) {
+            Scalar *t = col + n;
+            for (size_t i = 0; i < n; ++i) {
+                t[i] = b->elems[i * k + j];
+            }
+            memset(xj, 0, (size_t) n * sizeof(Scalar));
+            bj = t;
+        }
+        if (linalg_csr_cg(xj, &s, bj, tol, maxit) > maxit) {
+            value_unref(MK_MAT(z));
+            env_throw(e, "'SolveSparse': no convergence (is the matrix symmetric positive "
+                         "definite?)");
+        }
+        if (k > 1) {
+            for (size_t i = 0; i < n; ++i) {
+                z->elems[i * k + j] = xj[i];
+            }
+        }
+    }
+    if (col) {
+        scratch_free(col, 2 * (size_t) n * sizeof(Scalar));
+    }
+    return MK_MAT(z);
+}
 
 static
 Value
@@ -358,13 +1619,16 @@ X_Dim(Env *e, const Value *args, unsigned nargs)
     if (nargs != 1) {
         env_throw(e, "'Dim' expects exactly one argument");
     }
-    if (args[0].kind != VAL_KIND_MATRIX) {
+    if (args[0].kind != VAL_KIND_MATRIX && args[0].kind != VAL_KIND_SPARSE &&
+        args[0].kind != VAL_KIND_TYPED)
+    {
         env_throw(e, "'Dim' can only be applied to a matrix");
     }
-    Matrix *m = AS_MAT(args[0]);
-    Matrix *d = matrix_new(1, 2);
-    d->elems[0] = m->height;
-    d->elems[1] = m->width;
+    unsigned height, width;
+    dims_of(args[0], &height, &width);
+    Matrix *d = matrix_new_uninit(1, 2);
+    d->elems[0] = height;
+    d->elems[1] = width;
     return MK_MAT(d);
 }
 
@@ -375,19 +1639,26 @@ X_Transpose(Env *e, const Value *args, unsigned nargs)
     if (nargs != 1) {
         env_throw(e, "'Trans' expects exactly one argument");
     }
+    if (args[0].kind == VAL_KIND_SPARSE) {
+        return MK_SPARSE(sparse_transposed(AS_SPARSE(args[0])));
+    }
+    if (args[0].kind == VAL_KIND_TYPED) {
+        return MK_TYPED(typed_transposed(AS_TYPED(args[0])));
+    }
     if (args[0].kind != VAL_KIND_MATRIX) {
         env_throw(e, "'Trans' can only be applied to a matrix");
     }
     Matrix *x = AS_MAT(args[0]);
-    const unsigned height = x->height;
-    const unsigned width = x->width;
-    Matrix *y = matrix_new(width, height);
-    for (unsigned i = 0; i < width; ++i) {
-        for (unsigned j = 0; j < height; ++j) {
-            y->elems[i * height + j] = x->elems[j * width + i];
-        }
+    if (linalg_is_small(x->height, x->width)) {
+        // A copy costs no more than a view here, and keeps what comes next
+        // on the packed paths.
+        Matrix *z = matrix_new_uninit(x->width, x->height);
+        linalg_transpose_small(z->elems, x->elems, x->rstride, x->cstride, x->height, x->width);
+        return MK_MAT(z);
     }
-    return MK_MAT(y);
+    // Nothing moves until somebody needs the elements in order; see
+    // /matrix_pack/.
+    return MK_MAT(matrix_transposed(x));
 }
 
 static
@@ -444,7 +1715,9 @@ X_Kind(Env *e, const Value *args, unsigned nargs)
     if (nargs != 1) {
         env_throw(e, "'Kind' expects exactly one argument");
     }
-    const char *kind = value_kindname(args[0].kind);
+    const char *kind = args[0].kind == VAL_KIND_TYPED
+        ? typed_kindname(AS_TYPED(args[0])->elem)
+        : value_kindname(args[0].kind);
     return MK_STR(str_new(kind, strlen(kind)));
 }
 
@@ -472,6 +1745,14 @@ repr(char *buf, size_t nbuf, size_t *len, Value v)
         *len = snprintf(buf, nbuf, "<matrix>");
         return buf;
 
+    case VAL_KIND_SPARSE:
+        *len = snprintf(buf, nbuf, "<sparse matrix>");
+        return buf;
+
+    case VAL_KIND_TYPED:
+        *len = snprintf(buf, nbuf, "<%s>", typed_kindname(AS_TYPED(v)->elem));
+        return buf;
+
     case VAL_KIND_FUNC:
         *len = snprintf(buf, nbuf, "<function>");
         return buf;
@@ -548,6 +1829,19 @@ X_Clock(Env *e, const Value *args, unsigned nargs)
     return MK_SCL(clock() / (Scalar) CLOCKS_PER_SEC);
 }
 
+static
+Value
+X_Stats(Env *e, const Value *args, unsigned nargs)
+{
+    (void) args;
+    if (nargs != 0) {
+        env_throw(e, "'Stats' takes no arguments");
+    }
+    char buf[1024];
+    const size_t n = stats_format(buf, sizeof(buf));
+    return MK_STR(str_new(buf, n < sizeof(buf) ? n : sizeof(buf) - 1));
+}
+
 static
 bool
 dostring(Runtime rt, const char *name, const char *buf, size_t nbuf)
@@ -668,12 +1962,26 @@ static
 void
 usage(void)
 {
-    fprintf(stderr, "USAGE: main [-i] [FILE ...]\n"
-                    "       main -c CODE\n"
+    fprintf(stderr, "USAGE: main [-i] [-S] [-j NTHREADS] [FILE ...]\n"
+                    "       main [-S] [-j NTHREADS] -c CODE\n"
                     );
     exit(2);
 }
 
+// Parses a thread count given to -j or in $CALC_THREADS; 0 if invalid.
+static
+unsigned
+parse_nthreads(const char *s)
+{
+    char *end;
+    errno = 0;
+    const long r = strtol(s, &end, 10);
+    if (errno || end == s || *end || r < 1 || r > 1024) {
+        return 0;
+    }
+    return r;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -681,7 +1989,9 @@ main(int argc, char **argv)
     char *codearg = NULL;
     bool iflag = false;
     bool dflag = false;
-    for (int c; (c = getopt(argc, argv, "c:id")) != -1;) {
+    bool sflag = false;
+    unsigned nthreads = 0;
+    for (int c; (c = getopt(argc, argv, "c:idSj:")) != -1;) {
         switch (c) {
         case 'c':
             codearg = optarg;
@@ -692,6 +2002,14 @@ main(int argc, char **argv)
         case 'd':
             dflag = true;
             break;
+        case 'S':
+            sflag = true;
+            break;
+        case 'j':
+            if (!(nthreads = parse_nthreads(optarg))) {
+                usage();
+            }
+            break;
         case '?':
             usage();
             break;
@@ -702,19 +2020,27 @@ main(int argc, char **argv)
 
     is_interactive = iflag || osdep_is_interactive();
 
-    Runtime rt = runtime_new(userdata_new());
+    if (!nthreads) {
+        const char *env = getenv("CALC_THREADS");
+        if (!env || !(nthreads = parse_nthreads(env))) {
+            nthreads = osdep_ncpus();
+        }
+    }
+
+    Runtime rt = runtime_new(userdata_new(), nthreads);
     rt.dflag = dflag;
 
 #define UNARY(Exec_, ...) (Op) {.arity = 1, .exec = {.unary = Exec_}, __VA_ARGS__}
 #define BINARY(Exec_, ...) (Op) {.arity = 2, .exec = {.binary = Exec_}, __VA_ARGS__}
 
     runtime_reg_ambig_op(rt, "-",
-        UNARY(X_uminus, .assoc = OP_ASSOC_RIGHT, .priority = 100),
-        BINARY(X_bminus, .assoc = OP_ASSOC_LEFT, .priority = 1)
+        UNARY(X_uminus, .assoc = OP_ASSOC_RIGHT, .priority = 100, .lazy = 1),
+        BINARY(X_bminus, .assoc = OP_ASSOC_LEFT, .priority = 1, .lazy = 1)
     );
-    runtime_reg_op(rt, "+", BINARY(X_plus, .assoc = OP_ASSOC_LEFT, .priority = 1));
+    runtime_reg_op(rt, "+", BINARY(X_plus, .assoc = OP_ASSOC_LEFT, .priority = 1, .lazy = 1,
+                                    .means = OP_MEANS_ADD));
 
-    runtime_reg_op(rt, "*", BINARY(X_mul, .assoc = OP_ASSOC_LEFT, .priority = 2));
+    runtime_reg_op(rt, "*", BINARY(X_mul, .assoc = OP_ASSOC_LEFT, .priority = 2, .lazy = 1));
     runtime_reg_op(rt, "/", BINARY(X_div, .assoc = OP_ASSOC_LEFT, .priority = 2));
     runtime_reg_op(rt, "%", BINARY(X_mod, .assoc = OP_ASSOC_LEFT, .priority = 2));
     runtime_reg_op(rt, "^", BINARY(X_pow, .assoc = OP_ASSOC_RIGHT, .priority = 3));
@@ -725,8 +2051,10 @@ main(int argc, char **argv)
     runtime_reg_op(rt, "&&", BINARY(X_and, .assoc = OP_ASSOC_LEFT,  .priority = 0));
     runtime_reg_op(rt, "||", BINARY(X_or,  .assoc = OP_ASSOC_LEFT,  .priority = 0));
 
-    runtime_reg_op(rt, "<",  BINARY(X_lt, .assoc = OP_ASSOC_LEFT, .priority = 0));
-    runtime_reg_op(rt, "<=", BINARY(X_le, .assoc = OP_ASSOC_LEFT, .priority = 0));
+    runtime_reg_op(rt, "<",  BINARY(X_lt, .assoc = OP_ASSOC_LEFT, .priority = 0,
+                                     .means = OP_MEANS_BELOW));
+    runtime_reg_op(rt, "<=", BINARY(X_le, .assoc = OP_ASSOC_LEFT, .priority = 0,
+                                     .means = OP_MEANS_BELOW));
     runtime_reg_op(rt, "==", BINARY(X_eq, .assoc = OP_ASSOC_LEFT, .priority = 0));
     runtime_reg_op(rt, "!=", BINARY(X_ne, .assoc = OP_ASSOC_LEFT, .priority = 0));
     runtime_reg_op(rt, ">",  BINARY(X_gt, .assoc = OP_ASSOC_LEFT, .priority = 0));
@@ -748,6 +2076,42 @@ main(int argc, char **argv)
     runtime_put(rt, "ceil", MK_CFUNC(X_ceil));
     runtime_put(rt, "round", MK_CFUNC(X_round));
 
+    runtime_put(rt, "Sum", MK_CFUNC(X_Sum));
+    runtime_put(rt, "Prod", MK_CFUNC(X_Prod));
+    runtime_put(rt, "Min", MK_CFUNC(X_Min));
+    runtime_put(rt, "Max", MK_CFUNC(X_Max));
+    runtime_put(rt, "Mean", MK_CFUNC(X_Mean));
+    runtime_put(rt, "Dot", MK_CFUNC(X_Dot));
+    runtime_put(rt, "Norm", MK_CFUNC(X_Norm));
+    runtime_put(rt, "Any", MK_CFUNC(X_Any));
+    runtime_put(rt, "All", MK_CFUNC(X_All));
+    runtime_put(rt, "CumSum", MK_CFUNC(X_CumSum));
+
+    runtime_put(rt, "Solve", MK_CFUNC(X_Solve));
+    runtime_put(rt, "Inv", MK_CFUNC(X_Inv));
+    runtime_put(rt, "Det", MK_CFUNC(X_Det));
+    runtime_put(rt, "LU", MK_CFUNC(X_LU));
+    runtime_put(rt, "Chol", MK_CFUNC(X_Chol));
+    runtime_put(rt, "QR", MK_CFUNC(X_QR));
+    runtime_put(rt, "LstSq", MK_CFUNC(X_LstSq));
+    runtime_put(rt, "Eig", MK_CFUNC(X_Eig));
+
+    runtime_put(rt, "Sparse", MK_CFUNC(X_Sparse));
+    runtime_put(rt, "Full", MK_CFUNC(X_Full));
+    runtime_put(rt, "SolveSparse", MK_CFUNC(X_SolveSparse));
+
+    runtime_put(rt, "UInt8", MK_CFUNC(X_UInt8));
+    runtime_put(rt, "Int32", MK_CFUNC(X_Int32));
+    runtime_put(rt, "Float32", MK_CFUNC(X_Float32));
+    runtime_put(rt, "Double", MK_CFUNC(X_Double));
+
+    runtime_put(rt, "Save", MK_CFUNC(X_Save));
+    runtime_put(rt, "Load", MK_CFUNC(X_Load));
+    runtime_put(rt, "SaveNpy", MK_CFUNC(X_SaveNpy));
+    runtime_put(rt, "LoadNpy", MK_CFUNC(X_LoadNpy));
+    runtime_put(rt, "ReadCsv", MK_CFUNC(X_ReadCsv));
+    runtime_put(rt, "WriteCsv", MK_CFUNC(X_WriteCsv));
+
     runtime_put(rt, "Mat", MK_CFUNC(X_Mat));
     runtime_put(rt, "Dim", MK_CFUNC(X_Dim));
     runtime_put(rt, "Trans", MK_CFUNC(X_Transpose));
@@ -757,6 +2121,7 @@ main(int argc, char **argv)
     runtime_put(rt, "Input", MK_CFUNC(X_Input));
 
     runtime_put(rt, "Clock", MK_CFUNC(X_Clock));
+    runtime_put(rt, "Stats", MK_CFUNC(X_Stats));
 
     runtime_put(rt, "Pi", MK_SCL(acos(-1)));
     runtime_put(rt, "E", MK_SCL(exp(1)));
@@ -795,5 +2160,11 @@ main(int argc, char **argv)
     }
 
     runtime_destroy(rt);
+
+    if (sflag) {
+        char buf[1024];
+        const size_t n = stats_format(buf, sizeof(buf));
+        fwrite(buf, 1, n < sizeof(buf) ? n : sizeof(buf) - 1, stderr);
+    }
     return ret;
 }
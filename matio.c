@@ -0,0 +1,1204 @@
+#include "matio.h"
+#include "env.h"
+#include "osdep.h"
+#include "workers.h"
+
+#include <ctype.h>
+#include <float.h>
+#include <math.h>
+
+static
+bool
+host_is_little_endian(void)
+{
+    const uint_least16_t one = 1;
+    unsigned char first;
+    memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+static
+void
+put_u32(unsigned char *p, uint_least32_t x)
+{
+    for (int i = 0; i < 4; ++i) {
+        p[i] = (x >> (8 * i)) & 0xff;
+    }
+}
+
+static
+uint_least32_t
+get_u32(const unsigned char *p)
+{
+    uint_least32_t x = 0;
+    for (int i = 0; i < 4; ++i) {
+        x |= (uint_least32_t) p[i] << (8 * i);
+    }
+    return x;
+}
+
+static
+void
+put_scalar(unsigned char *p, Scalar x)
+{
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    for (int i = 0; i < 8; ++i) {
+        p[i] = (bits >> (8 * i)) & 0xff;
+    }
+}
+
+static
+Scalar
+get_scalar(const unsigned char *p)
+{
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i) {
+        bits |= (uint64_t) p[i] << (8 * i);
+    }
+    Scalar x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+// Writes the elements of /m/, row after row; returns false on failure.
+static
+bool
+write_elems(FILE *f, const Matrix *m)
+{
+    const size_t n = (size_t) m->height * m->width;
+    if (host_is_little_endian() && matrix_is_packed(m)) {
+        return fwrite(m->elems, sizeof(Scalar), n, f) == n;
+    }
+    unsigned char buf[4096];
+    size_t nbuf = 0;
+    for (size_t i = 0; i < m->height; ++i) {
+        for (size_t j = 0; j < m->width; ++j) {
+            if (nbuf == sizeof(buf)) {
+                if (fwrite(buf, 1, nbuf, f) != nbuf) {
+                    return false;
+                }
+                nbuf = 0;
+            }
+            put_scalar(buf + nbuf, matrix_at(m, i, j));
+            nbuf += 8;
+        }
+    }
+    return fwrite(buf, 1, nbuf, f) == nbuf;
+}
+
+// Size of the name of a replacement: /path/ and ".XXXXXX".
+#define TMP_PATH_MAX (MATIO_PATH_MAX + 8)
+
+// A file is replaced by writing the new one next to it, under a name of
+// its own put in tmp[TMP_PATH_MAX], then moving that over it: a matrix
+// loaded from the old file keeps mapping that one, and neither an existing
+// file nor another process saving to the same path is written over.
+static
+FILE *
+open_replacement(Env *e, const char *name, const char *path, char *tmp)
+{
+    snprintf(tmp, TMP_PATH_MAX, "%s.XXXXXX", path);
+    FILE *f = osdep_create_temp(tmp);
+    if (!f) {
+        env_throw(e, "'%s': cannot create a file next to '%s': %s", name, path, strerror(errno));
+    }
+    return f;
+}
+
+// Closes /f/ and, if everything was written to it (/ok/), moves it over
+// /path/.
+static
+void
+commit_replacement(Env *e, const char *name, FILE *f, bool ok, const char *tmp, const char *path)
+{
+    ok = fclose(f) == 0 && ok;
+    if (!ok || !osdep_replace_file(tmp, path)) {
+        const int saved_errno = errno;
+        remove(tmp);
+        env_throw(e, "'%s': cannot write '%s': %s", name, path, strerror(saved_errno));
+    }
+}
+
+void
+matio_save(Env *e, const Matrix *m, const char *path)
+{
+    assert(!m->pending);
+    char tmp[TMP_PATH_MAX];
+    FILE *f = open_replacement(e, "Save", path, tmp);
+    unsigned char hdr[MATIO_HEADER_NBYTES];
+    memcpy(hdr, MATIO_MAGIC, 8);
+    put_u32(hdr + 8, m->height);
+    put_u32(hdr + 12, m->width);
+    const bool ok = fwrite(hdr, 1, sizeof(hdr), f) == sizeof(hdr) && write_elems(f, m);
+    commit_replacement(e, "Save", f, ok, tmp, path);
+}
+
+Matrix *
+matio_load(Env *e, const char *path)
+{
+    size_t nbytes;
+    unsigned char *p = osdep_map_file(path, &nbytes);
+    if (!p) {
+        env_throw(e, "'Load': cannot open '%s': %s", path, strerror(errno));
+    }
+    if (nbytes < MATIO_HEADER_NBYTES || memcmp(p, MATIO_MAGIC, 8) != 0 ||
+        (get_u32(p + 8) == 0) != (get_u32(p + 12) == 0))
+    {
+        osdep_unmap_file(p, nbytes);
+        env_throw(e, "'Load': '%s' is not a matrix file", path);
+    }
+    const uint_least32_t height = get_u32(p + 8);
+    const uint_least32_t width = get_u32(p + 12);
+    const uint_least64_t n = (uint_least64_t) height * width;
+    if (n > UINT_MAX) {
+        osdep_unmap_file(p, nbytes);
+        env_throw(e, "'Load': the matrix in '%s' is too large", path);
+    }
+    if ((uint_least64_t) (nbytes - MATIO_HEADER_NBYTES) != n * sizeof(Scalar)) {
+        osdep_unmap_file(p, nbytes);
+        env_throw(e, "'Load': '%s' is truncated or has trailing data", path);
+    }
+    if (!n) {
+        osdep_unmap_file(p, nbytes);
+        return matrix_new(height, width);
+    }
+    if (!host_is_little_endian()) {
+        Matrix *m = matrix_new_uninit(height, width);
+        for (size_t k = 0; k < n; ++k) {
+            m->elems[k] = get_scalar(p + MATIO_HEADER_NBYTES + 8 * k);
+        }
+        osdep_unmap_file(p, nbytes);
+        return m;
+    }
+    // The mapping starts on a page boundary, so the elements are aligned.
+    return matrix_new_mapped((Scalar *) (p + MATIO_HEADER_NBYTES), MATIO_HEADER_NBYTES, height,
+                             width);
+}
+
+void
+matio_unmap(Matrix *m)
+{
+    assert(m->map_offset);
+    const size_t nelems = (size_t) m->height * m->width;
+    osdep_unmap_file((unsigned char *) m->elems - m->map_offset,
+                     m->map_offset + nelems * sizeof(Scalar));
+}
+
+// Text of at most this many bytes is parsed in one chunk by one thread;
+// chunks are cut at line ends, in the same places whatever the number of
+// threads.
+enum { CSV_CHUNK = 1 << 20 };
+
+// Numbers longer than this are not taken by the fast path of
+// /parse_number/, and written numbers are never this long.
+enum { CSV_NUMBER_MAX = 32 };
+
+// The powers of ten that a double holds exactly.
+static const Scalar pow10_exact[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Whether /c/ is blank space around fields separated by /sep/.
+static
+bool
+csv_is_space(char c, char sep)
+{
+    return (c == ' ' || c == '\t' || c == '\r') && c != sep;
+}
+
+static
+bool
+csv_is_blank(const char *p, const char *end, char sep)
+{
+    for (; p != end; ++p) {
+        if (!csv_is_space(*p, sep)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static
+bool
+is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 Uint128;
+
+static
+int
+bit_length(Uint128 x)
+{
+    const uint64_t hi = x >> 64;
+    const uint64_t lo = x;
+    return hi ? 128 - __builtin_clzll(hi) : lo ? 64 - __builtin_clzll(lo) : 0;
+}
+
+// /q/ + /sticky/ (a nonzero fraction below its last bit) rounded to 53
+// bits, half to even, times 2^/*shift/ on return.
+static
+uint64_t
+round_to_double(Uint128 q, bool sticky, int *shift)
+{
+    const int t = bit_length(q) - 53;
+    if (t <= 0) {
+        *shift = 0;
+        return q;
+    }
+    const Uint128 half = (Uint128) 1 << (t - 1);
+    const Uint128 low = q & ((half << 1) - 1);
+    uint64_t m = q >> t;
+    if (low > half || (low == half && (sticky || (m & 1)))) {
+        ++m;
+    }
+    *shift = t;
+    if (m == (uint64_t) 1 << 53) {
+        m >>= 1;
+        ++*shift;
+    }
+    return m;
+}
+
+// /mant/ x 10^/exp10/, correctly rounded, for |/exp10/| <= 27, where the
+// power of five it takes fits in 64 bits: the product, or enough bits of
+// the quotient, are computed exactly and rounded once.
+static
+Scalar
+scale_exact(uint64_t mant, int exp10)
+{
+    uint64_t pow5 = 1;
+    for (int i = 0; i < (exp10 < 0 ? -exp10 : exp10); ++i) {
+        pow5 *= 5;
+    }
+    int shift;
+    if (exp10 >= 0) {
+        const uint64_t m = round_to_double((Uint128) mant * pow5, false, &shift);
+        return ldexp(m, shift + exp10);
+    }
+    // At least 54 bits of quotient, and the remainder to round by.
+    int s = 55 + bit_length(pow5) - bit_length(mant);
+    if (s < 0) {
+        s = 0;
+    }
+    const Uint128 n = (Uint128) mant << s;
+    const uint64_t m = round_to_double(n / pow5, n % pow5 != 0, &shift);
+    return ldexp(m, shift - s + exp10);
+}
+
+// The 17 significant digits of /x/, finite and nonzero, correctly rounded,
+// and the power of ten of the first, where exact 128-bit arithmetic gets
+// them: for about 1e-11 <= |/x/| < 1e17.
+static
+bool
+digits17(Scalar x, uint64_t *d, int *e)
+{
+    // |x| = m x 2^k.
+    int k;
+    const uint64_t m = ldexp(frexp(fabs(x), &k), 53);
+    k -= 53;
+    // Off by one at most, which the loop corrects.
+    int e10 = floor(log10(fabs(x)));
+    for (int tries = 0; tries < 3; ++tries) {
+        const int p = 16 - e10;
+        if (p < 0 || p > 27) {
+            return false;
+        }
+        uint64_t pow5 = 1;
+        for (int i = 0; i < p; ++i) {
+            pow5 *= 5;
+        }
+        // |x| x 10^p = m x 5^p x 2^(p + k), rounded to an integer.
+        const Uint128 v = (Uint128) m * pow5;
+        const int sh = p + k;
+        Uint128 q;
+        if (sh >= 0) {
+            q = v << sh;
+        } else {
+            const Uint128 half = (Uint128) 1 << (-sh - 1);
+            const Uint128 low = v & ((half << 1) - 1);
+            q = v >> -sh;
+            q += low > half || (low == half && (q & 1));
+        }
+        if (q >= (Uint128) 100000000000000000) {
+            ++e10;
+        } else if (q < (Uint128) 10000000000000000) {
+            --e10;
+        } else {
+            *d = q;
+            *e = e10;
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+// Parses [p, end), "inf" or "nan" in any case (a sign is already read),
+// into /*out/; these are what /matio_write_csv_file/ writes for infinities
+// and NaNs.
+static
+bool
+parse_non_finite(const char *p, const char *end, bool neg, Scalar *out)
+{
+    if (end - p != 3) {
+        return false;
+    }
+    char word[3];
+    for (int i = 0; i < 3; ++i) {
+        word[i] = tolower((unsigned char) p[i]);
+    }
+    if (memcmp(word, "inf", 3) == 0) {
+        *out = neg ? -INFINITY : INFINITY;
+    } else if (memcmp(word, "nan", 3) == 0) {
+        *out = neg ? -NAN : NAN;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Parses [p, end), which must be a number and nothing else, into /*out/,
+// correctly rounded; returns false if it is not one. A number is an
+// optional sign, then digits with an optional '.' among or before or after
+// them, then an optional exponent: 'e' or 'E', an optional sign and digits.
+// Or it is a sign, optional again, and "inf" or "nan".
+static
+bool
+parse_number(const char *p, const char *end, Scalar *out)
+{
+    // The significant digits (up to 19, which fit in 64 bits) and the power
+    // of ten that scales them; anything that does not fit goes to /strtod/.
+    const char *s = p;
+    const bool neg = s != end && *s == '-';
+    if (s != end && (*s == '-' || *s == '+')) {
+        ++s;
+    }
+    const char *unsigned_at = s;
+    uint64_t mant = 0;
+    int ndigits = 0;
+    long exp10 = 0;
+    bool any = false;
+    bool inexact = false;
+    for (; s != end && is_digit(*s); ++s) {
+        any = true;
+        if (ndigits < 19) {
+            mant = mant * 10 + (*s - '0');
+            ndigits += mant != 0;
+        } else {
+            ++exp10;
+            inexact |= *s != '0';
+        }
+    }
+    if (s != end && *s == '.') {
+        for (++s; s != end && is_digit(*s); ++s) {
+            any = true;
+            if (ndigits < 19) {
+                mant = mant * 10 + (*s - '0');
+                ndigits += mant != 0;
+                --exp10;
+            } else {
+                inexact |= *s != '0';
+            }
+        }
+    }
+    if (any && s != end && (*s == 'e' || *s == 'E')) {
+        ++s;
+        const bool exp_neg = s != end && *s == '-';
+        if (s != end && (*s == '-' || *s == '+')) {
+            ++s;
+        }
+        if (s == end || !is_digit(*s)) {
+            return false;
+        }
+        long e = 0;
+        for (; s != end && is_digit(*s); ++s) {
+            if (e < 100000) {
+                e = e * 10 + (*s - '0');
+            }
+        }
+        exp10 += exp_neg ? -e : e;
+    }
+    // Nothing else is left to /strtod/, which would take hexadecimal and
+    // other spellings, some depending on the C library.
+    if (!any || s != end) {
+        return parse_non_finite(unsigned_at, end, neg, out);
+    }
+    if (!inexact) {
+        if (mant == 0) {
+            *out = neg ? -0.0 : 0.0;
+            return true;
+        }
+#if FLT_EVAL_METHOD == 0
+        // Clinger's fast path: when /mant/ and the power of ten are both
+        // exact doubles, one multiply or divide rounds correctly.
+        uint64_t m = mant;
+        long e = exp10;
+        while (e > 22 && m <= ((uint64_t) 1 << 53) / 10) {
+            m *= 10;
+            --e;
+        }
+        if (m <= (uint64_t) 1 << 53 && e >= -22 && e <= 22) {
+            const Scalar x = e < 0 ? (Scalar) m / pow10_exact[-e] : (Scalar) m * pow10_exact[e];
+            *out = neg ? -x : x;
+            return true;
+        }
+#endif
+#ifdef __SIZEOF_INT128__
+        if (exp10 >= -27 && exp10 <= 27) {
+            const Scalar x = scale_exact(mant, exp10);
+            *out = neg ? -x : x;
+            return true;
+        }
+#endif
+    }
+    const size_t n = end - p;
+    char local[CSV_NUMBER_MAX];
+    char *buf = n < sizeof(local) ? local : XNEW(char, n + 1);
+    memcpy(buf, p, n);
+    buf[n] = '\0';
+    char *stop;
+    *out = strtod(buf, &stop);
+    const bool ok = stop == buf + n;
+    if (buf != local) {
+        free(buf);
+    }
+    return ok;
+}
+
+typedef struct {
+    // Offset of the first line in error, or SIZE_MAX.
+    size_t line;
+    // The number of fields on it, if not the width of the matrix; else the
+    // one that is not a number, counting from 0.
+    unsigned nfields;
+    unsigned field;
+} CsvError;
+
+// Parses the fields of the line [p, end) into dst[width]; returns false,
+// filling in /err/ but its /line/, if it does not have exactly /width/
+// fields or one of them is not a number.
+static
+bool
+parse_line(const char *p, const char *end, char sep, Scalar *dst, unsigned width, CsvError *err)
+{
+    unsigned k = 0;
+    for (;;) {
+        const char *q = memchr(p, sep, end - p);
+        const char *field_end = q ? q : end;
+        if (k < width) {
+            const char *a = p;
+            const char *b = field_end;
+            while (a != b && csv_is_space(*a, sep)) {
+                ++a;
+            }
+            while (b != a && csv_is_space(b[-1], sep)) {
+                --b;
+            }
+            if (!parse_number(a, b, &dst[k])) {
+                err->nfields = width;
+                err->field = k;
+                return false;
+            }
+        }
+        ++k;
+        if (!q) {
+            break;
+        }
+        p = q + 1;
+    }
+    if (k != width) {
+        err->nfields = k;
+        return false;
+    }
+    return true;
+}
+
+typedef struct {
+    const char *buf;
+    char sep;
+    unsigned width;
+    // Chunk k is buf[bounds[k], bounds[k + 1]).
+    const size_t *bounds;
+    // Per chunk: its number of rows, then the index of its first one.
+    size_t *rows;
+    Scalar *dst;
+    CsvError *errs;
+} CsvReadCtx;
+
+static
+void
+count_rows(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    CsvReadCtx *c = ctx;
+    for (size_t k = begin; k < end; ++k) {
+        const char *p = c->buf + c->bounds[k];
+        const char *chunk_end = c->buf + c->bounds[k + 1];
+        size_t n = 0;
+        while (p != chunk_end) {
+            const char *nl = memchr(p, '\n', chunk_end - p);
+            const char *line_end = nl ? nl : chunk_end;
+            n += !csv_is_blank(p, line_end, c->sep);
+            p = nl ? nl + 1 : chunk_end;
+        }
+        c->rows[k] = n;
+    }
+}
+
+static
+void
+parse_rows(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    CsvReadCtx *c = ctx;
+    for (size_t k = begin; k < end; ++k) {
+        const char *p = c->buf + c->bounds[k];
+        const char *chunk_end = c->buf + c->bounds[k + 1];
+        Scalar *dst = c->dst + c->rows[k] * c->width;
+        c->errs[k].line = SIZE_MAX;
+        while (p != chunk_end) {
+            const char *nl = memchr(p, '\n', chunk_end - p);
+            const char *line_end = nl ? nl : chunk_end;
+            if (!csv_is_blank(p, line_end, c->sep)) {
+                if (!parse_line(p, line_end, c->sep, dst, c->width, &c->errs[k])) {
+                    c->errs[k].line = p - c->buf;
+                    break;
+                }
+                dst += c->width;
+            }
+            p = nl ? nl + 1 : chunk_end;
+        }
+    }
+}
+
+Matrix *
+matio_parse_csv(const char *buf, size_t nbuf, char sep, bool header, char *err, size_t nerr)
+{
+    size_t start = 0;
+    if (header) {
+        const char *nl = memchr(buf, '\n', nbuf);
+        start = nl ? (size_t) (nl + 1 - buf) : nbuf;
+    }
+
+    // The first row sets the width.
+    unsigned width = 0;
+    for (size_t p = start; p != nbuf && !width;) {
+        const char *nl = memchr(buf + p, '\n', nbuf - p);
+        const size_t line_end = nl ? (size_t) (nl - buf) : nbuf;
+        if (!csv_is_blank(buf + p, buf + line_end, sep)) {
+            width = 1;
+            for (size_t i = p; i != line_end; ++i) {
+                width += buf[i] == sep;
+            }
+        }
+        p = nl ? line_end + 1 : nbuf;
+    }
+    if (!width) {
+        return matrix_new(0, 0);
+    }
+
+    const size_t nchunks = (nbuf - start + CSV_CHUNK - 1) / CSV_CHUNK;
+    size_t *bounds = XNEW(size_t, nchunks + 1);
+    bounds[0] = start;
+    for (size_t k = 1; k < nchunks; ++k) {
+        const size_t p = start + k * CSV_CHUNK;
+        const char *nl = memchr(buf + p, '\n', nbuf - p);
+        bounds[k] = nl ? (size_t) (nl + 1 - buf) : nbuf;
+        if (bounds[k] < bounds[k - 1]) {
+            // A line longer than a chunk.
+            bounds[k] = bounds[k - 1];
+        }
+    }
+    bounds[nchunks] = nbuf;
+
+    CsvReadCtx c = {
+        .buf = buf,
+        .sep = sep,
+        .width = width,
+        .bounds = bounds,
+        .rows = XNEW(size_t, nchunks),
+        .errs = XNEW(CsvError, nchunks),
+    };
+    workers_run(workers_global, nchunks, 1, count_rows, &c);
+    size_t height = 0;
+    for (size_t k = 0; k < nchunks; ++k) {
+        const size_t n = c.rows[k];
+        c.rows[k] = height;
+        height += n;
+    }
+
+    Matrix *m = NULL;
+    if ((uint_least64_t) height * width > UINT_MAX) {
+        snprintf(err, nerr, "the matrix is too large");
+        goto done;
+    }
+    m = matrix_new_uninit(height, width);
+    c.dst = m->elems;
+    workers_run(workers_global, nchunks, 1, parse_rows, &c);
+    for (size_t k = 0; k < nchunks; ++k) {
+        const CsvError *e = &c.errs[k];
+        if (e->line == SIZE_MAX) {
+            continue;
+        }
+        size_t lineno = 1;
+        for (const char *p = buf; (p = memchr(p, '\n', buf + e->line - p)); ++p) {
+            ++lineno;
+        }
+        if (e->nfields != width) {
+            snprintf(err, nerr, "line %zu: expected %u fields, found %u", lineno, width,
+                     e->nfields);
+        } else {
+            snprintf(err, nerr, "line %zu, field %u: not a number", lineno, e->field + 1);
+        }
+        value_unref(MK_MAT(m));
+        m = NULL;
+        break;
+    }
+
+done:
+    free(bounds);
+    free(c.rows);
+    free(c.errs);
+    return m;
+}
+
+Matrix *
+matio_read_csv(Env *e, const char *path, char sep, bool header)
+{
+    size_t nbytes;
+    char *buf = osdep_map_file(path, &nbytes);
+    if (!buf) {
+        env_throw(e, "'ReadCsv': cannot open '%s': %s", path, strerror(errno));
+    }
+    char err[128];
+    Matrix *m = matio_parse_csv(buf, nbytes, sep, header, err, sizeof(err));
+    osdep_unmap_file(buf, nbytes);
+    if (!m) {
+        env_throw(e, "'ReadCsv': '%s', %s", path, err);
+    }
+    return m;
+}
+
+// Writes the /n/ significant digits /d/ of a number whose first digit
+// stands for 10^/e/ to /buf/ as "%.<n>g" would; returns the length.
+static
+size_t
+put_decimal(char *buf, bool neg, uint64_t d, int n, int e)
+{
+    const int prec = n;
+    while (n > 1 && d % 10 == 0) {
+        d /= 10;
+        --n;
+    }
+    char digits[20];
+    for (int i = n - 1; i >= 0; --i) {
+        digits[i] = '0' + d % 10;
+        d /= 10;
+    }
+    size_t len = 0;
+    if (neg) {
+        buf[len++] = '-';
+    }
+    if (e < -4 || e >= prec) {
+        buf[len++] = digits[0];
+        if (n > 1) {
+            buf[len++] = '.';
+            memcpy(buf + len, digits + 1, n - 1);
+            len += n - 1;
+        }
+        buf[len++] = 'e';
+        buf[len++] = e < 0 ? '-' : '+';
+        const int a = e < 0 ? -e : e;
+        if (a >= 100) {
+            buf[len++] = '0' + a / 100;
+        }
+        buf[len++] = '0' + a / 10 % 10;
+        buf[len++] = '0' + a % 10;
+    } else if (e < 0) {
+        buf[len++] = '0';
+        buf[len++] = '.';
+        for (int i = -1; i > e; --i) {
+            buf[len++] = '0';
+        }
+        memcpy(buf + len, digits, n);
+        len += n;
+    } else if (n <= e + 1) {
+        memcpy(buf + len, digits, n);
+        len += n;
+        for (int i = n; i <= e; ++i) {
+            buf[len++] = '0';
+        }
+    } else {
+        memcpy(buf + len, digits, e + 1);
+        len += e + 1;
+        buf[len++] = '.';
+        memcpy(buf + len, digits + e + 1, n - e - 1);
+        len += n - e - 1;
+    }
+    return len;
+}
+
+// Writes /x/ to /buf/ with as few significant digits as read back as /x/,
+// 15 to 17; returns the length, under CSV_NUMBER_MAX.
+static
+size_t
+format_number(char *buf, Scalar x)
+{
+    if (x >= -9007199254740992.0 && x <= 9007199254740992.0 && x == (Scalar) (int_least64_t) x) {
+        // An integer (-0 too): exact, and by far the most common.
+        int_least64_t v = x;
+        char digits[20];
+        int n = 0;
+        const bool neg = signbit(x);
+        if (v < 0) {
+            v = -v;
+        }
+        do {
+            digits[n++] = '0' + v % 10;
+            v /= 10;
+        } while (v);
+        size_t len = 0;
+        if (neg) {
+            buf[len++] = '-';
+        }
+        while (n) {
+            buf[len++] = digits[--n];
+        }
+        return len;
+    }
+    if (!isfinite(x)) {
+        return snprintf(buf, CSV_NUMBER_MAX, "%g", x);
+    }
+    // All 17 digits, once; 15 or 16 of them rounded off may do.
+    uint64_t d;
+    int e;
+#ifdef __SIZEOF_INT128__
+    if (!digits17(x, &d, &e))
+#endif
+    {
+        char all[CSV_NUMBER_MAX];
+        snprintf(all, sizeof(all), "%.16e", fabs(x));
+        d = all[0] - '0';
+        for (int i = 2; i < 18; ++i) {
+            d = d * 10 + (all[i] - '0');
+        }
+        e = atoi(all + 19);
+    }
+    static const uint64_t scale[] = {100, 10};
+    static const uint64_t limit[] = {1000000000000000, 10000000000000000};
+    for (int k = 0; k < 2; ++k) {
+        // Where the digits cut off are exactly a half, /x/ itself may be
+        // below it: rounding down is tried too.
+        const uint64_t rem = d % scale[k];
+        const int ntries = rem == scale[k] / 2 ? 2 : 1;
+        for (int t = 0; t < ntries; ++t) {
+            uint64_t dk = d / scale[k] + (rem > scale[k] / 2 || (rem == scale[k] / 2 && t));
+            int ek = e;
+            if (dk == limit[k]) {
+                dk /= 10;
+                ++ek;
+            }
+            const size_t len = put_decimal(buf, signbit(x), dk, 15 + k, ek);
+            Scalar y;
+            if (parse_number(buf, buf + len, &y) && y == x) {
+                return len;
+            }
+        }
+    }
+    return put_decimal(buf, signbit(x), d, 17, e);
+}
+
+typedef struct {
+    const Matrix *m;
+    char sep;
+    // Block b of the batch is rows [first + b * nrows, first + (b + 1) * nrows).
+    size_t first;
+    size_t nrows;
+    char **bufs;
+    size_t *lens;
+} CsvWriteCtx;
+
+static
+void
+format_rows(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    CsvWriteCtx *c = ctx;
+    const Matrix *m = c->m;
+    for (size_t b = begin; b < end; ++b) {
+        const size_t lo = c->first + b * c->nrows;
+        const size_t hi = lo + c->nrows < m->height ? lo + c->nrows : m->height;
+        char *p = c->bufs[b];
+        for (size_t i = lo; i < hi; ++i) {
+            for (size_t j = 0; j < m->width; ++j) {
+                p += format_number(p, matrix_at(m, i, j));
+                *p++ = j + 1 < m->width ? c->sep : '\n';
+            }
+        }
+        c->lens[b] = p - c->bufs[b];
+    }
+}
+
+bool
+matio_write_csv_file(FILE *f, const Matrix *m, char sep)
+{
+    assert(!m->pending);
+    if (!m->height || !m->width) {
+        return true;
+    }
+    // Rows are formatted in blocks of about /1 << 14/ elements, a batch of
+    // two per thread at a time, and written in order.
+    const size_t nrows = m->width < (1 << 14) ? (1 << 14) / m->width : 1;
+    const size_t nbatch = 2 * (size_t) workers_count();
+    const size_t nbuf = nrows * m->width * (CSV_NUMBER_MAX + 1);
+    CsvWriteCtx c = {
+        .m = m,
+        .sep = sep,
+        .nrows = nrows,
+        .bufs = XNEW(char *, nbatch),
+        .lens = XNEW(size_t, nbatch),
+    };
+    for (size_t b = 0; b < nbatch; ++b) {
+        c.bufs[b] = NULL;
+    }
+    bool ok = true;
+    for (; ok && c.first < m->height; c.first += nbatch * nrows) {
+        const size_t left = (m->height - c.first + nrows - 1) / nrows;
+        const size_t nblocks = left < nbatch ? left : nbatch;
+        for (size_t b = 0; b < nblocks; ++b) {
+            if (!c.bufs[b]) {
+                c.bufs[b] = XNEW(char, nbuf);
+            }
+        }
+        workers_run(workers_global, nblocks, 1, format_rows, &c);
+        for (size_t b = 0; ok && b < nblocks; ++b) {
+            ok = fwrite(c.bufs[b], 1, c.lens[b], f) == c.lens[b];
+        }
+    }
+    for (size_t b = 0; b < nbatch; ++b) {
+        free(c.bufs[b]);
+    }
+    free(c.bufs);
+    free(c.lens);
+    return ok;
+}
+
+void
+matio_write_csv(Env *e, const Matrix *m, const char *path, char sep)
+{
+    char tmp[TMP_PATH_MAX];
+    FILE *f = open_replacement(e, "WriteCsv", path, tmp);
+    commit_replacement(e, "WriteCsv", f, matio_write_csv_file(f, m, sep), tmp, path);
+}
+
+// The .npy format (version 1.0, or 2.0 and 3.0 with a longer header): the
+// magic "\x93NUMPY", two version bytes, the length of the header as a
+// little-endian integer, the header, a Python dict literal such as
+// "{'descr': '<f8', 'fortran_order': False, 'shape': (3, 4), }", then the
+// elements.
+#define NPY_MAGIC "\x93NUMPY"
+enum { NPY_MAGIC_NBYTES = 6 };
+
+// Longest header taken; NumPy's own are a few dozen bytes.
+enum { NPY_HEADER_MAX = 1 << 16 };
+
+typedef struct {
+    // 'f', 'i', 'u' or 'b', as in NumPy's type codes.
+    char kind;
+    // Bytes per element.
+    unsigned size;
+    bool big_endian;
+    bool fortran_order;
+    // As a matrix: a 1-D array is a column, a 0-D one a scalar.
+    uint_least64_t height;
+    uint_least64_t width;
+} NpyHeader;
+
+// The value of /key/ in the dict literal /dict/, past the colon and any
+// spaces; NULL if it is not there.
+static
+const char *
+npy_field(const char *dict, const char *key)
+{
+    const char *p = strstr(dict, key);
+    if (!p) {
+        return NULL;
+    }
+    p += strlen(key);
+    while (*p == ' ') {
+        ++p;
+    }
+    if (*p++ != ':') {
+        return NULL;
+    }
+    while (*p == ' ') {
+        ++p;
+    }
+    return p;
+}
+
+// Parses the header dict /dict/ into /h/; returns false if it is not one
+// of an array that can be made a matrix.
+static
+bool
+npy_parse_header(const char *dict, NpyHeader *h)
+{
+    const char *descr = npy_field(dict, "'descr'");
+    if (!descr || (*descr != '\'' && *descr != '"')) {
+        return false;
+    }
+    const char quote = *descr++;
+    // The byte order: '<', '>', '=' (native) or '|' (does not apply).
+    const char order = *descr++;
+    if (order != '<' && order != '>' && order != '=' && order != '|') {
+        return false;
+    }
+    h->big_endian = order == '>' || (order == '=' && !host_is_little_endian());
+    h->kind = *descr++;
+    char *end;
+    h->size = strtoul(descr, &end, 10);
+    if (*end != quote) {
+        return false;
+    }
+    switch (h->kind) {
+    case 'f':
+        if (h->size != 4 && h->size != 8) {
+            return false;
+        }
+        break;
+    case 'i':
+    case 'u':
+        if (h->size != 1 && h->size != 2 && h->size != 4 && h->size != 8) {
+            return false;
+        }
+        break;
+    case 'b':
+        if (h->size != 1) {
+            return false;
+        }
+        break;
+    default:
+        return false;
+    }
+
+    const char *fortran = npy_field(dict, "'fortran_order'");
+    if (!fortran) {
+        return false;
+    }
+    if (strncmp(fortran, "True", 4) == 0) {
+        h->fortran_order = true;
+    } else if (strncmp(fortran, "False", 5) == 0) {
+        h->fortran_order = false;
+    } else {
+        return false;
+    }
+
+    const char *shape = npy_field(dict, "'shape'");
+    if (!shape || *shape++ != '(') {
+        return false;
+    }
+    uint_least64_t dims[2];
+    unsigned ndims = 0;
+    for (;;) {
+        while (*shape == ' ') {
+            ++shape;
+        }
+        if (*shape == ')') {
+            break;
+        }
+        if (ndims == 2 || !is_digit(*shape)) {
+            return false;
+        }
+        dims[ndims++] = strtoull(shape, &end, 10);
+        shape = end;
+        while (*shape == ' ') {
+            ++shape;
+        }
+        if (*shape == ',') {
+            ++shape;
+        } else if (*shape != ')') {
+            return false;
+        }
+    }
+    // A 0-d array is a single number, not a matrix.
+    if (!ndims) {
+        return false;
+    }
+    h->height = dims[0];
+    h->width = ndims > 1 ? dims[1] : 1;
+    return true;
+}
+
+// Element /k/ of the array /src/ described by /h/, as a double.
+static
+Scalar
+npy_elem(const unsigned char *src, const NpyHeader *h, size_t k)
+{
+    const unsigned char *p = src + k * h->size;
+    uint64_t bits = 0;
+    for (unsigned i = 0; i < h->size; ++i) {
+        bits |= (uint64_t) p[h->big_endian ? h->size - 1 - i : i] << (8 * i);
+    }
+    switch (h->kind) {
+    case 'f':
+        if (h->size == 4) {
+            const uint32_t bits32 = bits;
+            float f;
+            memcpy(&f, &bits32, sizeof(f));
+            return f;
+        } else {
+            Scalar x;
+            memcpy(&x, &bits, sizeof(x));
+            return x;
+        }
+    case 'i':
+        {
+            if (h->size < 8 && (bits >> (8 * h->size - 1) & 1)) {
+                bits |= ~(uint64_t) 0 << (8 * h->size);
+            }
+            int64_t v;
+            memcpy(&v, &bits, sizeof(v));
+            return v;
+        }
+    case 'b':
+        return bits != 0;
+    default:
+        return bits;
+    }
+}
+
+typedef struct {
+    const unsigned char *src;
+    const NpyHeader *hdr;
+    Matrix *dst;
+} NpyConvertCtx;
+
+static
+void
+npy_convert(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    NpyConvertCtx *c = ctx;
+    const size_t height = c->dst->height;
+    const size_t width = c->dst->width;
+    for (size_t k = begin; k < end; ++k) {
+        // Element k of the result, which is row-major; the file may not be.
+        const size_t i = k / width;
+        const size_t j = k % width;
+        const size_t from = c->hdr->fortran_order ? j * height + i : k;
+        c->dst->elems[k] = npy_elem(c->src, c->hdr, from);
+    }
+}
+
+Matrix *
+matio_load_npy(Env *e, const char *path)
+{
+    size_t nbytes;
+    unsigned char *p = osdep_map_file(path, &nbytes);
+    if (!p) {
+        env_throw(e, "'LoadNpy': cannot open '%s': %s", path, strerror(errno));
+    }
+    // The magic, the version and at least two bytes of header length.
+    size_t hdr_at = NPY_MAGIC_NBYTES + 4;
+    size_t nhdr = 0;
+    if (nbytes >= hdr_at && memcmp(p, NPY_MAGIC, NPY_MAGIC_NBYTES) == 0) {
+        const unsigned major = p[NPY_MAGIC_NBYTES];
+        if (major == 1) {
+            nhdr = p[8] | (size_t) p[9] << 8;
+        } else if ((major == 2 || major == 3) && nbytes >= hdr_at + 2) {
+            nhdr = get_u32(p + 8);
+            hdr_at += 2;
+        }
+    }
+    if (!nhdr || nhdr > NPY_HEADER_MAX || nbytes - hdr_at < nhdr) {
+        osdep_unmap_file(p, nbytes);
+        env_throw(e, "'LoadNpy': '%s' is not a .npy file", path);
+    }
+    char dict[NPY_HEADER_MAX + 1];
+    memcpy(dict, p + hdr_at, nhdr);
+    dict[nhdr] = '\0';
+    NpyHeader h;
+    if (!npy_parse_header(dict, &h)) {
+        osdep_unmap_file(p, nbytes);
+        env_throw(e, "'LoadNpy': '%s' does not hold a 1-D or 2-D array of numbers", path);
+    }
+
+    // Like /Mat/, matrices are only empty as 0 x 0.
+    if ((h.height == 0) != (h.width == 0)) {
+        osdep_unmap_file(p, nbytes);
+        env_throw(e, "'LoadNpy': the array in '%s' is empty but not 0 x 0", path);
+    }
+
+    const size_t data_at = hdr_at + nhdr;
+    const uint_least64_t n = h.height * h.width;
+    if ((h.height && n / h.height != h.width) || n > UINT_MAX) {
+        osdep_unmap_file(p, nbytes);
+        env_throw(e, "'LoadNpy': the array in '%s' is too large", path);
+    }
+    if ((uint_least64_t) (nbytes - data_at) < n * h.size) {
+        osdep_unmap_file(p, nbytes);
+        env_throw(e, "'LoadNpy': '%s' is truncated", path);
+    }
+    if (!n) {
+        osdep_unmap_file(p, nbytes);
+        return matrix_new(0, 0);
+    }
+
+    // Little-endian doubles, aligned, up to the end of the file: mapped.
+    if (h.kind == 'f' && h.size == 8 && !h.big_endian && host_is_little_endian() &&
+        data_at % sizeof(Scalar) == 0 && data_at <= UINT_MAX &&
+        nbytes - data_at == n * sizeof(Scalar))
+    {
+        Scalar *elems = (Scalar *) (p + data_at);
+        if (!h.fortran_order) {
+            return matrix_new_mapped(elems, data_at, h.height, h.width);
+        }
+        // Column after column: the transposition of a row-major matrix.
+        Matrix *t = matrix_new_mapped(elems, data_at, h.width, h.height);
+        Matrix *m = matrix_transposed(t);
+        value_unref(MK_MAT(t));
+        return m;
+    }
+
+    NpyConvertCtx c = {
+        .src = p + data_at,
+        .hdr = &h,
+        .dst = matrix_new_uninit(h.height, h.width),
+    };
+    workers_for(n, 1 << 15, npy_convert, &c);
+    osdep_unmap_file(p, nbytes);
+    return c.dst;
+}
+
+void
+matio_save_npy(Env *e, const Matrix *m, const char *path)
+{
+    assert(!m->pending);
+    char hdr[128];
+    int ndict = snprintf(hdr + NPY_MAGIC_NBYTES + 4, sizeof(hdr) - NPY_MAGIC_NBYTES - 4,
+                         "{'descr': '<f8', 'fortran_order': False, 'shape': (%u, %u), }",
+                         m->height, m->width);
+    // Padded with spaces, and ended with a newline, for the elements to start
+    // at a multiple of 64 bytes, as NumPy does.
+    size_t len = NPY_MAGIC_NBYTES + 4 + ndict;
+    while ((len + 1) % 64) {
+        hdr[len++] = ' ';
+    }
+    hdr[len++] = '\n';
+    const size_t nhdr = len - NPY_MAGIC_NBYTES - 4;
+    memcpy(hdr, NPY_MAGIC, NPY_MAGIC_NBYTES);
+    hdr[6] = 1;
+    hdr[7] = 0;
+    hdr[8] = nhdr & 0xff;
+    hdr[9] = nhdr >> 8;
+
+    char tmp[TMP_PATH_MAX];
+    FILE *f = open_replacement(e, "SaveNpy", path, tmp);
+    const bool ok = fwrite(hdr, 1, len, f) == len && write_elems(f, m);
+    commit_replacement(e, "SaveNpy", f, ok, tmp, path);
+}
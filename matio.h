@@ -0,0 +1,74 @@
+#ifndef matio_h_
+#define matio_h_
+
+#include "common.h"
+#include "matrix.h"
+
+struct Env;
+
+// A matrix file starts with the 8 bytes of MATIO_MAGIC, then has the height
+// and the width as 32-bit little-endian integers, then the elements, row
+// after row, as little-endian IEEE 754 doubles, and nothing after them.
+#define MATIO_MAGIC "calcmat1"
+enum { MATIO_HEADER_NBYTES = 16 };
+
+// Longest file name taken, counting the terminating zero.
+enum { MATIO_PATH_MAX = 4096 };
+
+// Writes /m/, which must not be pending, to the file at /path/. The file is
+// replaced all at once, so that matrices loaded from it keep their
+// elements. Throws on failure.
+void
+matio_save(struct Env *e, const Matrix *m, const char *path);
+
+// Reads the matrix in the file at /path/. On a little-endian host, nothing
+// is read up front: the result is a view of a mapping of the file, shared
+// with every other process that loads it, and copied on the first
+// assignment to it. Throws on failure.
+Matrix *
+matio_load(struct Env *e, const char *path);
+
+// Parses the CSV text buf[nbuf]: a row per line, skipping blank ones and,
+// if /header/, the first, of fields separated by /sep/, each a number with
+// optional blanks around it. Every row must have as many fields as the
+// first. Numbers are rounded correctly. The text is split into chunks at
+// line ends, which are parsed in parallel straight into the result. On
+// error, returns NULL and writes a message to err[nerr].
+Matrix *
+matio_parse_csv(const char *buf, size_t nbuf, char sep, bool header, char *err, size_t nerr);
+
+// Maps the file at /path/ and parses it with /matio_parse_csv/. Throws on
+// failure.
+Matrix *
+matio_read_csv(struct Env *e, const char *path, char sep, bool header);
+
+// Writes /m/, which must not be pending, to /f/ as CSV with /sep/ between
+// fields: each element with as few digits as read back as it (integers
+// have none after the point). Rows are formatted in parallel. Returns false
+// on a write error.
+bool
+matio_write_csv_file(FILE *f, const Matrix *m, char sep);
+
+// Replaces the file at /path/ (as /matio_save/ does) with /m/ as CSV.
+// Throws on failure.
+void
+matio_write_csv(struct Env *e, const Matrix *m, const char *path, char sep);
+
+// Reads the 1-D (as a column) or 2-D array in the NumPy .npy file at
+// /path/: of doubles, floats, integers or booleans, of either byte order
+// and in either C or Fortran order. A file of little-endian doubles on a
+// little-endian host is mapped rather than read, as by /matio_load/. Throws
+// on failure.
+Matrix *
+matio_load_npy(struct Env *e, const char *path);
+
+// Replaces the file at /path/ (as /matio_save/ does) with /m/ as a 2-D
+// .npy array of little-endian doubles, in C order. Throws on failure.
+void
+matio_save_npy(struct Env *e, const Matrix *m, const char *path);
+
+// Unmaps the file of a mapped matrix (see /Matrix/) that is going away.
+void
+matio_unmap(Matrix *m);
+
+#endif
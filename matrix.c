@@ -1,28 +1,210 @@
 #include "matrix.h"
 #include "env.h"
+#include "stats.h"
+#include "alloc.h"
+#include "workers.h"
+#include "linalg.h"
+#include "vm.h"
 
+static
 Matrix *
-matrix_new(unsigned height, unsigned width)
+matrix_alloc(unsigned height, unsigned width, bool has_storage)
 {
-    const size_t nelems = xmul_mat_dims(height, width);
-    Matrix *m = xcalloc(sizeof(Matrix) + nelems * sizeof(Scalar), 1);
+    (void) xmul_mat_dims(height, width);
+    const Matrix hdr = {.height = height, .width = width, .has_storage = has_storage};
+    const size_t nbytes = matrix_nbytes(&hdr);
+    Matrix *m = heap_alloc(nbytes);
+    stats_on_alloc(STATS_OBJ_MATRIX, nbytes);
+    *m = hdr;
     m->gchdr.nrefs = 1;
-    m->height = height;
-    m->width = width;
+    m->elems = m->storage;
+    m->rstride = width;
+    m->cstride = 1;
+    return m;
+}
+
+Matrix *
+matrix_new_uninit(unsigned height, unsigned width)
+{
+    return matrix_alloc(height, width, true);
+}
+
+Matrix *
+matrix_new(unsigned height, unsigned width)
+{
+    Matrix *m = matrix_new_uninit(height, width);
+    memset(m->elems, 0, (size_t) height * width * sizeof(Scalar));
+    return m;
+}
+
+// Returns a /height/ x /width/ view of the elements of /x/ from /elems/ on,
+// with the given strides.
+static
+Matrix *
+borrow(Matrix *x, Scalar *elems, unsigned height, unsigned width, size_t rstride, size_t cstride)
+{
+    assert(!x->pending);
+    Matrix *owner = x->owner ? x->owner : x;
+    Matrix *v = matrix_alloc(height, width, false);
+    v->elems = elems;
+    v->rstride = rstride;
+    v->cstride = cstride;
+    v->owner = owner;
+    ++owner->gchdr.nrefs;
+    ++owner->nborrowers;
+    return v;
+}
+
+Matrix *
+matrix_new_mapped(Scalar *elems, unsigned map_offset, unsigned height, unsigned width)
+{
+    // The mapping has an owner of its own, so that every matrix that reads
+    // it is a view, which nothing overwrites in place.
+    Matrix *o = matrix_alloc(height, width, false);
+    o->elems = elems;
+    o->map_offset = map_offset;
+    Matrix *m = borrow(o, elems, height, width, width, 1);
+    value_unref(MK_MAT(o));
     return m;
 }
 
+Matrix *
+matrix_transposed(Matrix *x)
+{
+    return borrow(x, x->elems, x->width, x->height, x->cstride, x->rstride);
+}
+
+// Copies the elements of /m/ to /dst/, row after row.
+static
+void
+copy_packed(Scalar *dst, const Matrix *m)
+{
+    if (matrix_is_packed(m)) {
+        memcpy(dst, m->elems, (size_t) m->height * m->width * sizeof(Scalar));
+    } else if (m->rstride == 1 && m->cstride == m->height) {
+        // A transposed packed matrix.
+        linalg_transpose(dst, m->elems, m->width, m->height);
+    } else {
+        for (size_t i = 0; i < m->height; ++i) {
+            for (size_t j = 0; j < m->width; ++j) {
+                *dst++ = matrix_at(m, i, j);
+            }
+        }
+    }
+}
+
+// Moves the elements of /m/, packed, to the storage of a new matrix that
+// only /m/ refers to.
+static
+void
+relocate(Matrix *m)
+{
+    Matrix *s = matrix_new_uninit(m->height, m->width);
+    copy_packed(s->storage, m);
+    if (m->owner) {
+        --m->owner->nborrowers;
+        value_unref(MK_MAT(m->owner));
+    }
+    s->nborrowers = 1;
+    m->owner = s;
+    m->elems = s->storage;
+    m->rstride = m->width;
+    m->cstride = 1;
+}
+
+Matrix *
+matrix_copy(const Matrix *m)
+{
+    assert(!m->pending);
+    Matrix *z = matrix_new_uninit(m->height, m->width);
+    copy_packed(z->storage, m);
+    return z;
+}
+
+void
+matrix_pack(Matrix *m)
+{
+    assert(!m->pending);
+    if (matrix_is_packed(m)) {
+        return;
+    }
+    Matrix *o = m->owner;
+    if (o && o->gchdr.nrefs == 1 && m->elems == o->storage &&
+        m->height == m->width && m->rstride == 1 && m->cstride == m->height)
+    {
+        // The transposition of a square matrix nobody else can see any more:
+        // transpose its storage in place.
+        linalg_transpose_square(m->elems, m->height);
+        m->rstride = m->width;
+        m->cstride = 1;
+        return;
+    }
+    relocate(m);
+}
+
+void
+matrix_own(Matrix *m)
+{
+    if (!matrix_is_packed(m)) {
+        // Packing leaves /m/ the only user of its elements.
+        matrix_pack(m);
+    } else if (!matrix_is_owned(m)) {
+        relocate(m);
+    }
+}
+
+typedef struct {
+    Scalar *dst;
+    const Value *elems;
+    // Per thread: the first non-scalar element it has come across, or
+    // SIZE_MAX.
+    size_t *bad;
+} ConstructCtx;
+
+static
+void
+construct_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    ConstructCtx *c = ctx;
+    for (size_t i = begin; i < end; ++i) {
+        if (c->elems[i].kind != VAL_KIND_SCALAR) {
+            if (i < c->bad[self]) {
+                c->bad[self] = i;
+            }
+            return;
+        }
+        c->dst[i] = AS_SCL(c->elems[i]);
+    }
+}
+
 Matrix *
 matrix_construct(Env *e, const Value *elems, unsigned height, unsigned width)
 {
-    Matrix *m = matrix_new(height, width);
-    const size_t nelems = height * width;
-    for (size_t i = 0; i < nelems; ++i) {
-        if (elems[i].kind != VAL_KIND_SCALAR) {
-            free(m);
-            env_throw(e, "matrix element is %s (scalar expected)", value_kindname(elems[i].kind));
+    Matrix *m = matrix_new_uninit(height, width);
+    const size_t nelems = (size_t) height * width;
+
+    const unsigned nthreads = workers_count();
+    ConstructCtx c = {
+        .dst = m->elems,
+        .elems = elems,
+        .bad = scratch_alloc(nthreads * sizeof(size_t)),
+    };
+    for (unsigned i = 0; i < nthreads; ++i) {
+        c.bad[i] = SIZE_MAX;
+    }
+    workers_for(nelems, 1 << 15, construct_range, &c);
+
+    size_t bad = SIZE_MAX;
+    for (unsigned i = 0; i < nthreads; ++i) {
+        if (c.bad[i] < bad) {
+            bad = c.bad[i];
         }
-        m->elems[i] = AS_SCL(elems[i]);
+    }
+    scratch_free(c.bad, nthreads * sizeof(size_t));
+
+    if (bad != SIZE_MAX) {
+        value_unref(MK_MAT(m));
+        env_throw(e, "matrix element is %s (scalar expected)", value_kindname(elems[bad].kind));
     }
     return m;
 }
@@ -38,7 +220,7 @@ matrix_get1(Env *e, Matrix *m, Value elem)
         env_throw(e, "element number out of range");
     }
 
-    return MK_SCL(m->elems[num - 1]);
+    return MK_SCL(matrix_at(m, (num - 1) / m->width, (num - 1) % m->width));
 }
 
 Value
@@ -56,9 +238,7 @@ matrix_get2(Env *e, Matrix *m, Value row, Value col)
     if (j < 1 || j > m->width) {
         env_throw(e, "column number out of range");
     }
-    const size_t index = (i - 1) * m->width + (j - 1);
-
-    return MK_SCL(m->elems[index]);
+    return MK_SCL(matrix_at(m, i - 1, j - 1));
 }
 
 void
@@ -75,6 +255,7 @@ matrix_set1(Env *e, Matrix *m, Value elem, Value v)
     if (v.kind != VAL_KIND_SCALAR) {
         env_throw(e, "cannot assign matrix element a %s value", value_kindname(v.kind));
     }
+    matrix_own(m);
     m->elems[num - 1] = AS_SCL(v);
 }
 
@@ -98,5 +279,156 @@ matrix_set2(Env *e, Matrix *m, Value row, Value col, Value v)
     if (v.kind != VAL_KIND_SCALAR) {
         env_throw(e, "cannot assign matrix element a %s value", value_kindname(v.kind));
     }
+    matrix_own(m);
     m->elems[index] = AS_SCL(v);
 }
+
+// Rows and columns of a matrix picked by subscripts, counting from 0; or, if
+// /flat/, the /width/ elements from the /j/-th on, in the order a[k] counts
+// them, and /height/ is 1.
+typedef struct {
+    size_t i;
+    size_t j;
+    unsigned height;
+    unsigned width;
+    bool flat;
+} Block;
+
+static
+size_t
+index_value(Env *e, const char *what, Value v, size_t n)
+{
+    if (v.kind != VAL_KIND_SCALAR) {
+        env_throw(e, "cannot index matrix with %s value", value_kindname(v.kind));
+    }
+    const Scalar x = AS_SCL(v);
+    if (!(x >= 1 && x < n + 1.0)) {
+        env_throw(e, "%s number out of range", what);
+    }
+    return x;
+}
+
+// Reads the subscript of kind /kind/ from /*args/, advancing it past its
+// values, into the first (/*begin/) and the number (/*count/) of the /n/
+// rows, columns or elements (/what/) it picks.
+static
+void
+subscript(Env *e, const char *what, unsigned char kind, const Value **args, size_t n,
+          size_t *begin, unsigned *count)
+{
+    size_t lo;
+    size_t hi;
+    switch (kind) {
+    case INDEX_ALL:
+        *begin = 0;
+        *count = n;
+        return;
+    case INDEX_SCALAR:
+        lo = hi = index_value(e, what, (*args)[0], n);
+        *args += 1;
+        break;
+    default:
+        lo = index_value(e, what, (*args)[0], n);
+        hi = index_value(e, what, (*args)[1], n);
+        *args += 2;
+        if (hi < lo) {
+            env_throw(e, "%s range is empty", what);
+        }
+    }
+    *begin = lo - 1;
+    *count = hi - lo + 1;
+}
+
+static
+Block
+block(Env *e, const Matrix *m, unsigned nindices, const unsigned char *kinds, const Value *args)
+{
+    Block b = {.height = 1};
+    if (nindices == 1) {
+        b.flat = true;
+        subscript(e, "element", kinds[0], &args, (size_t) m->height * m->width, &b.j, &b.width);
+    } else {
+        subscript(e, "row", kinds[0], &args, m->height, &b.i, &b.height);
+        subscript(e, "column", kinds[1], &args, m->width, &b.j, &b.width);
+    }
+    return b;
+}
+
+Matrix *
+matrix_slice(Env *e, Matrix *m, unsigned nindices, const unsigned char *kinds, const Value *args)
+{
+    assert(!m->pending);
+    const Block b = block(e, m, nindices, kinds, args);
+    if (!b.height || !b.width) {
+        return matrix_new(0, 0);
+    }
+
+    Matrix hdr = {.height = b.height, .width = b.width};
+    if (!b.flat) {
+        hdr.elems = m->elems + b.i * m->rstride + b.j * m->cstride;
+        hdr.rstride = m->rstride;
+        hdr.cstride = m->cstride;
+    } else if (m->width == 1) {
+        // Elements of a column make a column.
+        hdr.height = b.width;
+        hdr.width = 1;
+        hdr.elems = m->elems + b.j * m->rstride;
+        hdr.rstride = m->rstride;
+        hdr.cstride = 1;
+    } else {
+        // Elements of anything else make a row, which can only be a view if
+        // they lie in order.
+        if (m->height > 1) {
+            matrix_pack(m);
+        }
+        hdr.elems = m->elems + b.j * m->cstride;
+        hdr.rstride = b.width;
+        hdr.cstride = m->cstride;
+    }
+
+    // The kernels for small matrices take them packed (see
+    // /linalg_is_small/), and copying a few elements costs no more than a
+    // view.
+    if (linalg_is_small(hdr.height, hdr.width) && !matrix_is_packed(&hdr)) {
+        Matrix *z = matrix_new_uninit(hdr.height, hdr.width);
+        copy_packed(z->storage, &hdr);
+        return z;
+    }
+    return borrow(m, hdr.elems, hdr.height, hdr.width, hdr.rstride, hdr.cstride);
+}
+
+void
+matrix_set_slice(Env *e, Matrix *m, unsigned nindices, const unsigned char *kinds,
+                 const Value *args, Value v)
+{
+    const Block b = block(e, m, nindices, kinds, args);
+    const Matrix *x = NULL;
+    if (v.kind == VAL_KIND_MATRIX) {
+        x = AS_MAT(v);
+        const bool fits = b.flat
+            ? (size_t) x->height * x->width == b.width
+            : x->height == b.height && x->width == b.width;
+        if (!fits) {
+            env_throw(e, "cannot assign a %u x %u matrix to a %u x %u slice",
+                      x->height, x->width, b.height, b.width);
+        }
+    } else if (v.kind != VAL_KIND_SCALAR) {
+        env_throw(e, "cannot assign a slice a %s value", value_kindname(v.kind));
+    }
+
+    // If /x/ shares its elements with /m/, this moves /m/ out from under it.
+    matrix_own(m);
+    if (b.flat) {
+        Scalar *dst = m->elems + b.j;
+        for (size_t k = 0; k < b.width; ++k) {
+            dst[k] = x ? matrix_at(x, k / x->width, k % x->width) : AS_SCL(v);
+        }
+    } else {
+        Scalar *dst = m->elems + b.i * m->width + b.j;
+        for (size_t i = 0; i < b.height; ++i, dst += m->width) {
+            for (size_t j = 0; j < b.width; ++j) {
+                dst[j] = x ? matrix_at(x, i, j) : AS_SCL(v);
+            }
+        }
+    }
+}
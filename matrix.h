@@ -16,17 +16,155 @@ xmul_mat_dims(unsigned height, unsigned width)
 }
 
 struct Env;
+struct Fusion;
 
-typedef struct {
+typedef struct Matrix {
     GcObject gchdr;
     unsigned height;
     unsigned width;
-    Scalar elems[];
+    // If not 0, /elems/ lie this many bytes into a read-only mapping of a
+    // file that ends with them (see matio.h), which is unmapped with this
+    // matrix; only views of it are handed out.
+    unsigned map_offset;
+    // If not NULL, /elems/ are yet to be computed; see fuse.h.
+    struct Fusion *pending;
+    // Element (i, j), counting from 0, is elems[i * rstride + j * cstride].
+    // A matrix made by /matrix_new/ keeps its elements in its own /storage/,
+    // row after row; a view (see /matrix_transposed/) points into the
+    // storage of /owner/ instead, in whatever order it finds them there
+    // (see also /matrix_slice/).
+    Scalar *elems;
+    size_t rstride;
+    size_t cstride;
+    // The matrix whose /storage/ /elems/ points into, if not this one; a
+    // reference to it is held.
+    struct Matrix *owner;
+    // Number of matrices whose /owner/ is this one.
+    unsigned nborrowers;
+    // Whether /storage/ has room for /height/ x /width/ elements; views have
+    // none of their own.
+    bool has_storage;
+    Scalar storage[];
 } Matrix;
 
+INHEADER
+size_t
+matrix_nbytes(const Matrix *m)
+{
+    const size_t nstorage = m->has_storage ? (size_t) m->height * m->width : 0;
+    return sizeof(Matrix) + nstorage * sizeof(Scalar);
+}
+
+// Whether the elements of /m/ lie row after row with no gaps, so that
+// /m->elems/ can be handed to the kernels of linalg.h as is.
+INHEADER
+bool
+matrix_is_packed(const Matrix *m)
+{
+    return (m->height <= 1 || m->rstride == m->width) &&
+           (m->width <= 1 || m->cstride == 1);
+}
+
+// Element (i, j), counting from 0.
+INHEADER
+Scalar
+matrix_at(const Matrix *m, size_t i, size_t j)
+{
+    return m->elems[i * m->rstride + j * m->cstride];
+}
+
+// Returns a zero-filled matrix.
 Matrix *
 matrix_new(unsigned height, unsigned width);
 
+// Returns a matrix with unspecified elements, for callers that are going to
+// overwrite all of them.
+Matrix *
+matrix_new_uninit(unsigned height, unsigned width);
+
+// If the matrix in /v/ is only referenced by the operand slot it was passed
+// in (see /Op/), takes a new reference to it and returns it, so that the
+// caller can overwrite it with its result. Otherwise, returns NULL.
+INHEADER
+Matrix *
+matrix_reuse(Value v)
+{
+    Matrix *m = AS_MAT(v);
+    // A matrix that borrows its elements may share them with another one.
+    if (m->gchdr.nrefs != 1 || m->owner) {
+        return NULL;
+    }
+    ++m->gchdr.nrefs;
+    return m;
+}
+
+// Returns a view of the /height/ x /width/ elements at /elems/, row after
+// row, /map_offset/ bytes into a read-only file mapping that is to be
+// unmapped when nothing refers to them any more (see /matio_unmap/).
+Matrix *
+matrix_new_mapped(Scalar *elems, unsigned map_offset, unsigned height, unsigned width);
+
+// Returns a view of the transposition of /x/, which shares its elements;
+// O(1). /x/ must not be pending.
+Matrix *
+matrix_transposed(Matrix *x);
+
+// Returns the rows and columns, or the elements, of /m/ that the subscripts
+// /args/ pick: /nindices/ (1 or 2) of them, of kinds /kinds/ (see
+// /IndexKind/), which take one, two or no values each. Unless it is small,
+// the result is a view that shares the elements of /m/, made in O(1); a
+// run of elements of a matrix that is neither a row nor a column packs
+// /m/ first. /m/ must not be pending.
+Matrix *
+matrix_slice(struct Env *e, Matrix *m, unsigned nindices, const unsigned char *kinds,
+             const Value *args);
+
+// Sets the rows and columns, or the elements, of /m/ that the subscripts
+// /args/ pick (see /matrix_slice/) to the scalar /v/, or to the elements of
+// the matrix /v/ of the same dimensions (of as many elements, for one
+// subscript).
+void
+matrix_set_slice(struct Env *e, Matrix *m, unsigned nindices, const unsigned char *kinds,
+                 const Value *args, Value v);
+
+// Returns a packed copy of /m/ that shares nothing with it. /m/ must not be
+// pending.
+Matrix *
+matrix_copy(const Matrix *m);
+
+// Rearranges the elements of /m/ so that it is packed (see
+// /matrix_is_packed/), copying them out of the storage it shares if need be.
+// The value of /m/ does not change, nor does that of any matrix it shares
+// its elements with.
+void
+matrix_pack(Matrix *m);
+
+// Makes /m/ safe to write to: packed, and sharing its elements with no
+// other matrix. (Two values that refer to the same /Matrix/ still see each
+// other's writes; the VM copies a matrix that others refer to before
+// assigning to its elements, see /rebind/ in vm.h.)
+void
+matrix_own(Matrix *m);
+
+// Whether /m/ can be written to as it is; see /matrix_own/.
+INHEADER
+bool
+matrix_is_owned(const Matrix *m)
+{
+    if (!matrix_is_packed(m)) {
+        return false;
+    }
+    if (m->owner) {
+        // Besides its borrowers, the owner itself uses its storage unless it
+        // has moved out, or is only kept alive by them.
+        // A mapped one has no storage to write into at all.
+        const Matrix *o = m->owner;
+        return o->nborrowers == 1 && !o->map_offset &&
+               (o->owner || o->gchdr.nrefs == o->nborrowers);
+    }
+    return m->nborrowers == 0 && !m->map_offset;
+}
+
 Matrix *
 matrix_construct(struct Env *e, const Value *elems, unsigned height, unsigned width);
 
@@ -8,10 +8,26 @@ struct Value;
 
 enum { OP_ASSOC_LEFT, OP_ASSOC_RIGHT };
 
+// What the parser may take an operator to do on scalars, to prove that the
+// subscripts of a loop stay in range (see /hoist_checks/ in parser.c):
+// OP_MEANS_ADD is addition, and OP_MEANS_BELOW a comparison that only holds
+// if its left operand is at most its right one.
+enum { OP_MEANS_OTHER, OP_MEANS_ADD, OP_MEANS_BELOW };
+
+// Handlers borrow their arguments: the VM releases them after the handler
+// returns. An argument whose reference count is 1 is therefore a temporary
+// that is about to die, and the handler may take it over for its result --
+// write into it and return it with a new reference (see /matrix_reuse/),
+// which the VM's release then balances.
+//
+// If /lazy/ is set, the handler may be given matrices with deferred elements
+// and may return one (see fuse.h); otherwise the VM computes them first.
 typedef struct {
     unsigned char arity;
     unsigned char assoc;
     unsigned char priority;
+    unsigned char lazy;
+    unsigned char means;
     union {
         struct Value (*unary)(struct Env *e, struct Value arg);
         struct Value (*binary)(struct Env *e, struct Value arg1, struct Value arg2);
@@ -1,8 +1,15 @@
 #include "osdep.h"
 
+// What an empty file "maps" to: it cannot really be mapped.
+static char empty_file[1];
+
 #ifdef __MINGW32__
 #   include <windows.h>
 #   include <ntstatus.h>
+#   include <io.h>
+#   include <fcntl.h>
+#   include <share.h>
+#   include <sys/stat.h>
 
 int OSDEP_UTF8_READY = 0;
 
@@ -43,9 +50,108 @@ osdep_rng_destroy(void *handle)
     (void) handle;
 }
 
+unsigned
+osdep_ncpus(void)
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors ? si.dwNumberOfProcessors : 1;
+}
+
+void *
+osdep_map_file(const char *path, size_t *nbytes)
+{
+    void *addr = NULL;
+    HANDLE h_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h_file == INVALID_HANDLE_VALUE) {
+        errno = ENOENT;
+        return NULL;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(h_file, &size) || (uint_least64_t) size.QuadPart > SIZE_MAX) {
+        errno = EFBIG;
+        goto done;
+    }
+    if (size.QuadPart == 0) {
+        addr = empty_file;
+        *nbytes = 0;
+        goto done;
+    }
+    HANDLE h_map = CreateFileMappingA(h_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!h_map) {
+        errno = EIO;
+        goto done;
+    }
+    addr = MapViewOfFile(h_map, FILE_MAP_READ, 0, 0, 0);
+    // The view keeps the mapping alive.
+    CloseHandle(h_map);
+    if (!addr) {
+        errno = ENOMEM;
+        goto done;
+    }
+    *nbytes = size.QuadPart;
+done:
+    CloseHandle(h_file);
+    return addr;
+}
+
+void
+osdep_unmap_file(void *addr, size_t nbytes)
+{
+    if (nbytes) {
+        UnmapViewOfFile(addr);
+    }
+}
+
+FILE *
+osdep_create_temp(char *templ)
+{
+    const size_t ntempl = strlen(templ);
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        memcpy(templ + ntempl - 6, "XXXXXX", 6);
+        if (_mktemp_s(templ, ntempl + 1) != 0) {
+            errno = EINVAL;
+            return NULL;
+        }
+        int fd;
+        if (_sopen_s(&fd, templ, _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY, _SH_DENYNO,
+                     _S_IREAD | _S_IWRITE) != 0)
+        {
+            if (errno == EEXIST) {
+                continue;
+            }
+            return NULL;
+        }
+        FILE *f = _fdopen(fd, "wb");
+        if (!f) {
+            const int saved_errno = errno;
+            _close(fd);
+            remove(templ);
+            errno = saved_errno;
+        }
+        return f;
+    }
+    errno = EEXIST;
+    return NULL;
+}
+
+bool
+osdep_replace_file(const char *from, const char *to)
+{
+    // Unlike POSIX, /rename/ here refuses to replace a file.
+    if (!MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING)) {
+        errno = EACCES;
+        return false;
+    }
+    return true;
+}
+
 #else
 #   include <unistd.h>
 #   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
 
 int OSDEP_UTF8_READY = 1;
 
@@ -93,4 +199,86 @@ osdep_rng_destroy(void *handle)
     free(handle);
 }
 
+unsigned
+osdep_ncpus(void)
+{
+    const long r = sysconf(_SC_NPROCESSORS_ONLN);
+    return r > 0 ? r : 1;
+}
+
+void *
+osdep_map_file(const char *path, size_t *nbytes)
+{
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    void *addr = NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        goto done;
+    }
+    if ((uint_least64_t) st.st_size > SIZE_MAX) {
+        errno = EFBIG;
+        goto done;
+    }
+    if (st.st_size == 0) {
+        addr = empty_file;
+        *nbytes = 0;
+        goto done;
+    }
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        addr = NULL;
+        goto done;
+    }
+    *nbytes = st.st_size;
+done:
+    {
+        // The mapping keeps the file open.
+        const int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+    }
+    return addr;
+}
+
+void
+osdep_unmap_file(void *addr, size_t nbytes)
+{
+    if (nbytes) {
+        munmap(addr, nbytes);
+    }
+}
+
+FILE *
+osdep_create_temp(char *templ)
+{
+    const int fd = mkstemp(templ);
+    if (fd < 0) {
+        return NULL;
+    }
+    // /mkstemp/ makes it private to the user; the umask can only be read
+    // by setting it, which nothing else here does.
+    const mode_t mask = umask(0);
+    umask(mask);
+    FILE *f = NULL;
+    if (fchmod(fd, 0666 & ~mask) == 0) {
+        f = fdopen(fd, "wb");
+    }
+    if (!f) {
+        const int saved_errno = errno;
+        close(fd);
+        remove(templ);
+        errno = saved_errno;
+    }
+    return f;
+}
+
+bool
+osdep_replace_file(const char *from, const char *to)
+{
+    return rename(from, to) == 0;
+}
+
 #endif
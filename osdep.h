@@ -17,4 +17,31 @@ osdep_rng_fill(void *handle, void *buf, size_t nbuf);
 void
 osdep_rng_destroy(void *handle);
 
+// Number of processors online; at least 1.
+unsigned
+osdep_ncpus(void);
+
+// Maps the whole file at /path/ into memory, read-only, and stores its size
+// in /*nbytes/; pages are shared with every other process that maps it.
+// An empty file gives an address with nothing there. Returns NULL on
+// failure, with /errno/ set.
+void *
+osdep_map_file(const char *path, size_t *nbytes);
+
+// Unmaps what /osdep_map_file/ returned.
+void
+osdep_unmap_file(void *addr, size_t nbytes);
+
+// Creates and opens for writing, in binary mode, a new file named after
+// /templ/, whose last six characters, "XXXXXX", are replaced to make a name
+// that no file has yet; the file gets the permissions a new file made by
+// /fopen/ would. Returns NULL on failure, with /errno/ set.
+FILE *
+osdep_create_temp(char *templ);
+
+// Renames /from/ to /to/, replacing the file there, if any, in one step.
+// Returns false on failure, with /errno/ set.
+bool
+osdep_replace_file(const char *from, const char *to);
+
 #endif
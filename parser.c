@@ -57,11 +57,21 @@ fixup_backward(Instr *chunk, FixupStack *fs, size_t pos)
     FixupList fl = VECTOR_POP(*fs);
     for (size_t i = 0; i < fl.size; ++i) {
         const size_t at = fl.data[i];
-        chunk[at].args.offset = (ssize_t) pos - at - 1;
+        chunk[at].args.offset = (ssize_t) pos - at;
     }
     VECTOR_FREE(fl);
 }
 
+// A load or store of an element by CMD_LOAD_AT1/2 or CMD_STORE_AT1/2, for
+// /hoist_checks/: where it is, and the instructions that load its container
+// and each of its subscripts, if that is all there is to them (else
+// CMD_EXIT).
+typedef struct {
+    size_t pos;
+    Instr container;
+    Instr sub[2];
+} Access;
+
 struct Parser {
     Lexer *lex;
     bool expr_end;
@@ -72,6 +82,13 @@ struct Parser {
     FixupStack fixup_loop_ctnue;
     VECTOR_OF(Ht *) locals;
     size_t bind_vars_from;
+    // The last instruction of the container of the last subscripted
+    // expression; if it loads a variable, an assignment to an element
+    // stores the container back into it (see /rebind/ in vm.h).
+    Instr container;
+    VECTOR_OF(Access) accesses;
+    // The last binary operator emitted.
+    const Op *last_binary;
     unsigned line;
     jmp_buf err_handler;
     ParserError err;
@@ -89,6 +106,7 @@ parser_new(Lexer *lex)
         .fixup_loop_break = VECTOR_NEW(),
         .fixup_loop_ctnue = VECTOR_NEW(),
         .locals = VECTOR_NEW(),
+        .accesses = VECTOR_NEW(),
     };
     return p;
 }
@@ -108,6 +126,7 @@ reset(Parser *p)
         ht_destroy(p->locals.data[i]);
     }
     VECTOR_CLEAR(p->locals);
+    VECTOR_CLEAR(p->accesses);
 
     p->bind_vars_from = 0;
     p->line = 0;
@@ -120,6 +139,7 @@ typedef enum {
     STOP_TOK_COMMA,
     STOP_TOK_SEMICOLON,
     STOP_TOK_EQ,
+    STOP_TOK_COLON,
     STOP_TOK_COLON_EQ,
 
     STOP_TOK_NONSENSE,
@@ -213,6 +233,26 @@ assignment(Parser *p, const char *name, size_t nname, bool local)
     }
 }
 
+// For an assignment to an element of /p->container/: returns the
+// instruction that stores the container back into its variable, and sets
+// /*rebind/, if it is one; else CMD_EXIT.
+static
+Instr
+store_back(Parser *p, bool *rebind)
+{
+    const Instr c = p->container;
+    *rebind = true;
+    switch (c.cmd) {
+    case CMD_LOAD:
+        return assignment(p, c.args.str.start, c.args.str.size, false);
+    case CMD_LOAD_FAST:
+        return (Instr) {CMD_STORE_FAST, {.index = c.args.index}};
+    default:
+        *rebind = false;
+        return (Instr) {.cmd = CMD_EXIT};
+    }
+}
+
 static
 void
 bind_vars(Parser *p)
@@ -238,6 +278,220 @@ bind_vars(Parser *p)
     p->bind_vars_from = nchunk;
 }
 
+// The local variable that /in/ loads, or UINT_MAX. (Names are bound to
+// locals by /bind_vars/ at the end of a function, so look them up.)
+static
+unsigned
+loaded_local(Parser *p, Instr in)
+{
+    if (in.cmd == CMD_LOAD_FAST) {
+        return in.args.index;
+    }
+    if (in.cmd != CMD_LOAD) {
+        return UINT_MAX;
+    }
+    Ht *h = p->locals.data[p->locals.size - 1];
+    const HtValue val = ht_get(h, in.args.str.start, in.args.str.size);
+    return val == HT_NO_VALUE ? UINT_MAX : val;
+}
+
+// Whether /code/[0..n) assigns to local variable /index/ other than to
+// store back the container of an element assignment, which leaves its
+// kind and dimensions as they are (see /rebind/ in vm.h).
+static
+bool
+assigns(const Instr *code, size_t n, unsigned index)
+{
+    for (size_t k = 0; k < n; ++k) {
+        if (code[k].cmd != CMD_STORE_FAST || code[k].args.index != index) {
+            continue;
+        }
+        const Instr prev = k ? code[k - 1] : (Instr) {.cmd = CMD_EXIT};
+        const bool rebind =
+            ((prev.cmd == CMD_STORE_AT1 || prev.cmd == CMD_STORE_AT2) && prev.args.at.rebind) ||
+            (prev.cmd == CMD_STORE_SLICE && prev.args.slice.rebind);
+        if (!rebind) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Copies the instructions of /code/[0..n) other than CMD_QUARKs to
+// /out/[0..n_out), if there are exactly that many.
+static
+bool
+match(const Instr *code, size_t n, Instr *out, size_t n_out)
+{
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (code[i].cmd == CMD_QUARK) {
+            continue;
+        }
+        if (k == n_out) {
+            return false;
+        }
+        out[k++] = code[i];
+    }
+    return k == n_out;
+}
+
+static
+bool
+is_binary(Instr in, const Op *op, unsigned means)
+{
+    return op && op->means == means && in.args.binary == op->exec.binary &&
+           (in.cmd == CMD_OP_BINARY || in.cmd == CMD_OP_BINARY_LAZY);
+}
+
+// Positions of a 'for' loop: the condition starts at /check/, the body at
+// /body/, and the assignment at /cont/, followed by the jump back, which
+// /end/ is just after.
+typedef struct {
+    unsigned line;
+    size_t check;
+    size_t body;
+    size_t cont;
+    size_t end;
+    // Where its entries in /p->accesses/ start.
+    size_t first_access;
+    // The last binary operators of the condition and the assignment.
+    const Op *cond_op;
+    const Op *step_op;
+} ForLoop;
+
+enum { MAX_HOISTED = 8 };
+
+// Bounds check hoisting. Take a loop 'for i | lo; i <= hi; i + c do ... end'
+// (or 'i < hi'), where /hi/ is a number or a local variable, and /c/ a
+// number >= 0: then i >= lo and i <= hi whenever the body runs, provided the
+// body does not assign to /i/ or /hi/. If it subscripts a local matrix,
+// which it does not assign to either (only to its elements), with /i/,
+// checking that lo >= 1 and hi is within the dimensions of that matrix at
+// the start covers every iteration.
+//
+// Such a loop is followed by a copy of itself where these subscripts are
+// marked checked, entered if a CMD_CHECK_BOUNDS per matrix and dimension
+// passes, and left for the original otherwise:
+//
+//     lo; jump G; [loop]; jump E; G: store i; [checks]; [copy]; E:
+static
+void
+hoist_checks(Parser *p, const ForLoop *l)
+{
+    Instr init = p->chunk.data[l->check - 1];
+    Instr cond[3];
+    Instr step[3];
+    if (init.cmd != CMD_STORE_FAST ||
+        !match(p->chunk.data + l->check, l->body - 1 - l->check, cond, 3) ||
+        !match(p->chunk.data + l->cont, l->end - 2 - l->cont, step, 3))
+    {
+        return;
+    }
+    const unsigned i = init.args.index;
+    const unsigned hi = loaded_local(p, cond[1]);
+    if (loaded_local(p, cond[0]) != i || !is_binary(cond[2], l->cond_op, OP_MEANS_BELOW) ||
+        (cond[1].cmd != CMD_LOAD_SCALAR && (hi == UINT_MAX || hi == i)) ||
+        loaded_local(p, step[0]) != i || step[1].cmd != CMD_LOAD_SCALAR ||
+        !(step[1].args.scalar >= 0) || !is_binary(step[2], l->step_op, OP_MEANS_ADD))
+    {
+        return;
+    }
+
+    const Instr *body = p->chunk.data + l->body;
+    const size_t nbody = l->cont - l->body;
+    for (size_t k = 0; k < nbody; ++k) {
+        // Its locals are another function's.
+        if (body[k].cmd == CMD_FUNCTION) {
+            return;
+        }
+    }
+    if (assigns(body, nbody, i) || (hi != UINT_MAX && assigns(body, nbody, hi))) {
+        return;
+    }
+
+    struct {
+        unsigned index;
+        unsigned char dim;
+    } checks[MAX_HOISTED];
+    unsigned nchecks = 0;
+
+    // Which subscripts of each access in the body to mark.
+    const size_t naccesses = p->accesses.size;
+    unsigned char *bits = XNEW0(unsigned char, naccesses - l->first_access + 1);
+    for (size_t a = l->first_access; a < naccesses; ++a) {
+        const Access acc = p->accesses.data[a];
+        if (acc.pos < l->body || acc.pos >= l->cont) {
+            continue;
+        }
+        const unsigned c = loaded_local(p, acc.container);
+        if (c == UINT_MAX || c == i || assigns(body, nbody, c)) {
+            continue;
+        }
+        const unsigned nindices = p->chunk.data[acc.pos].args.at.nindices;
+        for (unsigned k = 0; k < nindices; ++k) {
+            if (loaded_local(p, acc.sub[k]) != i) {
+                continue;
+            }
+            const unsigned char dim = nindices == 1 ? 0 : k + 1;
+            unsigned m = 0;
+            while (m < nchecks && !(checks[m].index == c && checks[m].dim == dim)) {
+                ++m;
+            }
+            if (m == MAX_HOISTED) {
+                continue;
+            }
+            if (m == nchecks) {
+                checks[nchecks].index = c;
+                checks[nchecks].dim = dim;
+                ++nchecks;
+            }
+            bits[a - l->first_access] |= 1 << k;
+        }
+    }
+    if (!nchecks) {
+        free(bits);
+        return;
+    }
+
+    p->chunk.data[l->check - 1] = (Instr) {CMD_JUMP, {.offset = l->end + 1 - (l->check - 1)}};
+    emit_command_noquark(p, CMD_JUMP);
+
+    emit_noquark(p, (Instr) {CMD_QUARK, {.nline = l->line}});
+    emit_noquark(p, init);
+    for (unsigned m = 0; m < nchecks; ++m) {
+        emit_noquark(p, (Instr) {CMD_LOAD_FAST, {.index = i}});
+        emit_noquark(p, hi == UINT_MAX ? cond[1] : (Instr) {CMD_LOAD_FAST, {.index = hi}});
+        emit_noquark(p, (Instr) {
+            CMD_CHECK_BOUNDS,
+            {.bounds = {
+                .offset = (ssize_t) l->check - p->chunk.size,
+                .index = checks[m].index,
+                .dim = checks[m].dim,
+            }}
+        });
+    }
+
+    const size_t copy = p->chunk.size;
+    for (size_t k = l->check; k < l->end; ++k) {
+        emit_noquark(p, p->chunk.data[k]);
+    }
+    // The copies are accesses too, for enclosing loops.
+    for (size_t a = l->first_access; a < naccesses; ++a) {
+        Access acc = p->accesses.data[a];
+        if (acc.pos < l->check || acc.pos >= l->end) {
+            continue;
+        }
+        acc.pos += copy - l->check;
+        p->chunk.data[acc.pos].args.at.checked |= bits[a - l->first_access];
+        VECTOR_PUSH(p->accesses, acc);
+    }
+    free(bits);
+
+    p->chunk.data[l->end].args.offset = p->chunk.size - l->end;
+    p->line = 0;
+}
+
 // forward declaration
 static inline
 StopTokenKind
@@ -391,14 +645,17 @@ expr(Parser *p, int min_priority)
                     return STOP_TOK_OP;
                 }
 
+                const Command unary_cmd = op->lazy ? CMD_OP_UNARY_LAZY : CMD_OP_UNARY;
+                const Command binary_cmd = op->lazy ? CMD_OP_BINARY_LAZY : CMD_OP_BINARY;
+
                 if (op->arity == 1) {
                     if (op->assoc == OP_ASSOC_LEFT) {
                         After_expr(p, m);
-                        emit(p, m, (Instr) {CMD_OP_UNARY, {.unary = op->exec.unary}});
+                        emit(p, m, (Instr) {unary_cmd, {.unary = op->exec.unary}});
                     } else {
                         This_is_expr(p, m);
                         StopTokenKind s = expr(p, op->priority);
-                        emit(p, m, (Instr) {CMD_OP_UNARY, {.unary = op->exec.unary}});
+                        emit(p, m, (Instr) {unary_cmd, {.unary = op->exec.unary}});
                         if (s != STOP_TOK_OP) {
                             return s;
                         }
@@ -407,7 +664,8 @@ expr(Parser *p, int min_priority)
                     After_expr(p, m);
                     p->expr_end = false;
                     StopTokenKind s = expr(p, op->priority + (op->assoc == OP_ASSOC_LEFT));
-                    emit(p, m, (Instr) {CMD_OP_BINARY, {.binary = op->exec.binary}});
+                    emit(p, m, (Instr) {binary_cmd, {.binary = op->exec.binary}});
+                    p->last_binary = op;
                     if (s != STOP_TOK_OP) {
                         return s;
                     }
@@ -448,20 +706,76 @@ expr(Parser *p, int min_priority)
 
         case LEX_KIND_LBRACKET:
             if (p->expr_end) {
-                // indexing
-                unsigned nindices = 1;
+                // indexing; a subscript is an expression, ':' or 'i:j' (see
+                // /IndexKind/)
+                const Instr container = p->chunk.data[p->chunk.size - 1];
+                unsigned nindices = 0;
+                unsigned char kinds[2] = {INDEX_SCALAR, INDEX_SCALAR};
+                Instr sub[2] = {{.cmd = CMD_EXIT}, {.cmd = CMD_EXIT}};
+                bool slice = false;
                 p->expr_end = false;
                 while (1) {
-                    StopTokenKind s = expr(p, -1);
+                    IndexKind kind = INDEX_SCALAR;
+                    StopTokenKind s;
+                    lexer_mark(p->lex);
+                    if (lexer_next(p->lex).kind == LEX_KIND_COLON) {
+                        kind = INDEX_ALL;
+                        lexer_mark(p->lex);
+                        switch (lexer_next(p->lex).kind) {
+                        case LEX_KIND_RBRACKET:
+                            s = STOP_TOK_RBRACKET;
+                            break;
+                        case LEX_KIND_COMMA:
+                            s = STOP_TOK_COMMA;
+                            break;
+                        default:
+                            s = STOP_TOK_NONSENSE;
+                        }
+                    } else {
+                        lexer_rollback(p->lex);
+                        const size_t start = p->chunk.size;
+                        s = expr(p, -1);
+                        if (s == STOP_TOK_COLON) {
+                            kind = INDEX_RANGE;
+                            s = expr(p, -1);
+                        } else if (p->chunk.size == start + 1 && nindices < 2) {
+                            sub[nindices] = p->chunk.data[start];
+                        }
+                    }
+                    if (nindices < 2) {
+                        kinds[nindices] = kind;
+                    }
+                    ++nindices;
+                    slice = slice || kind != INDEX_SCALAR;
+
                     if (s == STOP_TOK_RBRACKET) {
                         break;
-                    } else if (s == STOP_TOK_COMMA) {
-                        ++nindices;
-                    } else {
+                    } else if (s != STOP_TOK_COMMA) {
                         throw_there(p, "expected either ',' or ']'");
                     }
                 }
-                emit(p, m, (Instr) {CMD_LOAD_AT, {.nindices = nindices}});
+                p->expr_end = true;
+                p->container = container;
+                if (!slice) {
+                    const Command cmd = nindices == 1 ? CMD_LOAD_AT1
+                                      : nindices == 2 ? CMD_LOAD_AT2
+                                      : CMD_LOAD_AT;
+                    emit(p, m, (Instr) {cmd, {.at = {.nindices = nindices}}});
+                    if (cmd != CMD_LOAD_AT) {
+                        VECTOR_PUSH(p->accesses, ((Access) {
+                            .pos = p->chunk.size - 1,
+                            .container = container,
+                            .sub = {sub[0], sub[1]},
+                        }));
+                    }
+                } else if (nindices > 2) {
+                    throw_at(p, m, "number of indices is greater than 2");
+                } else {
+                    emit(p, m, (Instr) {
+                        CMD_LOAD_SLICE,
+                        {.slice = {.nindices = nindices, .kinds = {kinds[0], kinds[1]}}}
+                    });
+                }
             } else {
                 // matrix
                 unsigned width;
@@ -518,6 +832,11 @@ expr(Parser *p, int min_priority)
             p->expr_end = false;
             return STOP_TOK_EQ;
 
+        case LEX_KIND_COLON:
+            After_expr(p, m);
+            p->expr_end = false;
+            return STOP_TOK_COLON;
+
         case LEX_KIND_COLON_EQ:
             After_expr(p, m);
             p->expr_end = false;
@@ -705,14 +1024,14 @@ stmt(Parser *p)
 
             emit_noquark(p, (Instr) {
                 CMD_JUMP,
-                {.offset = (ssize_t) check_instr - p->chunk.size + 1}
+                {.offset = (ssize_t) check_instr - p->chunk.size}
             });
 
             const size_t end_pos = p->chunk.size;
             p->chunk.data[jump_instr].args.offset = end_pos - jump_instr;
 
             fixup_forward(p->chunk.data, &p->fixup_loop_break, end_pos);
-            fixup_backward(p->chunk.data, &p->fixup_loop_ctnue, jump_instr);
+            fixup_backward(p->chunk.data, &p->fixup_loop_ctnue, check_instr);
 
             p->expr_end = false;
 
@@ -743,9 +1062,12 @@ stmt(Parser *p)
 
             // loop condition
             const size_t check_instr = p->chunk.size;
+            const size_t first_access = p->accesses.size;
+            p->last_binary = NULL;
             if (expr(p, -1) != STOP_TOK_SEMICOLON) {
                 throw_there(p, "expected ';'");
             }
+            const Op *cond_op = p->last_binary;
 
             const size_t jump_instr = p->chunk.size;
             emit_command_noquark(p, CMD_JUMP_UNLESS);
@@ -754,10 +1076,15 @@ stmt(Parser *p)
             p->line = 0;
             const size_t old_aux_size = p->aux_chunk.size;
             swap_chunks(p);
+            const size_t step_accesses = p->accesses.size;
+            p->last_binary = NULL;
             if (expr(p, -1) != STOP_TOK_DO) {
                 throw_there(p, "expected 'do'");
             }
+            const Op *step_op = p->last_binary;
             emit_noquark(p, assignment(p, var.start, var.size, true));
+            // These are in /aux_chunk/, and moved below.
+            p->accesses.size = step_accesses;
             swap_chunks(p);
 
             // loop body
@@ -777,7 +1104,7 @@ stmt(Parser *p)
 
             emit_noquark(p, (Instr) {
                 CMD_JUMP,
-                {.offset = (ssize_t) check_instr - p->chunk.size + 1}
+                {.offset = (ssize_t) check_instr - p->chunk.size}
             });
 
             const size_t end_pos = p->chunk.size;
@@ -786,6 +1113,17 @@ stmt(Parser *p)
             fixup_forward(p->chunk.data, &p->fixup_loop_break, end_pos);
             fixup_forward(p->chunk.data, &p->fixup_loop_ctnue, cont_instr);
 
+            hoist_checks(p, &(ForLoop) {
+                .line = var.line,
+                .check = check_instr,
+                .body = jump_instr + 1,
+                .cont = cont_instr,
+                .end = end_pos,
+                .first_access = first_access,
+                .cond_op = cond_op,
+                .step_op = step_op,
+            });
+
             p->expr_end = false;
 
             return end_of_stmt(p);
@@ -854,6 +1192,14 @@ stmt(Parser *p)
             case STOP_TOK_COLON_EQ:
                 {
                     Instr last = VECTOR_POP(p->chunk);
+                    Instr rebind = {.cmd = CMD_EXIT};
+                    // If /last/ is an /Access/, it moves to the store.
+                    const bool access = p->accesses.size &&
+                        p->accesses.data[p->accesses.size - 1].pos == p->chunk.size;
+                    Access moved = {.pos = 0};
+                    if (access) {
+                        moved = VECTOR_POP(p->accesses);
+                    }
                     switch (last.cmd) {
                     case CMD_LOAD:
                         last = assignment(
@@ -863,8 +1209,20 @@ stmt(Parser *p)
                             s == STOP_TOK_COLON_EQ);
                         break;
                     case CMD_LOAD_AT:
+                    case CMD_LOAD_AT1:
+                    case CMD_LOAD_AT2:
                         if (s == STOP_TOK_EQ) {
-                            last.cmd = CMD_STORE_AT;
+                            last.cmd = last.cmd == CMD_LOAD_AT1 ? CMD_STORE_AT1
+                                     : last.cmd == CMD_LOAD_AT2 ? CMD_STORE_AT2
+                                     : CMD_STORE_AT;
+                            rebind = store_back(p, &last.args.at.rebind);
+                            break;
+                        }
+                        // fallthrough
+                    case CMD_LOAD_SLICE:
+                        if (s == STOP_TOK_EQ) {
+                            last.cmd = CMD_STORE_SLICE;
+                            rebind = store_back(p, &last.args.slice.rebind);
                             break;
                         }
                         // fallthrough
@@ -873,6 +1231,13 @@ stmt(Parser *p)
                     }
                     StopTokenKind s2 = expr(p, -1);
                     emit_noquark(p, last);
+                    if (access) {
+                        moved.pos = p->chunk.size - 1;
+                        VECTOR_PUSH(p->accesses, moved);
+                    }
+                    if (rebind.cmd != CMD_EXIT) {
+                        emit_noquark(p, rebind);
+                    }
                     switch (s2) {
                     case STOP_TOK_SEMICOLON:
                     case STOP_TOK_EOF:
@@ -941,6 +1306,7 @@ parser_destroy(Parser *p)
         ht_destroy(p->locals.data[i]);
     }
     VECTOR_FREE(p->locals);
+    VECTOR_FREE(p->accesses);
 
     free(p);
 }
@@ -2,9 +2,14 @@
 #include "disasm.h"
 
 Runtime
-runtime_new(void *userdata)
+runtime_new(void *userdata, unsigned nthreads)
 {
     Runtime r;
+    // Installed before anything else, so that every object created on behalf
+    // of this runtime comes from them.
+    alloc_heap = r.heap = alloc_pool_new();
+    alloc_scratch = r.scratch = alloc_arena_new();
+    workers_global = r.workers = workers_new(nthreads);
     r.ops = trie_new(TRIE_NRESERVE_DEFAULT);
     r.lexer = lexer_new(r.ops);
     r.parser = parser_new(r.lexer);
@@ -88,4 +93,11 @@ runtime_destroy(Runtime r)
     lexer_destroy(r.lexer);
     parser_destroy(r.parser);
     env_destroy(r.env);
+
+    workers_global = NULL;
+    workers_destroy(r.workers);
+
+    alloc_heap = alloc_scratch = alloc_libc();
+    r.heap->destroy(r.heap);
+    r.scratch->destroy(r.scratch);
 }
@@ -10,12 +10,17 @@
 #include "lexer.h"
 #include "parser.h"
 #include "env.h"
+#include "alloc.h"
+#include "workers.h"
 
 typedef struct {
     Trie *ops;
     Lexer *lexer;
     Parser *parser;
     Env *env;
+    Allocator *heap;
+    Allocator *scratch;
+    Workers *workers;
     bool dflag;
 } Runtime;
 
@@ -32,8 +37,9 @@ typedef struct {
     const char *msg;
 } ExecError;
 
+// /nthreads/ is the number of threads large matrix kernels may use.
 Runtime
-runtime_new(void *userdata);
+runtime_new(void *userdata, unsigned nthreads);
 
 void
 runtime_reg_op(Runtime r, const char *sym, Op op);
@@ -0,0 +1,421 @@
+#include "sparse.h"
+#include "env.h"
+#include "stats.h"
+#include "alloc.h"
+
+#include <math.h>
+
+Sparse *
+sparse_new(unsigned height, unsigned width, size_t nnz)
+{
+    const size_t nbytes = sparse_nbytes(height, nnz);
+    Sparse *s = heap_alloc(nbytes);
+    stats_on_alloc(STATS_OBJ_SPARSE, nbytes);
+    *s = (Sparse) {.height = height, .width = width, .nnz = nnz};
+    s->gchdr.nrefs = 1;
+    s->val = s->storage;
+    s->row = (size_t *) (s->val + nnz);
+    s->col = (unsigned *) (s->row + (size_t) height + 1);
+    return s;
+}
+
+// Zero-based index from the one-based /v/, or /n/ if that is not an
+// integer in [1, /n/].
+static
+unsigned
+index_of(Scalar v, unsigned n)
+{
+    return v >= 1 && v <= n && v == floor(v) ? (unsigned) v - 1 : n;
+}
+
+Sparse *
+sparse_from_triplets(Env *e, const Scalar *i, const Scalar *j, const Scalar *x, size_t n,
+                     unsigned height, unsigned width)
+{
+    unsigned *ri = scratch_alloc(n * sizeof(unsigned));
+    unsigned *ci = scratch_alloc(n * sizeof(unsigned));
+    for (size_t k = 0; k < n; ++k) {
+        if ((ri[k] = index_of(i[k], height)) == height) {
+            env_throw(e, "row number out of range");
+        }
+        if ((ci[k] = index_of(j[k], width)) == width) {
+            env_throw(e, "column number out of range");
+        }
+    }
+
+    // Two stable counting sorts, by column and then by row, put the
+    // elements in row order, columns ascending within a row, and
+    // duplicates in the order given.
+    const size_t ncount = (height > width ? (size_t) height : width) + 1;
+    size_t *count = scratch_alloc(ncount * sizeof(size_t));
+    size_t *by_col = scratch_alloc(n * sizeof(size_t));
+    size_t *by_row = scratch_alloc(n * sizeof(size_t));
+
+    memset(count, 0, ((size_t) width + 1) * sizeof(size_t));
+    for (size_t k = 0; k < n; ++k) {
+        ++count[ci[k] + 1];
+    }
+    for (size_t c = 0; c < width; ++c) {
+        count[c + 1] += count[c];
+    }
+    for (size_t k = 0; k < n; ++k) {
+        by_col[count[ci[k]]++] = k;
+    }
+
+    memset(count, 0, ((size_t) height + 1) * sizeof(size_t));
+    for (size_t k = 0; k < n; ++k) {
+        ++count[ri[k] + 1];
+    }
+    for (size_t r = 0; r < height; ++r) {
+        count[r + 1] += count[r];
+    }
+    for (size_t t = 0; t < n; ++t) {
+        const size_t k = by_col[t];
+        by_row[count[ri[k]]++] = k;
+    }
+
+    // Sums of the runs of equal (row, column), counted first, then stored.
+    Sparse *s = NULL;
+    for (int pass = 0; pass < 2; ++pass) {
+        size_t nnz = 0;
+        size_t t = 0;
+        for (unsigned r = 0; r < height; ++r) {
+            if (s) {
+                s->row[r] = nnz;
+            }
+            while (t < n && ri[by_row[t]] == r) {
+                const unsigned c = ci[by_row[t]];
+                Scalar v = 0;
+                for (; t < n && ri[by_row[t]] == r && ci[by_row[t]] == c; ++t) {
+                    v += x[by_row[t]];
+                }
+                if (v != 0) {
+                    if (s) {
+                        s->col[nnz] = c;
+                        s->val[nnz] = v;
+                    }
+                    ++nnz;
+                }
+            }
+        }
+        if (s) {
+            s->row[height] = nnz;
+        } else {
+            s = sparse_new(height, width, nnz);
+        }
+    }
+
+    scratch_free(by_row, n * sizeof(size_t));
+    scratch_free(by_col, n * sizeof(size_t));
+    scratch_free(count, ncount * sizeof(size_t));
+    scratch_free(ci, n * sizeof(unsigned));
+    scratch_free(ri, n * sizeof(unsigned));
+    return s;
+}
+
+Sparse *
+sparse_from_matrix(const Matrix *m)
+{
+    size_t nnz = 0;
+    for (size_t i = 0; i < m->height; ++i) {
+        for (size_t j = 0; j < m->width; ++j) {
+            nnz += matrix_at(m, i, j) != 0;
+        }
+    }
+    Sparse *s = sparse_new(m->height, m->width, nnz);
+    size_t k = 0;
+    for (size_t i = 0; i < m->height; ++i) {
+        s->row[i] = k;
+        for (size_t j = 0; j < m->width; ++j) {
+            const Scalar v = matrix_at(m, i, j);
+            if (v != 0) {
+                s->col[k] = j;
+                s->val[k] = v;
+                ++k;
+            }
+        }
+    }
+    s->row[m->height] = k;
+    return s;
+}
+
+Matrix *
+sparse_to_matrix(Env *e, const Sparse *s)
+{
+    if ((uint_least64_t) s->height * s->width > UINT_MAX) {
+        env_throw(e, "matrix is too large");
+    }
+    Matrix *m = matrix_new(s->height, s->width);
+    sparse_add_to_dense(m->elems, s, 1);
+    return m;
+}
+
+void
+sparse_add_to_dense(Scalar *z, const Sparse *s, Scalar a)
+{
+    for (size_t i = 0; i < s->height; ++i) {
+        Scalar *zi = z + i * s->width;
+        for (size_t k = s->row[i]; k < s->row[i + 1]; ++k) {
+            zi[s->col[k]] += a * s->val[k];
+        }
+    }
+    STATS_ADD(flops, 2 * s->nnz);
+}
+
+// Row /i/ of /x/ + /y/, or /x/ - /y/, merged into col[] and val[] if /z/
+// is not NULL, from /z->row[i]/ on; returns the number of nonzeros.
+static
+size_t
+add_row(Sparse *z, const Sparse *x, const Sparse *y, bool negate_y, size_t i)
+{
+    size_t a = x->row[i];
+    size_t b = y->row[i];
+    const size_t a_end = x->row[i + 1];
+    const size_t b_end = y->row[i + 1];
+    size_t nnz = 0;
+    while (a < a_end || b < b_end) {
+        const unsigned ca = a < a_end ? x->col[a] : UINT_MAX;
+        const unsigned cb = b < b_end ? y->col[b] : UINT_MAX;
+        const unsigned c = ca < cb ? ca : cb;
+        Scalar v = 0;
+        if (ca == c) {
+            v = x->val[a++];
+        }
+        if (cb == c) {
+            const Scalar w = y->val[b++];
+            v = ca == c ? (negate_y ? v - w : v + w) : (negate_y ? -w : w);
+        }
+        if (v != 0) {
+            if (z) {
+                z->col[z->row[i] + nnz] = c;
+                z->val[z->row[i] + nnz] = v;
+            }
+            ++nnz;
+        }
+    }
+    return nnz;
+}
+
+Sparse *
+sparse_add(const Sparse *x, const Sparse *y, bool negate_y)
+{
+    size_t nnz = 0;
+    for (size_t i = 0; i < x->height; ++i) {
+        nnz += add_row(NULL, x, y, negate_y, i);
+    }
+    Sparse *z = sparse_new(x->height, x->width, nnz);
+    z->row[0] = 0;
+    for (size_t i = 0; i < x->height; ++i) {
+        z->row[i + 1] = z->row[i] + add_row(z, x, y, negate_y, i);
+    }
+    STATS_ADD(flops, x->nnz + y->nnz);
+    return z;
+}
+
+Sparse *
+sparse_scale(Scalar a, Value v)
+{
+    const Sparse *x = AS_SPARSE(v);
+    size_t nnz = 0;
+    for (size_t k = 0; k < x->nnz; ++k) {
+        nnz += a * x->val[k] != 0;
+    }
+    // With nothing dropped, the structure stays, and so can the matrix.
+    Sparse *z = nnz == x->nnz ? sparse_reuse(v) : NULL;
+    if (!z) {
+        z = sparse_new(x->height, x->width, nnz);
+    }
+    size_t out = 0;
+    for (size_t i = 0; i < x->height; ++i) {
+        const size_t end = x->row[i + 1];
+        z->row[i] = out;
+        for (size_t k = x->row[i]; k < end; ++k) {
+            const Scalar p = a * x->val[k];
+            if (p != 0) {
+                z->col[out] = x->col[k];
+                z->val[out] = p;
+                ++out;
+            }
+        }
+    }
+    z->row[x->height] = out;
+    STATS_ADD(flops, x->nnz);
+    return z;
+}
+
+static
+int
+compare_unsigned(const void *a, const void *b)
+{
+    const unsigned x = *(const unsigned *) a;
+    const unsigned y = *(const unsigned *) b;
+    return (x > y) - (x < y);
+}
+
+Sparse *
+sparse_mul(const Sparse *x, const Sparse *y)
+{
+    // Row i of the product is the sum of the rows k of /y/ scaled by
+    // x(i, k), gathered in a dense accumulator (Gustavson's algorithm). The
+    // number of products is a bound on the number of nonzeros, so the
+    // result is built in scratch space and then copied out.
+    size_t nprod = 0;
+    for (size_t k = 0; k < x->nnz; ++k) {
+        nprod += y->row[x->col[k] + 1] - y->row[x->col[k]];
+    }
+    const size_t w = y->width;
+    Scalar *acc = scratch_alloc(w * sizeof(Scalar));
+    size_t *mark = scratch_alloc(w * sizeof(size_t));
+    size_t *row = scratch_alloc(((size_t) x->height + 1) * sizeof(size_t));
+    unsigned *col = scratch_alloc(nprod * sizeof(unsigned));
+    Scalar *val = scratch_alloc(nprod * sizeof(Scalar));
+    for (size_t j = 0; j < w; ++j) {
+        mark[j] = SIZE_MAX;
+    }
+
+    size_t nnz = 0;
+    for (size_t i = 0; i < x->height; ++i) {
+        row[i] = nnz;
+        // The columns touched go to col[], from /nnz/ on, in the order
+        // they are first met.
+        size_t ntouched = 0;
+        for (size_t a = x->row[i]; a < x->row[i + 1]; ++a) {
+            const size_t k = x->col[a];
+            const Scalar u = x->val[a];
+            for (size_t b = y->row[k]; b < y->row[k + 1]; ++b) {
+                const unsigned j = y->col[b];
+                if (mark[j] != i) {
+                    mark[j] = i;
+                    acc[j] = 0;
+                    col[nnz + ntouched++] = j;
+                }
+                acc[j] += u * y->val[b];
+            }
+        }
+        const size_t base = nnz;
+        qsort(col + base, ntouched, sizeof(unsigned), compare_unsigned);
+        for (size_t t = 0; t < ntouched; ++t) {
+            const unsigned j = col[base + t];
+            if (acc[j] != 0) {
+                col[nnz] = j;
+                val[nnz] = acc[j];
+                ++nnz;
+            }
+        }
+    }
+    row[x->height] = nnz;
+
+    Sparse *z = sparse_new(x->height, w, nnz);
+    memcpy(z->row, row, ((size_t) x->height + 1) * sizeof(size_t));
+    memcpy(z->col, col, nnz * sizeof(unsigned));
+    memcpy(z->val, val, nnz * sizeof(Scalar));
+    STATS_ADD(flops, 2 * nprod);
+
+    scratch_free(val, nprod * sizeof(Scalar));
+    scratch_free(col, nprod * sizeof(unsigned));
+    scratch_free(row, ((size_t) x->height + 1) * sizeof(size_t));
+    scratch_free(mark, w * sizeof(size_t));
+    scratch_free(acc, w * sizeof(Scalar));
+    return z;
+}
+
+Sparse *
+sparse_transposed(const Sparse *x)
+{
+    // A counting sort by column; going through the rows in order leaves
+    // each row of the result sorted.
+    Sparse *z = sparse_new(x->width, x->height, x->nnz);
+    memset(z->row, 0, ((size_t) x->width + 1) * sizeof(size_t));
+    for (size_t k = 0; k < x->nnz; ++k) {
+        ++z->row[x->col[k] + 1];
+    }
+    for (size_t j = 0; j < x->width; ++j) {
+        z->row[j + 1] += z->row[j];
+    }
+    // z->row[j] serves as the next free slot of row /j/, and ends up where
+    // row j + 1 starts; shifted back at the end.
+    for (size_t i = 0; i < x->height; ++i) {
+        for (size_t k = x->row[i]; k < x->row[i + 1]; ++k) {
+            const size_t t = z->row[x->col[k]]++;
+            z->col[t] = i;
+            z->val[t] = x->val[k];
+        }
+    }
+    memmove(z->row + 1, z->row, (size_t) x->width * sizeof(size_t));
+    z->row[0] = 0;
+    return z;
+}
+
+bool
+sparse_eq(const Sparse *x, const Sparse *y)
+{
+    for (size_t i = 0; i < x->height; ++i) {
+        size_t a = x->row[i];
+        size_t b = y->row[i];
+        while (a < x->row[i + 1] || b < y->row[i + 1]) {
+            const unsigned ca = a < x->row[i + 1] ? x->col[a] : UINT_MAX;
+            const unsigned cb = b < y->row[i + 1] ? y->col[b] : UINT_MAX;
+            const Scalar va = ca <= cb ? x->val[a++] : 0;
+            const Scalar vb = cb <= ca ? y->val[b++] : 0;
+            if (va != vb) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool
+sparse_eq_dense(const Sparse *s, const Matrix *m)
+{
+    for (size_t i = 0; i < s->height; ++i) {
+        size_t k = s->row[i];
+        for (size_t j = 0; j < s->width; ++j) {
+            const Scalar v = k < s->row[i + 1] && s->col[k] == j ? s->val[k++] : 0;
+            if (v != matrix_at(m, i, j)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static
+Value
+get(const Sparse *s, unsigned i, unsigned j)
+{
+    const LinalgCsr a = sparse_csr(s);
+    const size_t k = linalg_csr_find(&a, i, j);
+    return MK_SCL(k == SIZE_MAX ? 0 : s->val[k]);
+}
+
+Value
+sparse_get1(Env *e, const Sparse *s, Value elem)
+{
+    if (elem.kind != VAL_KIND_SCALAR) {
+        env_throw(e, "cannot index matrix with %s value", value_kindname(elem.kind));
+    }
+    const size_t num = AS_SCL(elem);
+    if (num < 1 || num > (size_t) s->width * s->height) {
+        env_throw(e, "element number out of range");
+    }
+    return get(s, (num - 1) / s->width, (num - 1) % s->width);
+}
+
+Value
+sparse_get2(Env *e, const Sparse *s, Value row, Value col)
+{
+    if (row.kind != VAL_KIND_SCALAR || col.kind != VAL_KIND_SCALAR) {
+        env_throw(e, "cannot index matrix with (%s, %s) values",
+                  value_kindname(row.kind), value_kindname(col.kind));
+    }
+    const size_t i = AS_SCL(row);
+    const size_t j = AS_SCL(col);
+    if (i < 1 || i > s->height) {
+        env_throw(e, "row number out of range");
+    }
+    if (j < 1 || j > s->width) {
+        env_throw(e, "column number out of range");
+    }
+    return get(s, i - 1, j - 1);
+}
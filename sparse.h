@@ -0,0 +1,119 @@
+#ifndef sparse_h_
+#define sparse_h_
+
+#include "common.h"
+#include "value.h"
+#include "matrix.h"
+#include "linalg.h"
+
+struct Env;
+
+// A matrix that stores only its nonzero elements, in compressed sparse row
+// form (see /LinalgCsr/), in one block with its header. Unlike /Matrix/,
+// its dimensions are only limited by how many nonzeros there are.
+// Elements cannot be assigned to: every operation makes a new one.
+typedef struct Sparse {
+    GcObject gchdr;
+    unsigned height;
+    unsigned width;
+    size_t nnz;
+    // val[nnz], then row[height + 1], then col[nnz], all in /storage/.
+    Scalar *val;
+    size_t *row;
+    unsigned *col;
+    Scalar storage[];
+} Sparse;
+
+INHEADER
+size_t
+sparse_nbytes(unsigned height, size_t nnz)
+{
+    return sizeof(Sparse) + nnz * sizeof(Scalar) + ((size_t) height + 1) * sizeof(size_t) +
+           nnz * sizeof(unsigned);
+}
+
+INHEADER
+LinalgCsr
+sparse_csr(const Sparse *s)
+{
+    return (LinalgCsr) {
+        .height = s->height,
+        .width = s->width,
+        .row = s->row,
+        .col = s->col,
+        .val = s->val,
+    };
+}
+
+// Returns a matrix with room for /nnz/ nonzeros and nothing set but the
+// dimensions, for callers that are going to fill in /row/, /col/ and /val/.
+Sparse *
+sparse_new(unsigned height, unsigned width, size_t nnz);
+
+// Like /matrix_reuse/.
+INHEADER
+Sparse *
+sparse_reuse(Value v)
+{
+    Sparse *s = AS_SPARSE(v);
+    if (s->gchdr.nrefs != 1) {
+        return NULL;
+    }
+    ++s->gchdr.nrefs;
+    return s;
+}
+
+// The matrix with x[k] at (i[k], j[k]), counting from 1, for k < n, and
+// zeros elsewhere; elements given more than once are added up, in the
+// order given, and those that come to zero are not stored. Throws if an
+// index is not an integer in range.
+Sparse *
+sparse_from_triplets(struct Env *e, const Scalar *i, const Scalar *j, const Scalar *x, size_t n,
+                     unsigned height, unsigned width);
+
+// The nonzero elements of /m/.
+Sparse *
+sparse_from_matrix(const Matrix *m);
+
+// /s/ as a dense matrix; throws if that would be too large.
+Matrix *
+sparse_to_matrix(struct Env *e, const Sparse *s);
+
+// /x/ + /y/, or /x/ - /y/ if /negate_y/, of equal dimensions; elements
+// that cancel out are not stored.
+Sparse *
+sparse_add(const Sparse *x, const Sparse *y, bool negate_y);
+
+// z[height x width] (packed) += /s/ times /a/.
+void
+sparse_add_to_dense(Scalar *z, const Sparse *s, Scalar a);
+
+// /a/ times the sparse matrix in /v/, which is overwritten if it is a dying
+// temporary (see /matrix_reuse/); products that come to zero are not
+// stored.
+Sparse *
+sparse_scale(Scalar a, Value v);
+
+// /x/ * /y/, /x->width/ == /y->height/.
+Sparse *
+sparse_mul(const Sparse *x, const Sparse *y);
+
+Sparse *
+sparse_transposed(const Sparse *x);
+
+// Whether /x/ and /y/, of equal dimensions, have equal elements, stored or
+// not.
+bool
+sparse_eq(const Sparse *x, const Sparse *y);
+
+// The same for /s/ and the dense matrix /m/, of equal dimensions.
+bool
+sparse_eq_dense(const Sparse *s, const Matrix *m);
+
+Value
+sparse_get1(struct Env *e, const Sparse *s, Value elem);
+
+Value
+sparse_get2(struct Env *e, const Sparse *s, Value row, Value col);
+
+#endif
@@ -0,0 +1,39 @@
+#include "stats.h"
+
+Stats stats;
+
+static const char *objkind_names[] = {
+    [STATS_OBJ_MATRIX] = "matrix",
+    [STATS_OBJ_STR]    = "str",
+    [STATS_OBJ_FUNC]   = "func",
+    [STATS_OBJ_SPARSE] = "sparse",
+    [STATS_OBJ_TYPED]  = "typed",
+};
+
+size_t
+stats_format(char *buf, size_t nbuf)
+{
+    size_t n = 0;
+
+#define PUT(...) \
+    do { \
+        const int r_ = snprintf(buf + (n < nbuf ? n : nbuf), n < nbuf ? nbuf - n : 0, \
+                                __VA_ARGS__); \
+        n += r_ > 0 ? r_ : 0; \
+    } while (0)
+
+    PUT("instrs %ju\n", (uintmax_t) stats.instrs);
+    PUT("calls %ju\n", (uintmax_t) stats.calls);
+    for (int i = 0; i < STATS_NOBJKINDS; ++i) {
+        PUT("allocs.%s %ju\n", objkind_names[i], (uintmax_t) stats.allocs[i]);
+        PUT("alloc_bytes.%s %ju\n", objkind_names[i], (uintmax_t) stats.alloc_bytes[i]);
+    }
+    PUT("heap_live %ju\n", (uintmax_t) stats.heap_live);
+    PUT("heap_peak %ju\n", (uintmax_t) stats.heap_peak);
+    PUT("flops %ju\n", (uintmax_t) stats.flops);
+    PUT("global_lookups %ju\n", (uintmax_t) stats.global_lookups);
+    PUT("throws %ju\n", (uintmax_t) stats.throws);
+
+#undef PUT
+    return n;
+}
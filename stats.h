@@ -0,0 +1,62 @@
+#ifndef stats_h_
+#define stats_h_
+
+#include "common.h"
+
+// Process-wide runtime counters. Updating one is a single non-atomic add:
+// the interpreter runs on one thread, and the numbers are for diagnostics,
+// so they are allowed to be off by a few if that ever changes.
+
+typedef enum {
+    STATS_OBJ_MATRIX,
+    STATS_OBJ_STR,
+    STATS_OBJ_FUNC,
+    STATS_OBJ_SPARSE,
+    STATS_OBJ_TYPED,
+} StatsObjKind;
+
+enum { STATS_NOBJKINDS = STATS_OBJ_TYPED + 1 };
+
+typedef struct {
+    uint_least64_t instrs;
+    uint_least64_t calls;
+    uint_least64_t allocs[STATS_NOBJKINDS];
+    uint_least64_t alloc_bytes[STATS_NOBJKINDS];
+    uint_least64_t heap_live;
+    uint_least64_t heap_peak;
+    uint_least64_t flops;
+    uint_least64_t global_lookups;
+    uint_least64_t throws;
+} Stats;
+
+extern Stats stats;
+
+#define STATS_ADD(Field_, N_) ((void) (stats.Field_ += (N_)))
+
+#define STATS_INC(Field_) STATS_ADD(Field_, 1)
+
+INHEADER
+void
+stats_on_alloc(StatsObjKind kind, size_t nbytes)
+{
+    ++stats.allocs[kind];
+    stats.alloc_bytes[kind] += nbytes;
+    if ((stats.heap_live += nbytes) > stats.heap_peak) {
+        stats.heap_peak = stats.heap_live;
+    }
+}
+
+INHEADER
+void
+stats_on_free(size_t nbytes)
+{
+    stats.heap_live -= nbytes;
+}
+
+// Writes the counters as "<name> <value>\n" lines, in a fixed order, into
+// /buf/; returns the number of characters that would have been written, as
+// /snprintf/ does.
+size_t
+stats_format(char *buf, size_t nbuf);
+
+#endif
@@ -1,11 +1,22 @@
 #include "str.h"
+#include "stats.h"
+#include "alloc.h"
 
+static inline
 Str *
-str_new(const char *buf, size_t nbuf)
+str_alloc(size_t ndata)
 {
-    Str *s = xmalloc(sizeof(Str) + nbuf, 1);
+    Str *s = heap_alloc(str_nbytes(ndata));
+    stats_on_alloc(STATS_OBJ_STR, str_nbytes(ndata));
     s->gchdr.nrefs = 1;
-    s->ndata = nbuf;
+    s->ndata = ndata;
+    return s;
+}
+
+Str *
+str_new(const char *buf, size_t nbuf)
+{
+    Str *s = str_alloc(nbuf);
     if (nbuf) {
         memcpy(s->data, buf, nbuf);
     }
@@ -15,10 +26,12 @@ str_new(const char *buf, size_t nbuf)
 Str *
 str_new_unescape(const char *buf, size_t nbuf)
 {
-    Str *s = xmalloc(sizeof(Str) + nbuf, 1);
-    s->gchdr.nrefs = 1;
+    // The result is never longer than the input; unescape into scratch
+    // space and then allocate exactly as much as is needed.
+    const size_t ntmp_max = nbuf;
+    char *tmp = scratch_alloc(ntmp_max);
 
-    char *ptr = s->data;
+    char *ptr = tmp;
     for (const char *t; nbuf && (t = memchr(buf, '\\', nbuf));) {
         const size_t nseg = t - buf;
         if (nseg) {
@@ -43,16 +56,15 @@ str_new_unescape(const char *buf, size_t nbuf)
         ptr += nbuf;
     }
 
-    s->ndata = ptr - s->data;
-    return xrealloc(s, sizeof(Str) + s->ndata, 1);
+    Str *s = str_new(tmp, ptr - tmp);
+    scratch_free(tmp, ntmp_max);
+    return s;
 }
 
 Str *
 str_new_concat(const char *a, size_t na, const char *b, size_t nb)
 {
-    Str *s = xmalloc(sizeof(Str) + na + nb, 1);
-    s->gchdr.nrefs = 1;
-    s->ndata = na + nb;
+    Str *s = str_alloc(na + nb);
     if (na) {
         memcpy(s->data, a, na);
     }
@@ -10,6 +10,13 @@ typedef struct {
     char data[];
 } Str;
 
+INHEADER
+size_t
+str_nbytes(size_t ndata)
+{
+    return sizeof(Str) + ndata;
+}
+
 Str *
 str_new(const char *buf, size_t nbuf);
 
@@ -0,0 +1,929 @@
+#include "typed.h"
+#include "env.h"
+#include "stats.h"
+#include "alloc.h"
+#include "workers.h"
+
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define TYPED_X86 1
+#endif
+
+// Double, the element type of /Matrix/, as a fourth type for the kernels:
+// dense comparisons, and conversions, go through it.
+enum { ELEM_FLOAT64 = TYPED_NELEMS, NKERNEL_ELEMS };
+
+static const unsigned char kernel_elem_sizes[] = {
+    [TYPED_UINT8]   = 1,
+    [TYPED_INT32]   = 4,
+    [TYPED_FLOAT32] = 4,
+    [ELEM_FLOAT64]  = 8,
+};
+
+static const char *elem_names[] = {
+    [TYPED_UINT8]   = "uint8",
+    [TYPED_INT32]   = "int32",
+    [TYPED_FLOAT32] = "float32",
+};
+
+enum {
+    // Elementwise kernels and products are split across /workers_global/
+    // in ranges of at least this many elements (multiply-adds, for
+    // products).
+    PAR_MIN = 1 << 15,
+    // What goes through double does so this many elements at a time, in a
+    // buffer on the stack.
+    CHUNK = 1 << 10,
+};
+
+static inline
+size_t
+count(const Typed *x)
+{
+    return (size_t) x->height * x->width;
+}
+
+// Kernels
+//
+// Each kernel is a plain loop, written once and instantiated by /DEF_ALL/
+// for every element type and, under the matching target attribute, every
+// instruction set /linalg_isa/ picks from; the vectorizer does the rest,
+// at the full width of the type: 32 uint8 comparisons, or 8 float32
+// multiply-adds, to an AVX2 instruction. At -O2 it only takes loops whose
+// trip count is a multiple of the vector width, hence /EACH/. With FMA
+// contraction off (as it is in ISO C mode), every instruction set gives the
+// same bits.
+
+typedef enum {
+    OP_ADD,         // z = x + y
+    OP_SUB,         // z = x - y
+    OP_NEG,         // z = -x
+    OP_SCALE,       // z = a * x
+    OP_LT,          // z = x < y, as uint8
+    OP_LE,          // z = x <= y
+    OP_GE_A,        // z = x >= a
+    OP_LE_A,        // z = x <= a
+    OP_FROM_F64,    // z = x, from double (see /typed_from_matrix/)
+    OP_TO_F64,      // z = x, to double
+} EltOp;
+
+enum { NOPS = OP_TO_F64 + 1 };
+
+typedef void (*EltKernel)(void *z, const void *x, const void *y, const void *a, size_t n);
+
+// Rows [/i0/, /i1/) of z[m x p] = x[m x n] * y[n x p].
+typedef void (*GemmKernel)(void *z, const void *x, const void *y, unsigned n, unsigned p,
+                           size_t i0, size_t i1);
+
+// The scalar argument of a kernel, as the type it takes.
+typedef union {
+    uint8_t uint8;
+    int32_t int32;
+    float float32;
+    double float64;
+} KernelScalar;
+
+enum {
+    EACH_BLOCK = 64,
+    // Products go through /y/ in panels of GEMM_KC rows by GEMM_NC columns,
+    // which stay in cache for all the rows of /x/.
+    GEMM_KC = 128,
+    GEMM_NC = 512,
+};
+
+// Runs /STMT_/ with /I_/ from 0 to /N_/ - 1: in blocks of EACH_BLOCK, then
+// one at a time.
+#define EACH(I_, N_, STMT_) \
+    do { \
+        size_t b_ = 0; \
+        for (; b_ + EACH_BLOCK <= (N_); b_ += EACH_BLOCK) { \
+            for (size_t k_ = 0; k_ < EACH_BLOCK; ++k_) { \
+                const size_t I_ = b_ + k_; \
+                STMT_; \
+            } \
+        } \
+        for (; b_ < (N_); ++b_) { \
+            const size_t I_ = b_; \
+            STMT_; \
+        } \
+    } while (0)
+
+// Conversions from double that saturate, rather than being undefined, out
+// of range.
+
+static inline
+uint8_t
+uint8_of(double v)
+{
+    return v >= UINT8_MAX ? UINT8_MAX : v > 0 ? (uint8_t) v : 0;
+}
+
+static inline
+int32_t
+int32_of(double v)
+{
+    return v >= INT32_MAX ? INT32_MAX : v > INT32_MIN ? (int32_t) v : v == v ? INT32_MIN : 0;
+}
+
+static inline
+float
+float32_of(double v)
+{
+    return v;
+}
+
+// The kernels of type /N_/, whose elements are /T_/, computed on as /U_/
+// (unsigned, for integers to wrap around) and converted from double by
+// /N_/_of.
+#define DEF_ARITH(ATTR_, S_, N_, T_, U_) \
+    ATTR_ \
+    static \
+    void \
+    add_ ## N_ ## _ ## S_(void *z_, const void *x_, const void *y_, const void *a_, size_t n) \
+    { \
+        U_ *restrict z = z_; \
+        const U_ *restrict x = x_; \
+        const U_ *restrict y = y_; \
+        (void) a_; \
+        EACH(i, n, z[i] = x[i] + y[i]); \
+    } \
+    \
+    ATTR_ \
+    static \
+    void \
+    sub_ ## N_ ## _ ## S_(void *z_, const void *x_, const void *y_, const void *a_, size_t n) \
+    { \
+        U_ *restrict z = z_; \
+        const U_ *restrict x = x_; \
+        const U_ *restrict y = y_; \
+        (void) a_; \
+        EACH(i, n, z[i] = x[i] - y[i]); \
+    } \
+    \
+    ATTR_ \
+    static \
+    void \
+    neg_ ## N_ ## _ ## S_(void *z_, const void *x_, const void *y_, const void *a_, size_t n) \
+    { \
+        U_ *restrict z = z_; \
+        const U_ *restrict x = x_; \
+        (void) y_; \
+        (void) a_; \
+        EACH(i, n, z[i] = -x[i]); \
+    } \
+    \
+    ATTR_ \
+    static \
+    void \
+    scale_ ## N_ ## _ ## S_(void *z_, const void *x_, const void *y_, const void *a_, size_t n) \
+    { \
+        U_ *restrict z = z_; \
+        const U_ *restrict x = x_; \
+        const U_ a = *(const U_ *) a_; \
+        (void) y_; \
+        EACH(i, n, z[i] = a * x[i]); \
+    } \
+    \
+    ATTR_ \
+    static \
+    void \
+    from_ ## N_ ## _ ## S_(void *z_, const void *x_, const void *y_, const void *a_, \
+                           size_t n) \
+    { \
+        T_ *restrict z = z_; \
+        const double *restrict x = x_; \
+        (void) y_; \
+        (void) a_; \
+        EACH(i, n, z[i] = N_ ## _of(x[i])); \
+    } \
+    \
+    ATTR_ \
+    static \
+    void \
+    to_ ## N_ ## _ ## S_(void *z_, const void *x_, const void *y_, const void *a_, size_t n) \
+    { \
+        double *restrict z = z_; \
+        const T_ *restrict x = x_; \
+        (void) y_; \
+        (void) a_; \
+        EACH(i, n, z[i] = x[i]); \
+    } \
+    \
+    /* z[n] += a[0] * y[0 ... n) + ... + a[3] * y[3p ... 3p + n), added in that order. */ \
+    ATTR_ \
+    static inline \
+    void \
+    axpy4_ ## N_ ## _ ## S_(U_ *restrict z, const U_ *restrict y, size_t p, const U_ *a, \
+                            size_t n) \
+    { \
+        const U_ a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3]; \
+        const U_ *restrict y1 = y + p; \
+        const U_ *restrict y2 = y1 + p; \
+        const U_ *restrict y3 = y2 + p; \
+        EACH(j, n, z[j] = z[j] + a0 * y[j] + a1 * y1[j] + a2 * y2[j] + a3 * y3[j]); \
+    } \
+    \
+    ATTR_ \
+    static inline \
+    void \
+    axpy_ ## N_ ## _ ## S_(U_ *restrict z, const U_ *restrict y, U_ a, size_t n) \
+    { \
+        EACH(j, n, z[j] = z[j] + a * y[j]); \
+    } \
+    \
+    ATTR_ \
+    static \
+    void \
+    gemm_ ## N_ ## _ ## S_(void *z_, const void *x_, const void *y_, unsigned n, unsigned p, \
+                           size_t i0, size_t i1) \
+    { \
+        U_ *z = z_; \
+        const U_ *x = x_; \
+        const U_ *y = y_; \
+        memset(z + i0 * p, 0, (i1 - i0) * p * sizeof(U_)); \
+        for (size_t j0 = 0; j0 < p; j0 += GEMM_NC) { \
+            const size_t nj = p - j0 < GEMM_NC ? p - j0 : GEMM_NC; \
+            for (size_t k0 = 0; k0 < n; k0 += GEMM_KC) { \
+                const size_t k1 = n - k0 < GEMM_KC ? n : k0 + GEMM_KC; \
+                for (size_t i = i0; i < i1; ++i) { \
+                    U_ *zi = z + i * p + j0; \
+                    const U_ *xi = x + i * n; \
+                    size_t k = k0; \
+                    for (; k + 4 <= k1; k += 4) { \
+                        axpy4_ ## N_ ## _ ## S_(zi, y + k * p + j0, p, xi + k, nj); \
+                    } \
+                    for (; k < k1; ++k) { \
+                        axpy_ ## N_ ## _ ## S_(zi, y + k * p + j0, xi[k], nj); \
+                    } \
+                } \
+            } \
+        } \
+    }
+
+// The comparisons of type /N_/, whose elements are /T_/.
+#define DEF_CMP(ATTR_, S_, N_, T_) \
+    ATTR_ \
+    static \
+    void \
+    lt_ ## N_ ## _ ## S_(void *z_, const void *x_, const void *y_, const void *a_, size_t n) \
+    { \
+        uint8_t *restrict z = z_; \
+        const T_ *restrict x = x_; \
+        const T_ *restrict y = y_; \
+        (void) a_; \
+        EACH(i, n, z[i] = x[i] < y[i]); \
+    } \
+    \
+    ATTR_ \
+    static \
+    void \
+    le_ ## N_ ## _ ## S_(void *z_, const void *x_, const void *y_, const void *a_, size_t n) \
+    { \
+        uint8_t *restrict z = z_; \
+        const T_ *restrict x = x_; \
+        const T_ *restrict y = y_; \
+        (void) a_; \
+        EACH(i, n, z[i] = x[i] <= y[i]); \
+    } \
+    \
+    ATTR_ \
+    static \
+    void \
+    ge_a_ ## N_ ## _ ## S_(void *z_, const void *x_, const void *y_, const void *a_, \
+                           size_t n) \
+    { \
+        uint8_t *restrict z = z_; \
+        const T_ *restrict x = x_; \
+        const T_ a = *(const T_ *) a_; \
+        (void) y_; \
+        EACH(i, n, z[i] = x[i] >= a); \
+    } \
+    \
+    ATTR_ \
+    static \
+    void \
+    le_a_ ## N_ ## _ ## S_(void *z_, const void *x_, const void *y_, const void *a_, \
+                           size_t n) \
+    { \
+        uint8_t *restrict z = z_; \
+        const T_ *restrict x = x_; \
+        const T_ a = *(const T_ *) a_; \
+        (void) y_; \
+        EACH(i, n, z[i] = x[i] <= a); \
+    }
+
+#define DEF_ALL(ATTR_, S_) \
+    DEF_ARITH(ATTR_, S_, uint8, uint8_t, uint8_t) \
+    DEF_ARITH(ATTR_, S_, int32, int32_t, uint32_t) \
+    DEF_ARITH(ATTR_, S_, float32, float, float) \
+    DEF_CMP(ATTR_, S_, uint8, uint8_t) \
+    DEF_CMP(ATTR_, S_, int32, int32_t) \
+    DEF_CMP(ATTR_, S_, float32, float) \
+    DEF_CMP(ATTR_, S_, float64, double)
+
+DEF_ALL(, generic)
+#ifdef TYPED_X86
+DEF_ALL(__attribute__((target("sse2"))), sse2)
+DEF_ALL(__attribute__((target("avx2"))), avx2)
+#endif
+
+#define ARITH_ROW(N_, S_) \
+    [OP_ADD]      = add_ ## N_ ## _ ## S_, \
+    [OP_SUB]      = sub_ ## N_ ## _ ## S_, \
+    [OP_NEG]      = neg_ ## N_ ## _ ## S_, \
+    [OP_SCALE]    = scale_ ## N_ ## _ ## S_, \
+    [OP_FROM_F64] = from_ ## N_ ## _ ## S_, \
+    [OP_TO_F64]   = to_ ## N_ ## _ ## S_,
+
+#define CMP_ROW(N_, S_) \
+    [OP_LT]   = lt_ ## N_ ## _ ## S_, \
+    [OP_LE]   = le_ ## N_ ## _ ## S_, \
+    [OP_GE_A] = ge_a_ ## N_ ## _ ## S_, \
+    [OP_LE_A] = le_a_ ## N_ ## _ ## S_,
+
+#define ELT_KERNELS(S_) \
+    { \
+        [TYPED_UINT8]   = {ARITH_ROW(uint8, S_) CMP_ROW(uint8, S_)}, \
+        [TYPED_INT32]   = {ARITH_ROW(int32, S_) CMP_ROW(int32, S_)}, \
+        [TYPED_FLOAT32] = {ARITH_ROW(float32, S_) CMP_ROW(float32, S_)}, \
+        [ELEM_FLOAT64]  = {CMP_ROW(float64, S_)}, \
+    }
+
+#define GEMM_KERNELS(S_) \
+    { \
+        [TYPED_UINT8]   = gemm_uint8_ ## S_, \
+        [TYPED_INT32]   = gemm_int32_ ## S_, \
+        [TYPED_FLOAT32] = gemm_float32_ ## S_, \
+    }
+
+static const EltKernel elt_kernels[][NKERNEL_ELEMS][NOPS] = {
+    [LINALG_ISA_GENERIC] = ELT_KERNELS(generic),
+#ifdef TYPED_X86
+    [LINALG_ISA_SSE2]    = ELT_KERNELS(sse2),
+    [LINALG_ISA_AVX2]    = ELT_KERNELS(avx2),
+    [LINALG_ISA_FMA]     = ELT_KERNELS(avx2),
+#endif
+};
+
+static const GemmKernel gemm_kernels[][TYPED_NELEMS] = {
+    [LINALG_ISA_GENERIC] = GEMM_KERNELS(generic),
+#ifdef TYPED_X86
+    [LINALG_ISA_SSE2]    = GEMM_KERNELS(sse2),
+    [LINALG_ISA_AVX2]    = GEMM_KERNELS(avx2),
+    [LINALG_ISA_FMA]     = GEMM_KERNELS(avx2),
+#endif
+};
+
+#undef GEMM_KERNELS
+#undef ELT_KERNELS
+#undef CMP_ROW
+#undef ARITH_ROW
+#undef DEF_ALL
+#undef DEF_CMP
+#undef DEF_ARITH
+
+static inline
+EltKernel
+elt_kernel(EltOp op, unsigned t)
+{
+    return elt_kernels[linalg_isa()][t][op];
+}
+
+typedef struct {
+    EltKernel kernel;
+    void *z;
+    const void *x;
+    const void *y;
+    const void *a;
+    unsigned char zsize;
+    unsigned char xsize;
+    unsigned char ysize;
+} EltCtx;
+
+static
+void
+elt_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    EltCtx *c = ctx;
+    c->kernel((char *) c->z + begin * c->zsize, (const char *) c->x + begin * c->xsize,
+              c->y ? (const char *) c->y + begin * c->ysize : NULL, c->a, end - begin);
+}
+
+// /op/ on n elements of kernel type /t/ (a /TypedElem/ or ELEM_FLOAT64).
+static
+void
+elt_run(EltOp op, unsigned t, void *z, const void *x, const void *y, const void *a, size_t n)
+{
+    const unsigned char size = kernel_elem_sizes[t];
+    EltCtx c = {
+        .kernel = elt_kernel(op, t),
+        .z = z, .x = x, .y = y, .a = a,
+        .zsize = op >= OP_LT && op <= OP_LE_A ? 1 : op == OP_TO_F64 ? sizeof(double) : size,
+        .xsize = op == OP_FROM_F64 ? sizeof(double) : size,
+        .ysize = size,
+    };
+    workers_for(n, PAR_MIN, elt_range, &c);
+}
+
+// Writes elements [/begin/, /begin/ + /n/) of /x/, n <= CHUNK, to /buf/
+// as doubles.
+static
+void
+chunk_to_f64(Scalar *buf, const Typed *x, size_t begin, size_t n)
+{
+    const char *elems = (const char *) x->storage + begin * typed_elem_size(x->elem);
+    elt_kernel(OP_TO_F64, x->elem)(buf, elems, NULL, NULL, n);
+}
+
+// Element /k/ of /x/, counting from 0 in row order.
+static
+Scalar
+elem_at(const Typed *x, size_t k)
+{
+    switch (x->elem) {
+    case TYPED_UINT8:
+        return ((const uint8_t *) x->storage)[k];
+    case TYPED_INT32:
+        return ((const int32_t *) x->storage)[k];
+    case TYPED_FLOAT32:
+        return ((const float *) x->storage)[k];
+    }
+    UNREACHABLE();
+}
+
+bool
+typed_scalar_fits(TypedElem elem, Scalar a)
+{
+    switch (elem) {
+    case TYPED_UINT8:
+        return a >= 0 && a <= UINT8_MAX && a == floor(a);
+    case TYPED_INT32:
+        return a >= INT32_MIN && a <= INT32_MAX && a == floor(a);
+    case TYPED_FLOAT32:
+        return true;
+    }
+    UNREACHABLE();
+}
+
+Typed *
+typed_new(TypedElem elem, unsigned height, unsigned width)
+{
+    xmul_mat_dims(height, width);
+    const size_t nbytes = typed_nbytes(elem, height, width);
+    Typed *x = heap_alloc(nbytes);
+    stats_on_alloc(STATS_OBJ_TYPED, nbytes);
+    *x = (Typed) {.height = height, .width = width, .elem = elem};
+    x->gchdr.nrefs = 1;
+    return x;
+}
+
+Typed *
+typed_from_matrix(TypedElem elem, Matrix *m)
+{
+    matrix_pack(m);
+    Typed *z = typed_new(elem, m->height, m->width);
+    elt_run(OP_FROM_F64, elem, z->storage, m->elems, NULL, NULL, count(z));
+    return z;
+}
+
+typedef struct {
+    const Typed *x;
+    Typed *z;
+} ConvertCtx;
+
+static
+void
+convert_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    ConvertCtx *c = ctx;
+    const EltKernel from = elt_kernel(OP_FROM_F64, c->z->elem);
+    const size_t zsize = typed_elem_size(c->z->elem);
+    Scalar buf[CHUNK];
+    for (size_t i = begin; i < end; i += CHUNK) {
+        const size_t n = end - i < CHUNK ? end - i : CHUNK;
+        chunk_to_f64(buf, c->x, i, n);
+        from((char *) c->z->storage + i * zsize, buf, NULL, NULL, n);
+    }
+}
+
+Typed *
+typed_convert(TypedElem elem, const Typed *x)
+{
+    Typed *z = typed_new(elem, x->height, x->width);
+    if (elem == x->elem) {
+        memcpy(z->storage, x->storage, count(x) * typed_elem_size(elem));
+    } else {
+        ConvertCtx c = {.x = x, .z = z};
+        workers_for(count(x), PAR_MIN, convert_range, &c);
+    }
+    return z;
+}
+
+Matrix *
+typed_to_matrix(const Typed *x)
+{
+    Matrix *m = matrix_new_uninit(x->height, x->width);
+    elt_run(OP_TO_F64, x->elem, m->elems, x->storage, NULL, NULL, count(x));
+    return m;
+}
+
+Typed *
+typed_add(const Typed *x, const Typed *y, bool subtract)
+{
+    Typed *z = typed_new(x->elem, x->height, x->width);
+    STATS_ADD(flops, count(x));
+    elt_run(subtract ? OP_SUB : OP_ADD, x->elem, z->storage, x->storage, y->storage, NULL,
+            count(x));
+    return z;
+}
+
+Typed *
+typed_neg(const Typed *x)
+{
+    Typed *z = typed_new(x->elem, x->height, x->width);
+    STATS_ADD(flops, count(x));
+    elt_run(OP_NEG, x->elem, z->storage, x->storage, NULL, NULL, count(x));
+    return z;
+}
+
+Typed *
+typed_scale(Scalar a, const Typed *x)
+{
+    KernelScalar ka;
+    switch (x->elem) {
+    case TYPED_UINT8:
+        ka.uint8 = a;
+        break;
+    case TYPED_INT32:
+        ka.int32 = a;
+        break;
+    case TYPED_FLOAT32:
+        ka.float32 = a;
+        break;
+    }
+    Typed *z = typed_new(x->elem, x->height, x->width);
+    STATS_ADD(flops, count(x));
+    elt_run(OP_SCALE, x->elem, z->storage, x->storage, NULL, &ka, count(x));
+    return z;
+}
+
+typedef struct {
+    GemmKernel kernel;
+    void *z;
+    const void *x;
+    const void *y;
+    unsigned n;
+    unsigned p;
+} GemmCtx;
+
+static
+void
+gemm_range(void *ctx, size_t begin, size_t end, unsigned self)
+{
+    (void) self;
+    GemmCtx *c = ctx;
+    c->kernel(c->z, c->x, c->y, c->n, c->p, begin, end);
+}
+
+Typed *
+typed_mul(const Typed *x, const Typed *y)
+{
+    Typed *z = typed_new(x->elem, x->height, y->width);
+    const unsigned m = x->height;
+    const unsigned n = x->width;
+    const unsigned p = y->width;
+    STATS_ADD(flops, 2 * (uint_least64_t) m * n * p);
+    GemmCtx c = {
+        .kernel = gemm_kernels[linalg_isa()][x->elem],
+        .z = z->storage, .x = x->storage, .y = y->storage,
+        .n = n, .p = p,
+    };
+    workers_for(m, PAR_MIN / ((size_t) n * p + 1) + 1, gemm_range, &c);
+    return z;
+}
+
+// /op/ of the packed x[h x w] and y[h x w] of kernel type /t/.
+static
+Typed *
+compare(TypedCmp op, unsigned t, const void *x, const void *y, unsigned h, unsigned w)
+{
+    Typed *z = typed_new(TYPED_UINT8, h, w);
+    // x > y is y < x, and x >= y is y <= x.
+    const bool swap = op == TYPED_GT || op == TYPED_GE;
+    elt_run(op == TYPED_LT || op == TYPED_GT ? OP_LT : OP_LE, t, z->storage, swap ? y : x,
+            swap ? x : y, NULL, count(z));
+    return z;
+}
+
+Typed *
+typed_compare(TypedCmp op, const Typed *x, const Typed *y)
+{
+    return compare(op, x->elem, x->storage, y->storage, x->height, x->width);
+}
+
+Typed *
+typed_compare_dense(TypedCmp op, const Matrix *x, const Matrix *y)
+{
+    return compare(op, ELEM_FLOAT64, x->elems, y->elems, x->height, x->width);
+}
+
+// How x /op/ /a/ comes out for every x of kernel type /t/: as x >= *b
+// (BOUND_GE) or x <= *b (BOUND_LE), where *b is the value of /t/ next to
+// /a/ that makes it exact, or the same for all of them.
+typedef enum {
+    BOUND_NONE,
+    BOUND_ALL,
+    BOUND_GE,
+    BOUND_LE,
+} Bound;
+
+static
+Bound
+bound_for(TypedCmp op, unsigned t, Scalar a, KernelScalar *b)
+{
+    if (a != a) {
+        return BOUND_NONE;
+    }
+    const bool ge = op == TYPED_GT || op == TYPED_GE;
+    if (t == TYPED_UINT8 || t == TYPED_INT32) {
+        // For an integer x, x < a if and only if x <= ceil(a) - 1, and so
+        // on; an integer type has no NaN, so a bound past either end
+        // decides for all x.
+        Scalar r;
+        switch (op) {
+        case TYPED_LT:
+            r = ceil(a) - 1;
+            break;
+        case TYPED_LE:
+            r = floor(a);
+            break;
+        case TYPED_GT:
+            r = floor(a) + 1;
+            break;
+        case TYPED_GE:
+            r = ceil(a);
+            break;
+        default:
+            UNREACHABLE();
+        }
+        const Scalar lo = t == TYPED_UINT8 ? 0 : INT32_MIN;
+        const Scalar hi = t == TYPED_UINT8 ? UINT8_MAX : INT32_MAX;
+        if (ge ? r <= lo : r >= hi) {
+            return BOUND_ALL;
+        }
+        if (ge ? r > hi : r < lo) {
+            return BOUND_NONE;
+        }
+        if (t == TYPED_UINT8) {
+            b->uint8 = r;
+        } else {
+            b->int32 = r;
+        }
+        return ge ? BOUND_GE : BOUND_LE;
+    }
+    // Floating point: NaN elements compare false, so there is always a
+    // bound to compare with, infinite if need be; x < -inf and x > inf
+    // hold for none.
+    if ((op == TYPED_LT && a == -INFINITY) || (op == TYPED_GT && a == INFINITY)) {
+        return BOUND_NONE;
+    }
+    if (t == TYPED_FLOAT32) {
+        // The float next to /a/ in the right direction: below it for < and
+        // <=, above it for > and >=, /a/ itself if it is a float and the
+        // comparison is not strict.
+        float f = a;
+        switch (op) {
+        case TYPED_LT:
+            if (f >= a) {
+                f = nextafterf(f, -INFINITY);
+            }
+            break;
+        case TYPED_LE:
+            if (f > a) {
+                f = nextafterf(f, -INFINITY);
+            }
+            break;
+        case TYPED_GT:
+            if (f <= a) {
+                f = nextafterf(f, INFINITY);
+            }
+            break;
+        case TYPED_GE:
+            if (f < a) {
+                f = nextafterf(f, INFINITY);
+            }
+            break;
+        }
+        b->float32 = f;
+    } else {
+        b->float64 = op == TYPED_LT ? nextafter(a, -INFINITY)
+                   : op == TYPED_GT ? nextafter(a, INFINITY)
+                   : a;
+    }
+    return ge ? BOUND_GE : BOUND_LE;
+}
+
+// x[h x w] /op/ /a/, x of kernel type /t/.
+static
+Typed *
+compare_scalar(TypedCmp op, unsigned t, const void *x, Scalar a, unsigned h, unsigned w)
+{
+    Typed *z = typed_new(TYPED_UINT8, h, w);
+    KernelScalar b;
+    switch (bound_for(op, t, a, &b)) {
+    case BOUND_NONE:
+        memset(z->storage, 0, count(z));
+        break;
+    case BOUND_ALL:
+        memset(z->storage, 1, count(z));
+        break;
+    case BOUND_GE:
+        elt_run(OP_GE_A, t, z->storage, x, NULL, &b, count(z));
+        break;
+    case BOUND_LE:
+        elt_run(OP_LE_A, t, z->storage, x, NULL, &b, count(z));
+        break;
+    }
+    return z;
+}
+
+Typed *
+typed_compare_scalar(TypedCmp op, const Typed *x, Scalar a)
+{
+    return compare_scalar(op, x->elem, x->storage, a, x->height, x->width);
+}
+
+Typed *
+typed_compare_dense_scalar(TypedCmp op, const Matrix *x, Scalar a)
+{
+    return compare_scalar(op, ELEM_FLOAT64, x->elems, a, x->height, x->width);
+}
+
+// z[n x m] = the transposition of x[m x n], elements of /T_/, in tiles.
+#define TRANSPOSE(T_) \
+    do { \
+        T_ *z = z_; \
+        const T_ *x = x_; \
+        for (size_t i0 = 0; i0 < m; i0 += TILE) { \
+            const size_t i1 = m - i0 < TILE ? m : i0 + TILE; \
+            for (size_t j0 = 0; j0 < n; j0 += TILE) { \
+                const size_t j1 = n - j0 < TILE ? n : j0 + TILE; \
+                for (size_t i = i0; i < i1; ++i) { \
+                    for (size_t j = j0; j < j1; ++j) { \
+                        z[j * m + i] = x[i * n + j]; \
+                    } \
+                } \
+            } \
+        } \
+    } while (0)
+
+Typed *
+typed_transposed(const Typed *x)
+{
+    enum { TILE = 32 };
+    Typed *z = typed_new(x->elem, x->width, x->height);
+    void *z_ = z->storage;
+    const void *x_ = x->storage;
+    const size_t m = x->height;
+    const size_t n = x->width;
+    if (typed_elem_size(x->elem) == 1) {
+        TRANSPOSE(uint8_t);
+    } else {
+        TRANSPOSE(uint32_t);
+    }
+    return z;
+}
+
+#undef TRANSPOSE
+
+bool
+typed_eq(const Typed *x, const Typed *y)
+{
+    Scalar bx[CHUNK];
+    Scalar by[CHUNK];
+    const size_t n = count(x);
+    for (size_t i = 0; i < n; i += CHUNK) {
+        const size_t nb = n - i < CHUNK ? n - i : CHUNK;
+        chunk_to_f64(bx, x, i, nb);
+        chunk_to_f64(by, y, i, nb);
+        if (!linalg_eq(bx, by, nb)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Scalar
+typed_reduce(LinalgRed op, const Typed *x)
+{
+    Scalar buf[CHUNK];
+    // What an empty matrix gives.
+    Scalar r = linalg_reduce(op, NULL, NULL, 0);
+    const size_t n = count(x);
+    for (size_t i = 0; i < n; i += CHUNK) {
+        const size_t nb = n - i < CHUNK ? n - i : CHUNK;
+        chunk_to_f64(buf, x, i, nb);
+        const Scalar v = linalg_reduce(op, buf, NULL, nb);
+        switch (op) {
+        case LINALG_RED_SUM:
+            r += v;
+            break;
+        case LINALG_RED_PROD:
+            r *= v;
+            break;
+        case LINALG_RED_MIN:
+            // Once /r/ is NaN, it stays so.
+            if (v != v || v < r) {
+                r = v;
+            }
+            break;
+        case LINALG_RED_MAX:
+            if (v != v || v > r) {
+                r = v;
+            }
+            break;
+        case LINALG_RED_ANY:
+            if (v) {
+                return 1;
+            }
+            break;
+        case LINALG_RED_ALL:
+            if (!v) {
+                return 0;
+            }
+            break;
+        default:
+            UNREACHABLE();
+        }
+    }
+    return r;
+}
+
+// Writes /x/ with as few digits as read back as the same float.
+static
+void
+print_float32(float x)
+{
+    char buf[32];
+    for (int prec = 6; prec < 9; ++prec) {
+        snprintf(buf, sizeof(buf), "%.*g", prec, x);
+        if ((float) strtod(buf, NULL) == x) {
+            fputs(buf, stdout);
+            return;
+        }
+    }
+    printf("%.9g", x);
+}
+
+void
+typed_print(const Typed *x)
+{
+    printf("%s %u x %u [\n", elem_names[x->elem], x->height, x->width);
+    for (size_t i = 0; i < x->height; ++i) {
+        for (size_t j = 0; j < x->width; ++j) {
+            const Scalar v = elem_at(x, i * x->width + j);
+            putchar('\t');
+            if (x->elem == TYPED_FLOAT32) {
+                print_float32(v);
+            } else {
+                printf("%.15g", v);
+            }
+        }
+        puts("");
+    }
+    puts("]");
+}
+
+Value
+typed_get1(Env *e, const Typed *x, Value elem)
+{
+    if (elem.kind != VAL_KIND_SCALAR) {
+        env_throw(e, "cannot index matrix with %s value", value_kindname(elem.kind));
+    }
+    const size_t num = AS_SCL(elem);
+    if (num < 1 || num > count(x)) {
+        env_throw(e, "element number out of range");
+    }
+    return MK_SCL(elem_at(x, num - 1));
+}
+
+Value
+typed_get2(Env *e, const Typed *x, Value row, Value col)
+{
+    if (row.kind != VAL_KIND_SCALAR || col.kind != VAL_KIND_SCALAR) {
+        env_throw(e, "cannot index matrix with (%s, %s) values",
+                  value_kindname(row.kind), value_kindname(col.kind));
+    }
+    const size_t i = AS_SCL(row);
+    const size_t j = AS_SCL(col);
+    if (i < 1 || i > x->height) {
+        env_throw(e, "row number out of range");
+    }
+    if (j < 1 || j > x->width) {
+        env_throw(e, "column number out of range");
+    }
+    return MK_SCL(elem_at(x, (i - 1) * x->width + j - 1));
+}
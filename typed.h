@@ -0,0 +1,169 @@
+#ifndef typed_h_
+#define typed_h_
+
+#include "common.h"
+#include "value.h"
+#include "matrix.h"
+#include "linalg.h"
+
+struct Env;
+
+// Element types of a /Typed/ matrix, narrowest first. Double, the fourth,
+// is that of a /Matrix/.
+typedef enum {
+    TYPED_UINT8,
+    TYPED_INT32,
+    TYPED_FLOAT32,
+} TypedElem;
+
+enum { TYPED_NELEMS = TYPED_FLOAT32 + 1 };
+
+// A matrix of narrower elements than /Matrix/, packed row after row in one
+// block with its header: a mask takes a byte per element instead of eight.
+// Like /Sparse/, elements cannot be assigned to: every operation makes a
+// new one. Integer arithmetic wraps around.
+typedef struct Typed {
+    GcObject gchdr;
+    unsigned height;
+    unsigned width;
+    TypedElem elem;
+    // height x width elements of type /elem/.
+    Scalar storage[];
+} Typed;
+
+// Comparisons, elementwise; the results are UINT8 masks of 0s and 1s.
+typedef enum {
+    TYPED_LT,
+    TYPED_LE,
+    TYPED_GT,
+    TYPED_GE,
+} TypedCmp;
+
+INHEADER
+size_t
+typed_elem_size(TypedElem elem)
+{
+    static const unsigned char sizes[] = {
+        [TYPED_UINT8]   = 1,
+        [TYPED_INT32]   = 4,
+        [TYPED_FLOAT32] = 4,
+    };
+    return sizes[elem];
+}
+
+INHEADER
+size_t
+typed_nbytes(TypedElem elem, unsigned height, unsigned width)
+{
+    const size_t n = (size_t) height * width * typed_elem_size(elem);
+    return sizeof(Typed) + (n + sizeof(Scalar) - 1) / sizeof(Scalar) * sizeof(Scalar);
+}
+
+// What /Kind/ calls a matrix of /elem/.
+INHEADER
+const char *
+typed_kindname(TypedElem elem)
+{
+    static const char *names[] = {
+        [TYPED_UINT8]   = "uint8 matrix",
+        [TYPED_INT32]   = "int32 matrix",
+        [TYPED_FLOAT32] = "float32 matrix",
+    };
+    return names[elem];
+}
+
+// Sets /*r/ to the narrowest type that elements of both /a/ and /b/
+// convert to exactly: the wider of the two, except that INT32 and FLOAT32
+// only meet in double, for which this returns false.
+INHEADER
+bool
+typed_promote(TypedElem a, TypedElem b, TypedElem *r)
+{
+    const TypedElem lo = a < b ? a : b;
+    const TypedElem hi = a < b ? b : a;
+    if (lo == TYPED_INT32 && hi == TYPED_FLOAT32) {
+        return false;
+    }
+    *r = hi;
+    return true;
+}
+
+// Whether the product of a matrix of /elem/ and the scalar /a/ is of
+// /elem/ too: always for FLOAT32, to which /a/ is rounded; only for an
+// integer in range for the others. Otherwise, it is a double one.
+bool
+typed_scalar_fits(TypedElem elem, Scalar a);
+
+// Returns a matrix with unspecified elements, for callers that are going
+// to overwrite all of them.
+Typed *
+typed_new(TypedElem elem, unsigned height, unsigned width);
+
+// The elements of /m/ as /elem/: rounded to nearest for FLOAT32, toward zero
+// for the integer types, which saturate (NaN gives 0). /m/ must not be
+// pending.
+Typed *
+typed_from_matrix(TypedElem elem, Matrix *m);
+
+// /x/ converted to /elem/, the same way.
+Typed *
+typed_convert(TypedElem elem, const Typed *x);
+
+Matrix *
+typed_to_matrix(const Typed *x);
+
+// /x/ + /y/, or /x/ - /y/ if /subtract/, of equal types and dimensions.
+Typed *
+typed_add(const Typed *x, const Typed *y, bool subtract);
+
+Typed *
+typed_neg(const Typed *x);
+
+// /a/ times /x/, for /typed_scalar_fits/.
+Typed *
+typed_scale(Scalar a, const Typed *x);
+
+// /x/ * /y/, of equal types, /x->width/ == /y->height/; each element is
+// summed in the order of the products.
+Typed *
+typed_mul(const Typed *x, const Typed *y);
+
+// /x/ /op/ /y/, of equal types and dimensions.
+Typed *
+typed_compare(TypedCmp op, const Typed *x, const Typed *y);
+
+// /x/ /op/ /a/, exactly: /a/ is not rounded to the type of /x/ first.
+Typed *
+typed_compare_scalar(TypedCmp op, const Typed *x, Scalar a);
+
+// The same for the packed dense matrices /x/ and /y/ of equal dimensions,
+// or /x/ and /a/.
+Typed *
+typed_compare_dense(TypedCmp op, const Matrix *x, const Matrix *y);
+
+Typed *
+typed_compare_dense_scalar(TypedCmp op, const Matrix *x, Scalar a);
+
+Typed *
+typed_transposed(const Typed *x);
+
+// Whether /x/ and /y/, of equal dimensions but any types, have equal
+// elements.
+bool
+typed_eq(const Typed *x, const Typed *y);
+
+// /op/ over the elements of /x/, as /linalg_reduce/ takes it; not DOT or
+// NORM.
+Scalar
+typed_reduce(LinalgRed op, const Typed *x);
+
+void
+typed_print(const Typed *x);
+
+Value
+typed_get1(struct Env *e, const Typed *x, Value elem);
+
+Value
+typed_get2(struct Env *e, const Typed *x, Value row, Value col);
+
+#endif
@@ -1,20 +1,58 @@
 #include "value.h"
 #include "matrix.h"
+#include "sparse.h"
+#include "typed.h"
+#include "matio.h"
 #include "str.h"
 #include "func.h"
+#include "stats.h"
+#include "alloc.h"
+#include "fuse.h"
+#include "linalg.h"
 
 void
 gcobject_destroy(Value v)
 {
+    size_t nbytes;
     switch (v.kind) {
+    case VAL_KIND_MATRIX:
+        {
+            Matrix *m = AS_MAT(v);
+            if (m->pending) {
+                fuse_drop(m);
+            }
+            nbytes = matrix_nbytes(m);
+            if (m->map_offset) {
+                matio_unmap(m);
+            }
+            if (m->owner) {
+                --m->owner->nborrowers;
+                value_unref(MK_MAT(m->owner));
+            }
+        }
+        break;
+    case VAL_KIND_STR:
+        nbytes = str_nbytes(AS_STR(v)->ndata);
+        break;
+    case VAL_KIND_SPARSE:
+        nbytes = sparse_nbytes(AS_SPARSE(v)->height, AS_SPARSE(v)->nnz);
+        break;
+    case VAL_KIND_TYPED:
+        nbytes = typed_nbytes(AS_TYPED(v)->elem, AS_TYPED(v)->height, AS_TYPED(v)->width);
+        break;
     case VAL_KIND_FUNC:
-        func_destroy(AS_FUNC(v));
+        {
+            Func *f = AS_FUNC(v);
+            nbytes = func_nbytes(f->nchunk);
+            func_destroy(f);
+        }
         break;
     default:
-        break;
+        // Since this function is called, /v/ *is* a garbage-collected object.
+        UNREACHABLE();
     }
-    // Since this function is called, /v/ *is* a garbage-collected object.
-    free(v.as.gcobj);
+    stats_on_free(nbytes);
+    heap_free(v.as.gcobj, nbytes);
 }
 
 void
@@ -30,17 +68,32 @@ value_print(Value v)
     case VAL_KIND_MATRIX:
         {
             Matrix *m = AS_MAT(v);
-            size_t elem_idx = 0;
             puts("[");
             for (unsigned i = 0; i < m->height; ++i) {
                 for (unsigned j = 0; j < m->width; ++j) {
-                    printf("\t%.15g", m->elems[elem_idx++]);
+                    printf("\t%.15g", matrix_at(m, i, j));
                 }
                 puts("");
             }
             puts("]");
         }
         break;
+    case VAL_KIND_SPARSE:
+        {
+            // Only the nonzeros, one per line, in row order.
+            Sparse *s = AS_SPARSE(v);
+            printf("sparse %u x %u [\n", s->height, s->width);
+            for (unsigned i = 0; i < s->height; ++i) {
+                for (size_t k = s->row[i]; k < s->row[i + 1]; ++k) {
+                    printf("\t(%u, %u)\t%.15g\n", i + 1, s->col[k] + 1, s->val[k]);
+                }
+            }
+            puts("]");
+        }
+        break;
+    case VAL_KIND_TYPED:
+        typed_print(AS_TYPED(v));
+        break;
     case VAL_KIND_CFUNC:
         printf("<built-in function %p>\n", *(void **) &v.as.cfunc);
         break;
@@ -68,15 +121,23 @@ value_is_truthy(Value v)
     case VAL_KIND_MATRIX:
         {
             Matrix *m = AS_MAT(v);
-            const size_t nelems = m->height * m->width;
-            for (size_t i = 0; i < nelems; ++i) {
-                if (m->elems[i]) {
-                    return true;
+            if (matrix_is_packed(m)) {
+                return linalg_any(m->elems, (size_t) m->height * m->width);
+            }
+            for (size_t i = 0; i < m->height; ++i) {
+                for (size_t j = 0; j < m->width; ++j) {
+                    if (matrix_at(m, i, j)) {
+                        return true;
+                    }
                 }
             }
             return false;
         }
         break;
+    case VAL_KIND_SPARSE:
+        return linalg_any(AS_SPARSE(v)->val, AS_SPARSE(v)->nnz);
+    case VAL_KIND_TYPED:
+        return typed_reduce(LINALG_RED_ANY, AS_TYPED(v));
     case VAL_KIND_CFUNC:
     case VAL_KIND_FUNC:
         return true;
@@ -9,12 +9,16 @@
 #define MK_CFUNC(X_) ((Value) {.kind = VAL_KIND_CFUNC, .as = {.cfunc = X_}})
 #define MK_FUNC(X_) ((Value) {.kind = VAL_KIND_FUNC, .as = {.gcobj = (GcObject *) X_}})
 #define MK_STR(X_) ((Value) {.kind = VAL_KIND_STR, .as = {.gcobj = (GcObject *) X_}})
+#define MK_SPARSE(X_) ((Value) {.kind = VAL_KIND_SPARSE, .as = {.gcobj = (GcObject *) X_}})
+#define MK_TYPED(X_) ((Value) {.kind = VAL_KIND_TYPED, .as = {.gcobj = (GcObject *) X_}})
 
 #define AS_SCL(X_) (X_).as.scalar
 #define AS_MAT(X_) ((Matrix *) (X_).as.gcobj)
 #define AS_CFUNC(X_) (X_).as.cfunc
 #define AS_FUNC(X_) ((Func *) (X_).as.gcobj)
 #define AS_STR(X_) ((Str *) (X_).as.gcobj)
+#define AS_SPARSE(X_) ((Sparse *) (X_).as.gcobj)
+#define AS_TYPED(X_) ((Typed *) (X_).as.gcobj)
 
 struct Env;
 
@@ -25,6 +29,8 @@ typedef enum {
     VAL_KIND_CFUNC,
     VAL_KIND_FUNC,
     VAL_KIND_STR,
+    VAL_KIND_SPARSE,
+    VAL_KIND_TYPED,
 } ValueKind;
 
 INHEADER
@@ -44,6 +50,10 @@ value_kindname(ValueKind kind)
         return "function";
     case VAL_KIND_STR:
         return "string";
+    case VAL_KIND_SPARSE:
+        return "sparse matrix";
+    case VAL_KIND_TYPED:
+        return "typed matrix";
     }
     UNREACHABLE();
 }
@@ -74,6 +84,8 @@ value_ref(Value v)
     case VAL_KIND_MATRIX:
     case VAL_KIND_FUNC:
     case VAL_KIND_STR:
+    case VAL_KIND_SPARSE:
+    case VAL_KIND_TYPED:
         ++v.as.gcobj->nrefs;
         break;
     default:
@@ -89,6 +101,8 @@ value_unref(Value v)
     case VAL_KIND_MATRIX:
     case VAL_KIND_FUNC:
     case VAL_KIND_STR:
+    case VAL_KIND_SPARSE:
+    case VAL_KIND_TYPED:
         if (!--v.as.gcobj->nrefs) {
             gcobject_destroy(v);
         }
@@ -15,11 +15,20 @@ typedef enum {
     CMD_LOAD_FAST,
     CMD_LOAD,
     CMD_LOAD_AT,
+    CMD_LOAD_AT1,
+    CMD_LOAD_AT2,
+    CMD_LOAD_SLICE,
     CMD_STORE_FAST,
     CMD_STORE,
     CMD_STORE_AT,
+    CMD_STORE_AT1,
+    CMD_STORE_AT2,
+    CMD_STORE_SLICE,
+    CMD_CHECK_BOUNDS,
     CMD_OP_UNARY,
     CMD_OP_BINARY,
+    CMD_OP_UNARY_LAZY,
+    CMD_OP_BINARY_LAZY,
     CMD_CALL,
     CMD_MATRIX,
     CMD_JUMP,
@@ -30,6 +39,16 @@ typedef enum {
     CMD_QUARK,
 } Command;
 
+// The kinds of subscripts of CMD_LOAD_SLICE and CMD_STORE_SLICE.
+typedef enum {
+    // a[i]: one value on the stack.
+    INDEX_SCALAR,
+    // a[:]: all rows, columns or elements; no value.
+    INDEX_ALL,
+    // a[i:j]: from i to j, both included; two values.
+    INDEX_RANGE,
+} IndexKind;
+
 typedef struct {
     Command cmd;
     union {
@@ -45,13 +64,34 @@ typedef struct {
         // CMD_LOAD_FAST, CMD_STORE_FAST
         unsigned index;
 
-        // CMD_LOAD_AT, CMD_STORE_AT
-        unsigned nindices;
-
-        // CMD_OP_UNARY
+        // CMD_LOAD_AT, CMD_STORE_AT, and their forms for one and two
+        // subscripts, which go straight to the element when the container is
+        // a matrix and the subscripts are scalars in range
+        struct {
+            unsigned nindices;
+            // For a store: see /rebind/ below.
+            bool rebind;
+            // Bit k is set if subscript k is known to be in range (see
+            // CMD_CHECK_BOUNDS).
+            unsigned char checked;
+        } at;
+
+        // CMD_LOAD_SLICE, CMD_STORE_SLICE
+        struct {
+            unsigned nindices;
+            // /IndexKind/ of each subscript; there are at most two.
+            unsigned char kinds[2];
+            // For a store: whether the container was loaded from a variable.
+            // Then it is left on the stack for the next instruction to store
+            // back, and if anything but that variable refers to it, the
+            // store goes to a copy instead (copy on write).
+            bool rebind;
+        } slice;
+
+        // CMD_OP_UNARY, CMD_OP_UNARY_LAZY
         Value (*unary)(struct Env *e, Value arg);
 
-        // CMD_OP_BINARY
+        // CMD_OP_BINARY, CMD_OP_BINARY_LAZY
         Value (*binary)(struct Env *e, Value arg1, Value arg2);
 
         // CMD_CALL
@@ -66,6 +106,17 @@ typedef struct {
         // CMD_JUMP, CMD_JUMP_UNLESS
         int offset;
 
+        // CMD_CHECK_BOUNDS: pops /lo/ and /hi/, and jumps by /offset/ unless
+        // they are scalars, /lo/ >= 1, and /hi/ is at most the number of
+        // elements (/dim/ = 0), rows (1) or columns (2) of the matrix in
+        // local variable /index/. A loop that goes from /lo/ up to /hi/ can
+        // then skip checking its subscripts.
+        struct {
+            int offset;
+            unsigned index;
+            unsigned char dim;
+        } bounds;
+
         // CMD_FUNCTION
         struct {
             int offset;
@@ -78,4 +129,17 @@ typedef struct {
     } args;
 } Instr;
 
+// How many values the subscripts of a CMD_LOAD_SLICE or CMD_STORE_SLICE take
+// on the stack.
+INHEADER
+unsigned
+vm_slice_nvalues(Instr in)
+{
+    unsigned n = 0;
+    for (unsigned i = 0; i < in.args.slice.nindices; ++i) {
+        n += in.args.slice.kinds[i] == INDEX_RANGE ? 2 : in.args.slice.kinds[i] == INDEX_SCALAR;
+    }
+    return n;
+}
+
 #endif
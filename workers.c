@@ -0,0 +1,183 @@
+#include "workers.h"
+
+#include <pthread.h>
+
+Workers *workers_global = NULL;
+
+struct Workers {
+    unsigned nthreads;
+    // Threads other than the caller; started by the first job.
+    pthread_t *threads;
+    bool started;
+
+    pthread_mutex_t mtx;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+
+    // Everything below is guarded by /mtx/.
+
+    // The current job.
+    WorkersFunc fn;
+    void *ctx;
+    size_t n;
+    size_t grain;
+    // Start of the next range nobody has taken yet.
+    size_t next;
+
+    // Incremented for every job, so that a worker can tell a new job from
+    // a spurious wakeup.
+    unsigned long generation;
+    // Workers inside /drain/.
+    unsigned nbusy;
+    bool running;
+    bool quit;
+};
+
+// Takes and runs ranges of the current job until there are none left.
+// Called, and returns, with /w->mtx/ held.
+static
+void
+drain(Workers *w, unsigned self)
+{
+    while (w->next < w->n) {
+        const size_t begin = w->next;
+        const size_t end = w->n - begin < w->grain ? w->n : begin + w->grain;
+        w->next = end;
+        pthread_mutex_unlock(&w->mtx);
+        w->fn(w->ctx, begin, end, self);
+        pthread_mutex_lock(&w->mtx);
+    }
+}
+
+typedef struct {
+    Workers *w;
+    unsigned self;
+} WorkerArg;
+
+static
+void *
+worker_main(void *arg)
+{
+    Workers *w = ((WorkerArg *) arg)->w;
+    const unsigned self = ((WorkerArg *) arg)->self;
+    free(arg);
+    unsigned long seen = 0;
+    pthread_mutex_lock(&w->mtx);
+    for (;;) {
+        while (w->generation == seen && !w->quit) {
+            pthread_cond_wait(&w->wake, &w->mtx);
+        }
+        if (w->quit) {
+            break;
+        }
+        seen = w->generation;
+        ++w->nbusy;
+        drain(w, self);
+        if (--w->nbusy == 0) {
+            pthread_cond_signal(&w->done);
+        }
+    }
+    pthread_mutex_unlock(&w->mtx);
+    return NULL;
+}
+
+Workers *
+workers_new(unsigned nthreads)
+{
+    Workers *w = XNEW(Workers, 1);
+    *w = (Workers) {
+        .nthreads = nthreads ? nthreads : 1,
+        .threads = NULL,
+        .started = false,
+    };
+    if (pthread_mutex_init(&w->mtx, NULL) != 0 ||
+        pthread_cond_init(&w->wake, NULL) != 0 ||
+        pthread_cond_init(&w->done, NULL) != 0)
+    {
+        PANIC("cannot initialize worker synchronization");
+    }
+    return w;
+}
+
+unsigned
+workers_nthreads(Workers *w)
+{
+    return w->nthreads;
+}
+
+static
+void
+start(Workers *w)
+{
+    w->started = true;
+    w->threads = XNEW(pthread_t, w->nthreads - 1);
+    for (unsigned i = 0; i < w->nthreads - 1; ++i) {
+        WorkerArg *arg = XNEW(WorkerArg, 1);
+        *arg = (WorkerArg) {.w = w, .self = i + 1};
+        if (pthread_create(&w->threads[i], NULL, worker_main, arg) != 0) {
+            // Go on with the threads we have got.
+            free(arg);
+            w->nthreads = i + 1;
+            break;
+        }
+    }
+}
+
+void
+workers_run(Workers *w, size_t n, size_t grain, WorkersFunc fn, void *ctx)
+{
+    if (!n) {
+        return;
+    }
+    if (!grain) {
+        grain = 1;
+    }
+    if (!w || w->nthreads == 1 || n <= grain) {
+        fn(ctx, 0, n, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&w->mtx);
+    if (w->running) {
+        pthread_mutex_unlock(&w->mtx);
+        fn(ctx, 0, n, 0);
+        return;
+    }
+    if (!w->started) {
+        start(w);
+    }
+    w->running = true;
+    w->fn = fn;
+    w->ctx = ctx;
+    w->n = n;
+    w->grain = grain;
+    w->next = 0;
+    ++w->generation;
+    pthread_cond_broadcast(&w->wake);
+
+    drain(w, 0);
+    while (w->nbusy) {
+        pthread_cond_wait(&w->done, &w->mtx);
+    }
+    w->running = false;
+    pthread_mutex_unlock(&w->mtx);
+}
+
+void
+workers_destroy(Workers *w)
+{
+    if (w->started) {
+        pthread_mutex_lock(&w->mtx);
+        w->quit = true;
+        pthread_cond_broadcast(&w->wake);
+        pthread_mutex_unlock(&w->mtx);
+        for (unsigned i = 0; i < w->nthreads - 1; ++i) {
+            pthread_join(w->threads[i], NULL);
+        }
+        free(w->threads);
+    }
+    pthread_cond_destroy(&w->done);
+    pthread_cond_destroy(&w->wake);
+    pthread_mutex_destroy(&w->mtx);
+    free(w);
+}
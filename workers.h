@@ -0,0 +1,75 @@
+#ifndef workers_h_
+#define workers_h_
+
+#include "common.h"
+
+// A fixed set of threads that split the work of one large kernel (the
+// "intra-op" parallelism of a matrix product, an elementwise pass, ...).
+// The calling thread takes part as well, and /workers_run/ returns only
+// once everything is done, so a kernel stays a plain blocking call.
+//
+// Threads are started on first use: a script that never touches a large
+// matrix never creates any.
+//
+// The functions run by the workers must not throw (/env_throw/), allocate
+// from /alloc_heap/ or /alloc_scratch/, or update /stats/: none of those
+// are thread-safe. A kernel allocates what its tasks need, and counts what
+// they do, on the calling thread.
+
+typedef struct Workers Workers;
+
+// Called on the range [/begin/, /end/) of a job by thread number /self/,
+// 0 <= /self/ < /workers_count()/; the calling thread is number 0. No two
+// calls with the same /self/ run at the same time, so /self/ can index
+// per-thread buffers that the caller has set up.
+typedef void (*WorkersFunc)(void *ctx, size_t begin, size_t end, unsigned self);
+
+// The set used by the kernels; NULL (the default, and the case until a
+// /Runtime/ installs its own) means everything runs on the calling thread.
+extern Workers *workers_global;
+
+// /nthreads/ counts the calling thread, so 1 means no extra threads.
+Workers *
+workers_new(unsigned nthreads);
+
+unsigned
+workers_nthreads(Workers *w);
+
+// Calls /fn/ on consecutive ranges of /grain/ items (the last one may be
+// shorter) covering [0, /n/), in parallel. The ranges do not depend on the
+// number of threads, only which thread gets which one does. Runs /fn/ once
+// on the calling thread if /w/ is NULL or has one thread, if /n/ <= /grain/,
+// or if called from inside another job.
+void
+workers_run(Workers *w, size_t n, size_t grain, WorkersFunc fn, void *ctx);
+
+void
+workers_destroy(Workers *w);
+
+// Number of threads of /workers_global/.
+INHEADER
+unsigned
+workers_count(void)
+{
+    return workers_global ? workers_nthreads(workers_global) : 1;
+}
+
+// Picks a grain that gives each thread of /workers_global/ a few ranges
+// (so that one slow thread does not hold everybody up), but no range under
+// /min/ items, which is where splitting stops paying for itself.
+INHEADER
+size_t
+workers_grain(size_t n, size_t min)
+{
+    const size_t g = n / (4 * (size_t) workers_count()) + 1;
+    return g < min ? min : g;
+}
+
+INHEADER
+void
+workers_for(size_t n, size_t min, WorkersFunc fn, void *ctx)
+{
+    workers_run(workers_global, n, workers_grain(n, min), fn, ctx);
+}
+
+#endif